@@ -43,6 +43,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <ctype.h>
 #include <limits.h>
 #include <signal.h>
 #include <fcntl.h>
@@ -137,11 +138,16 @@ struct ncds {
 	ncds_id* datastores_ids;
 	int count;
 	int array_size;
+	struct ncds_ds **index; /* datastores sorted by their IDs */
+	int index_size;
 };
 
 struct ncds_ds *nacm_ds = NULL; /* for NACM subsystem */
-static struct ncds ncds = {NULL, NULL, 0, 0};
+static struct ncds ncds = {NULL, NULL, 0, 0, NULL, 0};
 static struct model_list *models_list = NULL;
+/* models_list hashed by namespaces and by operations (with namespaces), built by ncds_consolidate() */
+static xmlHashTablePtr models_ns = NULL;
+static xmlHashTablePtr models_ops = NULL;
 static struct transapi_list* augment_tapi_list = NULL;
 static char** models_dirs = NULL;
 
@@ -166,6 +172,11 @@ static char* get_state_notifications(const char* UNUSED(model), const char* UNUS
 #endif
 
 static struct ncds_ds *datastores_get_ds(ncds_id id);
+static int datastores_index_reserve(void);
+static void datastores_index_add(struct ncds_ds* ds);
+static void datastores_index_remove(ncds_id id);
+static void models_hash_drop(void);
+static void rpc_pool_stop(void);
 
 #ifndef DISABLE_YANGFORMAT
 /* XSL stylesheet for transformation from YIN to YANG format */
@@ -194,6 +205,7 @@ static struct ncds_ds* ncds_fill_func(NCDS_TYPE type)
 		ds->func.copyconfig = ncds_custom_copyconfig;
 		ds->func.deleteconfig = ncds_custom_deleteconfig;
 		ds->func.editconfig = ncds_custom_editconfig;
+		/* getconfig_xml and editconfig_xml are set according to the plugin's callbacks in ncds_custom_set_xml_funcs() */
 		break;
 	case NCDS_TYPE_FILE:
 		if ((ds = (struct ncds_ds*) calloc(1, sizeof(struct ncds_ds_file))) == NULL ) {
@@ -210,7 +222,9 @@ static struct ncds_ds* ncds_fill_func(NCDS_TYPE type)
 		ds->func.getconfig = ncds_file_getconfig;
 		ds->func.copyconfig = ncds_file_copyconfig;
 		ds->func.deleteconfig = ncds_file_deleteconfig;
+		ds->func.getconfig_xml = ncds_file_getconfig_xml;
 		ds->func.editconfig = ncds_file_editconfig;
+		ds->func.editconfig_xml = ncds_file_editconfig_xml;
 		break;
 	case NCDS_TYPE_EMPTY:
 		if ((ds = (struct ncds_ds*) calloc(1, sizeof(struct ncds_ds_empty))) == NULL ) {
@@ -227,7 +241,9 @@ static struct ncds_ds* ncds_fill_func(NCDS_TYPE type)
 		ds->func.getconfig = ncds_empty_getconfig;
 		ds->func.copyconfig = ncds_empty_copyconfig;
 		ds->func.deleteconfig = ncds_empty_deleteconfig;
+		ds->func.getconfig_xml = ncds_empty_getconfig_xml;
 		ds->func.editconfig = ncds_empty_editconfig;
+		ds->func.editconfig_xml = ncds_empty_editconfig_xml;
 		break;
 	default:
 		ERROR("Unsupported datastore implementation required.");
@@ -445,6 +461,7 @@ int ncds_sysinit(int flags)
 		list_item->model = ds->data_model;
 		list_item->next = models_list;
 		models_list = list_item;
+		models_hash_drop();
 
 #ifndef DISABLE_VALIDATION
 		/* set validation */
@@ -458,7 +475,7 @@ int ncds_sysinit(int flags)
 		ds->func.init(ds);
 
 		/* add to a datastore list */
-		if ((dsitem = malloc (sizeof(struct ncds_ds_list))) == NULL ) {
+		if (datastores_index_reserve() != EXIT_SUCCESS || (dsitem = malloc (sizeof(struct ncds_ds_list))) == NULL ) {
 			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
 			ncds_free(ds);
 			internal_ds_count--;
@@ -471,11 +488,13 @@ int ncds_sysinit(int flags)
 		dsitem->datastore = ds;
 		dsitem->next = ncds.datastores;
 		ncds.datastores = dsitem;
+		datastores_index_add(ds);
 		ncds.count++;
 		if (ncds.count >= ncds.array_size) {
 			void *tmp = realloc(ncds.datastores_ids, (ncds.array_size + 10) * sizeof(ncds_id));
 			if (tmp == NULL) {
 				ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+				datastores_index_remove(ds->id);
 				ncds_free(ds);
 				internal_ds_count--;
 				ncds.datastores = NULL;
@@ -515,6 +534,61 @@ void ncds_startup_internal(void)
 	}
 }
 
+/* get position of the datastore with the given ID (or where to insert it) in the datastores index */
+static int datastores_index_pos(ncds_id id)
+{
+	int low = 0, high = ncds.count, mid;
+
+	while (low < high) {
+		mid = (low + high) / 2;
+		if (ncds.index[mid]->id < id) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return (low);
+}
+
+/* make room for one more datastore in the datastores index */
+static int datastores_index_reserve(void)
+{
+	struct ncds_ds** tmp;
+
+	if (ncds.count >= ncds.index_size) {
+		if ((tmp = realloc(ncds.index, (ncds.index_size + 10) * sizeof(struct ncds_ds*))) == NULL) {
+			ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+			return (EXIT_FAILURE);
+		}
+		ncds.index = tmp;
+		ncds.index_size += 10;
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+static void datastores_index_add(struct ncds_ds* ds)
+{
+	int pos;
+
+	/* ncds.count does not include the added datastore yet */
+	pos = datastores_index_pos(ds->id);
+	memmove(&ncds.index[pos + 1], &ncds.index[pos], (ncds.count - pos) * sizeof(struct ncds_ds*));
+	ncds.index[pos] = ds;
+}
+
+static void datastores_index_remove(ncds_id id)
+{
+	int pos;
+
+	/* ncds.count still includes the removed datastore */
+	pos = datastores_index_pos(id);
+	if (pos < ncds.count && ncds.index[pos]->id == id) {
+		memmove(&ncds.index[pos], &ncds.index[pos + 1], (ncds.count - pos - 1) * sizeof(struct ncds_ds*));
+	}
+}
+
 /**
  * @brief Get ncds_ds structure from the datastore list containing storage
  * information with the specified ID.
@@ -525,19 +599,14 @@ void ncds_startup_internal(void)
  */
 static struct ncds_ds *datastores_get_ds(ncds_id id)
 {
-	struct ncds_ds_list *ds_iter;
-
-	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
-		if (ds_iter->datastore != NULL && ds_iter->datastore->id == id) {
-			break;
-		}
-	}
+	int pos;
 
-	if (ds_iter == NULL) {
-		return NULL;
+	pos = datastores_index_pos(id);
+	if (pos < ncds.count && ncds.index[pos]->id == id) {
+		return (ncds.index[pos]);
 	}
 
-	return (ds_iter->datastore);
+	return (NULL);
 }
 
 /**
@@ -558,6 +627,10 @@ static struct ncds_ds *datastores_detach_ds(ncds_id id)
 		return (NULL);
 	}
 
+	if (datastores_get_ds(id) == NULL) {
+		return (NULL);
+	}
+
 	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_prev = ds_iter, ds_iter = ds_iter->next) {
 		if (ds_iter->datastore != NULL && ds_iter->datastore->id == id) {
 			break;
@@ -574,6 +647,7 @@ static struct ncds_ds *datastores_detach_ds(ncds_id id)
 		}
 		retval = ds_iter->datastore;
 		free(ds_iter);
+		datastores_index_remove(id);
 		ncds.count--;
 	}
 
@@ -1375,13 +1449,13 @@ static char* get_state_monitoring(const char* UNUSED(model), const char* UNUSED(
 				"<out-rpc-errors>%u</out-rpc-errors>"
 				"<out-notifications>%u</out-notifications></statistics>",
 				nc_info->stats.start_time,
-				nc_info->stats.bad_hellos,
-				nc_info->stats.sessions_in,
-				nc_info->stats.sessions_dropped,
-				nc_info->stats.counters.in_rpcs,
-				nc_info->stats.counters.in_bad_rpcs,
-				nc_info->stats.counters.out_rpc_errors,
-				nc_info->stats.counters.out_notifications) == -1) {
+				NC_STATS_GET(nc_info->stats.bad_hellos),
+				NC_STATS_GET(nc_info->stats.sessions_in),
+				NC_STATS_GET(nc_info->stats.sessions_dropped),
+				NC_STATS_GET(nc_info->stats.counters.in_rpcs),
+				NC_STATS_GET(nc_info->stats.counters.in_bad_rpcs),
+				NC_STATS_GET(nc_info->stats.counters.out_rpc_errors),
+				NC_STATS_GET(nc_info->stats.counters.out_notifications)) == -1) {
 			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
 			stats = NULL;
 		}
@@ -1417,20 +1491,18 @@ static char* get_state_nacm(const char* UNUSED(model), const char* UNUSED(runnin
 	char* retval = NULL;
 
 	if (nc_info != NULL ) {
-		pthread_rwlock_rdlock(&(nc_info->lock));
 		if (asprintf(&retval, "<nacm xmlns=\"%s\">"
 				"<denied-operations>%u</denied-operations>"
 				"<denied-data-writes>%u</denied-data-writes>"
 				"<denied-notifications>%u</denied-notifications>"
 				"</nacm>",
 				NC_NS_NACM,
-				nc_info->stats_nacm.denied_ops,
-				nc_info->stats_nacm.denied_data,
-				nc_info->stats_nacm.denied_notifs) == -1) {
+				NC_STATS_GET(nc_info->stats_nacm.denied_ops),
+				NC_STATS_GET(nc_info->stats_nacm.denied_data),
+				NC_STATS_GET(nc_info->stats_nacm.denied_notifs)) == -1) {
 			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
 			retval = NULL;
 		}
-		pthread_rwlock_unlock(&(nc_info->lock));
 	}
 	if (retval == NULL) {
 		retval = strdup("");
@@ -2038,6 +2110,7 @@ static int data_model_enlink(struct data_model** model)
 	listitem->model = *model;
 	listitem->next = models_list;
 	models_list = listitem;
+	models_hash_drop();
 
 	return (EXIT_SUCCESS);
 }
@@ -3642,6 +3715,40 @@ static void transapis_cleanup(struct transapi_list **list, int force)
 	}
 }
 
+static void models_hash_drop(void)
+{
+	xmlHashFree(models_ns, NULL);
+	models_ns = NULL;
+	xmlHashFree(models_ops, NULL);
+	models_ops = NULL;
+}
+
+static void models_hash_build(void)
+{
+	struct model_list* listitem;
+	int i;
+
+	models_hash_drop();
+
+	if ((models_ns = xmlHashCreate(64)) == NULL || (models_ops = xmlHashCreate(256)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		models_hash_drop();
+		return;
+	}
+
+	for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
+		/* the first model in the list wins as it does in ncds_get_model_data() */
+		if (listitem->model->ns == NULL || xmlHashLookup(models_ns, BAD_CAST listitem->model->ns) != NULL) {
+			continue;
+		}
+		xmlHashAddEntry(models_ns, BAD_CAST listitem->model->ns, listitem->model);
+
+		for (i = 0; listitem->model->rpcs != NULL && listitem->model->rpcs[i] != NULL; i++) {
+			xmlHashAddEntry2(models_ops, BAD_CAST listitem->model->rpcs[i], BAD_CAST listitem->model->ns, listitem->model);
+		}
+	}
+}
+
 API int ncds_consolidate(void)
 {
 	int ret, changes;
@@ -3653,6 +3760,7 @@ API int ncds_consolidate(void)
 	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
 		transapis_cleanup(&(ds_iter->datastore->transapis), 0);
 
+		model_index_unset(ds_iter->datastore->ext_model);
 		if (ds_iter->datastore->ext_model != ds_iter->datastore->data_model->xml) {
 			xmlFreeDoc(ds_iter->datastore->ext_model);
 			ds_iter->datastore->ext_model = ds_iter->datastore->data_model->xml;
@@ -3716,7 +3824,18 @@ API int ncds_consolidate(void)
 		}
 	}
 
+	/* index the final extended models to speed up the data processing */
+	for (ds_iter = ncds.datastores; ds_iter != NULL; ds_iter = ds_iter->next) {
+		if (ds_iter->datastore->ext_model != NULL && model_index_set(ds_iter->datastore->ext_model) != EXIT_SUCCESS) {
+			WARN("Indexing the data model \"%s\" failed.", ds_iter->datastore->data_model->name);
+		}
+	}
+
 	transapis_cleanup(&(augment_tapi_list), 0);
+
+	/* hash the models for the lookups done when processing every request */
+	models_hash_build();
+
 	return (EXIT_SUCCESS);
 }
 
@@ -3806,6 +3925,37 @@ static xmlDocPtr read_datastore_data(ncds_id id, const char *data)
 	}
 }
 
+/**
+ * @brief Get the configuration data of the datastore as XML document.
+ *
+ * Use the datastore's getconfig_xml() if the implementation provides it,
+ * otherwise parse the serialized data from getconfig().
+ *
+ * @param[in] ds Datastore from which the data will be obtained.
+ * @param[in] session Session originating the request.
+ * @param[in] source Datastore (running, startup, candidate) to get the data from.
+ * @param[out] e NETCONF error structure describing the experienced error.
+ * @return NULL on error, XML document with the configuration data as its top
+ * level elements on success.
+ */
+static xmlDocPtr ncds_getconfig_doc(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, struct nc_err** e)
+{
+	char *data;
+	xmlDocPtr doc;
+
+	if (ds->func.getconfig_xml != NULL) {
+		return (ds->func.getconfig_xml(ds, session, source, e));
+	}
+
+	if ((data = ds->func.getconfig(ds, session, source, e)) == NULL) {
+		return (NULL);
+	}
+	doc = read_datastore_data(ds->id, data);
+	free(data);
+
+	return (doc);
+}
+
 #ifndef DISABLE_VALIDATION
 static void relaxng_error_callback(void *error, const char * msg, ...)
 {
@@ -3990,7 +4140,6 @@ static int validate_ds(struct ncds_ds *ds, xmlDocPtr doc, struct nc_err **error)
 static int apply_rpc_validate_(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, const char* config, struct nc_err** e)
 {
 	int ret = EXIT_FAILURE;
-	char *data_cfg = NULL;
 	xmlDocPtr doc = NULL;
 	xmlNodePtr root, node;
 	xmlNsPtr ns;
@@ -4007,7 +4156,7 @@ static int apply_rpc_validate_(struct ncds_ds* ds, const struct nc_session* sess
 	case NC_DATASTORE_RUNNING:
 	case NC_DATASTORE_STARTUP:
 	case NC_DATASTORE_CANDIDATE:
-		if ((data_cfg = ds->func.getconfig(ds, session, source, e)) == NULL ) {
+		if ((doc = ncds_getconfig_doc(ds, session, source, e)) == NULL ) {
 			if (*e == NULL ) {
 				ERROR("%s: Failed to get data from the datastore (%s:%d).", __func__, __FILE__, __LINE__);
 				*e = nc_err_new(NC_ERR_OP_FAILED);
@@ -4021,7 +4170,7 @@ static int apply_rpc_validate_(struct ncds_ds* ds, const struct nc_session* sess
 		 * cover it with the <config> element to allow the creation of xml
 		 * document
 		 */
-		data_cfg = (char*)config;
+		doc = read_datastore_data(ds->id, config);
 		break;
 	default:
 		*e = nc_err_new(NC_ERR_BAD_ELEM);
@@ -4029,15 +4178,11 @@ static int apply_rpc_validate_(struct ncds_ds* ds, const struct nc_session* sess
 		return (EXIT_FAILURE);
 	}
 
-	doc = read_datastore_data(ds->id, data_cfg);
 	if (doc == NULL || doc->children == NULL) {
 		/* config is empty */
 		xmlFreeDoc(doc);
 		doc = NULL;
 	}
-	if (source != NC_DATASTORE_CONFIG) {
-		free(data_cfg);
-	}
 
 	if (!doc) {
 		/*
@@ -4416,6 +4561,7 @@ static void ncds_ds_model_free(struct data_model* model)
 				models_list = listitem->next;
 			}
 			free(listitem);
+			models_hash_drop();
 			break;
 		}
 		listprev = listitem;
@@ -4474,6 +4620,9 @@ API ncds_id ncds_init(struct ncds_ds* datastore)
 		ncds.datastores_ids = tmp;
 		ncds.array_size += 10;
 	}
+	if (datastores_index_reserve() != EXIT_SUCCESS) {
+		return (-4);
+	}
 	/* prepare slot for the datastore in the list */
 	item = malloc(sizeof(struct ncds_ds_list));
 	if (item == NULL) {
@@ -4498,6 +4647,7 @@ API ncds_id ncds_init(struct ncds_ds* datastore)
 	item->datastore = datastore;
 	item->next = ncds.datastores;
 	ncds.datastores = item;
+	datastores_index_add(datastore);
 	ncds.count++;
 
 	return datastore->id;
@@ -4511,6 +4661,8 @@ void ncds_cleanall()
 
         //pthread_spin_destroy(&server_cpblt_lock);
 
+	rpc_pool_stop();
+
 	ds_item = ncds.datastores;
 	while (ds_item != NULL) {
 		dsnext = ds_item->next;
@@ -4518,10 +4670,13 @@ void ncds_cleanall()
 		ds_item = dsnext;
 	}
 	free(ncds.datastores_ids);
+	free(ncds.index);
 	ncds.datastores = NULL;
 	ncds.datastores_ids = NULL;
+	ncds.index = NULL;
 	ncds.count = 0;
 	ncds.array_size = 0;
+	ncds.index_size = 0;
 
 	for (listitem = models_list; listitem != NULL; ) {
 		listnext = listitem->next;
@@ -4597,6 +4752,7 @@ API void ncds_free(struct ncds_ds* datastore)
 		ds->func.free(ds);
 
 		/* free models */
+		model_index_unset(ds->ext_model);
 		if (ds->data_model == NULL || (ds->data_model->xml != ds->ext_model)) {
 			xmlFreeDoc(ds->ext_model);
 		}
@@ -4641,88 +4797,27 @@ API void ncds_free2(ncds_id datastore_id)
  *
  * \param[in] parent Parent element which key node is checked.
  * \param[in] child Element to decide if it is a key element of the parent
- * \param[in] keys List of key elements from the configuration data model.
+ * \param[in] keys Index of the configuration data model.
  * \return Zero if the given child is NOT the key element of the parent.
  */
 int is_key(xmlNodePtr parent, xmlNodePtr child, keyList keys)
 {
-	xmlChar *str = NULL;
-	char *s, *token;
-	int i, match;
-	xmlNodePtr key_parent, node_parent;
+	struct model_node* mnode;
+	int i;
 
 	assert(parent != NULL);
 	assert(child != NULL);
 
-	if (keys == NULL) {
+	if ((mnode = model_index_find(keys, parent)) == NULL || mnode->keys == NULL) {
 		/* there are no keys */
 		return 0;
 	}
 
-	for (i = 0; i < keys->nodesetval->nodeNr; i++) {
-		match = 1;
-		key_parent = keys->nodesetval->nodeTab[i]->parent;
-		node_parent = parent;
-
-		while (1) {
-			if ((str = xmlGetProp(key_parent, BAD_CAST "name")) == NULL) {
-				match = 0;
-				break;
-			}
-			if (xmlStrcmp(str, node_parent->name)) {
-				xmlFree(str);
-				match = 0;
-				break;
-			}
-			xmlFree(str);
-
-			do {
-				key_parent = key_parent->parent;
-			} while (key_parent && ((xmlStrcmp(key_parent->name, BAD_CAST "augment") == 0)
-					|| (xmlStrcmp(key_parent->name, BAD_CAST "choice") == 0)
-					|| (xmlStrcmp(key_parent->name, BAD_CAST "case") == 0)));
-			node_parent = node_parent->parent;
-
-			if ((!key_parent && node_parent) || (key_parent && !node_parent)) {
-				match = 0;
-				break;
-			}
-
-			if (!xmlStrcmp(key_parent->name, BAD_CAST "module") && (node_parent->type == XML_DOCUMENT_NODE)) {
-				/* we have match */
-				break;
-			}
-		}
-
-		if (!match) {
-			continue;
-		}
-
-		/* so the node is in a key's place (list), but is it a key?
-		 * btw, now we don't want to iterate through next key specs,
-		 * so do not use continue from here
-		 */
-
-		/* get the name of the key node(s) from the 'value' attribute in key element in data model */
-		if ((str = xmlGetProp(keys->nodesetval->nodeTab[i], BAD_CAST "value")) == NULL) {
-			continue;
-		}
-
-		/* attribute have the form of space-separated list of key nodes */
-		/* compare all the key node names with the specified child */
-		for (token = s = (char*)str; token != NULL ; s = NULL) {
-			token = strtok(s, " ");
-			if (token == NULL) {
-				break;
-			}
-
-			if (xmlStrcmp(BAD_CAST token, child->name) == 0) {
-				xmlFree(str);
-				return 1;
-			}
+	/* compare all the key node names with the specified child */
+	for (i = 0; mnode->keys[i] != NULL; i++) {
+		if (xmlStrcmp(BAD_CAST mnode->keys[i], child->name) == 0) {
+			return 1;
 		}
-		xmlFree(str);
-		break;
 	}
 
 	return 0;
@@ -4803,314 +4898,477 @@ static int attrcmp(xmlNodePtr reference, xmlNodePtr node)
 	return 0;
 }
 
-/**
- * \brief NETCONF subtree filtering, stolen from old old netopeer
- *
- * \param config        pointer to xmlNode tree to filter
- * \param filter        pointer to NETCONF filter xml tree
- *
- * \return              1 if config satisfies the output filter, 0 otherwise
+/*
+ * Compiled subtree filter. The filter tree is preprocessed only once for all
+ * the datastores of the request (or all the events of the subscription) -
+ * comments are dropped, namespace wildcards and content match values are
+ * resolved and larger sets of the filter siblings are hashed by their names.
  */
+struct nc_filter_node {
+	xmlNodePtr node;                      /* filter element, its attributes are checked by attrcmp() */
+	const xmlChar* name;
+	const xmlChar* ns;                    /* required namespace, NULL for the namespace wildcard */
+	char* content;                        /* content match value without surrounding whitespaces */
+	size_t content_len;
+	const struct nc_filter_node* cmatch;  /* the first content match node among the siblings */
+	int selection;                        /* some of the siblings is not a content match node */
+	struct nc_filter_node* children;
+	xmlHashTablePtr index;                /* children hashed by their names */
+	struct nc_filter_node* same;          /* next sibling with the same name */
+	struct nc_filter_node* next;
+	struct nc_filter_node* prev;
+};
 
-static int ncxml_subtree_filter(xmlNodePtr config, xmlNodePtr filter, keyList keys)
+/* hash the filter siblings only if there is more of them */
+#define NCXML_FILTER_HASH_MIN 8
+
+static void ncxml_filter_node_free(struct nc_filter_node* fnode)
 {
-	xmlNodePtr config_node;
-	xmlNodePtr filter_node;
-	xmlNodePtr delete = NULL, delete2 = NULL;
-	char *content1 = NULL, *content2 = NULL;
-	int nomatch = 0;
-	int filter_in = 0, sibling_in = 0, end_node = 0, sibling_selection = 0;
-
-	/* normalize filter */
-	if (!config->prev) {
-		for (filter_node = filter; filter_node; ) {
-			delete = filter_node;
-			filter_node = filter_node->next;
-
-			/* remove comments from filter */
-			if (delete->type != XML_ELEMENT_NODE) {
-				if (delete == filter) {
-					filter = filter_node;
-				}
-				xmlUnlinkNode(delete);
-				xmlFreeNode(delete);
-				continue;
-			}
+	struct nc_filter_node* next;
+
+	for (; fnode != NULL; fnode = next) {
+		next = fnode->next;
+		ncxml_filter_node_free(fnode->children);
+		if (fnode->index != NULL) {
+			xmlHashFree(fnode->index, NULL);
 		}
+		free(fnode->content);
+		free(fnode);
 	}
+}
 
-	/* check if this filter level is last */
-	filter_node = filter;
-	while (filter_node) {
-		if ((filter_node->children) && (filter_node->children->type == XML_TEXT_NODE) &&
-				!xmlIsBlankNode(filter_node->children)) {
-			end_node = 1;
-			break;
-		}
-		filter_node = filter_node->next;
+void ncxml_filter_compiled_free(struct nc_filter_node** compiled)
+{
+	int i;
+
+	if (compiled == NULL) {
+		return;
 	}
 
-	if (end_node) {
+	for (i = 0; compiled[i] != NULL; i++) {
+		ncxml_filter_node_free(compiled[i]);
+	}
+	free(compiled);
+}
 
-		/* 0 means that all the sibling nodes will be in the filter result - this is a default
-		 * behavior when there are no selection or containment nodes in the filter sibling set.
-		 * If 1 is set, sibling nodes for the filter result will be selected according to the
-		 * rules in RFC 6241, sec. 6.2.5
-		 */
-		sibling_selection = 0;
+static int ncxml_filter_compile_list(xmlNodePtr first, struct nc_filter_node** list, xmlHashTablePtr* index);
 
-		/* init */
-		if ((content1 = nc_clrwspace((char *) filter_node->children->content)) == NULL) {
-			/* internal error - memory allocation failed, do not continue! */
-			return 0;
-		}
+static struct nc_filter_node* ncxml_filter_compile_node(xmlNodePtr node)
+{
+	struct nc_filter_node* fnode;
+	xmlNodePtr child;
+	const char* s;
+	size_t len;
 
-		/* try to find required node */
-		config_node = config;
-		while (config_node && config_node->children) {
-			if (!strcmp((char *) filter_node->name, (char *) config_node->name) &&
-					!nc_nscmp(filter_node, config_node) &&
-					!attrcmp(filter_node, config_node)) {
-				/* init */
-				content2 = NULL;
-				/* get node's content without leading and trailing spaces */
-				if ((content2 = nc_clrwspace((char *) config_node->children->content)) == NULL) {
-					free(content1);
-					free(content2);
-					/* internal error - memory allocation failed, do not continue! */
-					return 0;
-				}
+	if ((fnode = calloc(1, sizeof(struct nc_filter_node))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	fnode->node = node;
+	fnode->name = node->name;
 
-				if (strisempty(content1)) {
-					/* we have an empty content match node, so interpret it as a selection node,
-					 * which means that we will be selecting sibling nodes that will be in the
-					 * filter result
-					 */
-					filter_in = 1;
-					sibling_selection = 1;
-				} else if (strcmp(content1, content2) == 0) {
-					filter_in = 1;
-				}
-				free(content2);
-
-				if (filter_in) {
-					free(content1);
-					content1 = NULL;
-
-					/* we have the matching node, now decide what to do */
-					if (filter_node->next || filter_node->prev || sibling_selection == 1) {
-						/* check if all filter sibling nodes are content match nodes -> then no config sibling node will be removed */
-						/*go to the first filter sibling node */
-						filter_node = filter;
-						/* pass all filter sibling nodes */
-						while (sibling_selection == 0 && filter_node) {
-							if (!filter_node->children || (filter_node->children->type != XML_TEXT_NODE) ||
-									xmlIsBlankNode(filter_node->children)) {
-								sibling_selection = 1; /* filter result will be selected */
-								break;
-							}
-							filter_node = filter_node->next;
-						}
+	/* XML namespace wildcard mechanism:
+	 * 1) no namespace defined and namespace is inherited from message so it
+	 *    is NETCONF base namespace
+	 * 2) namespace is empty: xmlns=""
+	 */
+	if (node->ns != NULL && node->ns->href != NULL && xmlStrcmp(node->ns->href, BAD_CAST NC_NS_BASE10) != 0) {
+		for (s = (char*)(node->ns->href); isspace(*s); s++);
+		if (*s != '\0') {
+			fnode->ns = node->ns->href;
+		}
+	}
 
-						/* select and remove all unwanted nodes */
-						config_node = config;
-						while (config_node) {
-							/* init */
-							sibling_in = 0;
+	/* content match node */
+	for (child = node->children; child != NULL && (child->type == XML_COMMENT_NODE || child->type == XML_PI_NODE); child = child->next);
+	if (child != NULL && child->type == XML_TEXT_NODE && !xmlIsBlankNode(child)) {
+		for (s = (char*)(child->content); isspace(*s); s++);
+		for (len = strlen(s); len > 0 && isspace(s[len - 1]); len--);
+		if ((fnode->content = strndup(s, len)) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			free(fnode);
+			return (NULL);
+		}
+		fnode->content_len = len;
+	}
 
-							/* go to the first filter sibing node */
-							filter_node = filter;
+	if (ncxml_filter_compile_list(node->children, &fnode->children, &fnode->index) != EXIT_SUCCESS) {
+		ncxml_filter_node_free(fnode);
+		return (NULL);
+	}
 
-filter:
-							/* pass all filter sibling nodes */
-							while (filter_node) {
-								if (!strcmp((char *) filter_node->name, (char *) config_node->name) &&
-										!nc_nscmp(filter_node, config_node) && !attrcmp(filter_node, config_node)) {
-									/* content match node check */
-									if (filter_node->children && (filter_node->children->type == XML_TEXT_NODE) && !xmlIsBlankNode(filter_node->children) &&
-											config_node->children && (config_node->children->type == XML_TEXT_NODE) && !xmlIsBlankNode(config_node->children)) {
-										/* get filter's text node content ignoring whitespaces */
-										if ((content2 = nc_clrwspace((char *) filter_node->children->content)) == NULL ||
-												(content1 = nc_clrwspace((char *) config_node->children->content)) == NULL) {
-											free(content1);
-											free(content2);
-											/* internal error - memory allocation failed, do not continue! */
-											return 0;
-										}
-										if (strcmp(content1, content2) != 0) {
-											free(content1);
-											free(content2);
-											filter_node = filter_node->next;
-											nomatch = 1;
-											continue;
-										}
-										free(content1);
-										free(content2);
-									}
-									sibling_in = 1;
-									break;
-								}
-								filter_node = filter_node->next;
-							}
-							content1 = NULL;
-
-							if (!filter_node) {
-								if (nomatch) {
-									/* instance does not follow restrictions */
-									return 0;
-								} else if (is_key(config_node->parent, config_node, keys)) {
-									/* go to the next sibling */
-									config_node = config_node->next;
-									continue;
-								}
-							}
+	return (fnode);
+}
 
-							/* if this config node is not in filter, remove it */
-							if (sibling_selection && !sibling_in) {
-								if (filter_node) {
-									/* try another filter node */
-									filter_node = filter_node->next;
-									goto filter;
-								}
+static int ncxml_filter_compile_list(xmlNodePtr first, struct nc_filter_node** list, xmlHashTablePtr* index)
+{
+	struct nc_filter_node *fnode, *last = NULL, *cmatch = NULL;
+	xmlNodePtr node;
+	int count = 0, selection = 0;
 
-								delete = config_node;
-								config_node = config_node->next;
-								xmlUnlinkNode(delete);
-								xmlFreeNode(delete);
-							} else {
-								/* recursively process subtree filter */
-								if (filter_node && filter_node->children && (filter_node->children->type == XML_ELEMENT_NODE) && config_node->children && (config_node->children->type == XML_ELEMENT_NODE)) {
-									sibling_in = ncxml_subtree_filter(config_node->children, filter_node->children, keys);
-								}
-								if (sibling_selection && sibling_in == 0) {
-									if (filter_node) {
-										/* try another filter node */
-										filter_node = filter_node->next;
-										goto filter;
-									}
-
-									/* subtree is not a content of the filter output */
-									delete = config_node;
-
-									/* remeber where to go next */
-									config_node = config_node->next;
-
-									/* and remove unwanted subtree */
-									xmlUnlinkNode(delete);
-									xmlFreeNode(delete);
-								} else {
-									/* go to the next sibling */
-									config_node = config_node->next;
-								}
-							}
-						}
-					} else {
-						/* only content match node present - all sibling nodes stays */
-					}
-					break;
-				}
-			}
-			config_node = config_node->next;
+	*list = NULL;
+	*index = NULL;
+
+	/* compile the element siblings, everything else (comments) is skipped */
+	for (node = first; node != NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
 		}
-		free(content1);
-	} else {
-		/* this is containment node (no sibling node is content match node */
-		filter_node = filter;
-		while (filter_node) {
-			if (!strcmp((char *)filter_node->name, (char *)config->name) &&
-					!nc_nscmp(filter_node, config) &&
-					!attrcmp(filter_node, config)) {
-				filter_in = 1;
-				break;
-			}
-			filter_node = filter_node->next;
+		if ((fnode = ncxml_filter_compile_node(node)) == NULL) {
+			goto error;
 		}
-
-		if (filter_in == 1) {
-			while (config->children && filter_node && filter_node->children && !xmlIsBlankNode(filter_node->children) &&
-					((filter_in = ncxml_subtree_filter(config->children, filter_node->children, keys)) == 0)) {
-				filter_node = filter_node->next;
-				while (filter_node) {
-					if (!strcmp((char *)filter_node->name, (char *)config->name) &&
-							!nc_nscmp(filter_node, config) &&
-							!attrcmp(filter_node, config)) {
-						filter_in = 1;
-						break;
-					}
-					filter_node = filter_node->next;
-				}
-			}
-			if (filter_in == 0) {
-				/* subtree is not a content of the filter output */
-				delete = config->children;
-				xmlUnlinkNode(delete);
-				xmlFreeNode(delete);
-				delete2 = config;
-			}
+		if (last == NULL) {
+			*list = fnode;
 		} else {
-			delete2 = config;
-		}
-		/* filter next sibling node */
-		if (config->next != NULL) {
-			if (ncxml_subtree_filter(config->next, filter, keys) == 0) {
-				delete = config->next;
-				xmlUnlinkNode(delete);
-				xmlFreeNode(delete);
-			} else {
-				filter_in = 1;
-			}
+			last->next = fnode;
+			fnode->prev = last;
 		}
-		if (delete2) {
-			xmlUnlinkNode(delete2);
-			xmlFreeNode(delete2);
+		last = fnode;
+		count++;
+
+		if (fnode->content == NULL) {
+			selection = 1;
+		} else if (cmatch == NULL) {
+			cmatch = fnode;
 		}
 	}
 
-	return filter_in;
+	if (count >= NCXML_FILTER_HASH_MIN && (*index = xmlHashCreate(count)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		goto error;
+	}
+
+	/* link the siblings of the same name, the index points to the first of them */
+	for (fnode = last; fnode != NULL; fnode = fnode->prev) {
+		fnode->cmatch = cmatch;
+		fnode->selection = selection;
+		if (*index != NULL) {
+			fnode->same = xmlHashLookup(*index, fnode->name);
+			xmlHashUpdateEntry(*index, fnode->name, fnode, NULL);
+		} else {
+			for (fnode->same = fnode->next; fnode->same != NULL && !xmlStrEqual(fnode->same->name, fnode->name); fnode->same = fnode->same->next);
+		}
+	}
+
+	return (EXIT_SUCCESS);
+
+error:
+	ncxml_filter_node_free(*list);
+	*list = NULL;
+	if (*index != NULL) {
+		xmlHashFree(*index, NULL);
+		*index = NULL;
+	}
+	return (EXIT_FAILURE);
 }
 
-int ncxml_filter(xmlNodePtr old, const struct nc_filter* filter, xmlNodePtr *new, const xmlDocPtr data_model)
+/**
+ * \brief Compile the subtree filter.
+ *
+ * \param filter        \<filter\> element
+ *
+ * \return              NULL terminated list of the separately compiled
+ *                      top-level filter items, NULL on error
+ */
+static struct nc_filter_node** ncxml_filter_compile(xmlNodePtr filter)
 {
-	xmlDocPtr result, data_filtered[2] = {NULL, NULL};
-	xmlNodePtr filter_item, node;
-	keyList keys;
-	int ret = EXIT_FAILURE;
+	struct nc_filter_node** compiled;
+	xmlNodePtr node;
+	int i = 0;
 
-	if (new == NULL || old == NULL || filter == NULL) {
-		return EXIT_FAILURE;
+	for (node = filter->children; node != NULL; node = node->next) {
+		i++;
+	}
+	if ((compiled = calloc(i + 1, sizeof(struct nc_filter_node*))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
 	}
 
-	switch (filter->type) {
-	case NC_FILTER_SUBTREE:
-		if (filter->subtree_filter == NULL) {
-			ERROR("%s: invalid filter (%s:%d).", __func__, __FILE__, __LINE__);
-			return EXIT_FAILURE;
+	/*
+	 * the top-level items are processed one by one, so they have no
+	 * siblings except the previous ones
+	 */
+	for (i = 0, node = filter->children; node != NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
 		}
+		if ((compiled[i] = ncxml_filter_compile_node(node)) == NULL) {
+			ncxml_filter_compiled_free(compiled);
+			return (NULL);
+		}
+		compiled[i]->prev = (i > 0) ? compiled[i - 1] : NULL;
+		compiled[i]->cmatch = compiled[i]->content ? compiled[i] : NULL;
+		compiled[i]->selection = (compiled[i]->content == NULL);
+		i++;
+	}
 
-		/* get all keys from data model */
-		keys = get_keynode_list(data_model);
-
-		data_filtered[0] = xmlNewDoc(BAD_CAST "1.0");
-		data_filtered[1] = xmlNewDoc(BAD_CAST "1.0");
-		for (filter_item = filter->subtree_filter->children; filter_item != NULL; filter_item = filter_item->next) {
-			xmlAddChildList((xmlNodePtr)(data_filtered[0]), xmlCopyNodeList(old));
+	return (compiled);
+}
 
-			/* modify filter doc to deny ncxml_subtree_filter processing
-			 * siblings that are (on this top level) meaningless and they
-			 * will be processed separatelly in the next run of the loop.
-			 */
-			node = filter_item->next;
-			filter_item->next = NULL;
-			ncxml_subtree_filter(data_filtered[0]->children, filter_item, keys);
-			/* revert change made to the filter doc */
-			filter_item->next = node;
+static struct nc_filter_node** ncxml_filter_get_compiled(struct nc_filter* filter)
+{
+	if (filter->compiled == NULL) {
+		filter->compiled = ncxml_filter_compile(filter->subtree_filter);
+	}
+	return (filter->compiled);
+}
 
-			if (data_filtered[1]->children == NULL) {
-				/* there are no data so far */
-				if (data_filtered[0]->children != NULL) {
-					/* we have some result, move it to [1] */
-					node = data_filtered[0]->children;
-					xmlUnlinkNode(node);
+/* check the name, namespace and attributes of the data node */
+static int ncxml_filter_match(const struct nc_filter_node* fnode, xmlNodePtr node)
+{
+	if (!xmlStrEqual(fnode->name, node->name)) {
+		return (0);
+	}
+	if (fnode->ns != NULL && (node->ns == NULL || !xmlStrEqual(fnode->ns, node->ns->href))) {
+		return (0);
+	}
+	if (fnode->node->properties != NULL && attrcmp(fnode->node, node)) {
+		return (0);
+	}
+	return (1);
+}
+
+/* get the first of the filter siblings with the name of the data node */
+static const struct nc_filter_node* ncxml_filter_lookup(const struct nc_filter_node* filter, xmlHashTablePtr index, xmlNodePtr node)
+{
+	if (index != NULL) {
+		return (xmlHashLookup(index, node->name));
+	}
+
+	for (; filter != NULL && !xmlStrEqual(filter->name, node->name); filter = filter->next);
+	return (filter);
+}
+
+/* compare the content match value with the text ignoring its surrounding whitespaces */
+static int ncxml_filter_content_cmp(const struct nc_filter_node* fnode, xmlNodePtr text)
+{
+	const char* s;
+	size_t len;
+
+	if (text == NULL || text->content == NULL) {
+		return (1);
+	}
+
+	for (s = (char*)(text->content); isspace(*s); s++);
+	for (len = strlen(s); len > 0 && isspace(s[len - 1]); len--);
+
+	return (len != fnode->content_len || strncmp(fnode->content, s, len) != 0);
+}
+
+/**
+ * \brief NETCONF subtree filtering, stolen from old old netopeer
+ *
+ * \param config        pointer to xmlNode tree to filter
+ * \param filter        the first of the compiled filter siblings
+ * \param index         filter siblings hashed by their names, if any
+ *
+ * \return              1 if config satisfies the output filter, 0 otherwise
+ */
+static int ncxml_subtree_filter(xmlNodePtr config, const struct nc_filter_node* filter, xmlHashTablePtr index, keyList keys)
+{
+	xmlNodePtr config_node, next;
+	xmlNodePtr delete = NULL;
+	const struct nc_filter_node* filter_node;
+	int nomatch = 0;
+	int filter_in = 0, sibling_in = 0, sibling_selection = 0;
+
+	/* check if this filter level is last */
+	if ((filter_node = filter->cmatch) != NULL) {
+
+		/* 0 means that all the sibling nodes will be in the filter result - this is a default
+		 * behavior when there are no selection or containment nodes in the filter sibling set.
+		 * If 1 is set, sibling nodes for the filter result will be selected according to the
+		 * rules in RFC 6241, sec. 6.2.5
+		 */
+		sibling_selection = 0;
+
+		/* try to find required node */
+		for (config_node = config; config_node && config_node->children; config_node = config_node->next) {
+			if (!ncxml_filter_match(filter_node, config_node)) {
+				continue;
+			}
+
+			if (strisempty(filter_node->content)) {
+				/* we have an empty content match node, so interpret it as a selection node,
+				 * which means that we will be selecting sibling nodes that will be in the
+				 * filter result
+				 */
+				filter_in = 1;
+				sibling_selection = 1;
+			} else if (ncxml_filter_content_cmp(filter_node, config_node->children) == 0) {
+				filter_in = 1;
+			}
+
+			if (!filter_in) {
+				continue;
+			}
+
+			/* we have the matching node, now decide what to do */
+			if (filter_node->next || filter_node->prev || sibling_selection == 1) {
+				/* if all filter sibling nodes are content match nodes, no config sibling node will be removed */
+				sibling_selection |= filter->selection;
+
+				/* select and remove all unwanted nodes */
+				config_node = config;
+				while (config_node) {
+					/* init */
+					sibling_in = 0;
+
+					/* go to the first filter sibling node of the same name */
+					filter_node = ncxml_filter_lookup(filter, index, config_node);
+
+filter:
+					/* pass all filter sibling nodes of the same name */
+					for (; filter_node; filter_node = filter_node->same) {
+						if (!ncxml_filter_match(filter_node, config_node)) {
+							continue;
+						}
+						/* content match node check */
+						if (filter_node->content && config_node->children && (config_node->children->type == XML_TEXT_NODE) &&
+								!xmlIsBlankNode(config_node->children) &&
+								ncxml_filter_content_cmp(filter_node, config_node->children) != 0) {
+							nomatch = 1;
+							continue;
+						}
+						sibling_in = 1;
+						break;
+					}
+
+					if (!filter_node) {
+						if (nomatch) {
+							/* instance does not follow restrictions */
+							return 0;
+						} else if (is_key(config_node->parent, config_node, keys)) {
+							/* go to the next sibling */
+							config_node = config_node->next;
+							continue;
+						}
+					}
+
+					/* if this config node is not in filter, remove it */
+					if (sibling_selection && !sibling_in) {
+						delete = config_node;
+						config_node = config_node->next;
+						xmlUnlinkNode(delete);
+						xmlFreeNode(delete);
+					} else {
+						/* recursively process subtree filter */
+						if (filter_node && filter_node->children && filter_node->content == NULL &&
+								config_node->children && (config_node->children->type == XML_ELEMENT_NODE)) {
+							sibling_in = ncxml_subtree_filter(config_node->children, filter_node->children, filter_node->index, keys);
+						}
+						if (sibling_selection && sibling_in == 0) {
+							if (filter_node) {
+								/* try another filter node */
+								filter_node = filter_node->same;
+								goto filter;
+							}
+
+							/* subtree is not a content of the filter output */
+							delete = config_node;
+
+							/* remeber where to go next */
+							config_node = config_node->next;
+
+							/* and remove unwanted subtree */
+							xmlUnlinkNode(delete);
+							xmlFreeNode(delete);
+						} else {
+							/* go to the next sibling */
+							config_node = config_node->next;
+						}
+					}
+				}
+			} else {
+				/* only content match node present - all sibling nodes stays */
+			}
+			break;
+		}
+	} else {
+		/* this is containment node (no sibling node is content match node), filter all the config siblings */
+		for (config_node = config; config_node != NULL; config_node = next) {
+			next = config_node->next;
+			sibling_in = 0;
+
+			for (filter_node = ncxml_filter_lookup(filter, index, config_node); filter_node; filter_node = filter_node->same) {
+				if (!ncxml_filter_match(filter_node, config_node)) {
+					continue;
+				}
+				if (!config_node->children || !filter_node->children) {
+					/* selection node */
+					sibling_in = 1;
+					break;
+				}
+				if ((sibling_in = ncxml_subtree_filter(config_node->children, filter_node->children, filter_node->index, keys)) != 0) {
+					break;
+				}
+			}
+
+			if (sibling_in) {
+				filter_in = 1;
+			} else {
+				/* subtree is not a content of the filter output */
+				xmlUnlinkNode(config_node);
+				xmlFreeNode(config_node);
+			}
+		}
+	}
+
+	return filter_in;
+}
+
+int ncxml_filter(xmlNodePtr old, struct nc_filter* filter, xmlNodePtr *new, const xmlDocPtr data_model)
+{
+	xmlDocPtr result, data_filtered[2] = {NULL, NULL};
+	xmlNodePtr node;
+	const struct nc_filter_node* filter_item;
+	keyList keys;
+	int i, ret = EXIT_FAILURE;
+
+	if (new == NULL || old == NULL || filter == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	switch (filter->type) {
+	case NC_FILTER_SUBTREE:
+		if (filter->subtree_filter == NULL) {
+			ERROR("%s: invalid filter (%s:%d).", __func__, __FILE__, __LINE__);
+			return EXIT_FAILURE;
+		}
+
+		/* the filter is compiled on its first use and kept for the next ones */
+		if (ncxml_filter_get_compiled(filter) == NULL) {
+			return EXIT_FAILURE;
+		}
+
+		/* get all keys from data model */
+		keys = get_keynode_list(data_model);
+
+		data_filtered[0] = xmlNewDoc(BAD_CAST "1.0");
+		data_filtered[1] = xmlNewDoc(BAD_CAST "1.0");
+		for (i = 0; (filter_item = filter->compiled[i]) != NULL; i++) {
+			if (filter_item->content == NULL) {
+				/* do not copy the top-level data which cannot match the item */
+				for (node = old; node != NULL; node = node->next) {
+					if (node->type == XML_ELEMENT_NODE && ncxml_filter_match(filter_item, node)) {
+						xmlAddChild((xmlNodePtr)(data_filtered[0]), xmlDocCopyNode(node, data_filtered[0], 1));
+					}
+				}
+			} else {
+				xmlAddChildList((xmlNodePtr)(data_filtered[0]), xmlCopyNodeList(old));
+			}
+			if (data_filtered[0]->children == NULL) {
+				continue;
+			}
+
+			ncxml_subtree_filter(data_filtered[0]->children, filter_item, NULL, keys);
+
+			if (data_filtered[1]->children == NULL) {
+				/* there are no data so far */
+				if (data_filtered[0]->children != NULL) {
+					/* we have some result, move it to [1] */
+					node = data_filtered[0]->children;
+					xmlUnlinkNode(node);
 					xmlDocSetRootElement(data_filtered[1], node);
 				}
 			} else if (data_filtered[0]-> children != NULL) {
@@ -5136,7 +5394,7 @@ int ncxml_filter(xmlNodePtr old, const struct nc_filter* filter, xmlNodePtr *new
 			keyListFree(keys);
 		}
 
-		if (filter->subtree_filter->children != NULL) {
+		if (filter->compiled[0] != NULL) {
 			if(data_filtered[1] != NULL && data_filtered[1]->children != NULL) {
 				*new = xmlCopyNodeList(data_filtered[1]->children);
 			} else {
@@ -5157,6 +5415,123 @@ int ncxml_filter(xmlNodePtr old, const struct nc_filter* filter, xmlNodePtr *new
 	return ret;
 }
 
+static void ncxml_filter_prune_siblings(xmlNodePtr data, const struct nc_filter_node* filter, xmlHashTablePtr index)
+{
+	const struct nc_filter_node *filter_node, *match;
+	xmlNodePtr node, next;
+	int count;
+
+	if (filter->cmatch != NULL) {
+		/* content match nodes decide about their siblings, leave it to ncxml_filter() */
+		return;
+	}
+
+	for (node = data; node != NULL; node = next) {
+		next = node->next;
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+
+		match = NULL;
+		count = 0;
+		for (filter_node = ncxml_filter_lookup(filter, index, node); filter_node != NULL && count < 2; filter_node = filter_node->same) {
+			if (ncxml_filter_match(filter_node, node)) {
+				match = filter_node;
+				count++;
+			}
+		}
+
+		if (count == 0) {
+			/* no containment or selection node selects this subtree */
+			xmlUnlinkNode(node);
+			xmlFreeNode(node);
+		} else if (count == 1 && match->children != NULL && node->children != NULL) {
+			ncxml_filter_prune_siblings(node->children, match->children, match->index);
+			if (node->children == NULL) {
+				/* nothing selected from the subtree */
+				xmlUnlinkNode(node);
+				xmlFreeNode(node);
+			}
+		}
+		/* subtrees matching more filter nodes are left to ncxml_filter() */
+	}
+}
+
+/**
+ * \brief Remove the data the subtree filter certainly does not select.
+ *
+ * Only the subtrees which ncxml_filter() would remove regardless of the rest
+ * of the data are removed, so the filter can be applied before the default
+ * values and NACM are processed to save the work on the unwanted data. The
+ * filter itself still has to be applied to the result.
+ *
+ * Nothing is removed if the default values are going to be added into the
+ * data, since they can complete the subtrees (e.g. list entries) the pruning
+ * would remove as empty. Nothing is removed either if NACM data rules are
+ * going to be applied, since their paths can refer to the removed nodes
+ * (e.g. in predicates).
+ *
+ * The pruned data must not be merged with other data anymore, the list keys
+ * needed to match the list entries can be removed.
+ *
+ * \param doc           data to prune
+ * \param filter        subtree filter
+ * \param wd            with-defaults mode the data will be processed with
+ * \param nacm          NACM rules the data will be checked with
+ */
+static void ncxml_filter_prune(xmlDocPtr doc, struct nc_filter* filter, NCWD_MODE wd, const struct nacm_rpc* nacm)
+{
+	struct nc_filter_node** compiled;
+	xmlNodePtr node, next;
+	int i, count, last;
+
+	if (wd & (NCWD_MODE_ALL | NCWD_MODE_ALL_TAGGED | NCWD_MODE_IMPL_TAGGED)) {
+		return;
+	}
+
+	if (nacm != NULL && nacm->data_rules != NULL && nacm->data_rules[0] != NULL) {
+		return;
+	}
+
+	if (doc == NULL || filter == NULL || filter->type != NC_FILTER_SUBTREE || filter->subtree_filter == NULL ||
+			(compiled = ncxml_filter_get_compiled(filter)) == NULL) {
+		return;
+	}
+
+	for (i = 0; compiled[i] != NULL; i++) {
+		if (compiled[i]->content != NULL) {
+			/* top-level content match node, all the data can be selected */
+			return;
+		}
+	}
+
+	/* the top-level filter items are applied separately and their results are merged */
+	for (node = doc->children; node != NULL; node = next) {
+		next = node->next;
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+
+		for (i = count = last = 0; compiled[i] != NULL; i++) {
+			if (ncxml_filter_match(compiled[i], node)) {
+				last = i;
+				count++;
+			}
+		}
+
+		if (count == 0) {
+			xmlUnlinkNode(node);
+			xmlFreeNode(node);
+		} else if (count == 1 && compiled[last]->children != NULL && node->children != NULL) {
+			ncxml_filter_prune_siblings(node->children, compiled[last]->children, compiled[last]->index);
+			if (node->children == NULL) {
+				xmlUnlinkNode(node);
+				xmlFreeNode(node);
+			}
+		}
+	}
+}
+
 API int ncds_rollback(ncds_id id)
 {
 	struct ncds_ds *datastore = datastores_get_ds(id);
@@ -5228,11 +5603,13 @@ static int ncds_is_conflict(const nc_rpc * rpc, const struct nc_session * sessio
 }
 
 /**
+ * \param[in] edit Content of the edit-config that changed the running
+ * datastore to limit the comparison with its previous content, NULL to
+ * compare the whole datastore.
  * \return NULL on success, error reply with error info else
  */
-static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session* session, xmlDocPtr old, NC_EDIT_ERROPT_TYPE erropt, nc_reply *reply)
+static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session* session, xmlDocPtr old, xmlDocPtr edit, NC_EDIT_ERROPT_TYPE erropt, nc_reply *reply)
 {
-	char *new_data;
 	xmlDocPtr new;
 	xmlChar *config;
 	int ret;
@@ -5247,14 +5624,13 @@ static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session
 	}
 
 	/* find differences and call functions */
-	new_data = ds->func.getconfig(ds, session, NC_DATASTORE_RUNNING, &e);
-	new = read_datastore_data(ds->id, new_data);
-	free(new_data);
+	new = ncds_getconfig_doc(ds, session, NC_DATASTORE_RUNNING, &e);
 
 	/* add default values */
 	ncdflt_default_values(new, ds->ext_model, NCWD_MODE_IMPL_TAGGED);
 
 	if (new == NULL ) { /* cannot get or parse data */
+		nc_err_free(e);
 		e = nc_err_new(NC_ERR_OP_FAILED);
 		if (new_reply != NULL) {
 			/* second try, add the error info */
@@ -5274,7 +5650,7 @@ static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session
 		ncdflt_default_values(old, ds->ext_model, NCWD_MODE_IMPL_TAGGED);
 
 		/* perform TransAPI transactions */
-		ret = transapi_running_changed(ds, old, new, erropt, &e);
+		ret = transapi_running_changed(ds, old, new, edit, erropt, &e);
 		if (ret) {
 			e_new = nc_err_new(NC_ERR_OP_FAILED);
 			if (e != NULL) {
@@ -5330,6 +5706,48 @@ static nc_reply* ncds_apply_transapi(struct ncds_ds* ds, const struct nc_session
 	return (new_reply);
 }
 
+/* filter of the <get> request being processed by the current thread */
+static pthread_key_t state_filter_key;
+static pthread_once_t state_filter_once = PTHREAD_ONCE_INIT;
+
+static void state_filter_init(void)
+{
+	pthread_key_create(&state_filter_key, NULL);
+}
+
+API xmlNodePtr ncds_get_state_filter_xml(void)
+{
+	struct nc_filter* filter;
+
+	pthread_once(&state_filter_once, state_filter_init);
+	if ((filter = pthread_getspecific(state_filter_key)) == NULL || filter->type != NC_FILTER_SUBTREE) {
+		return (NULL);
+	}
+
+	return (filter->subtree_filter);
+}
+
+API char* ncds_get_state_filter(void)
+{
+	xmlNodePtr filter;
+	xmlBufferPtr buf;
+	char* retval;
+
+	if ((filter = ncds_get_state_filter_xml()) == NULL) {
+		return (NULL);
+	}
+
+	if ((buf = xmlBufferCreate()) == NULL) {
+		ERROR("%s: xmlBufferCreate failed (%s:%d).", __func__, __FILE__, __LINE__);
+		return (NULL);
+	}
+	xmlNodeDump(buf, filter->doc, filter, 0, 0);
+	retval = strdup((char*) xmlBufferContent(buf));
+	xmlBufferFree(buf);
+
+	return (retval);
+}
+
 /*
  * returns:
  *  0 - filter removes data from this datastore, do not continue
@@ -5382,6 +5800,30 @@ static int rpc_get_prefilter(struct nc_filter **filter, const struct ncds_ds* ds
 	return (retval);
 }
 
+/*
+ * Find the transAPI callback implementing the RPC of the given name in the
+ * datastore, NULL is returned if no transAPI module of the datastore
+ * implements it. Otherwise, index is set to the callback's position in the
+ * returned list.
+ */
+static struct transapi_rpc_callbacks* ds_rpc_callback(struct ncds_ds* ds, const char* op_name, int* index)
+{
+	struct transapi_list* tapi_iter;
+	int i;
+
+	for (tapi_iter = ds->transapis; tapi_iter != NULL; tapi_iter = tapi_iter->next) {
+		for (i = 0; i < tapi_iter->tapi->rpc_clbks->callbacks_count; i++) {
+			/* there can be only one RPC with name == op_name */
+			if (strcmp(op_name, tapi_iter->tapi->rpc_clbks->callbacks[i].name) == 0) {
+				*index = i;
+				return (tapi_iter->tapi->rpc_clbks);
+			}
+		}
+	}
+
+	return (NULL);
+}
+
 /**
  * @ingroup store
  * @brief Perform the requested RPC operation on the datastore.
@@ -5411,15 +5853,13 @@ static nc_reply* ncds_apply_rpc(ncds_id id, const struct nc_session* session, co
 	xmlBufferPtr resultbuffer;
 	xmlNodePtr aux_node, node;
 	NC_OP op;
-	xmlDocPtr old = NULL;
-	char * old_data = NULL;
+	xmlDocPtr old = NULL, config_doc = NULL, edit_doc = NULL;
 	NC_DATASTORE source_ds = 0, target_ds = 0;
 	struct nacm_rpc *nacm_aux;
 	nc_rpc *rpc_aux;
 	xmlNodePtr op_node;
 	xmlNodePtr op_input;
-	struct transapi_list* tapi_iter;
-	const char * rpc_name;
+	struct transapi_rpc_callbacks* rpc_clbks;
 	const char *data_ns = NULL;
 	char *aux = NULL;
 	NC_EDIT_ERROPT_TYPE erropt;
@@ -5464,8 +5904,7 @@ process_datastore:
 		&& (op == NC_OP_COMMIT || op == NC_OP_COPYCONFIG || (op == NC_OP_EDITCONFIG && (nc_rpc_get_testopt(rpc) != NC_EDIT_TESTOPT_TEST))) &&
 		(nc_rpc_get_target(rpc) == NC_DATASTORE_RUNNING)) {
 
-		old_data = ds->func.getconfig(ds, session, NC_DATASTORE_RUNNING, &e);
-		old = read_datastore_data(ds->id, old_data);
+		old = ncds_getconfig_doc(ds, session, NC_DATASTORE_RUNNING, &e);
 		if (old == NULL) {/* cannot get or parse data */
 			pthread_mutex_unlock(&ds->lock);
 			if (e == NULL) { /* error not set */
@@ -5474,7 +5913,6 @@ process_datastore:
 			}
 			return nc_reply_error(e);
 		}
-		free(old_data);
 	}
 
 	filter = NULL;
@@ -5529,7 +5967,7 @@ process_datastore:
 			break;
 		}
 
-		if ((data = ds->func.getconfig(ds, session, NC_DATASTORE_RUNNING, &e)) == NULL ) {
+		if ((doc1 = ncds_getconfig_doc(ds, session, NC_DATASTORE_RUNNING, &e)) == NULL ) {
 			if (e == NULL ) {
 				ERROR("%s: Failed to get data from the datastore (%s:%d).", __func__, __FILE__, __LINE__);
 				e = nc_err_new(NC_ERR_OP_FAILED);
@@ -5540,21 +5978,37 @@ process_datastore:
 		if (ds->get_state_xml != NULL || ds->get_state != NULL) {
 			/* caller provided callback function to retrieve status data */
 
-			/* convert configuration data into XML structure */
-			doc1 = read_datastore_data(ds->id, data);
-			if (doc1 == NULL || doc1->children == NULL) {
+			if (doc1->children == NULL) {
 				/* empty */
 				xmlFreeDoc(doc1);
 				doc1 = NULL;
 			}
 
+			/* let the callback know what the client asks for */
+			pthread_once(&state_filter_once, state_filter_init);
+			pthread_setspecific(state_filter_key, filter);
+
 			if (ds->get_state_xml != NULL) {
 				/* status data are directly in XML format */
 				doc2 = ds->get_state_xml(ds->ext_model, doc1, &e);
 			} else if (ds->get_state != NULL) {
+				/* the callback works with the serialized configuration data */
+				resultbuffer = xmlBufferCreate();
+				if (resultbuffer == NULL) {
+					ERROR("%s: xmlBufferCreate failed (%s:%d).", __func__, __FILE__, __LINE__);
+					e = nc_err_new(NC_ERR_OP_FAILED);
+					xmlFreeDoc(doc1);
+					pthread_setspecific(state_filter_key, NULL);
+					break;
+				}
+				for (aux_node = (doc1 != NULL) ? doc1->children : NULL; aux_node != NULL; aux_node = aux_node->next) {
+					xmlNodeDump(resultbuffer, doc1, aux_node, 0, 0);
+				}
+
 				/* status data are provided as string, convert it into XML structure */
 				xmlDocDumpMemory(ds->ext_model, (xmlChar**) (&model), &len);
-				data2 = ds->get_state(model, data, &e);
+				data2 = ds->get_state(model, (char*) xmlBufferContent(resultbuffer), &e);
+				xmlBufferFree(resultbuffer);
 				doc2 = read_datastore_data(ds->id, data2);
 				if (doc2 == NULL || doc2->children == NULL) {
 					/* empty */
@@ -5567,10 +6021,12 @@ process_datastore:
 				/* we have no status data */
 				doc2 = NULL;
 			}
+			pthread_setspecific(state_filter_key, NULL);
 
 			if (e != NULL) {
 				/* state data retrieval error */
-				free(data);
+				xmlFreeDoc(doc1);
+				xmlFreeDoc(doc2);
 				break;
 			}
 
@@ -5597,9 +6053,8 @@ process_datastore:
 				xmlFreeDoc(doc2);
 			}
 		} else {
-			doc_merged = read_datastore_data(ds->id, data);
+			doc_merged = doc1;
 		}
-		free(data);
 
 		if (doc_merged == NULL) {
 			ERROR("Reading the configuration datastore failed.");
@@ -5608,6 +6063,9 @@ process_datastore:
 			break;
 		}
 
+		/* drop the unwanted data before processing them */
+		ncxml_filter_prune(doc_merged, filter, rpc->with_defaults, rpc->nacm);
+
 		/* process default values */
 		if (ds && ds->data_model->xml) {
 			ncdflt_default_values(doc_merged, ds->ext_model, rpc->with_defaults);
@@ -5646,22 +6104,17 @@ process_datastore:
 			break;
 		}
 
-		if ((data = ds->func.getconfig(ds, session, nc_rpc_get_source(rpc), &e)) == NULL) {
+		if ((doc_merged = ncds_getconfig_doc(ds, session, nc_rpc_get_source(rpc), &e)) == NULL) {
 			if (e == NULL) {
-				ERROR ("%s: Failed to get data from the datastore (%s:%d).", __func__, __FILE__, __LINE__);
+				ERROR("Reading configuration datastore failed.");
 				e = nc_err_new(NC_ERR_OP_FAILED);
+				nc_err_set(e, NC_ERR_PARAM_MSG, "Invalid datastore content.");
 			}
 			break;
 		}
-		doc_merged = read_datastore_data(ds->id, data);
-		free(data);
 
-		if (doc_merged == NULL) {
-			ERROR("Reading configuration datastore failed.");
-			e = nc_err_new(NC_ERR_OP_FAILED);
-			nc_err_set(e, NC_ERR_PARAM_MSG, "Invalid datastore content.");
-			break;
-		}
+		/* drop the unwanted data before processing them */
+		ncxml_filter_prune(doc_merged, filter, rpc->with_defaults, rpc->nacm);
 
 		/* process default values */
 		if (ds && ds->data_model->xml) {
@@ -5807,6 +6260,20 @@ process_datastore:
 				}
 			}
 
+			if (op == NC_OP_EDITCONFIG && old != NULL && nc_rpc_get_defop(rpc) != NC_EDIT_DEFOP_REPLACE) {
+				/*
+				 * transAPI will compare only the nodes mentioned in the edit,
+				 * keep its copy since the datastore modifies the document
+				 */
+				edit_doc = xmlCopyDoc(doc2, 1);
+			}
+
+			if (op == NC_OP_EDITCONFIG && ds->func.editconfig_xml != NULL) {
+				/* the datastore is able to use the XML document directly */
+				config_doc = doc2;
+				goto apply_editcopyconfig;
+			}
+
 			/* dump the data to string */
 			resultbuffer = xmlBufferCreate();
 			if (resultbuffer == NULL) {
@@ -5824,7 +6291,13 @@ process_datastore:
 apply_editcopyconfig:
 		/* perform the operation */
 		if (op == NC_OP_EDITCONFIG) {
-			ret = ds->func.editconfig(ds, session, rpc, target_ds, config, nc_rpc_get_defop(rpc), nc_rpc_get_erropt(rpc), &e);
+			if (config_doc != NULL) {
+				ret = ds->func.editconfig_xml(ds, session, rpc, target_ds, config_doc, nc_rpc_get_defop(rpc), nc_rpc_get_erropt(rpc), &e);
+				xmlFreeDoc(config_doc);
+				config_doc = NULL;
+			} else {
+				ret = ds->func.editconfig(ds, session, rpc, target_ds, config, nc_rpc_get_defop(rpc), nc_rpc_get_erropt(rpc), &e);
+			}
 #ifndef DISABLE_VALIDATION
 			if (ret == EXIT_SUCCESS && (nc_cpblts_enabled(session, NC_CAP_VALIDATE11_ID) || nc_cpblts_enabled(session, NC_CAP_VALIDATE10_ID))) {
 				/* process test option if set */
@@ -5977,17 +6450,7 @@ apply_editcopyconfig:
 						}
 					}
 
-					data = ds->func.getconfig(ds, session, source_ds, &e);
-					if (data == NULL ) {
-						if (e == NULL ) {
-							ERROR("%s: Failed to get data from the datastore (%s:%d).", __func__, __FILE__, __LINE__);
-							e = nc_err_new(NC_ERR_OP_FAILED);
-						}
-						xmlFreeDoc(doc1);
-						break;
-					}
-					doc2 = read_datastore_data(ds->id, data);
-					free(data);
+					doc2 = ncds_getconfig_doc(ds, session, source_ds, &e);
 					if (doc2 == NULL) {
 						if (e == NULL ) {
 							ERROR("%s: Unable to process datastore data (%s:%d).", __func__, __FILE__, __LINE__);
@@ -6146,30 +6609,17 @@ apply_editcopyconfig:
 		op_name = nc_rpc_get_op_name (rpc);
 		/* prepare for case RPC is not supported by this datastore */
 		reply = NCDS_RPC_NOT_APPLICABLE;
-		/* go through all RPC implemented by datastore's transAPI modules */
-		for (tapi_iter = ds->transapis; tapi_iter != NULL; tapi_iter = tapi_iter->next) {
-			for (i = 0; i < tapi_iter->tapi->rpc_clbks->callbacks_count; i++) {
-				/* find matching rpc and call rpc callback function */
-				rpc_name = tapi_iter->tapi->rpc_clbks->callbacks[i].name;
-				if (strcmp(op_name, rpc_name) == 0) {
-					/* get operation node */
-					op_node = ncxml_rpc_get_op_content(rpc);
-					op_input = xmlCopyNodeList(op_node->children);
-					xmlFreeNode(op_node);
-
-					/* call RPC callback function */
-					VERB("Calling %s RPC function\n", rpc_name);
-					reply = tapi_iter->tapi->rpc_clbks->callbacks[i].func(op_input);
-					xmlFreeNodeList(op_input);
-
-					/* end RPC search, there can be only one RPC with name == op_name */
-					break;
-				}
-			}
-			if (i >= tapi_iter->tapi->rpc_clbks->callbacks_count) {
-				/* propagate break to outer for loop */
-				break;
-			}
+		/* find the RPC in the datastore's transAPI modules and call its callback function */
+		if ((rpc_clbks = ds_rpc_callback(ds, op_name, &i)) != NULL) {
+			/* get operation node */
+			op_node = ncxml_rpc_get_op_content(rpc);
+			op_input = xmlCopyNodeList(op_node->children);
+			xmlFreeNode(op_node);
+
+			/* call RPC callback function */
+			VERB("Calling %s RPC function\n", rpc_clbks->callbacks[i].name);
+			reply = rpc_clbks->callbacks[i].func(op_input);
+			xmlFreeNodeList(op_input);
 		}
 
 		free(op_name);
@@ -6236,13 +6686,15 @@ apply_editcopyconfig:
 			erropt = NC_EDIT_ERROPT_ROLLBACK;
 		}
 
-		if ((new_reply = ncds_apply_transapi(ds, session, old, erropt, NULL)) != NULL) {
+		if ((new_reply = ncds_apply_transapi(ds, session, old, edit_doc, erropt, NULL)) != NULL) {
 			nc_reply_free(reply);
 			reply = new_reply;
 		}
 	}
 	xmlFreeDoc (old);
 	old = NULL;
+	xmlFreeDoc(edit_doc);
+	edit_doc = NULL;
 
 	pthread_mutex_unlock(&ds->lock);
 
@@ -6300,6 +6752,312 @@ static char* serialize_cpblts(const struct nc_cpblts *capabilities)
 	return(retval);
 }
 
+/*
+ * Worker threads of ncds_apply_rpc2all() processing the read requests on
+ * several datastores concurrently.
+ */
+struct rpc_job {
+	ncds_id id;
+	const struct nc_session* session;
+	nc_rpc* rpc;                  /* private copy of the request */
+	struct nc_filter* filter;
+	nc_reply* reply;
+	int* pending;                 /* unfinished jobs of the request */
+	pthread_cond_t* done;
+	struct rpc_job* next;         /* queue of the waiting jobs */
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct rpc_job* queue;
+	pthread_t* threads;
+	unsigned int count;
+	int stop;
+} rpc_pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0, 0};
+
+static void rpc_job_run(struct rpc_job* job)
+{
+	job->reply = ncds_apply_rpc(job->id, job->session, job->rpc, job->filter);
+	nc_rpc_free(job->rpc);
+	job->rpc = NULL;
+
+	DBG_LOCK("rpc_pool.lock");
+	pthread_mutex_lock(&rpc_pool.lock);
+	if (--(*job->pending) == 0) {
+		pthread_cond_signal(job->done);
+	}
+	DBG_UNLOCK("rpc_pool.lock");
+	pthread_mutex_unlock(&rpc_pool.lock);
+}
+
+static void* rpc_pool_thread(void* UNUSED(arg))
+{
+	struct rpc_job* job;
+
+	DBG_LOCK("rpc_pool.lock");
+	pthread_mutex_lock(&rpc_pool.lock);
+	while (!rpc_pool.stop) {
+		if ((job = rpc_pool.queue) == NULL) {
+			pthread_cond_wait(&rpc_pool.cond, &rpc_pool.lock);
+			continue;
+		}
+		rpc_pool.queue = job->next;
+		DBG_UNLOCK("rpc_pool.lock");
+		pthread_mutex_unlock(&rpc_pool.lock);
+
+		rpc_job_run(job);
+
+		DBG_LOCK("rpc_pool.lock");
+		pthread_mutex_lock(&rpc_pool.lock);
+	}
+	DBG_UNLOCK("rpc_pool.lock");
+	pthread_mutex_unlock(&rpc_pool.lock);
+
+	return (NULL);
+}
+
+static void rpc_pool_stop(void)
+{
+	unsigned int i;
+
+	DBG_LOCK("rpc_pool.lock");
+	pthread_mutex_lock(&rpc_pool.lock);
+	rpc_pool.stop = 1;
+	pthread_cond_broadcast(&rpc_pool.cond);
+	DBG_UNLOCK("rpc_pool.lock");
+	pthread_mutex_unlock(&rpc_pool.lock);
+
+	for (i = 0; i < rpc_pool.count; i++) {
+		pthread_join(rpc_pool.threads[i], NULL);
+	}
+	free(rpc_pool.threads);
+	rpc_pool.threads = NULL;
+	rpc_pool.count = 0;
+	rpc_pool.stop = 0;
+}
+
+API int ncds_set_rpc2all_threads(unsigned int count)
+{
+	int r;
+
+	rpc_pool_stop();
+	if (count == 0) {
+		return (EXIT_SUCCESS);
+	}
+
+	if ((rpc_pool.threads = malloc(count * sizeof(pthread_t))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	for (rpc_pool.count = 0; rpc_pool.count < count; rpc_pool.count++) {
+		if ((r = pthread_create(&rpc_pool.threads[rpc_pool.count], NULL, rpc_pool_thread, NULL)) != 0) {
+			ERROR("%s: creating a thread failed (%s).", __func__, strerror(r));
+			rpc_pool_stop();
+			return (EXIT_FAILURE);
+		}
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/*
+ * Apply the read request on all the given datastores concurrently, the
+ * replies are returned in the jobs in the order of the datastores.
+ */
+static void rpc_pool_apply(struct rpc_job* jobs, int count)
+{
+	pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+	struct rpc_job *job, **prev;
+	int i, pending = count;
+
+	DBG_LOCK("rpc_pool.lock");
+	pthread_mutex_lock(&rpc_pool.lock);
+	for (i = count - 1; i >= 0; i--) {
+		jobs[i].pending = &pending;
+		jobs[i].done = &done;
+		jobs[i].next = rpc_pool.queue;
+		rpc_pool.queue = &jobs[i];
+	}
+	pthread_cond_broadcast(&rpc_pool.cond);
+
+	while (pending > 0) {
+		/* do not just wait, help with the jobs of this request not yet taken by the workers */
+		for (prev = &rpc_pool.queue; *prev != NULL && (*prev)->done != &done; prev = &(*prev)->next);
+		if ((job = *prev) != NULL) {
+			*prev = job->next;
+			DBG_UNLOCK("rpc_pool.lock");
+			pthread_mutex_unlock(&rpc_pool.lock);
+
+			rpc_job_run(job);
+
+			DBG_LOCK("rpc_pool.lock");
+			pthread_mutex_lock(&rpc_pool.lock);
+		} else {
+			pthread_cond_wait(&done, &rpc_pool.lock);
+		}
+	}
+	DBG_UNLOCK("rpc_pool.lock");
+	pthread_mutex_unlock(&rpc_pool.lock);
+
+	pthread_cond_destroy(&done);
+}
+
+/*
+ * Get the first of the top-level elements in the <config> parameter of the
+ * <edit-config> or <copy-config> request. NULL is returned if the data are not
+ * provided directly in the request or if they are empty.
+ */
+static xmlNodePtr rpc_config_roots(const nc_rpc* rpc, NC_OP op)
+{
+	xmlNodePtr node;
+
+	if ((node = xmlDocGetRootElement(rpc->doc)) == NULL) {
+		return (NULL);
+	}
+	for (node = node->children; node != NULL && node->type != XML_ELEMENT_NODE; node = node->next);
+	if (node == NULL) {
+		return (NULL);
+	}
+
+	if (op == NC_OP_COPYCONFIG) {
+		for (node = node->children; node != NULL; node = node->next) {
+			if (node->type == XML_ELEMENT_NODE && xmlStrcmp(node->name, BAD_CAST "source") == 0 &&
+					node->ns != NULL && xmlStrcmp(node->ns->href, BAD_CAST NC_NS_BASE10) == 0) {
+				break;
+			}
+		}
+		if (node == NULL) {
+			return (NULL);
+		}
+	}
+
+	for (node = node->children; node != NULL; node = node->next) {
+		if (node->type == XML_ELEMENT_NODE && xmlStrcmp(node->name, BAD_CAST "config") == 0 &&
+				node->ns != NULL && xmlStrcmp(node->ns->href, BAD_CAST NC_NS_BASE10) == 0) {
+			break;
+		}
+	}
+	if (node == NULL) {
+		return (NULL);
+	}
+
+	for (node = node->children; node != NULL && node->type != XML_ELEMENT_NODE; node = node->next);
+	return (node);
+}
+
+/*
+ * Decide whether the request is worth passing to the datastore, the datastores
+ * skipped here would return NCDS_RPC_NOT_APPLICABLE anyway.
+ */
+static int rpc_touches_ds(struct ncds_ds* ds, NC_OP op, xmlNodePtr config, const char* op_name)
+{
+	xmlNodePtr node;
+	int i;
+
+	switch (op) {
+	case NC_OP_EDITCONFIG:
+	case NC_OP_COPYCONFIG:
+		if (config == NULL) {
+			/* empty config or data from URL or another datastore */
+			return (1);
+		}
+		for (node = config; node != NULL; node = node->next) {
+			if (is_model_root(node, ds->data_model)) {
+				return (1);
+			}
+		}
+		return (0);
+	case NC_OP_UNKNOWN:
+		return (ds_rpc_callback(ds, op_name, &i) != NULL);
+	default:
+		return (1);
+	}
+}
+
+/* check whether ncds_apply_rpc2all() does not apply the request on the datastore */
+static int rpc_skips_ds(struct ncds_ds* ds, NC_OP op, xmlNodePtr config, const char* op_name)
+{
+	/* skip internal datastores */
+	if (ds->id > 0 && ds->id < internal_ds_count) {
+		return (1);
+	}
+
+	/* skip datastores not affected by the request */
+	if (ds->id >= internal_ds_count && !rpc_touches_ds(ds, op, config, op_name)) {
+		return (1);
+	}
+
+	return (0);
+}
+
+/*
+ * Prepare the jobs for applying the read request on the datastores by the
+ * worker threads, NULL is returned when the request is to be processed
+ * sequentially.
+ */
+static struct rpc_job* rpc_jobs_new(const struct nc_session* session, const nc_rpc* rpc, NC_OP op, struct nc_filter* shared_filter, const char* op_name, int* count)
+{
+	struct ncds_ds_list* ds;
+	struct rpc_job* jobs;
+	int i;
+
+	*count = 0;
+	if (rpc_pool.count == 0 || (op != NC_OP_GET && op != NC_OP_GETCONFIG)) {
+		return (NULL);
+	}
+
+	/* the filter is shared by the threads, so compile it now */
+	if (shared_filter != NULL && shared_filter->type == NC_FILTER_SUBTREE && shared_filter->subtree_filter != NULL
+			&& ncxml_filter_get_compiled(shared_filter) == NULL) {
+		return (NULL);
+	}
+
+	if ((jobs = calloc(ncds.count, sizeof(struct rpc_job))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+
+	for (ds = ncds.datastores; ds != NULL; ds = ds->next) {
+		if (rpc_skips_ds(ds->datastore, op, NULL, op_name)) {
+			continue;
+		}
+
+		/* every thread works with its own copy of the request */
+		jobs[*count].id = ds->datastore->id;
+		jobs[*count].session = session;
+		jobs[*count].filter = shared_filter;
+		if ((jobs[*count].rpc = nc_msg_dup_nodict((struct nc_msg*) rpc)) == NULL) {
+			for (i = 0; i < *count; i++) {
+				nc_rpc_free(jobs[i].rpc);
+			}
+			free(jobs);
+			*count = 0;
+			return (NULL);
+		}
+		(*count)++;
+	}
+
+	rpc_pool_apply(jobs, *count);
+
+	return (jobs);
+}
+
+/* free the jobs together with the replies not taken by ncds_apply_rpc2all() */
+static void rpc_jobs_free(struct rpc_job* jobs, int count)
+{
+	int i;
+
+	if (jobs == NULL) {
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		nc_reply_free(jobs[i].reply);
+	}
+	free(jobs);
+}
+
 API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc, ncds_id* ids[])
 {
 	struct ncds_ds_list* ds, *ds_rollback;
@@ -6313,6 +7071,9 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 	NC_RPC_TYPE req_type;
 	struct nc_err *e = NULL;
 	struct nc_filter *shared_filter = NULL;
+	xmlNodePtr config = NULL;
+	struct rpc_job *jobs = NULL;
+	int job_i = 0, job_count = 0;
 
 	if (rpc == NULL || session == NULL) {
 		ERROR("%s: invalid parameter %s", __func__, (rpc==NULL)?"rpc":"session");
@@ -6330,7 +7091,6 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 		return (nc_reply_error(nc_err_new (NC_ERR_OP_NOT_SUPPORTED)));
 	}
 	free(op_namespace);
-	free(op_name);
 
 	if (ids != NULL) {
 		*ids = ncds.datastores_ids;
@@ -6342,13 +7102,16 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 	switch (op) {
 	case NC_OP_EDITCONFIG:
 		erropt = nc_rpc_get_erropt(rpc);
+		/* fall through */
+	case NC_OP_COPYCONFIG:
+		config = rpc_config_roots(rpc, op);
 		break;
 	case NC_OP_GET:
 		data = serialize_cpblts(session->capabilities);
                 //pthread_spin_lock(&server_cpblt_lock);
 		server_capabilities = data;
                 //pthread_spin_unlock(&server_cpblt_lock);
-		/* no break */
+		/* fall through */
 	case NC_OP_GETCONFIG:
 		shared_filter = nc_rpc_get_filter(rpc);
 		break;
@@ -6357,14 +7120,22 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 		break;
 	}
 
+	/* read requests may be applied on the datastores concurrently by the worker threads */
+	jobs = rpc_jobs_new(session, rpc, op, shared_filter, op_name, &job_count);
+
 	for (ds = ncds.datastores; ds != NULL; ds = ds->next) {
-		/* skip internal datastores */
-		if (ds->datastore->id > 0 && ds->datastore->id < internal_ds_count) {
+		if (rpc_skips_ds(ds->datastore, op, config, op_name)) {
 			continue;
 		}
 
 		/* apply RPC on a single datastore */
-		reply = ncds_apply_rpc(ds->datastore->id, session, rpc, shared_filter);
+		if (jobs != NULL) {
+			/* already applied, take the reply in the order of the datastores */
+			reply = jobs[job_i].reply;
+			jobs[job_i++].reply = NULL;
+		} else {
+			reply = ncds_apply_rpc(ds->datastore->id, session, rpc, shared_filter);
+		}
 		if (ids != NULL && reply != NCDS_RPC_NOT_APPLICABLE) {
 			ncds.datastores_ids[id_i] = ds->datastore->id;
 			id_i++;
@@ -6376,8 +7147,10 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 			old_reply = reply;
 		} else if (old_reply != NCDS_RPC_NOT_APPLICABLE || reply != NCDS_RPC_NOT_APPLICABLE) {
 			if ((new_reply = nc_reply_merge(2, old_reply, reply)) == NULL) {
+				rpc_jobs_free(jobs, job_count);
 				nc_filter_free(shared_filter);
 				shared_filter = NULL;
+				free(op_name);
                                 //pthread_spin_lock(&server_cpblt_lock);
 				free(server_capabilities);
 				server_capabilities = NULL;
@@ -6413,19 +7186,16 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 
 						if (transapi) {
 							/* remeber data for transAPI diff */
-							data = ds_rollback->datastore->func.getconfig(ds_rollback->datastore, session, NC_DATASTORE_RUNNING, &e);
+							old = ncds_getconfig_doc(ds_rollback->datastore, session, NC_DATASTORE_RUNNING, &e);
 							nc_err_free(e);
 							e = NULL;
-
-							old = read_datastore_data(ds_rollback->datastore->id, data);
-							free(data);
 						}
 
 						ds_rollback->datastore->func.rollback(ds_rollback->datastore);
 
 						/* transAPI rollback */
 						if (transapi) {
-							reply = ncds_apply_transapi(ds_rollback->datastore, session, old, erropt, reply);
+							reply = ncds_apply_transapi(ds_rollback->datastore, session, old, NULL, erropt, reply);
 							xmlFreeDoc(old);
 						}
 
@@ -6440,6 +7210,12 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 		}
 	}
 
+	if (reply == NULL) {
+		/* no datastore was affected */
+		reply = NCDS_RPC_NOT_APPLICABLE;
+		goto cleanup;
+	}
+
 #ifndef DISABLE_NOTIFICATIONS
 	if (op == NC_OP_EDITCONFIG || op == NC_OP_COPYCONFIG || op == NC_OP_DELETECONFIG || op == NC_OP_COMMIT) {
 		/* log the event */
@@ -6452,8 +7228,10 @@ API nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc,
 
 cleanup:
 	/* clean up the common data for calling nc_apply_rpc() */
+	rpc_jobs_free(jobs, job_count);
 	nc_filter_free(shared_filter);
 	shared_filter = NULL;
+	free(op_name);
 
         //pthread_spin_lock(&server_cpblt_lock);
 	free(server_capabilities);
@@ -6589,6 +7367,10 @@ const struct data_model* ncds_get_model_data(const char* namespace)
 		return (NULL);
 	}
 
+	if (models_ns != NULL) {
+		return (xmlHashLookup(models_ns, BAD_CAST namespace));
+	}
+
 	for (listitem = models_list; listitem != NULL; listitem = listitem->next) {
 		if (listitem->model->ns != NULL && strcmp(listitem->model->ns, namespace) == 0) {
 			/* namespace matches */
@@ -6615,6 +7397,10 @@ const struct data_model* ncds_get_model_operation(const char* operation, const c
 		return (NULL);
 	}
 
+	if (models_ops != NULL) {
+		return (xmlHashLookup2(models_ops, BAD_CAST operation, BAD_CAST namespace));
+	}
+
 	model = ncds_get_model_data(namespace);
 	if (model != NULL && model->rpcs != NULL ) {
 		for (i = 0; model->rpcs[i] != NULL ; i++) {
@@ -470,6 +470,23 @@ void ncds_free2(ncds_id datastore_id);
  */
 nc_reply* ncds_apply_rpc2all(struct nc_session* session, const nc_rpc* rpc, ncds_id* ids[]);
 
+/**
+ * @ingroup store
+ * @brief Set the number of worker threads used by ncds_apply_rpc2all() to
+ * apply \<get\> and \<get-config\> requests on the datastores concurrently.
+ *
+ * The replies of the single datastores are still merged in the order of the
+ * datastores, so the result is the same as in the sequential processing. The
+ * get_state() callbacks of the datastores can be called from the worker
+ * threads, so they must be thread-safe when this mode is enabled. The
+ * function must not be called while any ncds_apply_rpc2all() is in progress.
+ *
+ * @param[in] count Number of the worker threads, 0 (default) switches back to
+ * the sequential processing.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_set_rpc2all_threads(unsigned int count);
+
 /**
  * @ingroup store
  * @brief Undo the last change performed on the specified datastore.
@@ -603,6 +620,21 @@ int ncds_feature_isenabled(const char* module, const char* feature);
  */
 int ncds_consolidate(void);
 
+/**
+ * @ingroup store
+ * @brief Get the subtree filter of the \<get\> request being processed.
+ *
+ * The function is supposed to be called from the get_state callback functions
+ * (including the transAPI ones). The state data not selected by the filter are
+ * removed from the reply anyway, so the callback can use the filter to skip
+ * generating them.
+ *
+ * @return Serialized \<filter\> element of the request, NULL if the request
+ * has no subtree filter and all the state data are requested. The caller is
+ * supposed to free the returned string.
+ */
+char* ncds_get_state_filter(void);
+
 #ifdef __cplusplus
 }
 #endif
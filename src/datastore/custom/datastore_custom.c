@@ -95,6 +95,16 @@ API void ncds_custom_set_data(struct ncds_ds* ds, void *custom_data, const struc
 	c_ds->callbacks = callbacks;
 }
 
+API void ncds_custom_set_xml_funcs(struct ncds_ds* ds, const struct ncds_custom_xml_funcs *callbacks) {
+	struct ncds_ds_custom *c_ds = (struct ncds_ds_custom *) ds;
+
+	c_ds->xml_callbacks = callbacks;
+
+	/* use the XML variants of the functions only if the plugin provides them */
+	ds->func.getconfig_xml = (callbacks != NULL && callbacks->getconfig_xml != NULL) ? ncds_custom_getconfig_xml : NULL;
+	ds->func.editconfig_xml = (callbacks != NULL && callbacks->editconfig_xml != NULL) ? ncds_custom_editconfig_xml : NULL;
+}
+
 int ncds_custom_was_changed(struct ncds_ds* ds) {
 	struct ncds_ds_custom *c_ds = (struct ncds_ds_custom *) ds;
 
@@ -369,6 +379,12 @@ char* ncds_custom_getconfig(struct ncds_ds* ds, const struct nc_session* UNUSED(
 	return c_ds->callbacks->getconfig(c_ds->data, source, error);
 }
 
+xmlDocPtr ncds_custom_getconfig_xml(struct ncds_ds* ds, const struct nc_session* UNUSED(session), NC_DATASTORE source, struct nc_err** error) {
+	struct ncds_ds_custom *c_ds = (struct ncds_ds_custom *) ds;
+
+	return c_ds->xml_callbacks->getconfig_xml(c_ds->data, source, error);
+}
+
 int ncds_custom_copyconfig(struct ncds_ds *ds, const struct nc_session* UNUSED(session), const nc_rpc* UNUSED(rpc), NC_DATASTORE target, NC_DATASTORE source, char * config, struct nc_err **error) {
 	struct ncds_ds_custom *c_ds = (struct ncds_ds_custom *) ds;
 
@@ -392,3 +408,9 @@ int ncds_custom_editconfig(struct ncds_ds *ds, const struct nc_session* UNUSED(s
 
 	return c_ds->callbacks->editconfig(c_ds->data, rpc, target, config, defop, errop, error);
 }
+
+int ncds_custom_editconfig_xml(struct ncds_ds *ds, const struct nc_session* UNUSED(session), const nc_rpc* rpc, NC_DATASTORE target, xmlDocPtr config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error) {
+	struct ncds_ds_custom *c_ds = (struct ncds_ds_custom *) ds;
+
+	return c_ds->xml_callbacks->editconfig_xml(c_ds->data, rpc, target, config, defop, errop, error);
+}
@@ -39,6 +39,8 @@
 #ifndef NC_DATASTORE_CUSTOM_H
 #define NC_DATASTORE_CUSTOM_H
 
+#include <libxml/tree.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -203,6 +205,61 @@ struct ncds_custom_funcs {
  */
 void ncds_custom_set_data(struct ncds_ds* datastore, void *custom_data, const struct ncds_custom_funcs *callbacks);
 
+/**
+ * \brief Optional callbacks working with the configuration data as XML documents.
+ *
+ * They are kept apart from the struct ncds_custom_funcs to keep the plugins
+ * built against its previous definition working. Provide them by the
+ * ncds_custom_set_xml_funcs() function.
+ */
+struct ncds_custom_xml_funcs {
+	/**
+	 * @brief Get content of the config as an XML document.
+	 *
+	 * Optional, set to NULL if not implemented - getconfig() is used then.
+	 * Implementing this function avoids serializing the configuration
+	 * data and parsing them again by libnetconf.
+	 *
+	 * The ownership of the returned document is passed onto the caller.
+	 *
+	 * \param[in] data The user data.
+	 * \param[in] target Where to read data from.
+	 * \param[out] error Set this in case of error, to indicate what went wrong.
+	 * \return Document with the configuration data as its (possibly multiple)
+	 * top level elements, NULL on error
+	 */
+	xmlDocPtr (*getconfig_xml)(void *data, NC_DATASTORE target, struct nc_err **error);
+	/**
+	 * \brief Perform the editconfig operation with the edit data as an XML document.
+	 *
+	 * Optional, set to NULL if not implemented - editconfig() is used then.
+	 *
+	 * \param[in] data The user data.
+	 * \param[in] rpc RPC message with the request. RPC message is used only
+	 * for access control. If rpc is NULL access control is skipped.
+	 * \param[in] target What datastore part is going to be modified.
+	 * \param[in] config Edit configuration data with the (possibly multiple)
+	 * top level elements. The document is freed by the caller.
+	 * \param[in] defop Default edit operation.
+	 * \param[in] errop Error-option.
+	 * \param[out] error Set this in case of EXIT_FAILURE, to indicate what went wrong.
+	 * \return EXIT_SUCCESS or EXIT_FAILURE.
+	 */
+	int (*editconfig_xml)(void *data, const nc_rpc* rpc, NC_DATASTORE target, xmlDocPtr config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error);
+};
+
+/**
+ * \brief Set the callbacks working with the configuration data as XML documents.
+ *
+ * Optional, call after ncds_custom_set_data(), but before initializing the
+ * datastore. The callbacks set to NULL are replaced by the serialized
+ * variants from the struct ncds_custom_funcs.
+ * \param datastore Custom datastore to set the callbacks for.
+ * \param callbacks Definition of the XML variants of the callbacks, NULL to
+ * use only the serialized variants.
+ */
+void ncds_custom_set_xml_funcs(struct ncds_ds* datastore, const struct ncds_custom_xml_funcs *callbacks);
+
 /** @}*/
 
 #ifdef __cplusplus
@@ -52,6 +52,7 @@ struct ncds_ds_custom {
 	 */
 	void *data;
 	const struct ncds_custom_funcs *callbacks;
+	const struct ncds_custom_xml_funcs *xml_callbacks;
 };
 
 /**
@@ -91,6 +92,18 @@ int ncds_custom_rollback(struct ncds_ds* ds);
  */
 char* ncds_custom_getconfig(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, struct nc_err** error);
 
+/**
+ * @brief Perform get-config on the specified repository, get the data as XML document.
+ *
+ * @param[in] ds Custom datastore structure (struct ncds_ds_custom) from which
+ * the data will be obtained.
+ * @param[in] session Session originating the request.
+ * @param[in] source Datastore (running, startup, candidate) to get the data from.
+ * @param[out] error NETCONF error structure describing the experienced error.
+ * @return NULL on error, resulting data on success.
+ */
+xmlDocPtr ncds_custom_getconfig_xml(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, struct nc_err** error);
+
 /**
  * @brief Get lock information about the specified NETCONF datastore
  * @param[in] ds Custom datastore structure that will be checked.
@@ -170,4 +183,19 @@ int ncds_custom_deleteconfig(struct ncds_ds *ds, const struct nc_session *sessio
  */
 int ncds_custom_editconfig(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, const char *config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error);
 
+/**
+ * @brief Perform the edit-config operation with the edit data as XML document
+ *
+ * @param[in] ds Custom datastore to edit
+ * @param[in] session Session sending the edit request
+ * @param[in] rpc RPC message with the request. RPC message is used only for access control. If rpc is NULL access control is skipped.
+ * @param[in] target Datastore type
+ * @param[in] config Edit configuration document.
+ * @param[in] defop Default edit operation.
+ * @param[in] errop Error-option.
+ * @param[out] error NETCONF error structure describing the experienced error.
+ * @return 0 on success, non-zero on error and error structure is filled.
+ */
+int ncds_custom_editconfig_xml(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, xmlDocPtr config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error);
+
 #endif /* NC_DATASTORE_CUSTOM_PRIVATE_H */
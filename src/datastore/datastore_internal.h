@@ -167,6 +167,41 @@ struct ncds_funcs {
 	 * @return EXIT_SUCCESS or EXIT_FAILURE
 	 */
 	int (*editconfig)(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, const char * config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error);
+	/**
+	 * @brief Get configuration data stored in target datastore as an XML document
+	 *
+	 * Optional variant of getconfig() avoiding serialization of the data
+	 * and their subsequent parsing by the caller. If NULL, getconfig() is
+	 * used instead.
+	 *
+	 * @param[in] ds Datastore structure from which the data will be obtained.
+	 * @param[in] session Session originating the request.
+	 * @param[in] source Datastore (runnign, startup, candidate) to get the data from.
+	 * @param[out] error NETCONF error structure describing the experienced error.
+	 * @return NULL on error, otherwise XML document with the configuration
+	 * data as its (possibly multiple) top level elements. Caller is supposed
+	 * to free the document.
+	 */
+	xmlDocPtr (*getconfig_xml)(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, struct nc_err** error);
+	/**
+	 * @brief Edit configuration in datastore with the edit data in the form of an XML document
+	 *
+	 * Optional variant of editconfig(). If NULL, editconfig() is used instead.
+	 *
+	 * @param ds Datastore to edit
+	 * @param session Session sending the edit request
+	 * @param rpc RPC message with the request. RPC message is used only for access control. If rpc is NULL access control is skipped.
+	 * @param target Datastore type
+	 * @param config Edit configuration as XML document with the (possibly
+	 * multiple) top level elements. The document can be modified by the function,
+	 * but it is still freed by the caller.
+	 * @param defop Default edit operation.
+	 * @param errop Edit-config's error-option
+	 * @param error Netconf error structure
+	 *
+	 * @return EXIT_SUCCESS or EXIT_FAILURE
+	 */
+	int (*editconfig_xml)(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, xmlDocPtr config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error);
 };
 
 struct model_feature {
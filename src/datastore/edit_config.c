@@ -45,6 +45,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include <libxml/tree.h>
 #include <libxml/xpath.h>
@@ -161,104 +162,335 @@ static NC_EDIT_OP_TYPE get_operation(xmlNodePtr node, NC_EDIT_DEFOP_TYPE defop,
 	return op;
 }
 
-/**
- * \brief Get all the key elements from the configuration data model
- *
- * \param model         XML form (YIN) of the configuration data model.
- *
- * \return              keyList with references to all the keys in the data model.
+/* lock for the reference counters of the model indexes */
+static pthread_mutex_t model_index_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static xmlNodePtr is_partof_choice(xmlNodePtr node);
+static int is_user_ordered_list(xmlNodePtr node);
+
+static void model_node_free(struct model_node* mnode)
+{
+	int i;
+
+	xmlHashFree(mnode->children, NULL);
+	for (i = 0; mnode->keys != NULL && mnode->keys[i] != NULL; i++) {
+		free(mnode->keys[i]);
+	}
+	free(mnode->keys);
+	xmlFree(mnode->dflt);
+	free(mnode);
+}
+
+static void model_index_free(struct model_index* index)
+{
+	struct model_node* mnode;
+
+	while ((mnode = index->nodes) != NULL) {
+		index->nodes = mnode->next;
+		model_node_free(mnode);
+	}
+	xmlHashFree(index->top, NULL);
+	xmlFree(index->ns);
+	free(index->defaults);
+	free(index);
+}
+
+/* get NULL terminated list of the key names from the list definition */
+static char** model_node_keys(xmlNodePtr list)
+{
+	xmlNodePtr aux;
+	xmlChar* str;
+	char **keys, *s, *token;
+	int i, c;
+
+	for (aux = list->children; aux != NULL; aux = aux->next) {
+		if (aux->type == XML_ELEMENT_NODE && xmlStrcmp(aux->name, BAD_CAST "key") == 0) {
+			break;
+		}
+	}
+	if (aux == NULL || (str = xmlGetProp(aux, BAD_CAST "value")) == NULL) {
+		return (NULL);
+	}
+
+	/* attribute have the form of space-separated list of key nodes */
+	for (i = 0, c = 1; str[i] != '\0'; i++) {
+		if (str[i] == ' ') {
+			c++;
+		}
+	}
+	if ((keys = calloc(c + 1, sizeof(char*))) == NULL) {
+		xmlFree(str);
+		return (NULL);
+	}
+	for (i = 0, s = (char*)str; (token = strtok(s, " ")) != NULL; s = NULL) {
+		keys[i++] = strdup(token);
+	}
+	xmlFree(str);
+
+	return (keys);
+}
+
+/*
+ * add children of the model's element into the index, choice, case and augment
+ * statements are transparent, the first definition of a name is used
  */
-keyList get_keynode_list(xmlDocPtr model)
+static int model_index_add(struct model_index* index, struct model_node* parent, xmlHashTablePtr* table, xmlNodePtr mparent, int attach)
 {
+	xmlNodePtr aux, dflt;
+	xmlChar* name;
+	struct model_node* mnode;
+
+	for (aux = mparent->children; aux != NULL; aux = aux->next) {
+		if (aux->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		if (xmlStrcmp(aux->name, BAD_CAST "choice") == 0 ||
+		    xmlStrcmp(aux->name, BAD_CAST "case") == 0 ||
+		    xmlStrcmp(aux->name, BAD_CAST "augment") == 0) {
+			if (model_index_add(index, parent, table, aux, attach) != EXIT_SUCCESS) {
+				return (EXIT_FAILURE);
+			}
+			continue;
+		}
+
+		if ((name = xmlGetProp(aux, BAD_CAST "name")) == NULL) {
+			continue;
+		}
+		if (*table == NULL && (*table = xmlHashCreate(8)) == NULL) {
+			xmlFree(name);
+			return (EXIT_FAILURE);
+		}
+		if (xmlHashLookup(*table, name) != NULL) {
+			/* already defined */
+			xmlFree(name);
+			continue;
+		}
+
+		if ((mnode = calloc(1, sizeof(struct model_node))) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			xmlFree(name);
+			return (EXIT_FAILURE);
+		}
+		mnode->next = index->nodes;
+		index->nodes = mnode;
+		mnode->model = aux;
+		mnode->parent = parent;
+		mnode->choice = is_partof_choice(aux);
+		if (xmlStrcmp(aux->name, BAD_CAST "list") == 0) {
+			mnode->flags |= MODEL_NODE_LIST;
+			mnode->keys = model_node_keys(aux);
+		} else if (xmlStrcmp(aux->name, BAD_CAST "leaf-list") == 0) {
+			mnode->flags |= MODEL_NODE_LEAFLIST;
+		}
+		if (is_user_ordered_list(aux)) {
+			mnode->flags |= MODEL_NODE_USERORDERED;
+		}
+		for (dflt = aux->children; dflt != NULL; dflt = dflt->next) {
+			if (dflt->type == XML_ELEMENT_NODE && xmlStrcmp(dflt->name, BAD_CAST "default") == 0) {
+				mnode->dflt = xmlGetProp(dflt, BAD_CAST "value");
+				break;
+			}
+		}
+
+		if (xmlHashAddEntry(*table, name, mnode) != 0) {
+			xmlFree(name);
+			return (EXIT_FAILURE);
+		}
+		xmlFree(name);
+
+		if (model_index_add(index, mnode, &(mnode->children), aux, attach) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
+		}
+		if (attach) {
+			aux->_private = mnode;
+		}
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+static struct model_index* model_index_new(xmlDocPtr model, int attach)
+{
+	struct model_index* index;
+	struct model_node* mnode;
 	xmlXPathContextPtr model_ctxt = NULL;
 	xmlXPathObjectPtr result = NULL;
+	xmlNodePtr root;
+	int i;
 
-	if (model == NULL) {
+	if ((root = xmlDocGetRootElement(model)) == NULL) {
 		return (NULL);
 	}
 
-	/* create xpath evaluation context */
-	model_ctxt = xmlXPathNewContext(model);
-	if (model_ctxt == NULL) {
+	if ((index = calloc(1, sizeof(struct model_index))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
 		return (NULL);
 	}
+	index->refs = 1;
 
-	if (xmlXPathRegisterNs(model_ctxt, BAD_CAST NC_NS_YIN_ID, BAD_CAST NC_NS_YIN) != 0) {
-		xmlXPathFreeContext(model_ctxt);
-		return (NULL);
+	if (model_index_add(index, NULL, &(index->top), root, attach) != EXIT_SUCCESS) {
+		goto error;
 	}
 
-	result = xmlXPathEvalExpression(BAD_CAST "//" NC_NS_YIN_ID ":key", model_ctxt);
-	if (result != NULL) {
-		if (xmlXPathNodeSetIsEmpty(result->nodesetval)) {
-			xmlXPathFreeObject(result);
-			result = (NULL);
+	/* remember information for the with-defaults processing */
+	if ((model_ctxt = xmlXPathNewContext(model)) == NULL ||
+	    xmlXPathRegisterNs(model_ctxt, BAD_CAST NC_NS_YIN_ID, BAD_CAST NC_NS_YIN) != 0) {
+		goto error;
+	}
+	if ((result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_YIN_ID":module/"NC_NS_YIN_ID":namespace", model_ctxt)) != NULL) {
+		if (!xmlXPathNodeSetIsEmpty(result->nodesetval)) {
+			index->ns = xmlGetProp(result->nodesetval->nodeTab[0], BAD_CAST "uri");
 		}
+		xmlXPathFreeObject(result);
+	}
+	if ((result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_YIN_ID":module/"NC_NS_YIN_ID":container//"NC_NS_YIN_ID":default", model_ctxt)) == NULL) {
+		goto error;
+	}
+	i = xmlXPathNodeSetIsEmpty(result->nodesetval) ? 0 : result->nodesetval->nodeNr;
+	if ((index->defaults = malloc((i + 1) * sizeof(xmlNodePtr))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		goto error;
+	}
+	if (i > 0) {
+		memcpy(index->defaults, result->nodesetval->nodeTab, i * sizeof(xmlNodePtr));
 	}
+	index->defaults[i] = NULL;
+	xmlXPathFreeObject(result);
 	xmlXPathFreeContext(model_ctxt);
 
-	return ((keyList)result);
+	return (index);
+
+error:
+	xmlXPathFreeObject(result);
+	xmlXPathFreeContext(model_ctxt);
+	if (attach) {
+		/* keep the model clean */
+		for (mnode = index->nodes; mnode != NULL; mnode = mnode->next) {
+			mnode->model->_private = NULL;
+		}
+	}
+	model_index_free(index);
+	return (NULL);
 }
 
-/* get the key nodes from the xml document */
-static int find_key_elems(xmlNodePtr modelnode, xmlNodePtr node, int all, xmlNodePtr **result)
+int model_index_set(xmlDocPtr model)
 {
-	xmlChar *str = NULL;
-	char* s, *token;
-	unsigned int i, c;
+	if (model == NULL) {
+		return (EXIT_FAILURE);
+	}
 
-	/* get the name of the key node(s) from the 'value' attribute in key element in data model */
-	if ((str = xmlGetProp(modelnode, BAD_CAST "value")) == NULL) {
-		return EXIT_FAILURE;
+	model_index_unset(model);
+	if ((model->_private = model_index_new(model, 1)) == NULL) {
+		return (EXIT_FAILURE);
 	}
 
-	/* attribute have the form of space-separated list of key nodes */
-	/* get the number of keys */
-	for (i = 0, c = 1; i < strlen((char*)str); i++) {
-		if (str[i] == ' ') {
-			c++;
+	return (EXIT_SUCCESS);
+}
+
+void model_index_unset(xmlDocPtr model)
+{
+	struct model_index* index;
+	struct model_node* mnode;
+
+	if (model == NULL || (index = model->_private) == NULL) {
+		return;
+	}
+
+	for (mnode = index->nodes; mnode != NULL; mnode = mnode->next) {
+		mnode->model->_private = NULL;
+	}
+	model->_private = NULL;
+	keyListFree(index);
+}
+
+keyList get_keynode_list(xmlDocPtr model)
+{
+	struct model_index* index;
+
+	if (model == NULL) {
+		return (NULL);
+	}
+
+	if ((index = model->_private) != NULL) {
+		pthread_mutex_lock(&model_index_lock);
+		index->refs++;
+		pthread_mutex_unlock(&model_index_lock);
+		return (index);
+	}
+
+	/* the model was not consolidated, build a temporary index */
+	return (model_index_new(model, 0));
+}
+
+void keyListFree(keyList keys)
+{
+	unsigned int refs;
+
+	if (keys == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&model_index_lock);
+	refs = --keys->refs;
+	pthread_mutex_unlock(&model_index_lock);
+	if (refs == 0) {
+		model_index_free(keys);
+	}
+}
+
+struct model_node* model_index_find(keyList keys, xmlNodePtr node)
+{
+	struct model_node* parent;
+
+	if (keys == NULL || node == NULL || node->parent == NULL || node->name == NULL) {
+		return (NULL);
+	}
+
+	if (node->parent->type != XML_DOCUMENT_NODE) {
+		if ((parent = model_index_find(keys, node->parent)) == NULL || parent->children == NULL) {
+			return (NULL);
 		}
+		return (xmlHashLookup(parent->children, node->name));
+	} else if (keys->top != NULL) {
+		return (xmlHashLookup(keys->top, node->name));
 	}
+
+	return (NULL);
+}
+
+/* get the key nodes from the xml document */
+static int find_key_elems(char** keys, xmlNodePtr node, int all, xmlNodePtr **result)
+{
+	xmlNodePtr key;
+	int i, c;
+
 	/* allocate sufficient array of pointers to key nodes */
+	for (c = 0; keys[c] != NULL; c++);
 	*result = (xmlNodePtr*)calloc(c + 1, sizeof(xmlNodePtr));
 	if (*result == NULL) {
-		xmlFree(str);
 		return (EXIT_FAILURE);
 	}
 
-	/* and now process all key nodes defined in attribute value list */
-	for (i = 0, s = (char*)str; i < c; i++, s = NULL) {
-		token = strtok(s, " ");
-		if (token == NULL) {
-			break;
-		}
-
+	/* and now process all key nodes defined in the model */
+	for (i = c = 0; keys[i] != NULL; i++) {
 		/* get key nodes in original xml tree - all keys are needed */
-		(*result)[i] = node->children;
-		while (((*result)[i] != NULL) && strcmp(token, (char*) ((*result)[i])->name)) {
-			(*result)[i] = ((*result)[i])->next;
-		}
-		if ((*result)[i] == NULL) {
-			if (all) {
-				xmlFree(str);
-				free(*result);
-				*result = NULL;
-				return (EXIT_FAILURE);
-			} else {
-				i--;
-			}
+		for (key = node->children; key != NULL && strcmp(keys[i], (char*)(key->name)); key = key->next);
+		if (key != NULL) {
+			(*result)[c++] = key;
+		} else if (all) {
+			free(*result);
+			*result = NULL;
+			return (EXIT_FAILURE);
 		}
 	}
 
-	xmlFree(str);
-
 	return EXIT_SUCCESS;
 }
 
 /**
  * \brief Get all the key nodes for the specific element.
  *
- * \param[in] keys List of key elements from the configuration data model.
+ * \param[in] keys Index of the configuration data model.
  * \param[in] node Node for which the key elements are needed.
  * \param[in] all If set to 1, all the keys must be found in the node, non-zero is
  * returned otherwise.
@@ -267,9 +499,7 @@ static int find_key_elems(xmlNodePtr modelnode, xmlNodePtr node, int all, xmlNod
  */
 static int get_keys(keyList keys, xmlNodePtr node, int all, xmlNodePtr **result)
 {
-	xmlChar *str = NULL;
-	int j, match;
-	xmlNodePtr key_parent, node_parent;
+	struct model_node* mnode;
 
 	assert(keys != NULL);
 	assert(node != NULL);
@@ -277,59 +507,14 @@ static int get_keys(keyList keys, xmlNodePtr node, int all, xmlNodePtr **result)
 
 	*result = NULL;
 
-	for (j = 0; j < keys->nodesetval->nodeNr; j++) {
-		/* get corresponding key definition from the data model */
-		// name = xmlGetNsProp (keys->nodesetval->nodeTab[i]->parent, BAD_CAST "name", BAD_CAST NC_NS_YIN);
-		match = 1;
-		key_parent = keys->nodesetval->nodeTab[j]->parent;
-		node_parent = node;
-
-		while (1) {
-			if ((str = xmlGetProp(key_parent, BAD_CAST "name")) == NULL) {
-				match = 0;
-				break;
-			}
-			if (xmlStrcmp(str, node_parent->name)) {
-				xmlFree(str);
-				match = 0;
-				break;
-			}
-			xmlFree(str);
-
-			do {
-				key_parent = key_parent->parent;
-			} while (key_parent && ((xmlStrcmp(key_parent->name, BAD_CAST "augment") == 0)
-                    || (xmlStrcmp(key_parent->name, BAD_CAST "choice") == 0)
-                    || (xmlStrcmp(key_parent->name, BAD_CAST "case") == 0)));
-			node_parent = node_parent->parent;
-
-			if ((!key_parent && node_parent) || (key_parent && !node_parent)) {
-				match = 0;
-				break;
-			}
-
-			if (!xmlStrcmp(key_parent->name, BAD_CAST "module") && (node_parent->type == XML_DOCUMENT_NODE)) {
-				break;
-			}
-		}
-
-		if (!match) {
-			continue;
-		}
-
-		/*
-		 * now we have key values for the appropriate node which was
-		 * specified as function parameter, so there will be no other
-		 * run in this for loop - no continue command is allowed from
-		 * now to the end of the loop
-		 */
-		return find_key_elems(keys->nodesetval->nodeTab[j], node, all, result);
+	if ((mnode = model_index_find(keys, node)) == NULL || mnode->keys == NULL) {
+		/* not a list or a list without keys */
+		return (EXIT_SUCCESS);
 	}
 
-	return (EXIT_SUCCESS);
+	return find_key_elems(mnode->keys, node, all, result);
 }
 
-
 /**
  * @return NULL if the node is not a part of the choice statement,
  * the branch node where the given node belongs to
@@ -340,6 +525,9 @@ static xmlNodePtr is_partof_choice(xmlNodePtr node)
 
 	if (node == NULL) {
 		return (NULL);
+	} else if (node->_private != NULL) {
+		/* indexed model */
+		return (((struct model_node*)(node->_private))->choice);
 	}
 
 	for (aux = node; aux->parent != NULL && aux->parent->type == XML_ELEMENT_NODE; aux = aux->parent) {
@@ -364,10 +552,17 @@ static int is_user_ordered_list(xmlNodePtr node)
 {
 	xmlNodePtr child;
 	xmlChar *prop;
+	struct model_node* mnode;
 	int ret = 0;
 
 	if (node == NULL) {
 		return (0);
+	} else if ((mnode = node->_private) != NULL) {
+		/* indexed model */
+		if ((mnode->flags & MODEL_NODE_USERORDERED) == 0) {
+			return (0);
+		}
+		return ((mnode->flags & MODEL_NODE_LIST) ? 1 : 2);
 	}
 
 	if (xmlStrcmp(node->name, BAD_CAST "list") == 0) {
@@ -413,7 +608,7 @@ static int is_user_ordered_list(xmlNodePtr node)
  *
  * \param[in] node1 First node to compare.
  * \param[in] node2 Second node to compare.
- * \param[in] keys List of key elements from configuration data model.
+ * \param[in] keys Index of the configuration data model.
  *
  * \return 0 - false, 1 - true (matching elements), -1 - error.
  */
@@ -567,11 +762,18 @@ static xmlNodePtr find_element_model_compare(xmlNodePtr node, xmlNodePtr model_n
 xmlNodePtr find_element_model(xmlNodePtr node, xmlDocPtr model)
 {
 	xmlNodePtr mparent, aux, retval;
+	struct model_node* mnode;
 
 	if (node == NULL || node->parent == NULL) {
 		return (NULL);
 	}
 
+	if (model != NULL && model->_private != NULL) {
+		/* indexed model */
+		mnode = model_index_find(model->_private, node);
+		return ((mnode != NULL) ? mnode->model : NULL);
+	}
+
 	if (node->parent->type != XML_DOCUMENT_NODE) {
 		mparent = find_element_model(node->parent, model);
 	} else {
@@ -605,11 +807,14 @@ static xmlChar* get_default_value(xmlNodePtr node, xmlDocPtr model)
 	mnode = find_element_model(node, model);
 	if (mnode == NULL) {
 		return (NULL);
+	} else if (mnode->_private != NULL) {
+		/* indexed model */
+		return (xmlStrdup(((struct model_node*)(mnode->_private))->dflt));
 	}
 
 	for (aux = mnode->children; aux != NULL; aux = aux->next) {
 		if (xmlStrcmp(aux->name, BAD_CAST "default") == 0) {
-			value = xmlGetNsProp(aux, BAD_CAST "value", BAD_CAST NC_NS_YIN);
+			value = xmlGetProp(aux, BAD_CAST "value");
 			break;
 		}
 	}
@@ -623,7 +828,7 @@ static xmlChar* get_default_value(xmlNodePtr node, xmlDocPtr model)
  * \param[in] orig_doc Original configuration document to edit.
  * \param[in] edit Element from the edit-config's \<config\>. Its equivalent in
  *                 orig_doc should be found.
- * \param[in] keys List of the key elements from the configuration data model.
+ * \param[in] keys Index of the configuration data model.
  * \return Found equivalent element, NULL if no such element exists.
  */
 xmlNodePtr find_element_equiv(xmlDocPtr orig_doc, xmlNodePtr edit, xmlDocPtr model, keyList keys)
@@ -1020,7 +1225,7 @@ static int edit_delete(xmlNodePtr node)
  * \param[in] orig_doc Original configuration document to edit.
  * \param[in] edit_node Node from the edit-config's \<config\> element with
  * the specified "remove" operation.
- * \param[in] keys  List of the key elements from the configuration data model.
+ * \param[in] keys  Index of the configuration data model.
  *
  * \return Zero on success, non-zero otherwise.
  */
@@ -1717,7 +1922,7 @@ static int edit_create_choice(xmlNodePtr parent, xmlNodePtr edit_node, xmlDocPtr
  * \param[in] edit_node Node from the missing parent chain of the element to
  *                      create. If there is no equivalent node in the original
  *                      document, it is created.
- * \param[in] keys  List of key elements from configuration data model.
+ * \param[in] keys  Index of the configuration data model.
  *
  * \return Zero on success, non-zero otherwise.
  */
@@ -1801,7 +2006,7 @@ static xmlNodePtr edit_create_recursively(xmlDocPtr orig_doc, xmlNodePtr edit_no
  * \param[in] orig_doc Original configuration document to edit.
  * \param[in] edit_node Node from the edit-config's \<config\> element with
  * specified "create" operation.
- * \param[in] keys  List of key elements from configuration data model.
+ * \param[in] keys  Index of the configuration data model.
  *
  * \return Zero on success, non-zero otherwise.
  */
@@ -1917,7 +2122,7 @@ int edit_replace_nacmcheck(xmlNodePtr orig_node, xmlDocPtr edit_doc, xmlDocPtr m
  * \param[in] orig_doc Original configuration document to edit.
  * \param[in] edit_node Node from the edit-config's \<config\> element with
  * the specified "replace" operation.
- * \param[in] keys  List of the key elements from the configuration data model.
+ * \param[in] keys  Index of the configuration data model.
  *
  * \return Zero on success, non-zero otherwise.
  */
@@ -2094,21 +2299,6 @@ static int edit_merge_lists(xmlNodePtr merged_node, xmlNodePtr edit_node, xmlDoc
 	return (0);
 }
 
-static xmlNodePtr is_list(xmlNodePtr node, xmlDocPtr model)
-{
-	xmlNodePtr model_node;
-
-	model_node = find_element_model(node, model);
-	if (model_node == NULL) {
-		WARN("unknown element %s!", (char* )(node->name));
-		return (0);
-	} else if (xmlStrcmp(model_node->name, BAD_CAST "list") == 0) {
-		return (model_node);
-	} else {
-		return (NULL);
-	}
-}
-
 static int is_leaf_list(xmlNodePtr node, xmlDocPtr model)
 {
 	xmlNodePtr model_node;
@@ -2664,12 +2854,11 @@ static int compact_edit_operations(xmlDocPtr edit_doc, NC_EDIT_DEFOP_TYPE defop)
 
 static int check_list_keys(xmlDocPtr edit, xmlDocPtr model, struct nc_err **error)
 {
-	xmlNodePtr listdef;
+	struct model_node* listdef;
 	xmlNodePtr *keys = NULL;
 	xmlNodePtr node, next;
 	keyList modelkeys;
 	int ret = EXIT_SUCCESS;
-	int i;
 
 	modelkeys = get_keynode_list(model);
 	if (!modelkeys) {
@@ -2679,24 +2868,17 @@ static int check_list_keys(xmlDocPtr edit, xmlDocPtr model, struct nc_err **erro
 
 	node = xmlDocGetRootElement(edit);
 	while (node) {
-		if ((listdef = is_list(node, model)) != NULL) {
-			for (i = 0; i < modelkeys->nodesetval->nodeNr; i++) {
-				if (modelkeys->nodesetval->nodeTab[i]->parent == listdef) {
-					break;
-				}
+		if ((listdef = model_index_find(modelkeys, node)) == NULL) {
+			WARN("unknown element %s!", (char* )(node->name));
+		} else if (listdef->keys != NULL) {
+			/* find out if all the keys are present in edit data */
+			if (find_key_elems(listdef->keys, node, 1, &keys)) {
+				ret = EXIT_FAILURE;
+				goto cleanup;
 			}
-
-			if (i < modelkeys->nodesetval->nodeNr) {
-				/* find out if all the keys are present in edit data */
-				if (find_key_elems(modelkeys->nodesetval->nodeTab[i], node, 1, &keys)) {
-					ret = EXIT_FAILURE;
-					goto cleanup;
-				}
-				free(keys);
-				keys = NULL;
-
-			} /* else list has no keys */
-		}
+			free(keys);
+			keys = NULL;
+		} /* else not a list or list has no keys */
 
 		/* go to the next element to process (depth-first processing) */
 		/* children first */
@@ -39,6 +39,7 @@
 
 #include <libxml/tree.h>
 #include <libxml/xpath.h>
+#include <libxml/hash.h>
 
 #include "datastore_internal.h"
 #include "../netconf.h"
@@ -48,11 +49,89 @@
 #ifndef NC_EDIT_CONFIG_H_
 #define NC_EDIT_CONFIG_H_
 
-typedef xmlXPathObjectPtr keyList;
-#define keyListFree(x) xmlXPathFreeObject((xmlXPathObjectPtr)x)
+/* flags of the model_node */
+#define MODEL_NODE_LIST        0x01 /* list */
+#define MODEL_NODE_LEAFLIST    0x02 /* leaf-list */
+#define MODEL_NODE_USERORDERED 0x04 /* list or leaf-list ordered by user */
 
+/**
+ * @brief Node of the configuration data model index, it describes the model's
+ * (YIN) element which a data element with the given name is an instance of.
+ */
+struct model_node {
+	xmlNodePtr model;          /* model's (YIN) element */
+	struct model_node* parent; /* NULL for the top-level elements */
+	xmlHashTablePtr children;  /* children elements hashed by their names */
+	int flags;                 /* MODEL_NODE_* flags */
+	xmlNodePtr choice;         /* branch node of the choice the element is part of */
+	char** keys;               /* NULL terminated list of the list's key names */
+	xmlChar* dflt;             /* default value */
+	struct model_node* next;   /* list of all the nodes in the index */
+};
+
+/**
+ * @brief Index of the configuration data model (YIN) to map the data elements
+ * to their definitions without searching the model.
+ *
+ * Datastore's extended model gets its index in ncds_consolidate(), the index is
+ * then connected with the model document via its _private pointer and the
+ * model_node structures via the _private pointers of the model's elements.
+ */
+struct model_index {
+	xmlHashTablePtr top;       /* top-level elements hashed by their names */
+	struct model_node* nodes;  /* list of all the nodes */
+	xmlChar* ns;               /* namespace of the model */
+	xmlNodePtr* defaults;      /* NULL terminated list of the default statements in containers */
+	unsigned int refs;         /* number of references */
+};
+
+typedef struct model_index* keyList;
+
+/**
+ * @brief Get the index of the configuration data model.
+ *
+ * The index prepared by ncds_consolidate() is returned if the model has any,
+ * a new one is built otherwise. The returned index is supposed to be released
+ * by keyListFree().
+ *
+ * @param[in] model Configuration data model (YIN format)
+ * @return Index of the model, NULL on error.
+ */
 keyList get_keynode_list(xmlDocPtr model);
 
+/**
+ * @brief Release the index of the configuration data model.
+ * @param[in] keys Index returned by get_keynode_list().
+ */
+void keyListFree(keyList keys);
+
+/**
+ * @brief Build an index of the configuration data model and connect it with
+ * the model. The previous index of the model, if any, is dropped.
+ *
+ * @param[in] model Configuration data model (YIN format)
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int model_index_set(xmlDocPtr model);
+
+/**
+ * @brief Disconnect the index from the configuration data model and release it.
+ * It must be called before the model is modified or freed.
+ *
+ * @param[in] model Configuration data model (YIN format)
+ */
+void model_index_unset(xmlDocPtr model);
+
+/**
+ * @brief Get the model's definition of the data element from the index.
+ *
+ * @param[in] keys Index of the configuration data model.
+ * @param[in] node Data element.
+ * @return Index node describing the element, NULL if the element is not defined
+ * in the model.
+ */
+struct model_node* model_index_find(keyList keys, xmlNodePtr node);
+
 /**
  * \brief Compare 2 elements and decide if they are equal for NETCONF.
  *
@@ -63,7 +142,7 @@ keyList get_keynode_list(xmlDocPtr model);
  *
  * \param[in] node1 First node to compare.
  * \param[in] node2 Second node to compare.
- * \param[in] keys List of the key elements from the configuration data model.
+ * \param[in] keys Index of the configuration data model.
  *
  * \return 0 - false, 1 - true (matching elements).
  */
@@ -75,7 +154,7 @@ int matching_elements(xmlNodePtr node1, xmlNodePtr node2, keyList keys, int leaf
  * \param[in] orig_doc Original configuration document to edit.
  * \param[in] node Element whose equivalent in orig_doc should be found.
  * \param[in] model Configuration data model.
- * \param[in] keys List of the key elements from the configuration data model.
+ * \param[in] keys Index of the configuration data model.
  * \return Found equivalent element, NULL if no such element exists.
  */
 xmlNodePtr find_element_equiv(xmlDocPtr orig_doc, xmlNodePtr edit, xmlDocPtr model, keyList keys);
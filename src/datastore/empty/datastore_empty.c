@@ -89,6 +89,11 @@ char* ncds_empty_getconfig(struct ncds_ds* UNUSED(ds), const struct nc_session*
 	return strdup ("");
 }
 
+xmlDocPtr ncds_empty_getconfig_xml(struct ncds_ds* UNUSED(ds), const struct nc_session* UNUSED(session), NC_DATASTORE UNUSED(target), struct nc_err** UNUSED(error))
+{
+	return xmlNewDoc (BAD_CAST "1.0");
+}
+
 int ncds_empty_copyconfig(struct ncds_ds* UNUSED(ds), const struct nc_session* UNUSED(session), const nc_rpc* UNUSED(rpc), NC_DATASTORE UNUSED(target), NC_DATASTORE UNUSED(source), char*  UNUSED(config), struct nc_err** UNUSED(error))
 {
 	return EXIT_SUCCESS;
@@ -103,3 +108,8 @@ int ncds_empty_editconfig(struct ncds_ds* UNUSED(ds), const struct nc_session* U
 {
 	return EXIT_SUCCESS;
 }
+
+int ncds_empty_editconfig_xml(struct ncds_ds* UNUSED(ds), const struct nc_session* UNUSED(session), const nc_rpc* UNUSED(rpc), NC_DATASTORE UNUSED(target), xmlDocPtr UNUSED(config), NC_EDIT_DEFOP_TYPE  UNUSED(defop), NC_EDIT_ERROPT_TYPE  UNUSED(errop), struct nc_err **UNUSED(error))
+{
+	return EXIT_SUCCESS;
+}
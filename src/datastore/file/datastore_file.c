@@ -44,6 +44,7 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
@@ -67,25 +68,59 @@ static const char rcsid[] __attribute__((used)) ="$Id: "__FILE__": "RCSID" $";
 
 #define FILEDSFRAME "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\
 <datastores xmlns=\"urn:cesnet:tmc:datastores:file\">\
-  <running lock=\"\"/>\
-  <startup lock=\"\"/>\
-  <candidate modified=\"false\" lock=\"\"/>\
+  <running/>\
+  <startup/>\
+  <candidate modified=\"false\"/>\
 </datastores>"
 
-static struct timespec tv_timeout;
-static sigset_t fullsigset;
-
 #define LOCK(file_ds, ret) {\
-	sigfillset(&fullsigset);\
-	sigprocmask(SIG_SETMASK, &fullsigset, &(file_ds->ds_lock.sigset));\
-	tv_timeout.tv_sec += NCDS_LOCK_TIMEOUT;\
-	ret = 0;\
-	file_ds->ds_lock.holding_lock = 1;\
+	struct timespec lock_timeout;\
+	sigset_t lock_fullset, lock_oldset;\
+	sigfillset(&lock_fullset);\
+	pthread_sigmask(SIG_SETMASK, &lock_fullset, &lock_oldset);\
+	clock_gettime(CLOCK_REALTIME, &lock_timeout);\
+	lock_timeout.tv_sec += NCDS_LOCK_TIMEOUT;\
+	ret = pthread_mutex_timedlock(&file_ds->shared->lock, &lock_timeout);\
+	if (ret == EOWNERDEAD) {\
+		/* the previous holder died, its change may be incomplete, so read\
+		 * the stored datastore content again */\
+		WARN("Recovering the lock of the datastore %s held by a dead process.", file_ds->path);\
+		pthread_mutex_consistent(&file_ds->shared->lock);\
+		file_ds->xml_valid = 0;\
+		ret = 0;\
+	}\
+	if (ret == 0) {\
+		file_ds->ds_lock.sigset = lock_oldset;\
+		file_ds->ds_lock.holding_lock = 1;\
+	} else {\
+		pthread_sigmask(SIG_SETMASK, &lock_oldset, NULL);\
+	}\
 }
 #define UNLOCK(file_ds) {\
-	sem_post(file_ds->ds_lock.lock);\
+	sigset_t lock_oldset = file_ds->ds_lock.sigset;\
 	file_ds->ds_lock.holding_lock = 0;\
-	sigprocmask(SIG_SETMASK, &(file_ds->ds_lock.sigset), NULL);\
+	pthread_mutex_unlock(&file_ds->shared->lock);\
+	pthread_sigmask(SIG_SETMASK, &lock_oldset, NULL);\
+}
+
+/**
+ * @brief Get the NETCONF lock record of the target datastore from the shared
+ * lock table.
+ *
+ * @return Lock record or NULL for invalid target.
+ */
+static struct ncds_file_lock* file_get_lock(struct ncds_ds_file* file_ds, NC_DATASTORE target)
+{
+	switch(target) {
+	case NC_DATASTORE_RUNNING:
+		return (&file_ds->shared->running);
+	case NC_DATASTORE_STARTUP:
+		return (&file_ds->shared->startup);
+	case NC_DATASTORE_CANDIDATE:
+		return (&file_ds->shared->candidate);
+	default:
+		return (NULL);
+	}
 }
 
 /**
@@ -102,42 +137,25 @@ static sigset_t fullsigset;
  */
 static int file_ds_access(struct ncds_ds_file* file_ds, NC_DATASTORE target, const struct nc_session* session)
 {
-	xmlChar * lock;
-	xmlNodePtr target_ds;
-	int retval;
+	struct ncds_file_lock* lock;
 
 	if (file_ds == NULL) {
 		ERROR("%s: invalid datastore structure.", __func__);
 		return (EXIT_FAILURE);
 	}
 
-	switch(target) {
-	case NC_DATASTORE_RUNNING:
-		target_ds = file_ds->running;
-		break;
-	case NC_DATASTORE_STARTUP:
-		target_ds = file_ds->startup;
-		break;
-	case NC_DATASTORE_CANDIDATE:
-		target_ds = file_ds->candidate;
-		break;
-	default:
+	if ((lock = file_get_lock(file_ds, target)) == NULL) {
 		ERROR("%s: invalid target.", __func__);
 		return (EXIT_FAILURE);
-		break;
 	}
 
-	lock = xmlGetProp (target_ds, BAD_CAST "lock");
-	if (xmlStrEqual (lock, BAD_CAST "")) {
-		retval = EXIT_SUCCESS;
-	} else if (session != NULL && xmlStrEqual (lock, BAD_CAST session->session_id)) {
-		retval = EXIT_SUCCESS;
+	if (lock->sid[0] == '\0') {
+		return (EXIT_SUCCESS);
+	} else if (session != NULL && strcmp(lock->sid, session->session_id) == 0) {
+		return (EXIT_SUCCESS);
 	} else {
-		retval = EXIT_FAILURE;
+		return (EXIT_FAILURE);
 	}
-
-	xmlFree (lock);
-	return retval;
 }
 
 API int ncds_file_set_path(struct ncds_ds* datastore, const char* path)
@@ -304,24 +322,20 @@ invalid_ds:
 
 int ncds_file_changed(struct ncds_ds* ds)
 {
-	time_t t;
-	struct stat statbuf;
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	int ret;
 
-	/* get current time */
-	if ((t = time(NULL)) == ((time_t)(-1))) {
-		ERROR("time() failed (%s)", strerror(errno));
-		/* we do not know, so answer that file was changed */
+	LOCK(file_ds, ret);
+	if (ret) {
+		/* we cannot be sure */
 		return (1);
 	}
+	/* compare the last change with the state of the last access, the
+	 * datastore not read yet is always considered changed */
+	ret = (!file_ds->xml_valid || file_ds->shared->seq != file_ds->access_seq);
+	UNLOCK(file_ds);
 
-	/* check when the file was modified */
-	if (stat(((struct ncds_ds_file*)ds)->path, &statbuf) == 0) {
-		if (statbuf.st_mtime < ds->last_access) {
-			/* file was not modified */
-			return (0);
-		}
-	}
-	return (1);
+	return (ret);
 }
 
 /**
@@ -335,11 +349,13 @@ int ncds_file_changed(struct ncds_ds* ds)
 int ncds_file_init(struct ncds_ds* ds)
 {
 	struct stat st;
-	char* new_path = NULL, *sempath, *dir_name, *file_name, *dup_path;
+	char* new_path = NULL, *shmpath, *dir_name, *file_name, *dup_path;
 	struct dirent * file_info;
 	DIR * dir;
 	int fd;
 	mode_t mask;
+	struct flock fl;
+	pthread_mutexattr_t mattr;
 	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
 
 	file_ds->xml = xmlReadFile(file_ds->path, NULL, NC_XMLREAD_OPTIONS);
@@ -465,45 +481,112 @@ int ncds_file_init(struct ncds_ds* ds)
 			return (EXIT_FAILURE);
 		}
 		xmlDocFormatDump(file_ds->file, file_ds->xml, 1);
+		fflush(file_ds->file);
 		WARN("File %s was empty. Basic structure created.", file_ds->path);
 	}
 
 	/* init value */
 	file_ds->xml_rollback = NULL;
 
+	/* open the journal with the changes not yet stored in the datastore file */
+	if (asprintf(&file_ds->journal_path, "%s%s", file_ds->path, NCDS_JOURNAL_SUFFIX) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		file_ds->journal_path = NULL;
+		return (EXIT_FAILURE);
+	}
+	mask = umask(MASK_PERM);
+	file_ds->journal = fopen(file_ds->journal_path, "a+");
+	umask(mask);
+	if (file_ds->journal == NULL) {
+		ERROR("Datastore journal %s cannot be opened (%s).", file_ds->journal_path, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+	/* the file content is read again and the journal is applied on the first access */
+	file_ds->xml_valid = 0;
+
 	/* get pointers to running, startup and candidate nodes in xml */
 	if (file_fill_dsnodes(file_ds) != EXIT_SUCCESS) {
 		return (EXIT_FAILURE);
 	}
 
-	/* unlock forgotten locks if any */
-	xmlSetProp (file_ds->running, BAD_CAST "lock", BAD_CAST "");
-	xmlSetProp (file_ds->startup, BAD_CAST "lock", BAD_CAST "");
-	xmlSetProp (file_ds->candidate, BAD_CAST "lock", BAD_CAST "");
-
 	/*
-	 * open and eventually create a lock
-	 */
-	/* first - prepare the path, there must be a separate lock for each
-	 * datastore(set), so name it according to the filepath with a special prefix.
-	 * Slashes in the path are replaced with underscores.
+	 * open and eventually create the datastore state shared by all the
+	 * processes including the datastore lock, there must be a separate state
+	 * for each datastore(set), so name it according to the filepath with a
+	 * special prefix. Slashes in the path are replaced with underscores.
 	 * Sequences of slashes are treated as a single slash character.
 	 */
-	if (asprintf(&sempath, "%s/%s", NCDS_LOCK, file_ds->path) == -1) {
+	if (asprintf(&shmpath, "%s/%s", NCDS_SHARED, file_ds->path) == -1) {
 		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
 		return (EXIT_FAILURE);
 	}
-	nc_clip_occurences_with(sempath, '/', '_');
-	/* recreate initial backslash in the semaphore name */
-	sempath[0] = '/';
-	/* and then create the lock (actually it is a semaphore) */
+	nc_clip_occurences_with(shmpath, '/', '_');
+	/* recreate initial backslash in the shared memory name */
+	shmpath[0] = '/';
 	mask = umask(0000);
-	if ((file_ds->ds_lock.lock = sem_open (sempath, O_CREAT, FILE_PERM, 1)) == SEM_FAILED) {
-		umask(mask);
+	fd = shm_open(shmpath, O_CREAT | O_RDWR, FILE_PERM);
+	umask(mask);
+	if (fd == -1) {
+		ERROR("Accessing datastore shared memory %s failed (%s).", shmpath, strerror(errno));
+		free(shmpath);
 		return (EXIT_FAILURE);
 	}
-	umask(mask);
-	free (sempath);
+
+	/* only a single process initializes the memory, the file lock is released
+	 * by the system even if the process dies */
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = 0;
+	fl.l_len = 0;
+	while (fcntl(fd, F_SETLKW, &fl) == -1) {
+		if (errno != EINTR) {
+			ERROR("Locking datastore shared memory %s failed (%s).", shmpath, strerror(errno));
+			free(shmpath);
+			close(fd);
+			return (EXIT_FAILURE);
+		}
+	}
+
+	if (fstat(fd, &st) == -1 || (st.st_size != sizeof(struct ncds_file_shared) &&
+			ftruncate(fd, sizeof(struct ncds_file_shared)) == -1)) {
+		ERROR("Truncating datastore shared memory %s failed (%s).", shmpath, strerror(errno));
+		free(shmpath);
+		close(fd);
+		return (EXIT_FAILURE);
+	}
+	file_ds->shared = mmap(NULL, sizeof(struct ncds_file_shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (file_ds->shared == MAP_FAILED) {
+		ERROR("Mapping datastore shared memory %s failed (%s).", shmpath, strerror(errno));
+		file_ds->shared = NULL;
+		free(shmpath);
+		close(fd);
+		return (EXIT_FAILURE);
+	}
+
+	if (st.st_size != sizeof(struct ncds_file_shared) || file_ds->shared->version != NCDS_SHARED_VERSION) {
+		/* newly created memory or memory of a different layout - no
+		 * datastore is locked and the sequence numbers are updated from
+		 * the datastore file on the first access */
+		memset(file_ds->shared, 0, sizeof(struct ncds_file_shared));
+		pthread_mutexattr_init(&mattr);
+		pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+		pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+		if (pthread_mutex_init(&file_ds->shared->lock, &mattr) != 0) {
+			ERROR("Initiating the lock of the datastore shared memory %s failed.", shmpath);
+			pthread_mutexattr_destroy(&mattr);
+			munmap(file_ds->shared, sizeof(struct ncds_file_shared));
+			file_ds->shared = NULL;
+			free(shmpath);
+			close(fd);
+			return (EXIT_FAILURE);
+		}
+		pthread_mutexattr_destroy(&mattr);
+		file_ds->shared->version = NCDS_SHARED_VERSION;
+	}
+
+	/* closing the descriptor releases the file lock */
+	close(fd);
+	free(shmpath);
 
 	return (EXIT_SUCCESS);
 }
@@ -518,21 +601,301 @@ void ncds_file_free(struct ncds_ds* ds)
 			fclose(file_ds->file);
 		}
 		free(file_ds->path);
+		if (file_ds->journal != NULL) {
+			fclose(file_ds->journal);
+		}
+		free(file_ds->journal_path);
 		xmlFreeDoc(file_ds->xml);
 		xmlFreeDoc(file_ds->xml_rollback);
-		if (file_ds->ds_lock.lock != NULL) {
+		if (file_ds->shared != NULL) {
 			if (file_ds->ds_lock.holding_lock) {
-				sem_post (file_ds->ds_lock.lock);
+				pthread_mutex_unlock(&file_ds->shared->lock);
+			}
+			munmap(file_ds->shared, sizeof(struct ncds_file_shared));
+		}
+	}
+}
+
+/* types of the journal records */
+#define JOURNAL_EDIT 'E'
+#define JOURNAL_COPY 'C'
+#define JOURNAL_DELETE 'D'
+
+static xmlNodePtr file_get_dsnode(struct ncds_ds_file* file_ds, NC_DATASTORE target)
+{
+	switch(target) {
+	case NC_DATASTORE_RUNNING:
+		return (file_ds->running);
+	case NC_DATASTORE_STARTUP:
+		return (file_ds->startup);
+	case NC_DATASTORE_CANDIDATE:
+		return (file_ds->candidate);
+	default:
+		return (NULL);
+	}
+}
+
+/**
+ * @brief Parse the serialized configuration data into an XML document with
+ * the (possibly multiple) configuration elements on the top level.
+ *
+ * @param config Serialized configuration data without the XML declaration.
+ *
+ * @return XML document or NULL on error.
+ */
+static xmlDocPtr file_read_config(const char* config)
+{
+	xmlDocPtr config_doc;
+	xmlNodePtr root, aux_node;
+	char* aux = NULL;
+
+	if (asprintf(&aux, "<config>%s</config>", config) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+
+	/* read config to XML doc */
+	if ((config_doc = xmlReadMemory (aux, strlen(aux), NULL, NULL, NC_XMLREAD_OPTIONS)) == NULL) {
+		free(aux);
+		ERROR("%s: Reading xml data failed!", __func__);
+		return (NULL);
+	}
+	free(aux);
+
+	/* magic - get off the root config element and move all children to the 1st level */
+	root = xmlDocGetRootElement(config_doc);
+	for (aux_node = root->children; aux_node != NULL; aux_node = root->children) {
+		xmlUnlinkNode(aux_node);
+		xmlAddNextSibling(config_doc->last, aux_node);
+	}
+	xmlUnlinkNode(root);
+	xmlFreeNode(root);
+
+	return (config_doc);
+}
+
+/**
+ * @brief Serialize the list of sibling nodes.
+ *
+ * @param doc Document of the nodes.
+ * @param list First node of the list.
+ *
+ * @return Buffer with the serialized nodes, NULL on error. Caller is supposed
+ * to free it.
+ */
+static xmlBufferPtr file_dump_nodes(xmlDocPtr doc, xmlNodePtr list)
+{
+	xmlBufferPtr buf;
+
+	if ((buf = xmlBufferCreate()) == NULL) {
+		ERROR("%s: xmlBufferCreate failed (%s:%d).", __func__, __FILE__, __LINE__);
+		return (NULL);
+	}
+	for (; list != NULL; list = list->next) {
+		xmlNodeDump(buf, doc, list, 0, 0);
+	}
+
+	return (buf);
+}
+
+/**
+ * @brief Apply the edit-config on the target datastore node.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_edit_node(struct ncds_ds_file* file_ds, NC_DATASTORE target, xmlNodePtr target_ds, xmlDocPtr config_doc, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, const struct nacm_rpc* nacm, struct nc_err** error)
+{
+	xmlDocPtr datastore_doc;
+	xmlNodePtr aux_node, root;
+
+	/* create an XML doc with a copy of the datastore configuration */
+	datastore_doc = xmlNewDoc (BAD_CAST "1.0");
+	xmlDocSetRootElement(datastore_doc, xmlCopyNode(target_ds->children, 1));
+	if (target_ds->children) {
+		for (root = target_ds->children->next; root != NULL; root = aux_node) {
+			aux_node = root->next;
+			xmlAddNextSibling(datastore_doc->last, xmlCopyNode(root, 1));
+		}
+	}
+
+	/* preform edit config */
+	if (edit_config(datastore_doc, config_doc, (struct ncds_ds*)file_ds, defop, errop, nacm, error)) {
+		xmlFreeDoc(datastore_doc);
+		return (EXIT_FAILURE);
+	}
+
+	/* replace datastore by edited configuration */
+	while ((aux_node = target_ds->children) != NULL) {
+		xmlUnlinkNode(aux_node);
+		xmlFreeNode(aux_node);
+	}
+	xmlAddChildList(target_ds, xmlCopyNodeList(datastore_doc->children));
+	xmlFreeDoc(datastore_doc);
+
+	/*
+	 * if we are changing candidate, mark it as modified, since we need
+	 * this information for locking - according to RFC, candidate cannot
+	 * be locked since it has been modified and not committed.
+	 */
+	if (target == NC_DATASTORE_CANDIDATE) {
+		xmlSetProp(target_ds, BAD_CAST "modified", BAD_CAST "true");
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Replace the content of the target datastore node by a copy of the
+ * list of nodes.
+ */
+static void file_copy_nodes(NC_DATASTORE target, xmlNodePtr target_ds, NC_DATASTORE source, xmlNodePtr list)
+{
+	xmlNodePtr aux_node;
+
+	/* drop current target configuration */
+	while ((aux_node = target_ds->children) != NULL) {
+		xmlUnlinkNode (target_ds->children);
+		xmlFreeNode (aux_node);
+	}
+
+	/* copy new target configuration */
+	if (list != NULL) {
+		xmlAddChildList(target_ds, xmlCopyNodeList(list));
+	}
+
+	/*
+	 * if we are changing candidate, mark it as modified, since we need
+	 * this information for locking - according to RFC, candidate cannot
+	 * be locked since it has been modified and not committed.
+	 */
+	if (target == NC_DATASTORE_CANDIDATE) {
+		if (source == NC_DATASTORE_RUNNING) {
+			xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "false");
+		} else {
+			xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "true");
+		}
+	}
+}
+
+/**
+ * @brief Apply a single journal record to the xml.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_journal_apply(struct ncds_ds_file* file_ds, char type, NC_DATASTORE target, int arg1, int arg2, char* data)
+{
+	xmlNodePtr target_ds, source_ds;
+	xmlDocPtr config_doc;
+	struct nc_err* e = NULL;
+	int ret = EXIT_SUCCESS;
+
+	if ((target_ds = file_get_dsnode(file_ds, target)) == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	switch (type) {
+	case JOURNAL_EDIT:
+		if ((config_doc = file_read_config(data)) == NULL) {
+			return (EXIT_FAILURE);
+		}
+		ret = file_edit_node(file_ds, target, target_ds, config_doc, (NC_EDIT_DEFOP_TYPE) arg1, (NC_EDIT_ERROPT_TYPE) arg2, NULL, &e);
+		nc_err_free(e);
+		xmlFreeDoc(config_doc);
+		break;
+	case JOURNAL_COPY:
+		if (arg2) {
+			/* the resulting content is part of the record */
+			if ((config_doc = file_read_config(data)) == NULL) {
+				return (EXIT_FAILURE);
+			}
+			file_copy_nodes(target, target_ds, (NC_DATASTORE) arg1, config_doc->children);
+			xmlFreeDoc(config_doc);
+		} else {
+			if ((source_ds = file_get_dsnode(file_ds, (NC_DATASTORE) arg1)) == NULL) {
+				return (EXIT_FAILURE);
+			}
+			file_copy_nodes(target, target_ds, (NC_DATASTORE) arg1, source_ds->children);
+		}
+		break;
+	case JOURNAL_DELETE:
+		file_copy_nodes(target, target_ds, NC_DATASTORE_ERROR, NULL);
+		break;
+	default:
+		return (EXIT_FAILURE);
+	}
+
+	return (ret);
+}
+
+/**
+ * @brief Apply the journal records not yet applied to the xml. This function
+ * MUST be called ONLY between file_ds_lock() and file_ds_unlock().
+ *
+ * Incomplete record at the end of the journal (interrupted write) is ignored.
+ * If a record cannot be applied, the replay stops before it, so the xml
+ * contains the changes up to the journal_seq.
+ *
+ * @param file_ds Pointer to the datastorage structure
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_journal_replay(struct ncds_ds_file* file_ds)
+{
+	char *line = NULL, *data = NULL, type;
+	size_t line_size = 0, len;
+	unsigned long long seq;
+	int target, arg1, arg2;
+
+	if (fseeko(file_ds->journal, file_ds->journal_offset, SEEK_SET) == -1) {
+		ERROR("%s: seeking in the journal %s failed (%s)", __func__, file_ds->journal_path, strerror(errno));
+		return (EXIT_FAILURE);
+	}
+
+	while (getline(&line, &line_size, file_ds->journal) != -1) {
+		/* record header: <seq> <type> <target> <arg1> <arg2> <data length> */
+		if (line[strlen(line) - 1] != '\n' ||
+				sscanf(line, "%llu %c %d %d %d %zu", &seq, &type, &target, &arg1, &arg2, &len) != 6) {
+			break;
+		}
+		/* data are terminated by a newline */
+		if ((data = malloc(len + 1)) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			break;
+		}
+		if (fread(data, 1, len + 1, file_ds->journal) != len + 1 || data[len] != '\n') {
+			break;
+		}
+		data[len] = '\0';
+
+		if (seq > file_ds->journal_seq) {
+			/* the record is not yet included in the datastore file */
+			if (file_journal_apply(file_ds, type, (NC_DATASTORE) target, arg1, arg2, data) != EXIT_SUCCESS) {
+				ERROR("%s: applying the record %llu from the journal %s failed.", __func__, seq, file_ds->journal_path);
+				free(data);
+				free(line);
+				return (EXIT_FAILURE);
 			}
-			sem_close(file_ds->ds_lock.lock);
+			file_ds->journal_seq = seq;
 		}
+		file_ds->journal_offset = ftello(file_ds->journal);
+		free(data);
+		data = NULL;
 	}
+	free(data);
+	free(line);
+
+	return (EXIT_SUCCESS);
 }
 
 /**
  * @brief Reloads xml configuration from the datastorage file. This function MUST be
  * called ONLY between file_ds_lock() and file_ds_unlock().
  *
+ * Nothing is done if the datastore was not changed since the last reload according
+ * to the sequence number in the shared memory. The datastore file is read only if
+ * it contains changes compacted from the journal and not yet applied to the
+ * current xml, otherwise only the new records from the journal are applied.
+ *
  * Tries to read from the datastore and find the datastore root elements.
  * If succussfully, the old xml is freed and replaced with a new one.
  * If it fails, the structure is preserved as it was.
@@ -543,94 +906,280 @@ void ncds_file_free(struct ncds_ds* ds)
  */
 static int file_reload(struct ncds_ds_file* file_ds)
 {
-	xmlDocPtr new_xml;
+	struct ncds_file_shared* shared;
+	xmlDocPtr new_xml, old_xml;
+	xmlChar* seq;
 	struct stat statbuf;
-	time_t t;
+	int reread = 0;
 
 	if (file_ds == NULL || !file_ds->ds_lock.holding_lock) {
 		ERROR("%s: invalid parameter.", __func__);
 		return EXIT_FAILURE;
 	}
+	shared = file_ds->shared;
 
-	/* get current time */
-	if ((t = time(NULL)) == ((time_t)(-1))) {
-		t = 0;
-		WARN("Setting datastore access time failed (%s)", strerror(errno));
+	if (file_ds->xml_valid && file_ds->journal_seq == shared->seq) {
+		/* nothing changed since the last access */
+		file_ds->access_seq = file_ds->journal_seq;
+		return EXIT_SUCCESS;
 	}
 
-	/* check when the file was modified */
-	if (stat(file_ds->path, &statbuf) == 0) {
-		if (statbuf.st_mtime < file_ds->ds.last_access) {
-			/* file was not modified */
-			return (EXIT_SUCCESS);
+	if (!file_ds->xml_valid || shared->compact_seq > file_ds->journal_seq) {
+		/* some changes are stored only in the (replaced) file, reopen and read it */
+		fclose(file_ds->file);
+		file_ds->file = fopen(file_ds->path, "r+");
+		if (file_ds->file == NULL) {
+			ERROR("%s: reopenening the file %s failed (%s)", __func__, file_ds->path, strerror(errno));
+			return EXIT_FAILURE;
+		}
+
+		new_xml = xmlReadFd(fileno(file_ds->file), file_ds->path, NULL, NC_XMLREAD_OPTIONS);
+		if (new_xml == NULL) {
+			return EXIT_FAILURE;
+		}
+
+		old_xml = file_ds->xml;
+		file_ds->xml = new_xml;
+		if (file_fill_dsnodes (file_ds)) {
+			file_ds->xml = old_xml;
+			file_fill_dsnodes (file_ds);
+			xmlFreeDoc (new_xml);
+			return EXIT_FAILURE;
+		}
+		xmlFreeDoc (old_xml);
+
+		/* the journal records up to this sequence number are already in the file */
+		seq = xmlGetProp(xmlDocGetRootElement(new_xml), BAD_CAST "seq");
+		file_ds->journal_seq = (seq != NULL) ? strtoull((char*) seq, NULL, 10) : 0;
+		xmlFree(seq);
+		file_ds->journal_offset = 0;
+		file_ds->xml_valid = 1;
+
+		/* the content of the file and the journal is the only reliable source
+		 * of the state, the shared memory could be created (or the files
+		 * replaced) after the last change */
+		shared->compact_seq = file_ds->journal_seq;
+		if (fstat(fileno(file_ds->file), &statbuf) == 0) {
+			shared->file_size = statbuf.st_size;
 		}
+		reread = 1;
+	} else if (shared->compact_seq != file_ds->compact_seq) {
+		/* the journal was compacted by another process, but the xml already
+		 * contains all the compacted changes, read the rest of the journal */
+		file_ds->journal_offset = 0;
+	}
+	file_ds->compact_seq = shared->compact_seq;
+
+	/* apply the changes made since the last access */
+	if (file_journal_replay(file_ds)) {
+		/* the xml cannot follow the other processes */
+		file_ds->xml_valid = 0;
+		if (reread) {
+			return EXIT_FAILURE;
+		}
+		/* the xml of this process could differ, start from the stored content */
+		WARN("%s: reading the datastore file %s again.", __func__, file_ds->path);
+		return file_reload(file_ds);
 	}
 
-	/* file was modified, it may be necessary to reopen it */
-	fclose(file_ds->file);
-	file_ds->file = fopen(file_ds->path, "r+");
-	if (file_ds->file == NULL) {
-		ERROR("%s: reopenening the file %s failed (%s)", __func__, file_ds->path, strerror(errno));
-		return EXIT_FAILURE;
+	if (reread && shared->seq < file_ds->journal_seq) {
+		/* never decrease it, the other processes could miss the next change */
+		shared->seq = file_ds->journal_seq;
 	}
+	file_ds->access_seq = file_ds->journal_seq;
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Store the current version of the configuration into the datastore file
+ * and empty the journal. This function MUST be called ONLY between
+ * file_ds_lock() and file_ds_unlock().
+ *
+ * The new content is written into a temporary file which then atomically
+ * replaces the datastore file, the journal is truncated afterwards. Records
+ * left in the journal by an interruption between these steps are recognized
+ * according to the sequence number stored in the datastore file.
+ *
+ * @param file_ds Datastore to compact.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int file_compact(struct ncds_ds_file* file_ds)
+{
+	char* tmp_path = NULL, *dup_path, seq[21];
+	FILE* tmp;
+	struct stat statbuf;
+	mode_t mask;
+	int fd;
 
-	new_xml = xmlReadFile (file_ds->path, NULL, NC_XMLREAD_OPTIONS);
-	if (new_xml == NULL) {
+	if (asprintf(&tmp_path, "%s.tmp", file_ds->path) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
 		return EXIT_FAILURE;
 	}
 
-	xmlFreeDoc (file_ds->xml);
-	file_ds->xml = new_xml;
+	snprintf(seq, sizeof(seq), "%llu", file_ds->journal_seq);
+	xmlSetProp(xmlDocGetRootElement(file_ds->xml), BAD_CAST "seq", BAD_CAST seq);
+
+	mask = umask(MASK_PERM);
+	tmp = fopen(tmp_path, "w+");
+	umask(mask);
+	if (tmp == NULL) {
+		ERROR("%s: creating the file %s failed (%s)", __func__, tmp_path, strerror(errno));
+		free(tmp_path);
+		return EXIT_FAILURE;
+	}
+	if (xmlDocFormatDump(tmp, file_ds->xml, 1) == -1 || fflush(tmp) != 0 || fsync(fileno(tmp)) == -1) {
+		ERROR("%s: storing repository into the file %s failed.", __func__, tmp_path);
+		fclose(tmp);
+		unlink(tmp_path);
+		free(tmp_path);
+		return EXIT_FAILURE;
+	}
 
-	if (file_fill_dsnodes (file_ds)) {
-		xmlFreeDoc (new_xml);
+	/* replace the datastore file */
+	if (rename(tmp_path, file_ds->path) == -1) {
+		ERROR("%s: renaming %s to %s failed (%s)", __func__, tmp_path, file_ds->path, strerror(errno));
+		fclose(tmp);
+		unlink(tmp_path);
+		free(tmp_path);
 		return EXIT_FAILURE;
 	}
+	free(tmp_path);
+
+	/* make the rename persistent before truncating the journal */
+	dup_path = strdup(file_ds->path);
+	if ((fd = open(dirname(dup_path), O_RDONLY)) != -1) {
+		fsync(fd);
+		close(fd);
+	}
+	free(dup_path);
 
-	/* update access time */
-	file_ds->ds.last_access = t;
+	fclose(file_ds->file);
+	file_ds->file = tmp;
+	fstat(fileno(file_ds->file), &statbuf);
+	file_ds->shared->file_size = statbuf.st_size;
+	file_ds->shared->compact_seq = file_ds->compact_seq = file_ds->journal_seq;
+
+	/* empty the journal */
+	if (ftruncate(fileno(file_ds->journal), 0) == -1) {
+		WARN("%s: truncating the journal %s failed (%s)", __func__, file_ds->journal_path, strerror(errno));
+		return EXIT_SUCCESS;
+	}
+	fdatasync(fileno(file_ds->journal));
+	file_ds->journal_offset = 0;
 
 	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Get the sequence number for the next change of the datastore. It is
+ * higher than any number used by this or any other process, even if this
+ * process did not reload the datastore. This function MUST be called ONLY
+ * between file_ds_lock() and file_ds_unlock().
+ *
+ * @param file_ds Changed datastore.
+ *
+ * @return Sequence number of the next change.
+ */
+static unsigned long long file_next_seq(struct ncds_ds_file* file_ds)
+{
+	unsigned long long seq = file_ds->journal_seq;
 
+	if (file_ds->shared->seq > seq) {
+		seq = file_ds->shared->seq;
+	}
+	if (file_ds->shared->compact_seq > seq) {
+		seq = file_ds->shared->compact_seq;
+	}
+
+	return (seq + 1);
 }
 
 /**
- * @brief Write the current version of the configuration to a file. This function MUST be
- * called ONLY between file_ds_lock() and file_ds_unlock().
+ * @brief Append a record describing a change of the xml to the journal. This
+ * function MUST be called ONLY between file_ds_lock() and file_ds_unlock() and
+ * after file_reload().
  *
  * @param file_ds Datastore to sync.
+ * @param type Type of the record.
+ * @param target Changed datastore.
+ * @param arg1 Type specific argument.
+ * @param arg2 Type specific argument.
+ * @param data Type specific data, NULL if no data.
  *
  * @return EXIT_SUCCESS or EXIT_FAILURE
  */
-static int file_sync(struct ncds_ds_file* file_ds)
+static int file_journal_write(struct ncds_ds_file* file_ds, char type, NC_DATASTORE target, int arg1, int arg2, const char* data)
 {
-	time_t t;
+	unsigned long long seq;
+	size_t len;
+	int fd;
 
 	if (file_ds == NULL || !file_ds->ds_lock.holding_lock) {
 		ERROR("%s: invalid parameter.", __func__);
 		return EXIT_FAILURE;
 	}
-
-	/* erase actual config */
-	if (ftruncate (fileno(file_ds->file), 0) == -1) {
-		ERROR ("%s: truncate() of file %s failed (%s)", __func__, file_ds->path, strerror(errno));
-		return EXIT_FAILURE;
+	fd = fileno(file_ds->journal);
+	len = (data != NULL) ? strlen(data) : 0;
+	seq = file_next_seq(file_ds);
+
+	/* drop an incomplete record possibly left by an interrupted write */
+	if (ftruncate(fd, file_ds->journal_offset) == -1 || fseeko(file_ds->journal, 0, SEEK_END) == -1) {
+		ERROR("%s: preparing the journal %s failed (%s)", __func__, file_ds->journal_path, strerror(errno));
+		goto error;
+	}
+
+	if (fprintf(file_ds->journal, "%llu %c %d %d %d %zu\n", seq, type, target, arg1, arg2, len) < 0 ||
+			(len && fwrite(data, 1, len, file_ds->journal) != len) ||
+			fputc('\n', file_ds->journal) == EOF ||
+			fflush(file_ds->journal) != 0 ||
+			fdatasync(fd) == -1) {
+		ERROR("%s: writing into the journal %s failed (%s)", __func__, file_ds->journal_path, strerror(errno));
+		/* remove the partial record */
+		clearerr(file_ds->journal);
+		if (ftruncate(fd, file_ds->journal_offset) == -1) {
+			WARN("%s: truncating the journal %s failed (%s)", __func__, file_ds->journal_path, strerror(errno));
+		}
+		goto error;
 	}
-	rewind (file_ds->file);
+	file_ds->journal_seq = seq;
+	file_ds->journal_offset = ftello(file_ds->journal);
 
-	if(xmlDocFormatDump(file_ds->file, file_ds->xml, 1) == -1) {
-		ERROR("%s: storing repository into the file %s failed.", __func__, file_ds->path);
-		return (EXIT_FAILURE);
-	}
+	/* announce the change to the other processes */
+	file_ds->shared->seq = file_ds->journal_seq;
 
-	/* update last access time */
-	if ((t = time(NULL)) == ((time_t)(-1))) {
-		WARN("Setting datastore access time failed (%s)", strerror(errno));
-	} else {
-		file_ds->ds.last_access = t;
+	if (file_ds->journal_offset > NCDS_JOURNAL_COMPACT_SIZE && file_ds->journal_offset > file_ds->shared->file_size) {
+		/* the journal is big enough to be compacted into the datastore file,
+		 * failure is not fatal, the change is already stored in the journal */
+		file_compact(file_ds);
 	}
 
 	return EXIT_SUCCESS;
+
+error:
+	/* the xml does not correspond to the stored data, force its reload */
+	file_ds->xml_valid = 0;
+	return EXIT_FAILURE;
+}
+
+/**
+ * @brief Append a record with the serialized list of nodes to the journal.
+ * See file_journal_write().
+ */
+static int file_journal_write_nodes(struct ncds_ds_file* file_ds, char type, NC_DATASTORE target, int arg1, int arg2, xmlNodePtr list)
+{
+	xmlBufferPtr buf;
+	int ret;
+
+	if ((buf = file_dump_nodes(file_ds->xml, list)) == NULL) {
+		file_ds->xml_valid = 0;
+		return EXIT_FAILURE;
+	}
+	ret = file_journal_write(file_ds, type, target, arg1, arg2, (char*) xmlBufferContent(buf));
+	xmlBufferFree(buf);
+
+	return (ret);
 }
 
 static int file_rollback_store(struct ncds_ds_file* file_ds)
@@ -646,6 +1195,28 @@ static int file_rollback_store(struct ncds_ds_file* file_ds)
 	return (EXIT_SUCCESS);
 }
 
+/**
+ * @brief Return the xml to the state stored by file_rollback_store() after
+ * a change that was not stored into the journal, so the process keeps the same
+ * content as the other processes. The backup is kept for ncds_file_rollback().
+ * If it cannot be done, the xml is read again on the next access.
+ */
+static void file_rollback_revert(struct ncds_ds_file* file_ds)
+{
+	xmlDocPtr backup;
+
+	if (file_ds->xml_rollback == NULL || (backup = xmlCopyDoc(file_ds->xml_rollback, 1)) == NULL) {
+		file_ds->xml_valid = 0;
+		return;
+	}
+
+	xmlFreeDoc(file_ds->xml);
+	file_ds->xml = backup;
+	if (file_fill_dsnodes(file_ds)) {
+		file_ds->xml_valid = 0;
+	}
+}
+
 static int file_rollback_restore(struct ncds_ds_file* file_ds)
 {
 	if (file_ds == NULL || !file_ds->ds_lock.holding_lock) {
@@ -661,9 +1232,25 @@ static int file_rollback_restore(struct ncds_ds_file* file_ds)
 	xmlFreeDoc(file_ds->xml);
 	file_ds->xml = file_ds->xml_rollback;
 	file_ds->xml_rollback = NULL;
-	file_ds->ds.last_access = 0;
+	if (file_fill_dsnodes(file_ds)) {
+		file_ds->xml_valid = 0;
+		return (EXIT_FAILURE);
+	}
+
+	/*
+	 * the restored configuration cannot be described by a journal record,
+	 * store it into the datastore file as a new change, so the other processes
+	 * are forced to read the file, the other processes could change the
+	 * datastore since this process reloaded it, so do not reuse their numbers
+	 */
+	file_ds->journal_seq = file_next_seq(file_ds);
+	if (file_compact(file_ds)) {
+		file_ds->xml_valid = 0;
+		return (EXIT_FAILURE);
+	}
+	file_ds->shared->seq = file_ds->journal_seq;
 
-	return (file_sync(file_ds));
+	return (EXIT_SUCCESS);
 }
 
 int ncds_file_rollback(struct ncds_ds* ds)
@@ -693,49 +1280,39 @@ const struct ncds_lockinfo *ncds_file_lockinfo(struct ncds_ds* ds, NC_DATASTORE
 {
 	int ret;
 	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
-	xmlNodePtr target_ds;
+	struct ncds_file_lock* lock;
 	struct ncds_lockinfo *info;
 
-	LOCK(file_ds, ret);
-	if (ret) {
-		return (NULL);
-	}
-
-	if (file_reload (file_ds)) {
-		UNLOCK(file_ds);
-		return (NULL);
-	}
-
 	/* check validity of function parameters */
 	switch(target) {
 	case NC_DATASTORE_RUNNING:
-		target_ds = file_ds->running;
 		info = &lockinfo_running;
 		break;
 	case NC_DATASTORE_STARTUP:
-		target_ds = file_ds->startup;
 		info = &lockinfo_startup;
 		break;
 	case NC_DATASTORE_CANDIDATE:
-		target_ds = file_ds->candidate;
 		info = &lockinfo_candidate;
 		break;
 	default:
-		UNLOCK(file_ds);
 		return (NULL);
 		break;
 	}
+	lock = file_get_lock(file_ds, target);
+
+	LOCK(file_ds, ret);
+	if (ret) {
+		return (NULL);
+	}
+
 	free((*info).sid);
 	free((*info).time);
-	(*info).sid = (char*) xmlGetProp (target_ds, BAD_CAST "lock");
-	(*info).time = (char*) xmlGetProp (target_ds, BAD_CAST "locktime");
-	if ((*info).sid == NULL) {
-		WARN("%s: missing the \"lock\" attribute in the %s datastore.", __func__, file_ds->ds.data_model->name);
-	} else if (strisempty((*info).sid)) {
-		free((*info).sid);
-		free((*info).time);
+	if (lock->sid[0] == '\0') {
 		(*info).sid = NULL;
 		(*info).time = NULL;
+	} else {
+		(*info).sid = strdup(lock->sid);
+		(*info).time = strdup(lock->time);
 	}
 
 	UNLOCK(file_ds);
@@ -746,77 +1323,58 @@ const struct ncds_lockinfo *ncds_file_lockinfo(struct ncds_ds* ds, NC_DATASTORE
 int ncds_file_lock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error)
 {
 	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
-	xmlChar* lock, *modified = NULL;
-	xmlNodePtr target_ds;
+	xmlChar *modified = NULL;
+	struct ncds_file_lock* lock;
 	struct nc_session* no_session;
 	int retval = EXIT_SUCCESS, ret;
 	char* t;
 
 	assert(error);
 
-	LOCK(file_ds, ret);
-	if (ret) {
-		*error = nc_err_new(NC_ERR_OP_FAILED);
-		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
-		return EXIT_FAILURE;
-	}
-
-	if (file_reload (file_ds)) {
-		UNLOCK(file_ds);
-		return EXIT_FAILURE;
-	}
-
 	/* check validity of function parameters */
-	switch(target) {
-	case NC_DATASTORE_RUNNING:
-		target_ds = file_ds->running;
-		break;
-	case NC_DATASTORE_STARTUP:
-		target_ds = file_ds->startup;
-		break;
-	case NC_DATASTORE_CANDIDATE:
-		target_ds = file_ds->candidate;
-		break;
-	default:
-		UNLOCK(file_ds);
+	if ((lock = file_get_lock(file_ds, target)) == NULL) {
 		ERROR("%s: invalid target.", __func__);
 		*error = nc_err_new(NC_ERR_BAD_ELEM);
 		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
 		return (EXIT_FAILURE);
-		break;
+	}
+
+	LOCK(file_ds, ret);
+	if (ret) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
+		return EXIT_FAILURE;
 	}
 
 	/* check if repository is locked by anyone including me */
 	no_session = nc_session_dummy(INTERNAL_DUMMY_ID, session->username, session->hostname, session->capabilities);
 	if (file_ds_access (file_ds, target, no_session) != 0) {
 		/* someone is already holding the lock */
-		lock = xmlGetProp (target_ds, BAD_CAST "lock");
 		*error = nc_err_new(NC_ERR_LOCK_DENIED);
-		nc_err_set(*error, NC_ERR_PARAM_INFO_SID, (char*)lock);
-		xmlFree(lock);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_SID, lock->sid);
+		retval = EXIT_FAILURE;
+	} else if (target == NC_DATASTORE_CANDIDATE && file_reload(file_ds)) {
+		/* the modified flag of candidate is part of the datastore content */
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
+		retval = EXIT_FAILURE;
+	} else if (target == NC_DATASTORE_CANDIDATE &&
+			(modified = xmlGetProp(file_ds->candidate, BAD_CAST "modified")) != NULL &&
+			xmlStrcmp(modified, BAD_CAST "true") == 0) {
+		*error = nc_err_new(NC_ERR_LOCK_DENIED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Candidate datastore not locked but already modified.");
 		retval = EXIT_FAILURE;
 	} else {
-		if (target == NC_DATASTORE_CANDIDATE &&
-				(modified = xmlGetProp(target_ds, BAD_CAST "modified")) != NULL &&
-				xmlStrcmp(modified, BAD_CAST "true") == 0) {
-			*error = nc_err_new(NC_ERR_LOCK_DENIED);
-			nc_err_set(*error, NC_ERR_PARAM_MSG, "Candidate datastore not locked but already modified.");
-			retval = EXIT_FAILURE;
-		} else {
-			xmlSetProp (target_ds, BAD_CAST "lock", BAD_CAST session->session_id);
-			xmlSetProp (target_ds, BAD_CAST "locktime", BAD_CAST (t = nc_time2datetime(time(NULL), NULL)));
-			free(t);
-			if (file_sync(file_ds)) {
-				*error = nc_err_new(NC_ERR_OP_FAILED);
-				nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
-				retval = EXIT_FAILURE;
-			}
-		}
-		xmlFree(modified);
+		strcpy(lock->sid, session->session_id);
+		t = nc_time2datetime(time(NULL), NULL);
+		strncpy(lock->time, (t != NULL) ? t : "", NCDS_LOCKTIME_SIZE - 1);
+		lock->time[NCDS_LOCKTIME_SIZE - 1] = '\0';
+		free(t);
 	}
 	UNLOCK(file_ds);
 
 	/* cleanup */
+	xmlFree(modified);
 	nc_session_free(no_session);
 
 	return (retval);
@@ -825,42 +1383,25 @@ int ncds_file_lock(struct ncds_ds* ds, const struct nc_session* session, NC_DATA
 int ncds_file_unlock(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE target, struct nc_err** error)
 {
 	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
-	xmlNodePtr target_ds, del;
+	struct ncds_file_lock* lock;
 	struct nc_session* no_session;
 	int retval = EXIT_SUCCESS, ret;
 
 	assert(error);
 
-	LOCK(file_ds, ret);
-	if (ret) {
-		*error = nc_err_new(NC_ERR_OP_FAILED);
-		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
-		return EXIT_FAILURE;
-	}
-
-	if (file_reload (file_ds)) {
-		UNLOCK(file_ds);
-		return EXIT_FAILURE;
-	}
-
 	/* check validity of function parameters */
-	switch(target) {
-	case NC_DATASTORE_RUNNING:
-		target_ds = file_ds->running;
-		break;
-	case NC_DATASTORE_STARTUP:
-		target_ds = file_ds->startup;
-		break;
-	case NC_DATASTORE_CANDIDATE:
-		target_ds = file_ds->candidate;
-		break;
-	default:
-		UNLOCK(file_ds);
+	if ((lock = file_get_lock(file_ds, target)) == NULL) {
 		ERROR("%s: invalid target.", __func__);
 		*error = nc_err_new(NC_ERR_BAD_ELEM);
 		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
 		return (EXIT_FAILURE);
-		break;
+	}
+
+	LOCK(file_ds, ret);
+	if (ret) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
+		return EXIT_FAILURE;
 	}
 
 	/* check if repository is locked */
@@ -877,28 +1418,22 @@ int ncds_file_unlock(struct ncds_ds* ds, const struct nc_session* session, NC_DA
 		retval = EXIT_FAILURE;
 	} else {
 		/* the datastore is locked by request originating session */
-
 		if (target == NC_DATASTORE_CANDIDATE) {
-			/* drop current candidate configuration */
-			while ((del = file_ds->candidate->children) != NULL) {
-				xmlUnlinkNode (file_ds->candidate->children);
-				xmlFreeNode (del);
+			/* unlocked candidate is reverted to the content of running */
+			if (file_reload(file_ds) == EXIT_SUCCESS) {
+				file_copy_nodes(NC_DATASTORE_CANDIDATE, file_ds->candidate, NC_DATASTORE_RUNNING, file_ds->running->children);
+				retval = file_journal_write(file_ds, JOURNAL_COPY, NC_DATASTORE_CANDIDATE, NC_DATASTORE_RUNNING, 0, NULL);
+			} else {
+				retval = EXIT_FAILURE;
+			}
+			if (retval) {
+				*error = nc_err_new(NC_ERR_OP_FAILED);
+				nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
 			}
-
-			/* copy running into candidate configuration */
-			xmlAddChildList(file_ds->candidate, xmlCopyNodeList(file_ds->running->children));
-
-			/* mark candidate as not modified */
-			xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "false");
 		}
-
-		/* unlock datastore */
-		xmlSetProp (target_ds, BAD_CAST "lock", BAD_CAST "");
-		xmlSetProp (target_ds, BAD_CAST "locktime", BAD_CAST "");
-		if (file_sync(file_ds)) {
-			*error = nc_err_new(NC_ERR_OP_FAILED);
-			nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
-			retval = EXIT_FAILURE;
+		if (retval == EXIT_SUCCESS) {
+			lock->sid[0] = '\0';
+			lock->time[0] = '\0';
 		}
 	}
 
@@ -971,6 +1506,60 @@ char* ncds_file_getconfig(struct ncds_ds* ds, const struct nc_session* UNUSED(se
 	return (data);
 }
 
+xmlDocPtr ncds_file_getconfig_xml(struct ncds_ds* ds, const struct nc_session* UNUSED(session), NC_DATASTORE source, struct nc_err** error)
+{
+	struct ncds_ds_file* file_ds = (struct ncds_ds_file*)ds;
+	xmlNodePtr target_ds, aux_node;
+	xmlDocPtr doc;
+	int ret;
+
+	assert(error);
+
+	LOCK(file_ds, ret);
+	if (ret) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
+		return NULL;
+	}
+
+	if (file_reload (file_ds)) {
+		UNLOCK(file_ds);
+		return NULL;
+	}
+
+	/* check validity of function parameters */
+	switch(source) {
+	case NC_DATASTORE_RUNNING:
+		target_ds = file_ds->running;
+		break;
+	case NC_DATASTORE_STARTUP:
+		target_ds = file_ds->startup;
+		break;
+	case NC_DATASTORE_CANDIDATE:
+		target_ds = file_ds->candidate;
+		break;
+	default:
+		UNLOCK(file_ds);
+		ERROR("%s: invalid target.", __func__);
+		*error = nc_err_new(NC_ERR_BAD_ELEM);
+		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "source");
+		return (NULL);
+		break;
+	}
+
+	/* copy the configuration elements directly into the resulting document */
+	doc = xmlNewDoc(BAD_CAST "1.0");
+	for (aux_node = target_ds->children; aux_node != NULL; aux_node = aux_node->next) {
+		if (aux_node->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		xmlAddChild((xmlNodePtr) doc, xmlDocCopyNode(aux_node, doc, 1));
+	}
+
+	UNLOCK(file_ds);
+	return (doc);
+}
+
 /**
  * @brief Copy the content of the datastore or externally send
  * the configuration to another datastore
@@ -995,7 +1584,7 @@ int ncds_file_copyconfig(struct ncds_ds *ds, const struct nc_session *session, c
 	xmlNodePtr target_ds, source_ds, aux_node, root;
 	keyList keys;
 	char *aux = NULL, *configp;
-	int r, ret = 0;
+	int r, ret = 0, filtered = 0;
 
 	assert(error);
 
@@ -1109,6 +1698,7 @@ int ncds_file_copyconfig(struct ncds_ds *ds, const struct nc_session *session, c
 	 */
 	if (source_ds == NULL && target_ds->children == NULL) {
 		ret = EXIT_RPC_NOT_APPLICABLE;
+		file_copy_nodes(target, target_ds, source, NULL);
 		goto finish;
 	}
 
@@ -1138,6 +1728,7 @@ int ncds_file_copyconfig(struct ncds_ds *ds, const struct nc_session *session, c
 				 * are silently omitted
 				 */
 				nacm_check_data_read(aux_doc, rpc->nacm);
+				filtered = 1;
 			}
 
 			/* RFC 6536, sec. 3.2.4., paragraph 4
@@ -1173,34 +1764,26 @@ int ncds_file_copyconfig(struct ncds_ds *ds, const struct nc_session *session, c
 		}
 	}
 
-	/* drop current target configuration */
-	while ((aux_node = target_ds->children) != NULL) {
-		xmlUnlinkNode (target_ds->children);
-		xmlFreeNode (aux_node);
-	}
-
-	/* copy new target configuration */
-	xmlAddChildList(target_ds, xmlCopyNodeList(aux_doc->children));
+	/* replace current target configuration */
+	file_copy_nodes(target, target_ds, source, aux_doc->children);
 	xmlFreeDoc(aux_doc);
 
 finish:
-	/*
-	 * if we are changing candidate, mark it as modified, since we need
-	 * this information for locking - according to RFC, candidate cannot
-	 * be locked since it has been modified and not committed.
-	 */
-	if (target == NC_DATASTORE_CANDIDATE) {
-		if (source == NC_DATASTORE_RUNNING) {
-			xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "false");
-		} else {
-			xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "true");
-		}
+	if (source != NC_DATASTORE_CONFIG && !filtered) {
+		/* the copy can be repeated from the source datastore */
+		r = file_journal_write(file_ds, JOURNAL_COPY, target, source, 0, NULL);
+	} else {
+		r = file_journal_write_nodes(file_ds, JOURNAL_COPY, target, source, 1, target_ds->children);
 	}
-
-	if (file_sync (file_ds)) {
+	if (r) {
+		/* the change is not stored, do not keep it */
+		file_rollback_revert(file_ds);
 		UNLOCK(file_ds);
-		*error = nc_err_new(NC_ERR_OP_FAILED);
-		nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
+		xmlFreeDoc (config_doc);
+		if (error != NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
+		}
 		return EXIT_FAILURE;
 	}
 	UNLOCK(file_ds);
@@ -1222,7 +1805,7 @@ finish:
 int ncds_file_deleteconfig(struct ncds_ds * ds, const struct nc_session * session, NC_DATASTORE target, struct nc_err **error)
 {
 	struct ncds_ds_file * file_ds = (struct ncds_ds_file*)ds;
-	xmlNodePtr target_ds, del;
+	xmlNodePtr target_ds;
 	int ret;
 
 	assert(error);
@@ -1268,21 +1851,11 @@ int ncds_file_deleteconfig(struct ncds_ds * ds, const struct nc_session * sessio
 		return EXIT_FAILURE;
 	}
 
-	while ((del = target_ds->children) != NULL) {
-		xmlUnlinkNode (target_ds->children);
-		xmlFreeNode (del);
-	}
-
-	/*
-	 * if we are changing the candidate, mark it as modified, since we need
-	 * this information for locking - according to RFC, candidate cannot
-	 * be locked since it has been modified and not committed.
-	 */
-	if (target == NC_DATASTORE_CANDIDATE) {
-		xmlSetProp (target_ds, BAD_CAST "modified", BAD_CAST "true");
-	}
+	file_copy_nodes(target, target_ds, NC_DATASTORE_ERROR, NULL);
 
-	if (file_sync (file_ds)) {
+	if (file_journal_write(file_ds, JOURNAL_DELETE, target, 0, 0, NULL)) {
+		/* the change is not stored, do not keep it */
+		file_rollback_revert(file_ds);
 		UNLOCK(file_ds);
 		*error = nc_err_new(NC_ERR_OP_FAILED);
 		nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
@@ -1294,40 +1867,28 @@ int ncds_file_deleteconfig(struct ncds_ds * ds, const struct nc_session * sessio
 }
 
 /**
- * @brief Perform the edit-config operation
+ * @brief Perform the edit-config operation on the locked datastore
  *
- * @param ds Datastore to edit
+ * @param file_ds Datastore to edit, the caller holds its lock
  * @param session Session sending the edit request
  * @param rpc
  * @param target Datastore type
- * @param config Edit configuration.
+ * @param config_doc Edit configuration with the (possibly multiple) top level elements.
+ * @param config Serialized config_doc for the journal, NULL if not available.
  * @param defop Default edit operation.
+ * @param errop Edit-config's error-option
  * @param error Netconf error structure
  *
  * @return EXIT_SUCCESS or EXIT_FAILURE
  */
-int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, const char * config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error)
+static int file_editconfig(struct ncds_ds_file *file_ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, xmlDocPtr config_doc, const char* config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error)
 {
-	struct ncds_ds_file * file_ds = (struct ncds_ds_file *)ds;
-	xmlDocPtr config_doc, datastore_doc;
-	xmlNodePtr target_ds, aux_node, root;
-	int retval = EXIT_SUCCESS, ret;
-	char* aux = NULL;
-	const char* configp;
-
-	assert(error);
-
-	/* lock the datastore */
-	LOCK(file_ds, ret);
-	if (ret) {
-		*error = nc_err_new(NC_ERR_OP_FAILED);
-		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
-		return EXIT_FAILURE;
-	}
+	xmlNodePtr target_ds;
+	xmlBufferPtr buf = NULL;
+	int retval = EXIT_SUCCESS;
 
 	/* reload the datastore content */
 	if (file_reload (file_ds)) {
-		UNLOCK(file_ds);
 		return EXIT_FAILURE;
 	}
 	file_rollback_store(file_ds);
@@ -1343,7 +1904,6 @@ int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session,
 		target_ds = file_ds->candidate;
 		break;
 	default:
-		UNLOCK(file_ds);
 		ERROR("%s: invalid target.", __func__);
 		*error = nc_err_new(NC_ERR_BAD_ELEM);
 		nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "target");
@@ -1352,14 +1912,58 @@ int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session,
 	}
 
 	if (file_ds_access (file_ds, target, session) != 0) {
-		UNLOCK(file_ds);
 		*error = nc_err_new (NC_ERR_IN_USE);
 		return EXIT_FAILURE;
 	}
 
+	if (config == NULL) {
+		/* edit_config() modifies the document, so serialize it for the journal now */
+		if ((buf = file_dump_nodes(config_doc, config_doc->children)) == NULL) {
+			*error = nc_err_new(NC_ERR_OP_FAILED);
+			return EXIT_FAILURE;
+		}
+		config = (char*) xmlBufferContent(buf);
+	}
+
+	/* preform edit config */
+	if (file_edit_node(file_ds, target, target_ds, config_doc, defop, errop, (rpc != NULL) ? rpc->nacm : NULL, error)) {
+		retval = EXIT_FAILURE;
+	} else if (file_journal_write(file_ds, JOURNAL_EDIT, target, defop, errop, config)) {
+		/* the change is not stored, do not keep it */
+		file_rollback_revert(file_ds);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
+		retval = EXIT_FAILURE;
+	}
+	xmlBufferFree(buf);
+
+	return retval;
+}
+
+/**
+ * @brief Perform the edit-config operation
+ *
+ * @param ds Datastore to edit
+ * @param session Session sending the edit request
+ * @param rpc
+ * @param target Datastore type
+ * @param config Edit configuration.
+ * @param defop Default edit operation.
+ * @param error Netconf error structure
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, const char * config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error)
+{
+	struct ncds_ds_file * file_ds = (struct ncds_ds_file *)ds;
+	xmlDocPtr config_doc;
+	int retval, ret;
+	const char* configp;
+
+	assert(error);
+
 	if (strncmp(config, "<?xml", 5) == 0) {
 		if ((configp = strchr(config, '>')) == NULL) {
-			UNLOCK(file_ds);
 			ERROR("%s: invalid config.", __func__);
 			*error = nc_err_new(NC_ERR_BAD_ELEM);
 			nc_err_set(*error, NC_ERR_PARAM_INFO_BADELEM, "config");
@@ -1372,72 +1976,44 @@ int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session,
 	} else {
 		configp = config;
 	}
-	if (asprintf(&aux, "<config>%s</config>", configp) == -1) {
-		UNLOCK(file_ds);
-		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
-		*error = nc_err_new(NC_ERR_OP_FAILED);
-		return EXIT_FAILURE;
-	}
 
 	/* read config to XML doc */
-	if ((config_doc = xmlReadMemory (aux, strlen(aux), NULL, NULL, NC_XMLREAD_OPTIONS)) == NULL) {
-		UNLOCK(file_ds);
-		free(aux);
-		ERROR("%s: Reading xml data failed!", __func__);
+	if ((config_doc = file_read_config(configp)) == NULL) {
 		return EXIT_FAILURE;
 	}
-	free(aux);
-	/* magic - get off the root config element and move all children to the 1st level */
-	root = xmlDocGetRootElement(config_doc);
-	for (aux_node = root->children; aux_node != NULL; aux_node = root->children) {
-		xmlUnlinkNode(aux_node);
-		xmlAddNextSibling(config_doc->last, aux_node);
-	}
-	aux_node = root->next;
-	xmlUnlinkNode(root);
-	xmlFreeNode(root);
 
-	/* create an XML doc with a copy of the datastore configuration */
-	datastore_doc = xmlNewDoc (BAD_CAST "1.0");
-	xmlDocSetRootElement(datastore_doc, xmlCopyNode(target_ds->children, 1));
-	if (target_ds->children) {
-		for (root = target_ds->children->next; root != NULL; root = aux_node) {
-			aux_node = root->next;
-			xmlAddNextSibling(datastore_doc->last, xmlCopyNode(root, 1));
-		}
+	/* lock the datastore */
+	LOCK(file_ds, ret);
+	if (ret) {
+		xmlFreeDoc(config_doc);
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
+		return EXIT_FAILURE;
 	}
+	retval = file_editconfig(file_ds, session, rpc, target, config_doc, configp, defop, errop, error);
+	UNLOCK(file_ds);
 
-	/* preform edit config */
-	if (edit_config(datastore_doc, config_doc, (struct ncds_ds*)file_ds, defop, errop, (rpc != NULL) ? rpc->nacm : NULL, error)) {
-		retval = EXIT_FAILURE;
-	} else {
-		/* replace datastore by edited configuration */
-		while ((aux_node = target_ds->children) != NULL) {
-			xmlUnlinkNode(aux_node);
-			xmlFreeNode(aux_node);
-		}
-		xmlAddChildList(target_ds, xmlCopyNodeList(datastore_doc->children));
+	xmlFreeDoc(config_doc);
 
-		/*
-		 * if we are changing candidate, mark it as modified, since we need
-		 * this information for locking - according to RFC, candidate cannot
-		 * be locked since it has been modified and not committed.
-		 */
-		if (target == NC_DATASTORE_CANDIDATE) {
-			xmlSetProp(target_ds, BAD_CAST "modified", BAD_CAST "true");
-		}
+	return retval;
+}
 
-		/* sync xml tree with file on the hdd */
-		if (file_sync(file_ds)) {
-			*error = nc_err_new(NC_ERR_OP_FAILED);
-			nc_err_set(*error, NC_ERR_PARAM_MSG, "Datastore file synchronisation failed.");
-			retval = EXIT_FAILURE;
-		}
+int ncds_file_editconfig_xml(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, xmlDocPtr config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error)
+{
+	struct ncds_ds_file * file_ds = (struct ncds_ds_file *)ds;
+	int retval, ret;
+
+	assert(error);
+
+	/* lock the datastore */
+	LOCK(file_ds, ret);
+	if (ret) {
+		*error = nc_err_new(NC_ERR_OP_FAILED);
+		nc_err_set(*error, NC_ERR_PARAM_MSG, "Locking datastore file timeouted.");
+		return EXIT_FAILURE;
 	}
+	retval = file_editconfig(file_ds, session, rpc, target, config, NULL, defop, errop, error);
 	UNLOCK(file_ds);
 
-	xmlFreeDoc(datastore_doc);
-	xmlFreeDoc(config_doc);
-
 	return retval;
 }
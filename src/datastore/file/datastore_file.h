@@ -42,16 +42,89 @@
 
 #include "../../netconf_internal.h"
 #include "../datastore_internal.h"
-#include <semaphore.h>
 
-/* Unique name prefix of every semaphore created */
+/* Name prefix of the semaphores used as the datastore locks by the older
+ * versions, they are only removed by nc_shared_cleanup() */
 #define NCDS_LOCK "/NCDS_FLOCK"
 
-/* Number of seconds waiting for a semaphore increment before
+/* Number of seconds waiting for the datastore lock before
  * giving up and cancelling the locking
  */
 #define NCDS_LOCK_TIMEOUT 5
 
+/* Unique name prefix of every shared memory object holding the datastore state */
+#define NCDS_SHARED "/NCDS_FSTATE"
+
+/* Version of the ncds_file_shared layout, the shared memory of a different
+ * version is initialized again */
+#define NCDS_SHARED_VERSION 1
+
+/* Size of the buffer for the time of the NETCONF lock */
+#define NCDS_LOCKTIME_SIZE 64
+
+/* Suffix of the journal file kept next to the datastore file */
+#define NCDS_JOURNAL_SUFFIX ".journal"
+
+/* Minimal size of the journal (in bytes) to compact it into the datastore
+ * file. The journal is compacted when it exceeds this size as well as the
+ * size of the datastore file.
+ */
+#define NCDS_JOURNAL_COMPACT_SIZE (1024*1024)
+
+/**
+ * @brief NETCONF lock of a single datastore (running, startup, candidate)
+ */
+struct ncds_file_lock {
+	/**
+	 * @brief Session ID of the session holding the lock, empty string if
+	 * the datastore is not locked
+	 */
+	char sid[SID_SIZE];
+	/**
+	 * @brief Time when the lock was acquired
+	 */
+	char time[NCDS_LOCKTIME_SIZE];
+};
+
+/**
+ * @brief State of the file datastore placed in the shared memory, so it is
+ * shared by all the processes working with the datastore file. It is accessed
+ * only while holding its lock.
+ *
+ * Every change of the datastore is identified by the sequence number of its
+ * journal record, so comparing the sequence numbers tells a process whether
+ * its copy of the datastore is out of date.
+ */
+struct ncds_file_shared {
+	/**
+	 * @brief Layout version (NCDS_SHARED_VERSION), set when the memory is
+	 * initialized
+	 */
+	unsigned int version;
+	/**
+	 * @brief Process-shared robust mutex serializing access to the datastore,
+	 * it is released by the system when its holder dies
+	 */
+	pthread_mutex_t lock;
+	/**
+	 * @brief Sequence number of the last change of the datastore
+	 */
+	unsigned long long seq;
+	/**
+	 * @brief Sequence number of the last change compacted into the datastore
+	 * file, the journal records up to this number were removed.
+	 */
+	unsigned long long compact_seq;
+	/**
+	 * @brief Size of the datastore file after the last compaction
+	 */
+	off_t file_size;
+	/**
+	 * @brief NETCONF locks of the individual datastores
+	 */
+	struct ncds_file_lock running, startup, candidate;
+};
+
 /**
  * @brief File datastore implementation-specific ncds_ds structure.
  */
@@ -69,6 +142,41 @@ struct ncds_ds_file {
 	 * @brief File descriptor of an opened file containing the configuration data
 	 */
 	FILE* file;
+	/**
+	 * @brief Flag whether the xml corresponds to the stored datastore content
+	 * up to the journal_seq. If not, the datastore file must be read again.
+	 */
+	int xml_valid;
+	/**
+	 * @brief Path to the journal file with the changes made since the last
+	 * compaction of the datastore file.
+	 */
+	char* journal_path;
+	/**
+	 * @brief Opened journal file (in append mode).
+	 */
+	FILE* journal;
+	/**
+	 * @brief Sequence number of the last journal record applied to the xml
+	 */
+	unsigned long long journal_seq;
+	/**
+	 * @brief Offset of the first journal record not yet applied to the xml
+	 */
+	off_t journal_offset;
+	/**
+	 * @brief Sequence number of the last compaction known to this process
+	 */
+	unsigned long long compact_seq;
+	/**
+	 * @brief Sequence number of the last change applied to the xml when the
+	 * datastore was accessed (reloaded) for the last time.
+	 */
+	unsigned long long access_seq;
+	/**
+	 * @brief Datastore state shared with the other processes
+	 */
+	struct ncds_file_shared* shared;
 	/**
 	 * libxml2's document structure of the datastore
 	 */
@@ -85,10 +193,6 @@ struct ncds_ds_file {
 	 * locking structure
 	 */
 	struct ds_lock_s {
-		/**
-		 * semaphore pointer
-		 */
-		sem_t * lock;
 		/**
 		 * signal set before locked
 	 	 */
@@ -135,6 +239,17 @@ int ncds_file_rollback(struct ncds_ds* ds);
 */
 char* ncds_file_getconfig(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, struct nc_err** error);
 
+/**
+ * @brief Perform get-config on the specified repository, return the data as XML document.
+ *
+ * @param[in] ds File datastore structure from which the data will be obtained.
+ * @param[in] session Session originating the request.
+ * @param[in] source Datastore (running, startup, candidate) to get the data from.
+ * @param[out] error NETCONF error structure describing the experienced error.
+ * @return NULL on error, copy of the configuration data on success.
+*/
+xmlDocPtr ncds_file_getconfig_xml(struct ncds_ds* ds, const struct nc_session* session, NC_DATASTORE source, struct nc_err** error);
+
 /**
  * @brief Get lock information about the specified NETCONF datastore
  * @param[in] ds File datastore structure that will be checked.
@@ -213,4 +328,18 @@ int ncds_file_deleteconfig(struct ncds_ds * ds, const struct nc_session * sessio
  */
 int ncds_file_editconfig(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, const char * config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error);
 
+/**
+ * @brief Perform the edit-config operation with the edit data in the form of XML document
+ *
+ * @param[in] ds File datastore to edit
+ * @param[in] session Session sending the edit request
+ * @param[in] rpc RPC message with the request. RPC message is used only for access control. If rpc is NULL access control is skipped.
+ * @param[in] target Datastore type
+ * @param[in] config Edit configuration document.
+ * @param[in] defop Default edit operation.
+ * @param[out] error NETCONF error structure describing the experienced error.
+ * @return 0 on success, non-zero on error and error structure is filled.
+ */
+int ncds_file_editconfig_xml(struct ncds_ds *ds, const struct nc_session * session, const nc_rpc* rpc, NC_DATASTORE target, xmlDocPtr config, NC_EDIT_DEFOP_TYPE defop, NC_EDIT_ERROPT_TYPE errop, struct nc_err **error);
+
 #endif /* NC_DATASTORE_FILE_H_ */
@@ -150,6 +150,23 @@ int ncds_set_validation2(struct ncds_ds* ds, int enable, const char* relaxng,
     const char* schematron,
     int (*valid_func)(const xmlDocPtr config, struct nc_err **err));
 
+/**
+ * @ingroup store
+ * @brief Get the subtree filter of the \<get\> request being processed.
+ *
+ * To make this function available, you have to include libnetconf_xml.h.
+ *
+ * The function is supposed to be called from the get_state callback functions
+ * (including the transAPI ones). The state data not selected by the filter are
+ * removed from the reply anyway, so the callback can use the filter to skip
+ * generating them.
+ *
+ * @return The \<filter\> element of the request, NULL if the request has no
+ * subtree filter and all the state data are requested. The element is valid
+ * only during the callback and it must not be modified or freed.
+ */
+xmlNodePtr ncds_get_state_filter_xml(void);
+
 #ifdef __cplusplus
 }
 #endif
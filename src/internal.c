@@ -299,7 +299,7 @@ static int nc_apps_check(const char* comm, struct nc_apps* apps) {
 }
 
 static int nc_shared_cleanup(int del_shm) {
-	char path[256], lock_prefix[32];
+	char path[256], lock_prefix[32], state_prefix[32];
 	struct dirent* dr;
 	DIR* dir;
 
@@ -313,20 +313,22 @@ static int nc_shared_cleanup(int del_shm) {
 		return (-1);
 	}
 
-	/* remove semaphores */
+	/* remove the datastore states and the semaphores left by older versions */
 	strcpy(lock_prefix, NCDS_LOCK);
 	memmove(lock_prefix+4, lock_prefix+1, strlen(lock_prefix));
 	memcpy(lock_prefix, "sem.", 4);
+	strcpy(state_prefix, NCDS_SHARED + 1);
 
 	if ((dir = opendir("/dev/shm")) == NULL) {
 		/* let's just ignore this fail */
 		DBG("Failed to open semaphore directory \"/dev/shm\" (%s).", strerror(errno));
 	} else {
 		while ((dr = readdir(dir))) {
-			if (strncmp(dr->d_name, lock_prefix, strlen(lock_prefix)) == 0) {
+			if (strncmp(dr->d_name, lock_prefix, strlen(lock_prefix)) == 0 ||
+					strncmp(dr->d_name, state_prefix, strlen(state_prefix)) == 0) {
 				sprintf(path, "/dev/shm/%s", dr->d_name);
 				if (unlink(path) == -1) {
-					DBG("Failed to remove semaphore \"%s\" (%s).", path, strerror(errno));
+					DBG("Failed to remove shared object \"%s\" (%s).", path, strerror(errno));
 				}
 			}
 		}
@@ -428,7 +428,11 @@
  * When the NETCONF rpc is sent, use nc_session_recv_reply() to receive the
  * reply. To learn when the reply is coming, a file descriptor of the
  * communication channel can be checked by poll(), select(), ... This descriptor
- * can be obtained via nc_session_get_eventfd() function.
+ * can be obtained via nc_session_get_eventfd() function. A reply to a specific
+ * request can be received by nc_session_recv_reply_msgid().\n
+ * To pipeline many requests without waiting for each reply, send them by
+ * nc_session_send_rpc_async() and let nc_session_process_replies() pass the
+ * replies to the specified callbacks as they come.
  * -# **Close the NETCONF session**.\n
  * When the communication is done, the NETCONF session should be freed (session
  * is also properly closed) via  nc_session_free() function.
@@ -1261,9 +1265,11 @@
  * libnetconf can stay unlocked so a consequent call to a libnetconf function
  * can cause application freeze. To recover from this state, a developer has to
  * manually unlock the locks removing the following files.
- *  - /dev/shm/sem.NCDS_FLOCK_*
  *  - /var/lib/libnetconf/libnetconf_sessions.bin
  *
+ * The locks of the file datastores (kept in /dev/shm/NCDS_FSTATE_*) are
+ * recovered automatically when their holder dies.
+ *
  * Note that before removing the locks manually, all applications using
  * libnetconf should be stopped.
  */
@@ -118,6 +118,7 @@ static struct nc_filter *nc_filter_new_subtree(const xmlNodePtr filter)
 	}
 
 	retval->type = NC_FILTER_SUBTREE;
+	retval->compiled = NULL;
 	retval->subtree_filter = xmlNewNode(NULL, BAD_CAST "filter");
 	if (retval->subtree_filter == NULL) {
 		ERROR("xmlNewNode failed (%s:%d).", __FILE__, __LINE__);
@@ -219,6 +220,7 @@ API void nc_filter_free(struct nc_filter* filter)
 		if (filter->subtree_filter) {
 			xmlFreeNode(filter->subtree_filter);
 		}
+		ncxml_filter_compiled_free(filter->compiled);
 		free(filter);
 	}
 }
@@ -339,9 +341,11 @@ static struct nc_msg* ncxml_msg_build(xmlDocPtr msg_dump)
 
 	msg->doc = msg_dump;
 	msg->next = NULL;
+	msg->prev = NULL;
 	msg->error = NULL;
 	msg->with_defaults = NCWD_MODE_NOTSET;
 	msg->type.rpc = 0;
+	msg->envelope.valid = 0;
 
 	if ((id = nc_msg_parse_msgid (msg)) != NULL) {
 		msg->msgid = strdup(id);
@@ -381,6 +385,152 @@ static struct nc_msg* ncxml_msg_build(xmlDocPtr msg_dump)
 	return (msg);
 }
 
+/*
+ * Get the value of the edit-config's parameter as the position of its content
+ * in the values list (starting with 1), -1 if the value is invalid.
+ */
+static int nc_rpc_envelope_value(xmlNodePtr node, const char* values[])
+{
+	int i;
+
+	if (node->children == NULL || node->children->type != XML_TEXT_NODE || node->children->content == NULL) {
+		return (-1);
+	}
+	for (i = 0; values[i] != NULL; i++) {
+		if (xmlStrEqual(node->children->content, BAD_CAST values[i])) {
+			return (i + 1);
+		}
+	}
+
+	return (-1);
+}
+
+void nc_rpc_parse_envelope(nc_rpc* rpc)
+{
+	static const char* defops[] = {"merge", "replace", "none", NULL};
+	static const char* erropts[] = {"stop-on-error", "continue-on-error", "rollback-on-error", NULL};
+	static const char* testopts[] = {"test-then-set", "set", "test-only", NULL};
+	static const char* wdmodes[] = {"report-all", "report-all-tagged", "trim", "explicit", NULL};
+	static const NCWD_MODE wdvalues[] = {NCWD_MODE_ALL, NCWD_MODE_ALL_TAGGED, NCWD_MODE_TRIM, NCWD_MODE_EXPLICIT};
+	/* the order of the datastores as they are checked by the XPath queries in nc_rpc_assign_ds() */
+	static const char* dsnames[] = {"candidate", "running", "startup", "url", "config", NULL};
+	static const NC_DATASTORE dsvalues[] = {NC_DATASTORE_CANDIDATE, NC_DATASTORE_RUNNING, NC_DATASTORE_STARTUP, NC_DATASTORE_URL, NC_DATASTORE_CONFIG};
+	xmlNodePtr root, op, param, node;
+	xmlNodePtr defop = NULL, erropt = NULL, testopt = NULL, wd = NULL;
+	int defop_count = 0, erropt_count = 0, testopt_count = 0, wd_count = 0;
+	int src_count[5] = {0, 0, 0, 0, 0}, trg_count[5] = {0, 0, 0, 0, 0}, *count, i;
+	int base_op;
+	xmlChar* content;
+
+	if (rpc == NULL || rpc->doc == NULL) {
+		return;
+	}
+
+	memset(&rpc->envelope, 0, sizeof(struct nc_rpc_envelope));
+	rpc->envelope.valid = 1;
+
+	if ((root = xmlDocGetRootElement(rpc->doc)) == NULL || !xmlStrEqual(root->name, BAD_CAST "rpc")
+			|| root->ns == NULL || !xmlStrEqual(root->ns->href, BAD_CAST NC_NS_BASE10)) {
+		return;
+	}
+
+	/* walk through the parameters of the operation only once */
+	for (op = root->children; op != NULL; op = op->next) {
+		if (op->type != XML_ELEMENT_NODE) {
+			continue;
+		}
+		base_op = (op->ns != NULL && xmlStrEqual(op->ns->href, BAD_CAST NC_NS_BASE10));
+
+		for (param = op->children; param != NULL; param = param->next) {
+			if (param->type != XML_ELEMENT_NODE || param->ns == NULL) {
+				continue;
+			}
+
+			if (xmlStrEqual(param->ns->href, BAD_CAST NC_NS_BASE10)) {
+				if (xmlStrEqual(param->name, BAD_CAST "source") || xmlStrEqual(param->name, BAD_CAST "target")) {
+					count = (param->name[0] == 's') ? src_count : trg_count;
+					for (node = param->children; node != NULL; node = node->next) {
+						if (node->type != XML_ELEMENT_NODE || node->ns == NULL || !xmlStrEqual(node->ns->href, BAD_CAST NC_NS_BASE10)) {
+							continue;
+						}
+						for (i = 0; dsnames[i] != NULL; i++) {
+							if (xmlStrEqual(node->name, BAD_CAST dsnames[i])) {
+								count[i]++;
+								break;
+							}
+						}
+					}
+				} else if (base_op && xmlStrEqual(op->name, BAD_CAST "edit-config")) {
+					if (xmlStrEqual(param->name, BAD_CAST "default-operation")) {
+						defop = param;
+						defop_count++;
+					} else if (xmlStrEqual(param->name, BAD_CAST "error-option")) {
+						erropt = param;
+						erropt_count++;
+					} else if (xmlStrEqual(param->name, BAD_CAST "test-option")) {
+						testopt = param;
+						testopt_count++;
+					}
+				} else if (base_op && xmlStrEqual(param->name, BAD_CAST "filter")
+						&& (xmlStrEqual(op->name, BAD_CAST "get") || xmlStrEqual(op->name, BAD_CAST "get-config"))) {
+					if (rpc->envelope.filter_count++ == 0) {
+						rpc->envelope.filter = param;
+					}
+				}
+			} else if (xmlStrEqual(param->ns->href, BAD_CAST NC_NS_NOTIFICATIONS)) {
+				if (xmlStrEqual(param->name, BAD_CAST "filter") && xmlStrEqual(op->name, BAD_CAST "create-subscription")
+						&& op->ns != NULL && xmlStrEqual(op->ns->href, BAD_CAST NC_NS_NOTIFICATIONS)) {
+					if (rpc->envelope.filter_count++ == 0) {
+						rpc->envelope.filter = param;
+					}
+				}
+			} else if (xmlStrEqual(param->ns->href, BAD_CAST NC_NS_WITHDEFAULTS)) {
+				if (xmlStrEqual(param->name, BAD_CAST "with-defaults")) {
+					wd = param;
+					wd_count++;
+				}
+			}
+		}
+	}
+
+	/* the datastore is recognized only when it is specified exactly once */
+	rpc->envelope.source = rpc->envelope.target = NC_DATASTORE_ERROR;
+	for (i = 0; dsnames[i] != NULL; i++) {
+		if (src_count[i] == 1 && rpc->envelope.source == NC_DATASTORE_ERROR) {
+			rpc->envelope.source = dsvalues[i];
+		}
+		if (trg_count[i] == 1 && rpc->envelope.target == NC_DATASTORE_ERROR) {
+			rpc->envelope.target = dsvalues[i];
+		}
+	}
+
+	if (defop_count > 1) {
+		rpc->envelope.defop = NC_EDIT_DEFOP_ERROR;
+	} else if (defop != NULL) {
+		rpc->envelope.defop = nc_rpc_envelope_value(defop, defops);
+	}
+	if (erropt_count > 1) {
+		rpc->envelope.erropt = NC_EDIT_ERROPT_ERROR;
+	} else if (erropt != NULL) {
+		rpc->envelope.erropt = nc_rpc_envelope_value(erropt, erropts);
+	}
+	if (testopt_count > 1) {
+		rpc->envelope.testopt = NC_EDIT_TESTOPT_ERROR;
+	} else if (testopt != NULL) {
+		rpc->envelope.testopt = nc_rpc_envelope_value(testopt, testopts);
+	}
+
+	if (wd_count == 1 && rpc->with_defaults == NCWD_MODE_NOTSET) {
+		if ((i = nc_rpc_envelope_value(wd, wdmodes)) > 0) {
+			rpc->with_defaults = wdvalues[i - 1];
+		} else {
+			content = xmlNodeGetContent(wd);
+			WARN("%s: unknown with-defaults mode detected (%s), disabling with-defaults.", __func__, content);
+			xmlFree(content);
+		}
+	}
+}
+
 NCWD_MODE nc_rpc_parse_withdefaults(nc_rpc* rpc, const struct nc_session* session)
 {
 	xmlXPathContextPtr rpc_ctxt = NULL;
@@ -392,7 +542,7 @@ NCWD_MODE nc_rpc_parse_withdefaults(nc_rpc* rpc, const struct nc_session* sessio
 		return (NCWD_MODE_NOTSET);
 	}
 
-	if (rpc->with_defaults != NCWD_MODE_NOTSET) {
+	if (rpc->with_defaults != NCWD_MODE_NOTSET || rpc->envelope.valid) {
 		/* already known */
 		return (rpc->with_defaults);
 	}
@@ -511,6 +661,9 @@ static nc_rpc* _rpc_build(int libxml2, const struct nc_session* session, const c
 	/* assign operation value */
 	op = nc_rpc_assign_op(rpc);
 
+	/* decode the operation parameters */
+	nc_rpc_parse_envelope(rpc);
+
 	/* assign source/target datastore types */
 	if (op == NC_OP_GETCONFIG || op == NC_OP_COPYCONFIG || op == NC_OP_VALIDATE) {
 		if (!nc_rpc_assign_ds(rpc, "source")) {
@@ -555,8 +708,8 @@ API nc_rpc* ncxml_rpc_build(xmlDocPtr rpc_dump, const struct nc_session* session
 
 NC_REPLY_TYPE nc_reply_parse_type(nc_reply* reply)
 {
-	xmlXPathObjectPtr query_result = NULL;
-	xmlNodePtr node;
+	xmlNodePtr root, node;
+	int ok = 0, error = 0, data = 0;
 
 	if (reply == NULL) {
 		return (NC_REPLY_UNKNOWN);
@@ -565,34 +718,37 @@ NC_REPLY_TYPE nc_reply_parse_type(nc_reply* reply)
 	/* set default value */
 	reply->type.reply = NC_REPLY_UNKNOWN;
 
-	/* try to detect the type from the message body */
-	if ((query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc-reply/"NC_NS_BASE10_ID":ok", reply->ctxt)) != NULL) {
-		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval) && query_result->nodesetval->nodeNr == 1) {
-			reply->type.reply = NC_REPLY_OK;
-		}
-		xmlXPathFreeObject(query_result);
+	if ((root = xmlDocGetRootElement(reply->doc)) == NULL || !xmlStrEqual(root->name, BAD_CAST "rpc-reply")
+			|| root->ns == NULL || !xmlStrEqual(root->ns->href, BAD_CAST NC_NS_BASE10)) {
+		return (NC_REPLY_UNKNOWN);
 	}
-	if (reply->type.reply == NC_REPLY_UNKNOWN && (query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc-reply/"NC_NS_BASE10_ID":rpc-error", reply->ctxt)) != NULL) {
-		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
-			reply->type.reply = NC_REPLY_ERROR;
-			nc_err_parse(reply);
+
+	/* try to detect the type from the message body in a single pass */
+	for (node = root->children; node != NULL; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE) {
+			continue;
 		}
-		xmlXPathFreeObject(query_result);
-	}
-	/* NOTE: data element's namespace can vary (e.g. for get-schema) */
-	if (reply->type.reply == NC_REPLY_UNKNOWN && (query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc-reply", reply->ctxt)) != NULL) {
-		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval) && query_result->nodesetval->nodeNr == 1) {
-			for (node = query_result->nodesetval->nodeTab[0]->children; node != NULL; node = node->next) {
-				if (node->type != XML_ELEMENT_NODE) {
-					continue;
-				}
-				if (xmlStrcmp(node->name, BAD_CAST "data") == 0) {
-					reply->type.reply = NC_REPLY_DATA;
-					break;
-				}
-			}
+		/* NOTE: data element's namespace can vary (e.g. for get-schema) */
+		if (xmlStrEqual(node->name, BAD_CAST "data")) {
+			data++;
 		}
-		xmlXPathFreeObject(query_result);
+		if (node->ns == NULL || !xmlStrEqual(node->ns->href, BAD_CAST NC_NS_BASE10)) {
+			continue;
+		}
+		if (xmlStrEqual(node->name, BAD_CAST "ok")) {
+			ok++;
+		} else if (xmlStrEqual(node->name, BAD_CAST "rpc-error")) {
+			error++;
+		}
+	}
+
+	if (ok == 1) {
+		reply->type.reply = NC_REPLY_OK;
+	} else if (error > 0) {
+		reply->type.reply = NC_REPLY_ERROR;
+		nc_err_parse(reply);
+	} else if (data > 0) {
+		reply->type.reply = NC_REPLY_DATA;
 	}
 
 	return (reply->type.reply);
@@ -950,6 +1106,12 @@ NC_DATASTORE nc_rpc_assign_ds(nc_rpc* rpc, const char* ds_type)
 		return NC_DATASTORE_ERROR;
 	}
 
+	if (rpc->envelope.valid) {
+		/* already decoded by nc_rpc_parse_envelope() */
+		*rpcstore = (rpcstore == &(rpc->source)) ? rpc->envelope.source : rpc->envelope.target;
+		return (*rpcstore);
+	}
+
 	for (i = 0; i < nc_rpc_get_ds_RETVALS_COUNT; i++) {
 		if ((query_result = xmlXPathEvalExpression(BAD_CAST queries[i], rpc->ctxt)) != NULL) {
 			if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval) && query_result->nodesetval->nodeNr == 1) {
@@ -1343,6 +1505,13 @@ API NC_EDIT_DEFOP_TYPE nc_rpc_get_defop(const nc_rpc* rpc)
 	xmlNodePtr defop = NULL;
 	NC_EDIT_DEFOP_TYPE retval = NC_EDIT_DEFOP_NOTSET;
 
+	if (rpc->envelope.valid) {
+		if (rpc->envelope.defop == NC_EDIT_DEFOP_ERROR) {
+			ERROR("%s: invalid default-operation parameter of the edit-config request", __func__);
+		}
+		return (rpc->envelope.defop);
+	}
+
 	if ((query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":edit-config/"NC_NS_BASE10_ID":default-operation", rpc->ctxt)) != NULL) {
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
 			if (query_result->nodesetval->nodeNr > 1) {
@@ -1380,6 +1549,13 @@ API NC_EDIT_ERROPT_TYPE nc_rpc_get_erropt(const nc_rpc* rpc)
 	xmlNodePtr erropt = NULL;
 	NC_EDIT_ERROPT_TYPE retval = NC_EDIT_ERROPT_NOTSET;
 
+	if (rpc->envelope.valid) {
+		if (rpc->envelope.erropt == NC_EDIT_ERROPT_ERROR) {
+			ERROR("%s: invalid error-option parameter of the edit-config request", __func__);
+		}
+		return (rpc->envelope.erropt);
+	}
+
 	if ((query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":edit-config/"NC_NS_BASE10_ID":error-option", rpc->ctxt)) != NULL) {
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
 			if (query_result->nodesetval->nodeNr > 1) {
@@ -1417,6 +1593,13 @@ API NC_EDIT_TESTOPT_TYPE nc_rpc_get_testopt(const nc_rpc* rpc)
 	xmlNodePtr testopt = NULL;
 	NC_EDIT_TESTOPT_TYPE retval = NC_EDIT_TESTOPT_NOTSET;
 
+	if (rpc->envelope.valid) {
+		if (rpc->envelope.testopt == NC_EDIT_TESTOPT_ERROR) {
+			ERROR("%s: invalid test-option parameter of the edit-config request", __func__);
+		}
+		return (rpc->envelope.testopt);
+	}
+
 	if ((query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":edit-config/"NC_NS_BASE10_ID":test-option", rpc->ctxt)) != NULL) {
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
 			if (query_result->nodesetval->nodeNr > 1) {
@@ -1456,6 +1639,16 @@ API struct nc_filter* nc_rpc_get_filter(const nc_rpc* rpc)
 	xmlChar *type_string;
 	char* query;
 
+	if (rpc->envelope.valid) {
+		/* already decoded by nc_rpc_parse_envelope() */
+		if (rpc->envelope.filter_count > 1) {
+			ERROR("%s: multiple filter elements found", __func__);
+			return (NULL);
+		}
+		filter_node = rpc->envelope.filter;
+		goto create;
+	}
+
 	query = "/"NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":get/"NC_NS_BASE10_ID":filter | /"
 			NC_NS_BASE10_ID":rpc/"NC_NS_BASE10_ID":get-config/"NC_NS_BASE10_ID":filter | /"
 			NC_NS_BASE10_ID":rpc/"NC_NS_NOTIFICATIONS_ID":create-subscription/"NC_NS_NOTIFICATIONS_ID":filter";
@@ -1471,8 +1664,10 @@ API struct nc_filter* nc_rpc_get_filter(const nc_rpc* rpc)
 		xmlXPathFreeObject(query_result);
 	}
 
+create:
 	if (filter_node != NULL) {
 		retval = malloc(sizeof(struct nc_filter));
+		retval->compiled = NULL;
 		type_string = xmlGetProp(filter_node, BAD_CAST "type");
 		/* set filter type */
 		if (type_string == NULL || xmlStrcmp(type_string, BAD_CAST "subtree") == 0) {
@@ -1642,7 +1837,6 @@ API const char* nc_reply_get_errormsg(const nc_reply* reply)
 void nc_msg_free(struct nc_msg* msg)
 {
 	struct nc_err* e, *efree;
-	int i;
 
 	if (msg != NULL && msg != NCDS_RPC_NOT_APPLICABLE) {
 		if (msg->doc != NULL) {
@@ -1661,13 +1855,7 @@ void nc_msg_free(struct nc_msg* msg)
 		if (msg->msgid != NULL) {
 			free(msg->msgid);
 		}
-		if (msg->nacm != NULL) {
-			for (i = 0; msg->nacm->rule_lists != NULL && msg->nacm->rule_lists[i] != NULL; i++) {
-				nacm_rule_list_free(msg->nacm->rule_lists[i]);
-			}
-			free(msg->nacm->rule_lists);
-			free(msg->nacm);
-		}
+		nacm_rpc_free(msg->nacm);
 		free(msg);
 	}
 }
@@ -1682,7 +1870,7 @@ API void nc_reply_free(nc_reply *reply)
 	nc_msg_free((struct nc_msg*) reply);
 }
 
-struct nc_msg *nc_msg_dup(struct nc_msg *msg)
+static struct nc_msg *nc_msg_dup_doc(struct nc_msg *msg, int nodict)
 {
 	struct nc_msg *dupmsg;
 
@@ -1695,21 +1883,19 @@ struct nc_msg *nc_msg_dup(struct nc_msg *msg)
 		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
 		return (NULL);
 	}	
-	dupmsg->doc = xmlCopyDoc(msg->doc, 1);
+	if (nodict) {
+		/* the copied nodes get their own strings instead of the original document's dictionary */
+		dupmsg->doc = xmlNewDoc(BAD_CAST "1.0");
+		xmlDocSetRootElement(dupmsg->doc, xmlDocCopyNode(xmlDocGetRootElement(msg->doc), dupmsg->doc, 1));
+	} else {
+		dupmsg->doc = xmlCopyDoc(msg->doc, 1);
+	}
 	dupmsg->type = msg->type;
 	dupmsg->with_defaults = msg->with_defaults;
 	dupmsg->op = msg->op;
 	dupmsg->source = msg->source;
 	dupmsg->target = msg->target;
-	if (msg->nacm != NULL) {
-		dupmsg->nacm = malloc(sizeof(struct nacm_rpc));
-		dupmsg->nacm->default_exec = msg->nacm->default_exec;
-		dupmsg->nacm->default_read = msg->nacm->default_read;
-		dupmsg->nacm->default_write = msg->nacm->default_write;
-		dupmsg->nacm->rule_lists = nacm_rule_lists_dup(msg->nacm->rule_lists);
-	} else {
-		dupmsg->nacm = NULL;
-	}
+	dupmsg->nacm = nacm_rpc_dup(msg->nacm);
 	if (msg->msgid != NULL) {
 		dupmsg->msgid = strdup(msg->msgid);
 	} else {
@@ -1750,9 +1936,24 @@ struct nc_msg *nc_msg_dup(struct nc_msg *msg)
 		return NULL;
 	}
 
+	if (msg->envelope.valid) {
+		/* the decoded parameters point into the original document */
+		nc_rpc_parse_envelope(dupmsg);
+	}
+
 	return (dupmsg);
 }
 
+struct nc_msg *nc_msg_dup(struct nc_msg *msg)
+{
+	return (nc_msg_dup_doc(msg, 0));
+}
+
+struct nc_msg *nc_msg_dup_nodict(struct nc_msg *msg)
+{
+	return (nc_msg_dup_doc(msg, 1));
+}
+
 API nc_rpc *nc_rpc_dup(const nc_rpc* rpc)
 {
 	return ((nc_rpc*)nc_msg_dup((struct nc_msg*)rpc));
@@ -1851,6 +2052,10 @@ static struct nc_msg* nc_msg_create(const xmlNodePtr content, char* msgtype)
 	xmlDOMWrapReconcileNamespaces(NULL, msg->doc->children, 1);
 #endif
 
+	if (strcmp(msgtype, "rpc") == 0) {
+		nc_rpc_parse_envelope(msg);
+	}
+
 	return (msg);
 }
 
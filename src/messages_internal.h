@@ -87,6 +87,15 @@ NC_DATASTORE nc_rpc_assign_ds(nc_rpc* rpc, const char* ds_type);
  */
 NC_REPLY_TYPE nc_reply_parse_type(nc_reply* reply);
 
+/**
+ * @brief Decode the parameters of the RPC operation (source and target
+ * datastores, edit-config options, filter and with-defaults) in a single pass
+ * through the message. The getters then only read the stored values.
+ *
+ * @param[in] rpc RPC message to decode.
+ */
+void nc_rpc_parse_envelope(nc_rpc* rpc);
+
 /**
  * @brief Parse rpc and get with-defaults mode
  * @param[in] rpc NETCONF rpc message to be parsed
@@ -115,4 +124,12 @@ void nc_msg_free(struct nc_msg *msg);
  */
 struct nc_msg *nc_msg_dup(struct nc_msg *msg);
 
+/**
+ * @brief Duplicate a message so that the copy does not share the libxml2
+ * dictionary with the original and it can be processed in another thread.
+ * @param[in] msg Message to duplicate.
+ * @return The copy of the given NETCONF message.
+ */
+struct nc_msg *nc_msg_dup_nodict(struct nc_msg *msg);
+
 #endif /* NC_MESSAGES_INTERNAL_H_ */
@@ -43,6 +43,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 #include <libxml/tree.h>
 #include <libxml/parser.h>
@@ -84,8 +85,13 @@ struct nacm_ns {
 struct nacm_path {
 	char* path;
 	struct nacm_ns* ns_list;
+	xmlXPathCompExprPtr expr; /* compiled path, NULL if the path is invalid */
+	unsigned int refs; /* number of rules sharing the path */
 };
 
+/* lock for the reference counters of the shared paths */
+static pthread_mutex_t nacm_path_lock = PTHREAD_MUTEX_INITIALIZER;
+
 struct nacm_rule {
 	char* module;
 	NACM_RULE_TYPE type;
@@ -117,18 +123,58 @@ static struct nacm_config {
 	bool external_groups;
 	struct nacm_group** groups;
 	struct rule_list** rule_lists;
-} nacm_config = {false, false, true, false, true, NULL, NULL};
+	unsigned int generation; /* changed with every reload of the configuration */
+} nacm_config = {false, false, true, false, true, NULL, NULL, 0};
+
+/*
+ * lock for the nacm_config, the configuration is read by many threads at once
+ * (e.g. by the workers of the rpc dispatcher) and it is replaced as a whole by
+ * nacm_config_refresh()
+ */
+static pthread_rwlock_t nacm_config_lock = PTHREAD_RWLOCK_INITIALIZER;
+/* serialize the reloads of the configuration */
+static pthread_mutex_t nacm_refresh_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* maximal number of the users' NACM structures kept in the cache */
+#define NACM_CACHE_SIZE 32
+
+/*
+ * cache of the NACM structures prepared for the users, the key is the user
+ * name, list of the user's system groups and the configuration generation
+ */
+struct nacm_cache_item {
+	char* username;
+	char** groups;
+	unsigned int generation;
+	struct nacm_rpc* nacm;
+	struct nacm_cache_item* next;
+};
+static struct nacm_cache_item* nacm_cache = NULL;
+
+/* lock for the cache and the reference counters of the NACM structures */
+static pthread_mutex_t nacm_cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* access to the NACM statistics */
 extern struct nc_shared_info *nc_info;
 
 static int nacm_config_refresh(void);
+static void nacm_cache_clean(void);
 
 static void nacm_path_free(struct nacm_path* path)
 {
 	struct nacm_ns* aux;
+	unsigned int refs;
 
 	if (path != NULL) {
+		pthread_mutex_lock(&nacm_path_lock);
+		refs = --path->refs;
+		pthread_mutex_unlock(&nacm_path_lock);
+		if (refs > 0) {
+			/* path is still used by another rule */
+			return;
+		}
+
+		xmlXPathFreeCompExpr(path->expr);
 		free(path->path);
 		for (aux = path->ns_list; aux!= NULL; aux = path->ns_list) {
 			path->ns_list = aux->next;
@@ -159,10 +205,16 @@ static struct nacm_path* nacm_path_parse(xmlNodePtr node)
 	}
 
 	retval->ns_list = NULL;
+	retval->expr = NULL;
+	retval->refs = 1;
 	if ((retval->path = nc_clrwspace((char*)node->children->content)) == NULL) {
 		free(retval);
 		return (NULL);
 	}
+	/* compile the path once for all the checks */
+	if ((retval->expr = xmlXPathCompile(BAD_CAST retval->path)) == NULL) {
+		WARN("%s: Unable to compile path \"%s\"", __func__, retval->path);
+	}
 	ns = xmlGetNsList(node->doc, node);
 
 	for(i = 0; ns != NULL && ns[i] != NULL; i++) {
@@ -199,35 +251,16 @@ static struct nacm_path* nacm_path_parse(xmlNodePtr node)
 
 static struct nacm_path* nacm_path_dup(struct nacm_path* orig)
 {
-	struct nacm_path *new;
-	struct nacm_ns *ns, *ns_new;
-
 	if (orig == NULL || orig->path == NULL) {
 		return (NULL);
 	}
 
-	new = malloc(sizeof(struct nacm_path));
-	if (new == NULL) {
-		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-		return (NULL);
-	}
-	new->path = strdup(orig->path);
-	new->ns_list = NULL;
-
-	for(ns = orig->ns_list; ns != NULL; ns = ns->next) {
-		ns_new = malloc(sizeof(struct nacm_ns));
-		if (ns_new == NULL) {
-			ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-			nacm_path_free(new);
-			return (NULL);
-		}
-		ns_new->prefix = strdup(ns->prefix);
-		ns_new->href = strdup(ns->href);
-		ns_new->next = new->ns_list;
-		new->ns_list = ns_new;
-	}
+	/* path is never modified, so share it including the compiled expression */
+	pthread_mutex_lock(&nacm_path_lock);
+	orig->refs++;
+	pthread_mutex_unlock(&nacm_path_lock);
 
-	return (new);
+	return (orig);
 }
 
 static void nacm_group_free(struct nacm_group* g)
@@ -274,7 +307,7 @@ static void nacm_rule_free(struct nacm_rule* r)
 	}
 }
 
-void nacm_rule_list_free(struct rule_list* rl)
+static void nacm_rule_list_free(struct rule_list* rl)
 {
 	int i;
 
@@ -382,34 +415,6 @@ static struct rule_list* nacm_rule_list_dup(struct rule_list* r)
 	return (new);
 }
 
-struct rule_list** nacm_rule_lists_dup(struct rule_list** list)
-{
-	int i;
-	struct rule_list** new;
-
-	if (list == NULL) {
-		return (NULL);
-	}
-
-	for(i = 0; list[i] != NULL; i++);
-	new = malloc((i+1) * sizeof(struct rule_list*));
-	if (new == NULL) {
-		return (NULL);
-	}
-	for(i = 0; list[i] != NULL; i++) {
-		new[i] = nacm_rule_list_dup(list[i]);
-		if (new[i] == NULL) {
-			for(i--; i >= 0; i--) {
-				nacm_rule_list_free(new[i]);
-			}
-			return (NULL);
-		}
-	}
-	new[i] = NULL; /* list terminating NULL byte */
-
-	return (new);
-}
-
 static struct nacm_rule* nacm_get_rule(xmlNodePtr rulenode)
 {
 	xmlNodePtr node;
@@ -543,6 +548,20 @@ static struct nacm_rule* nacm_get_rule(xmlNodePtr rulenode)
 	return (rule);
 }
 
+static void nacm_config_free(struct nacm_group** groups, struct rule_list** rule_lists)
+{
+	int i;
+
+	for (i = 0; groups != NULL && groups[i] != NULL; i++) {
+		nacm_group_free(groups[i]);
+	}
+	free(groups);
+	for (i = 0; rule_lists != NULL && rule_lists[i] != NULL; i++) {
+		nacm_rule_list_free(rule_lists[i]);
+	}
+	free(rule_lists);
+}
+
 int nacm_init(void)
 {
 	if (nacm_initiated == 1) {
@@ -560,26 +579,22 @@ int nacm_init(void)
 
 void nacm_close(void)
 {
-	int i;
+	struct nacm_group** groups;
+	struct rule_list** rule_lists;
 
 	if (nacm_initiated == 0) {
 		return;
 	}
 
-	if (nacm_config.groups != NULL) {
-		for (i = 0; nacm_config.groups[i] != NULL; i++) {
-			nacm_group_free(nacm_config.groups[i]);
-		}
-		free(nacm_config.groups);
-		nacm_config.groups = NULL;
-	}
-	if (nacm_config.rule_lists != NULL) {
-		for (i = 0; nacm_config.rule_lists[i] != NULL; i++) {
-			nacm_rule_list_free(nacm_config.rule_lists[i]);
-		}
-		free(nacm_config.rule_lists);
-		nacm_config.rule_lists = NULL;
-	}
+	pthread_rwlock_wrlock(&nacm_config_lock);
+	groups = nacm_config.groups;
+	rule_lists = nacm_config.rule_lists;
+	nacm_config.groups = NULL;
+	nacm_config.rule_lists = NULL;
+	pthread_rwlock_unlock(&nacm_config_lock);
+
+	nacm_config_free(groups, rule_lists);
+	nacm_cache_clean();
 	nacm_initiated = 0;
 }
 
@@ -606,6 +621,8 @@ static int check_query_result(xmlXPathObjectPtr query_result, const char* object
 
 /**
  * @brief Refresh internal structures according to the NACM configuration data.
+ * The new configuration is parsed aside and then it replaces the current one
+ * under nacm_config_lock, so the readers never see it partially changed.
  * @return 0 on success, -1 on error
  */
 static int nacm_config_refresh(void)
@@ -619,10 +636,11 @@ static int nacm_config_refresh(void)
 	xmlDocPtr data_doc = NULL;
 	int i, j, gl, rl, gc, rc;
 	bool allgroups;
-	struct nacm_group* gr;
-	struct rule_list* rlist;
+	struct nacm_group* gr, **gr_list;
+	struct rule_list* rlist, **rl_list;
 	struct nacm_rule** new_rules;
 	struct nc_err *e = NULL;
+	struct nacm_config config = {false, false, true, false, true, NULL, NULL, 0};
 
 	if (nacm_initiated == 0) {
 		ERROR("%s: NACM Subsystem not initialized.", __func__);
@@ -634,27 +652,38 @@ static int nacm_config_refresh(void)
 		return (EXIT_FAILURE);
 	}
 
+	pthread_mutex_lock(&nacm_refresh_lock);
+
 	/* check if NACM  datastore was modified */
 	if (nacm_ds->func.was_changed(nacm_ds) == 0) {
 		/* it wasn't, we have up to date configuration data */
+		pthread_mutex_unlock(&nacm_refresh_lock);
 		return (EXIT_SUCCESS);
 	}
 
-	data = nacm_ds->func.getconfig(nacm_ds, NULL, NC_DATASTORE_RUNNING, &e);
-	nc_err_free(e);
-	if (data == NULL) {
-		ERROR("%s: getting NACM configuration data from the datastore failed.", __func__);
-		return (EXIT_FAILURE);
-	}
-	if (strcmp(data, "") == 0) {
-		data_doc = xmlNewDoc(BAD_CAST "1.0");
+	if (nacm_ds->func.getconfig_xml != NULL) {
+		/* get the data directly as XML document */
+		data_doc = nacm_ds->func.getconfig_xml(nacm_ds, NULL, NC_DATASTORE_RUNNING, &e);
+		nc_err_free(e);
 	} else {
-		data_doc = xmlReadDoc(BAD_CAST data, NULL, NULL, NC_XMLREAD_OPTIONS);
+		data = nacm_ds->func.getconfig(nacm_ds, NULL, NC_DATASTORE_RUNNING, &e);
+		nc_err_free(e);
+		if (data == NULL) {
+			ERROR("%s: getting NACM configuration data from the datastore failed.", __func__);
+			pthread_mutex_unlock(&nacm_refresh_lock);
+			return (EXIT_FAILURE);
+		}
+		if (strcmp(data, "") == 0) {
+			data_doc = xmlNewDoc(BAD_CAST "1.0");
+		} else {
+			data_doc = xmlReadDoc(BAD_CAST data, NULL, NULL, NC_XMLREAD_OPTIONS);
+		}
+		free(data);
 	}
-	free(data);
 
 	if (data_doc == NULL) {
 		ERROR("%s: Reading configuration datastore failed.", __func__);
+		pthread_mutex_unlock(&nacm_refresh_lock);
 		return (EXIT_FAILURE);
 	}
 
@@ -680,9 +709,9 @@ static int nacm_config_refresh(void)
 	}
 	content = (xmlChar*) nc_clrwspace((char*)query_result->nodesetval->nodeTab[0]->children->content);
 	if (xmlStrcmp(content, BAD_CAST "true") == 0) {
-		nacm_config.enabled = true;
+		config.enabled = true;
 	} else if (xmlStrcmp(BAD_CAST content, BAD_CAST "false") == 0) {
-		nacm_config.enabled = false;
+		config.enabled = false;
 	} else {
 		ERROR("%s: Invalid /nacm/enable-nacm value (%s).", __func__, content);
 		goto errorcleanup;
@@ -698,9 +727,9 @@ static int nacm_config_refresh(void)
 	}
 	content = (xmlChar*) nc_clrwspace((char*)query_result->nodesetval->nodeTab[0]->children->content);
 	if (xmlStrcmp(content, BAD_CAST "permit") == 0) {
-		nacm_config.default_read = NACM_PERMIT;
+		config.default_read = NACM_PERMIT;
 	} else if (xmlStrcmp(BAD_CAST content, BAD_CAST "deny") == 0) {
-		nacm_config.default_read = NACM_DENY;
+		config.default_read = NACM_DENY;
 	} else {
 		ERROR("%s: Invalid /nacm/read-default value (%s).", __func__, content);
 		goto errorcleanup;
@@ -716,9 +745,9 @@ static int nacm_config_refresh(void)
 	}
 	content = (xmlChar*) nc_clrwspace((char*)query_result->nodesetval->nodeTab[0]->children->content);
 	if (xmlStrcmp(content, BAD_CAST "permit") == 0) {
-		nacm_config.default_write = NACM_PERMIT;
+		config.default_write = NACM_PERMIT;
 	} else if (xmlStrcmp(BAD_CAST content, BAD_CAST "deny") == 0) {
-		nacm_config.default_write = NACM_DENY;
+		config.default_write = NACM_DENY;
 	} else {
 		ERROR("%s: Invalid /nacm/write-default value (%s).", __func__, content);
 		goto errorcleanup;
@@ -734,9 +763,9 @@ static int nacm_config_refresh(void)
 	}
 	content = (xmlChar*) nc_clrwspace((char*)query_result->nodesetval->nodeTab[0]->children->content);
 	if (xmlStrcmp(content, BAD_CAST "permit") == 0) {
-		nacm_config.default_exec = NACM_PERMIT;
+		config.default_exec = NACM_PERMIT;
 	} else if (xmlStrcmp(BAD_CAST content, BAD_CAST "deny") == 0) {
-		nacm_config.default_exec = NACM_DENY;
+		config.default_exec = NACM_DENY;
 	} else {
 		ERROR("%s: Invalid /nacm/exec-default value (%s).", __func__, content);
 		goto errorcleanup;
@@ -752,9 +781,9 @@ static int nacm_config_refresh(void)
 	}
 	content = (xmlChar*) nc_clrwspace((char*)query_result->nodesetval->nodeTab[0]->children->content);
 	if (xmlStrcmp(content, BAD_CAST "true") == 0) {
-		nacm_config.external_groups = true;
+		config.external_groups = true;
 	} else if (xmlStrcmp(BAD_CAST content, BAD_CAST "false") == 0) {
-		nacm_config.external_groups = false;
+		config.external_groups = false;
 	} else {
 		ERROR("%s: Invalid /nacm/enable-external-groups value (%s).", __func__, content);
 		goto errorcleanup;
@@ -766,22 +795,14 @@ static int nacm_config_refresh(void)
 	/* /nacm/groups/group */
 	query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_NACM_ID":nacm/"NC_NS_NACM_ID":groups/"NC_NS_NACM_ID":group", data_ctxt);
 	if (query_result != NULL) {
-		/* free previously parsed list of groups if any */
-		if (nacm_config.groups != NULL) {
-			for (i = 0; nacm_config.groups[i] != NULL; i++) {
-				nacm_group_free(nacm_config.groups[i]);
-			}
-			free(nacm_config.groups);
-			nacm_config.groups = NULL;
-		}
 		/* parse the currently set groups */
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
-			nacm_config.groups = malloc((query_result->nodesetval->nodeNr + 1) * sizeof(struct nacm_group*));
-			if (nacm_config.groups == NULL) {
+			config.groups = malloc((query_result->nodesetval->nodeNr + 1) * sizeof(struct nacm_group*));
+			if (config.groups == NULL) {
 				ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
 				goto errorcleanup;
 			}
-			nacm_config.groups[0] = NULL; /* list terminating NULL byte */
+			config.groups[0] = NULL; /* list terminating NULL byte */
 			for (i = j = 0; i < query_result->nodesetval->nodeNr; i++) {
 				gr = malloc(sizeof(struct nacm_group));
 				if (gr == NULL) {
@@ -817,35 +838,27 @@ static int nacm_config_refresh(void)
 				if (gr->name == NULL || gr->users == NULL) {
 					nacm_group_free(gr);
 				} else {
-					nacm_config.groups[j++] = gr;
-					nacm_config.groups[j] = NULL; /* list terminating NULL */
+					config.groups[j++] = gr;
+					config.groups[j] = NULL; /* list terminating NULL */
 				}
 			}
 		}
 		xmlXPathFreeObject(query_result);
 	} else {
 		ERROR("%s: Unable to get information about NACM groups", __func__);
-		return (EXIT_FAILURE);
+		goto errorcleanup;
 	}
 
 	/* /nacm/rule-list */
 	query_result = xmlXPathEvalExpression(BAD_CAST "/"NC_NS_NACM_ID":nacm/"NC_NS_NACM_ID":rule-list", data_ctxt);
 	if (query_result != NULL) {
-		/* free previously parsed list of rule-lists if any */
-		if (nacm_config.rule_lists != NULL) {
-			for (i = 0; nacm_config.rule_lists[i] != NULL; i++) {
-				nacm_rule_list_free(nacm_config.rule_lists[i]);
-			}
-			free(nacm_config.rule_lists);
-			nacm_config.rule_lists = NULL;
-		}
 		if (!xmlXPathNodeSetIsEmpty(query_result->nodesetval)) {
-			nacm_config.rule_lists = malloc((query_result->nodesetval->nodeNr + 1) * sizeof(struct rule_list*));
-			if (nacm_config.rule_lists == NULL) {
+			config.rule_lists = malloc((query_result->nodesetval->nodeNr + 1) * sizeof(struct rule_list*));
+			if (config.rule_lists == NULL) {
 				ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
 				goto errorcleanup;
 			}
-			nacm_config.rule_lists[0] = NULL; /* list terminating NULL byte */
+			config.rule_lists[0] = NULL; /* list terminating NULL byte */
 			for (i = j = 0; i < query_result->nodesetval->nodeNr; i++) {
 				rlist = malloc(sizeof(struct rule_list));
 				if (rlist == NULL) {
@@ -904,24 +917,43 @@ static int nacm_config_refresh(void)
 				if (rlist->groups == NULL || rlist->rules == NULL) {
 					nacm_rule_list_free(rlist);
 				} else {
-					nacm_config.rule_lists[j++] = rlist;
-					nacm_config.rule_lists[j] = NULL; /* list terminating NULL */
+					config.rule_lists[j++] = rlist;
+					config.rule_lists[j] = NULL; /* list terminating NULL */
 				}
 			}
 		}
 		xmlXPathFreeObject(query_result);
 	} else {
 		ERROR("%s: Unable to get information about NACM's lists of rules", __func__);
-		return (EXIT_FAILURE);
+		goto errorcleanup;
 	}
 
 	xmlXPathFreeContext(data_ctxt);
 	xmlFreeDoc(data_doc);
 
+	/* replace the current configuration */
+	pthread_rwlock_wrlock(&nacm_config_lock);
+	gr_list = nacm_config.groups;
+	rl_list = nacm_config.rule_lists;
+	config.generation = nacm_config.generation;
+	nacm_config = config;
+	/* the NACM structures prepared for the previous configuration are outdated */
+	pthread_mutex_lock(&nacm_cache_lock);
+	nacm_config.generation++;
+	pthread_mutex_unlock(&nacm_cache_lock);
+	pthread_rwlock_unlock(&nacm_config_lock);
+	pthread_mutex_unlock(&nacm_refresh_lock);
+
+	nacm_config_free(gr_list, rl_list);
+
 	return (EXIT_SUCCESS);
 
 errorcleanup:
 
+	/* keep the current configuration */
+	pthread_mutex_unlock(&nacm_refresh_lock);
+	nacm_config_free(config.groups, config.rule_lists);
+
 	xmlXPathFreeObject(query_result);
 	xmlXPathFreeContext(data_ctxt);
 	xmlFreeDoc(data_doc);
@@ -930,19 +962,133 @@ errorcleanup:
 	return (EXIT_FAILURE);
 }
 
-static struct nacm_rpc* nacm_rpc_struct(const struct nc_session* session)
+/*
+ * get NULL terminated list of the rules of the specified type and the generic
+ * rules (without a type) from the rule lists, the order of the rules is kept
+ */
+static struct nacm_rule** nacm_rules_select(struct rule_list** rule_lists, NACM_RULE_TYPE type)
+{
+	struct nacm_rule** rules;
+	int i, j, c = 0;
+
+	for (i = 0; rule_lists != NULL && rule_lists[i] != NULL; i++) {
+		for (j = 0; rule_lists[i]->rules != NULL && rule_lists[i]->rules[j] != NULL; j++) {
+			c++;
+		}
+	}
+	if ((rules = malloc((c + 1) * sizeof(struct nacm_rule*))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+
+	c = 0;
+	for (i = 0; rule_lists != NULL && rule_lists[i] != NULL; i++) {
+		for (j = 0; rule_lists[i]->rules != NULL && rule_lists[i]->rules[j] != NULL; j++) {
+			if (rule_lists[i]->rules[j]->type == NACM_RULE_NOTSET || rule_lists[i]->rules[j]->type == type) {
+				rules[c++] = rule_lists[i]->rules[j];
+			}
+		}
+	}
+	rules[c] = NULL; /* list terminating NULL */
+
+	return (rules);
+}
+
+static void nacm_rpc_release(struct nacm_rpc* nacm)
+{
+	int i;
+
+	for (i = 0; nacm->rule_lists != NULL && nacm->rule_lists[i] != NULL; i++) {
+		nacm_rule_list_free(nacm->rule_lists[i]);
+	}
+	free(nacm->rule_lists);
+	free(nacm->data_rules);
+	free(nacm->rpc_rules);
+	free(nacm->ntf_rules);
+	free(nacm);
+}
+
+struct nacm_rpc* nacm_rpc_dup(struct nacm_rpc* nacm)
+{
+	if (nacm != NULL) {
+		pthread_mutex_lock(&nacm_cache_lock);
+		nacm->refs++;
+		pthread_mutex_unlock(&nacm_cache_lock);
+	}
+
+	return (nacm);
+}
+
+void nacm_rpc_free(struct nacm_rpc* nacm)
+{
+	unsigned int refs;
+
+	if (nacm != NULL) {
+		pthread_mutex_lock(&nacm_cache_lock);
+		refs = --nacm->refs;
+		pthread_mutex_unlock(&nacm_cache_lock);
+		if (refs == 0) {
+			nacm_rpc_release(nacm);
+		}
+	}
+}
+
+/* return 1 if both NULL terminated lists of strings are the same */
+static int nacm_strlist_equal(char** l1, char** l2)
+{
+	int i;
+
+	if (l1 == NULL || l2 == NULL) {
+		return (l1 == l2);
+	}
+	for (i = 0; l1[i] != NULL && l2[i] != NULL; i++) {
+		if (strcmp(l1[i], l2[i]) != 0) {
+			return (0);
+		}
+	}
+	return (l1[i] == l2[i]);
+}
+
+static void nacm_cache_item_free(struct nacm_cache_item* item)
+{
+	int i;
+
+	free(item->username);
+	for (i = 0; item->groups != NULL && item->groups[i] != NULL; i++) {
+		free(item->groups[i]);
+	}
+	free(item->groups);
+	nacm_rpc_free(item->nacm);
+	free(item);
+}
+
+static void nacm_cache_clean(void)
+{
+	struct nacm_cache_item *item, *next;
+
+	pthread_mutex_lock(&nacm_cache_lock);
+	item = nacm_cache;
+	nacm_cache = NULL;
+	pthread_mutex_unlock(&nacm_cache_lock);
+
+	for (; item != NULL; item = next) {
+		next = item->next;
+		nacm_cache_item_free(item);
+	}
+}
+
+/*
+ * Build the NACM structure for the session's user from the current
+ * configuration. The caller is supposed to hold nacm_config_lock.
+ */
+static struct nacm_rpc* nacm_rpc_new(const struct nc_session* session)
 {
 	struct nacm_rpc* nacm_rpc;
 	struct rule_list** new_rulelist;
 	char** groups = NULL, **new_groups;
 	int l, c, i, j, k;
 
-	if (session == NULL || (session->status != NC_SESSION_STATUS_WORKING && session->status != NC_SESSION_STATUS_DUMMY)) {
-		ERROR("%s: invalid session to use", __func__);
-		return (NULL);
-	}
-
-	nacm_rpc = malloc(sizeof(struct nacm_rpc));
+	nacm_rpc = calloc(1, sizeof(struct nacm_rpc));
 	if (nacm_rpc == NULL) {
 		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
 		return (NULL);
@@ -951,6 +1097,7 @@ static struct nacm_rpc* nacm_rpc_struct(const struct nc_session* session)
 	nacm_rpc->default_read = nacm_config.default_read;
 	nacm_rpc->default_write = nacm_config.default_write;
 	nacm_rpc->rule_lists = NULL;
+	nacm_rpc->refs = 1;
 
 	l = c = 0;
 	/* get list of user's groups specified in NACM configuration */
@@ -1035,11 +1182,123 @@ static struct nacm_rpc* nacm_rpc_struct(const struct nc_session* session)
 		free(groups);
 	}
 
+	/* split the rules according to the kind of access they apply to */
+	if ((nacm_rpc->data_rules = nacm_rules_select(nacm_rpc->rule_lists, NACM_RULE_DATA)) == NULL ||
+			(nacm_rpc->rpc_rules = nacm_rules_select(nacm_rpc->rule_lists, NACM_RULE_OPERATION)) == NULL ||
+			(nacm_rpc->ntf_rules = nacm_rules_select(nacm_rpc->rule_lists, NACM_RULE_NOTIF)) == NULL) {
+		nacm_rpc_release(nacm_rpc);
+		return (NULL);
+	}
+
+	return (nacm_rpc);
+}
+
+/*
+ * Get NACM structure for the session's user. The structure is taken from the
+ * cache if it was already prepared for the current NACM configuration. The
+ * configuration is not replaced while the structure is built and cached.
+ */
+static struct nacm_rpc* nacm_rpc_struct(const struct nc_session* session)
+{
+	struct nacm_cache_item *item, *prev, *next, *dropped = NULL;
+	struct nacm_rpc* nacm_rpc;
+	int i, c;
+
+	if (session == NULL || (session->status != NC_SESSION_STATUS_WORKING && session->status != NC_SESSION_STATUS_DUMMY)) {
+		ERROR("%s: invalid session to use", __func__);
+		return (NULL);
+	}
+
+	pthread_rwlock_rdlock(&nacm_config_lock);
+	pthread_mutex_lock(&nacm_cache_lock);
+	for (item = nacm_cache, prev = NULL; item != NULL; prev = item, item = item->next) {
+		if (item->generation == nacm_config.generation &&
+				strcmp(item->username, session->username) == 0 &&
+				nacm_strlist_equal(item->groups, session->groups)) {
+			/* move the item to the beginning of the cache */
+			if (prev != NULL) {
+				prev->next = item->next;
+				item->next = nacm_cache;
+				nacm_cache = item;
+			}
+			item->nacm->refs++;
+			nacm_rpc = item->nacm;
+			pthread_mutex_unlock(&nacm_cache_lock);
+			pthread_rwlock_unlock(&nacm_config_lock);
+			return (nacm_rpc);
+		}
+	}
+	pthread_mutex_unlock(&nacm_cache_lock);
+
+	/* not found - prepare a new structure */
+	if ((nacm_rpc = nacm_rpc_new(session)) == NULL) {
+		pthread_rwlock_unlock(&nacm_config_lock);
+		return (NULL);
+	}
+
+	if ((item = calloc(1, sizeof(struct nacm_cache_item))) == NULL ||
+			(item->username = strdup(session->username)) == NULL) {
+		goto nocache;
+	}
+	if (session->groups != NULL) {
+		for (i = 0; session->groups[i] != NULL; i++);
+		if ((item->groups = calloc(i + 1, sizeof(char*))) == NULL) {
+			goto nocache;
+		}
+		for (i = 0; session->groups[i] != NULL; i++) {
+			if ((item->groups[i] = strdup(session->groups[i])) == NULL) {
+				goto nocache;
+			}
+		}
+	}
+	item->generation = nacm_config.generation;
+	item->nacm = nacm_rpc;
+	nacm_rpc->refs++;
+
+	pthread_mutex_lock(&nacm_cache_lock);
+	item->next = nacm_cache;
+	nacm_cache = item;
+	/* drop outdated and the least recently used items */
+	for (item = nacm_cache, prev = NULL, c = 0; item != NULL; item = next) {
+		next = item->next;
+		if (item->generation != nacm_config.generation || ++c > NACM_CACHE_SIZE) {
+			if (prev != NULL) {
+				prev->next = next;
+			} else {
+				nacm_cache = next;
+			}
+			item->next = dropped;
+			dropped = item;
+		} else {
+			prev = item;
+		}
+	}
+	pthread_mutex_unlock(&nacm_cache_lock);
+	pthread_rwlock_unlock(&nacm_config_lock);
+
+	for (item = dropped; item != NULL; item = next) {
+		next = item->next;
+		nacm_cache_item_free(item);
+	}
+
+	return (nacm_rpc);
+
+nocache:
+	/* the item would not match the user's groups, just do not cache the structure */
+	pthread_rwlock_unlock(&nacm_config_lock);
+	ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+	if (item != NULL) {
+		/* item->nacm is not set, so the structure is not released */
+		nacm_cache_item_free(item);
+	}
+
 	return (nacm_rpc);
 }
 
 int nacm_start(nc_rpc* rpc, const struct nc_session* session)
 {
+	bool enabled;
+
 	if (rpc == NULL || session == NULL) {
 		return (EXIT_FAILURE);
 	}
@@ -1061,7 +1320,10 @@ int nacm_start(nc_rpc* rpc, const struct nc_session* session)
 
 	nacm_config_refresh();
 
-	if (nacm_config.enabled == false) {
+	pthread_rwlock_rdlock(&nacm_config_lock);
+	enabled = nacm_config.enabled;
+	pthread_rwlock_unlock(&nacm_config_lock);
+	if (enabled == false) {
 		/* NACM subsystem is switched off */
 		return (EXIT_SUCCESS);
 	}
@@ -1072,45 +1334,6 @@ int nacm_start(nc_rpc* rpc, const struct nc_session* session)
 	return (EXIT_SUCCESS);
 }
 
-static void nacm_check_data_read_recursion(xmlNodePtr subtree, const struct nacm_rpc* nacm)
-{
-	xmlNodePtr node, next;
-
-	if (nacm_check_data(subtree, NACM_ACCESS_READ, nacm) == NACM_DENY) {
-		xmlUnlinkNode(subtree);
-		xmlFreeNode(subtree);
-	} else {
-		for (node = subtree->children; node != NULL; node = next) {
-			next = node->next;
-			if (node->type == XML_ELEMENT_NODE) {
-				nacm_check_data_read_recursion(node, nacm);
-			}
-		}
-	}
-}
-
-int nacm_check_data_read(xmlDocPtr doc, const struct nacm_rpc* nacm)
-{
-	xmlNodePtr node, next;
-
-	if (doc == NULL) {
-		return (EXIT_FAILURE);
-	}
-
-	if (nacm == NULL) {
-		return (EXIT_SUCCESS);
-	}
-
-	for (node = doc->children; node != NULL; node = next) {
-		next = node->next;
-		if (node->type == XML_ELEMENT_NODE) {
-			nacm_check_data_read_recursion(node, nacm);
-		}
-	}
-
-	return (EXIT_SUCCESS);
-}
-
 /*
  * return 0 as false (nodes are not equivalent), 1 as true (model_node defines
  * node in model)
@@ -1160,158 +1383,207 @@ static int compare_node_to_model(const xmlNodePtr node, const xmlNodePtr model_n
 	}
 }
 
-int nacm_check_data(const xmlNodePtr node, const int access, const struct nacm_rpc* nacm)
+/*
+ * nacm:default-deny-all and nacm:default-deny-write statements of a data model,
+ * found only once for all the nodes checked together
+ */
+struct nacm_defdeny {
+	const struct data_model* module;
+	xmlXPathObjectPtr all;
+	xmlXPathObjectPtr write;
+	struct nacm_defdeny* next;
+};
+
+static void nacm_defdeny_free(struct nacm_defdeny* list)
+{
+	struct nacm_defdeny* aux;
+
+	while (list != NULL) {
+		aux = list;
+		list = list->next;
+		xmlXPathFreeObject(aux->all);
+		xmlXPathFreeObject(aux->write);
+		free(aux);
+	}
+}
+
+static struct nacm_defdeny* nacm_defdeny_get(const struct data_model* module, struct nacm_defdeny** list)
+{
+	struct nacm_defdeny* item;
+	xmlXPathContextPtr model_ctxt;
+
+	for (item = *list; item != NULL; item = item->next) {
+		if (item->module == module) {
+			return (item);
+		}
+	}
+
+	if ((item = calloc(1, sizeof(struct nacm_defdeny))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	item->module = module;
+	if ((model_ctxt = xmlXPathNewContext(module->xml)) != NULL &&
+	    xmlXPathRegisterNs(model_ctxt, BAD_CAST "yin", BAD_CAST NC_NS_YIN) == 0 &&
+	    xmlXPathRegisterNs(model_ctxt, BAD_CAST "nacm", BAD_CAST NC_NS_NACM) == 0) {
+		item->all = xmlXPathEvalExpression(BAD_CAST "/yin:module//nacm:default-deny-all", model_ctxt);
+		item->write = xmlXPathEvalExpression(BAD_CAST "/yin:module//nacm:default-deny-write", model_ctxt);
+	}
+	xmlXPathFreeContext(model_ctxt);
+	item->next = *list;
+	*list = item;
+
+	return (item);
+}
+
+/*
+ * return 1 if any of the default-deny-* statements applies to the node, 0 otherwise
+ */
+static int nacm_defdeny_match(const xmlNodePtr node, const struct data_model* module, xmlXPathObjectPtr defdeny)
+{
+	int i;
+
+	if (defdeny == NULL || xmlXPathNodeSetIsEmpty(defdeny->nodesetval)) {
+		return (0);
+	}
+	for (i = 0; i < defdeny->nodesetval->nodeNr; i++) {
+		if (compare_node_to_model(node, defdeny->nodesetval->nodeTab[i]->parent, module->ns) == 1) {
+			return (1);
+		}
+	}
+	return (0);
+}
+
+/*
+ * evaluate compiled path of the data rule in the context's document
+ */
+static xmlXPathObjectPtr nacm_path_eval(const struct nacm_path* path, xmlXPathContextPtr ctxt)
 {
-	xmlXPathObjectPtr defdeny;
-	xmlXPathContextPtr model_ctxt = NULL;
-	xmlXPathContextPtr ctxt = NULL;
-	xmlXPathObjectPtr xpath_result = NULL;
 	struct nacm_ns *ns;
-	struct nacm_rule* rule;
-	const struct data_model* module;
-	int i, j, k;
-	int retval = -1;
 
-	if (access == 0 || node == NULL || node->doc == NULL) {
-		/* invalid input parameter */
-		return (-1);
+	if (path->expr == NULL) {
+		return (NULL);
 	}
 
-	if (nacm == NULL) {
-		/* NACM will not affect this request */
-		return (NACM_PERMIT);
+	/* register namespaces from the rule's path */
+	xmlXPathRegisteredNsCleanup(ctxt);
+	for (ns = path->ns_list; ns != NULL; ns = ns->next) {
+		if (xmlXPathRegisterNs(ctxt, BAD_CAST ns->prefix, BAD_CAST ns->href) != 0) {
+			ERROR("Registering NACM rule path namespace for the xpath context failed.");
+			return (NULL);
+		}
 	}
 
-	if (node->type != XML_ELEMENT_NODE) {
-		/* skip comments or other elements not covered by NACM rules */
-		return (NACM_PERMIT);
+	return (xmlXPathCompiledEval(path->expr, ctxt));
+}
+
+/*
+ * Check the data node according to the rules and defaults. Data rules' paths
+ * are evaluated in *ctxt (created on demand) unless the matching rule was
+ * already found by nacm_mark_data() - in such a case marked is set to 1 and
+ * the node's _private holds the index of the rule (starting at 1, 0 for no
+ * matching data rule).
+ */
+static int nacm_check_node(const xmlNodePtr node, const int access, const struct nacm_rpc* nacm, int marked, xmlXPathContextPtr* ctxt, struct nacm_defdeny** defdeny_list)
+{
+	xmlXPathObjectPtr xpath_result = NULL;
+	struct nacm_rule* rule;
+	struct nacm_defdeny* defdeny;
+	const struct data_model* module;
+	uintptr_t mark = 0;
+	int i, k;
+	int retval = -1;
+
+	if (marked) {
+		mark = (uintptr_t) node->_private;
+		node->_private = NULL;
 	}
 
 	/* get module name where the data node is defined */
 	module = ncds_get_model_data((node->ns != NULL) ? (char*)(node->ns->href) : NULL);
 
 	if (module != NULL) {
-		for (i = 0; nacm->rule_lists != NULL && nacm->rule_lists[i] != NULL; i++) {
-			for (j = 0; nacm->rule_lists[i]->rules != NULL && nacm->rule_lists[i]->rules[j] != NULL; j++) {
-				/*
-				 * check rules (all must be met):
-				 * - module-name matches "*" or the name of the module where the data node is defined
-				 * - type is NACM_RULE_NOTSET or type is NACM_RULE_DATA and data contain "*" or the operation name
-				 * - access has set NACM_ACCESS_EXEC bit
-				 */
-				rule = nacm->rule_lists[i]->rules[j]; /* shortcut */
-
-				/* 1) module name */
-				if (!(strcmp(rule->module, "*") == 0 ||
-				    strcmp(rule->module, module->name) == 0)) {
-					/* rule does not match */
-					continue;
-				}
+		for (i = 0; nacm->data_rules[i] != NULL; i++) {
+			/*
+			 * check rules (all must be met):
+			 * - module-name matches "*" or the name of the module where the data node is defined
+			 * - type is NACM_RULE_NOTSET or type is NACM_RULE_DATA and data contain "*" or the operation name
+			 * - access has set NACM_ACCESS_EXEC bit
+			 */
+			rule = nacm->data_rules[i]; /* shortcut */
+
+			/* 1) module name */
+			if (!(strcmp(rule->module, "*") == 0 ||
+			    strcmp(rule->module, module->name) == 0)) {
+				/* rule does not match */
+				continue;
+			}
 
-				/* 3) access - do it before 2 for optimize, the 2nd step is the most difficult */
-				if ((rule->access & access) == 0) {
-					/* rule does not match */
-					continue;
-				}
+			/* 3) access - do it before 2 for optimize, the 2nd step is the most difficult */
+			if ((rule->access & access) == 0) {
+				/* rule does not match */
+				continue;
+			}
 
-				/* 2) type and operation name */
-				if (rule->type != NACM_RULE_NOTSET) {
-					if (rule->type == NACM_RULE_DATA &&
-					    rule->type_data.path != NULL) {
+			/* 2) type and operation name */
+			if (rule->type != NACM_RULE_NOTSET) {
+				if (rule->type == NACM_RULE_DATA &&
+				    rule->type_data.path != NULL) {
+					if (marked) {
+						/* the paths were already evaluated */
+						if ((uintptr_t)(i + 1) != mark) {
+							/* rule does not match */
+							continue;
+						}
+					} else {
 						/* create xPath context for search in node's document */
-						if ((ctxt = xmlXPathNewContext(node->doc)) == NULL) {
+						if (*ctxt == NULL && (*ctxt = xmlXPathNewContext(node->doc)) == NULL) {
 							ERROR("%s: Creating XPath context failed.", __func__);
 							return (-1);
 						}
 
-						/* register namespaces from the rule's path */
-						for (ns = rule->type_data.path->ns_list; ns != NULL; ns = ns->next) {
-							if (xmlXPathRegisterNs(ctxt, BAD_CAST ns->prefix, BAD_CAST ns->href) != 0) {
-								ERROR("Registering NACM rule path namespace for the xpath context failed.");
-								xmlXPathFreeContext(ctxt);
-								return (-1);
-							}
-						}
-
 						/* query the rule's path in the node's document and compare results with the node */
-						if ((xpath_result = xmlXPathEvalExpression(BAD_CAST rule->type_data.path->path, ctxt)) != NULL) {
-							if (xmlXPathNodeSetIsEmpty(xpath_result->nodesetval)) {
-								/* rule does not match - path does not exist in document */
-								xmlXPathFreeObject(xpath_result);
-								xmlXPathFreeContext(ctxt);
-								continue;
-							}
-							for (k = 0; k < xpath_result->nodesetval->nodeNr; k++) {
+						if ((xpath_result = nacm_path_eval(rule->type_data.path, *ctxt)) != NULL) {
+							for (k = 0; xpath_result->nodesetval != NULL && k < xpath_result->nodesetval->nodeNr; k++) {
 								if (node == xpath_result->nodesetval->nodeTab[k]) {
 									/* the path selects the node */
 									break;
 								}
 							}
-
-							if (k == xpath_result->nodesetval->nodeNr) {
-								/* rule does not match */
+							if (xpath_result->nodesetval == NULL || k == xpath_result->nodesetval->nodeNr) {
+								/* rule does not match - path does not select the node */
 								xmlXPathFreeObject(xpath_result);
-								xmlXPathFreeContext(ctxt);
 								continue;
 							}
-
 							xmlXPathFreeObject(xpath_result);
 						} else {
 							WARN("%s: Unable to evaluate path \"%s\"", __func__, rule->type_data.path->path);
 						}
-
-						/* cleanup */
-						xmlXPathFreeContext(ctxt);
-					} else {
-						/* rule does not match - another type of rule */
-						continue;
 					}
+				} else {
+					/* rule does not match - another type of rule */
+					continue;
 				}
-
-				/* rule matches */
-				retval = rule->action;
-				goto result;
 			}
+
+			/* rule matches */
+			retval = rule->action;
+			goto result;
 		}
 		/* no matching rule found */
 
 		/* check nacm:default-deny-all and nacm:default-deny-write */
-		if ((model_ctxt = xmlXPathNewContext(module->xml)) != NULL &&
-		    xmlXPathRegisterNs(model_ctxt, BAD_CAST "yin", BAD_CAST NC_NS_YIN) == 0 &&
-		    xmlXPathRegisterNs(model_ctxt, BAD_CAST "nacm", BAD_CAST NC_NS_NACM) == 0) {
-			if ((defdeny = xmlXPathEvalExpression(BAD_CAST "/yin:module//nacm:default-deny-all", model_ctxt)) != NULL) {
-				if (!xmlXPathNodeSetIsEmpty(defdeny->nodesetval)) {
-					/* process all default-deny-all elements */
-					for (i = 0; i < defdeny->nodesetval->nodeNr; i++) {
-						if (compare_node_to_model(node, defdeny->nodesetval->nodeTab[i]->parent, module->ns) == 1) {
-							xmlXPathFreeObject(defdeny);
-							xmlXPathFreeContext(model_ctxt);
-							retval = NACM_DENY;
-							goto result;
-						}
-					}
-				}
-				xmlXPathFreeObject(defdeny);
+		if ((defdeny = nacm_defdeny_get(module, defdeny_list)) != NULL) {
+			if (nacm_defdeny_match(node, module, defdeny->all)) {
+				retval = NACM_DENY;
+				goto result;
 			}
-			if ((access & (NACM_ACCESS_CREATE | NACM_ACCESS_DELETE | NACM_ACCESS_UPDATE)) != 0) {
-				/* check default-deny-write */
-				if ((defdeny = xmlXPathEvalExpression(BAD_CAST "/yin:module//nacm:default-deny-write", model_ctxt)) != NULL ) {
-					if (!xmlXPathNodeSetIsEmpty(defdeny->nodesetval)) {
-						/* process all default-deny-all elements */
-						for (i = 0; i < defdeny->nodesetval->nodeNr; i++) {
-							if (compare_node_to_model(node, defdeny->nodesetval->nodeTab[i]->parent, module->ns) == 1) {
-								xmlXPathFreeObject(defdeny);
-								xmlXPathFreeContext(model_ctxt);
-								retval = NACM_DENY;
-								goto result;
-							}
-						}
-					}
-					xmlXPathFreeObject(defdeny);
-				}
+			if ((access & (NACM_ACCESS_CREATE | NACM_ACCESS_DELETE | NACM_ACCESS_UPDATE)) != 0 &&
+					nacm_defdeny_match(node, module, defdeny->write)) {
+				retval = NACM_DENY;
+				goto result;
 			}
 		}
-		xmlXPathFreeContext(model_ctxt);
 	}
 	/* no matching rule found */
 
@@ -1331,14 +1603,158 @@ int nacm_check_data(const xmlNodePtr node, const int access, const struct nacm_r
 result:
 	/* update stats */
 	if (retval == NACM_DENY && nc_info) {
-		pthread_rwlock_wrlock(&(nc_info->lock));
-		nc_info->stats_nacm.denied_data++;
-		pthread_rwlock_unlock(&(nc_info->lock));
+		NC_STATS_INC(nc_info->stats_nacm.denied_data);
 	}
 
 	return (retval);
 }
 
+int nacm_check_data(const xmlNodePtr node, const int access, const struct nacm_rpc* nacm)
+{
+	xmlXPathContextPtr ctxt = NULL;
+	struct nacm_defdeny* defdeny = NULL;
+	int retval;
+
+	if (access == 0 || node == NULL || node->doc == NULL) {
+		/* invalid input parameter */
+		return (-1);
+	}
+
+	if (nacm == NULL) {
+		/* NACM will not affect this request */
+		return (NACM_PERMIT);
+	}
+
+	if (node->type != XML_ELEMENT_NODE) {
+		/* skip comments or other elements not covered by NACM rules */
+		return (NACM_PERMIT);
+	}
+
+	retval = nacm_check_node(node, access, nacm, 0, &ctxt, &defdeny);
+
+	xmlXPathFreeContext(ctxt);
+	nacm_defdeny_free(defdeny);
+
+	return (retval);
+}
+
+/*
+ * Evaluate each data rule applicable to the access once in the whole document
+ * and mark every selected element node (in its _private) with the index of the
+ * first such rule matching also the node's module. Rules are indexed from 1
+ * in the order they are processed by nacm_check_node().
+ */
+static int nacm_mark_data(xmlDocPtr doc, const int access, const struct nacm_rpc* nacm)
+{
+	xmlXPathContextPtr ctxt;
+	xmlXPathObjectPtr xpath_result;
+	xmlNodePtr node;
+	struct nacm_rule* rule;
+	const struct data_model* module;
+	int i, k;
+
+	if ((ctxt = xmlXPathNewContext(doc)) == NULL) {
+		ERROR("%s: Creating XPath context failed.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	for (i = 0; nacm->data_rules != NULL && nacm->data_rules[i] != NULL; i++) {
+		rule = nacm->data_rules[i]; /* shortcut */
+
+		if (rule->type != NACM_RULE_DATA || rule->type_data.path == NULL || (rule->access & access) == 0) {
+			continue;
+		}
+
+		if ((xpath_result = nacm_path_eval(rule->type_data.path, ctxt)) == NULL) {
+			/* let the caller check the nodes one by one */
+			WARN("%s: Unable to evaluate path \"%s\"", __func__, rule->type_data.path->path);
+			xmlXPathFreeContext(ctxt);
+			return (EXIT_FAILURE);
+		}
+		for (k = 0; xpath_result->nodesetval != NULL && k < xpath_result->nodesetval->nodeNr; k++) {
+			node = xpath_result->nodesetval->nodeTab[k];
+			if (node->type != XML_ELEMENT_NODE || node->_private != NULL) {
+				/* not checked or already matched by a preceding rule */
+				continue;
+			}
+			module = ncds_get_model_data((node->ns != NULL) ? (char*)(node->ns->href) : NULL);
+			if (module != NULL && (strcmp(rule->module, "*") == 0 || strcmp(rule->module, module->name) == 0)) {
+				node->_private = (void*)(uintptr_t)(i + 1);
+			}
+		}
+		xmlXPathFreeObject(xpath_result);
+	}
+
+	xmlXPathFreeContext(ctxt);
+	return (EXIT_SUCCESS);
+}
+
+static void nacm_unmark_data(xmlNodePtr subtree)
+{
+	xmlNodePtr node;
+
+	for (node = subtree; node != NULL; node = node->next) {
+		if (node->type == XML_ELEMENT_NODE) {
+			node->_private = NULL;
+			nacm_unmark_data(node->children);
+		}
+	}
+}
+
+static void nacm_check_data_read_recursion(xmlNodePtr subtree, const struct nacm_rpc* nacm, int marked, xmlXPathContextPtr* ctxt, struct nacm_defdeny** defdeny)
+{
+	xmlNodePtr node, next;
+
+	if (nacm_check_node(subtree, NACM_ACCESS_READ, nacm, marked, ctxt, defdeny) == NACM_DENY) {
+		xmlUnlinkNode(subtree);
+		xmlFreeNode(subtree);
+	} else {
+		for (node = subtree->children; node != NULL; node = next) {
+			next = node->next;
+			if (node->type == XML_ELEMENT_NODE) {
+				nacm_check_data_read_recursion(node, nacm, marked, ctxt, defdeny);
+			}
+		}
+	}
+}
+
+int nacm_check_data_read(xmlDocPtr doc, const struct nacm_rpc* nacm)
+{
+	xmlNodePtr node, next;
+	xmlXPathContextPtr ctxt = NULL;
+	struct nacm_defdeny* defdeny = NULL;
+	int marked;
+
+	if (doc == NULL) {
+		return (EXIT_FAILURE);
+	}
+
+	if (nacm == NULL) {
+		return (EXIT_SUCCESS);
+	}
+
+	/*
+	 * evaluate the rules' paths only once for the whole document instead of
+	 * evaluating all of them for each node, if it fails, check the nodes
+	 * one by one
+	 */
+	if ((marked = (nacm_mark_data(doc, NACM_ACCESS_READ, nacm) == EXIT_SUCCESS)) == 0) {
+		nacm_unmark_data(doc->children);
+	}
+
+	for (node = doc->children; node != NULL; node = next) {
+		next = node->next;
+		if (node->type == XML_ELEMENT_NODE) {
+			nacm_check_data_read_recursion(node, nacm, marked, &ctxt, &defdeny);
+		}
+	}
+
+	xmlXPathFreeContext(ctxt);
+	nacm_defdeny_free(defdeny);
+
+	return (EXIT_SUCCESS);
+}
+
 #ifndef DISABLE_NOTIFICATIONS
 
 int nacm_check_notification(const nc_ntf* ntf, const struct nc_session* session)
@@ -1349,7 +1765,8 @@ int nacm_check_notification(const nc_ntf* ntf, const struct nc_session* session)
 	xmlNodePtr ntfnode;
 	const struct data_model* ntfmodule;
 	struct nacm_rpc *nacm;
-	int i, j, k;
+	struct nacm_rule* rule;
+	int i, k;
 	int retval;
 	NCNTF_EVENT event;
 
@@ -1419,51 +1836,51 @@ int nacm_check_notification(const nc_ntf* ntf, const struct nc_session* session)
 	ntfmodule = ncds_get_model_notification((char*)(ntfnode->name), (ntfnode->ns != NULL) ? (char*)(ntfnode->ns->href) : NULL);
 
 	if (ntfmodule != NULL) {
-		for (i = 0; nacm->rule_lists != NULL && nacm->rule_lists[i] != NULL; i++) {
-			for (j = 0; nacm->rule_lists[i]->rules != NULL && nacm->rule_lists[i]->rules[j] != NULL; j++) {
-				/*
-				 * check rules (all must be met):
-				 * - module-name matches "*" or the name of the module where the operation is defined
-				 * - type is NACM_RULE_NOTSET or type is NACM_RULE_NOTIF and data contain "*" or the notification name
-				 * - access has set NACM_ACCESS_READ bit
-				 */
-
-				/* 1) module name */
-				if (!(strcmp(nacm->rule_lists[i]->rules[j]->module, "*") == 0 ||
-				    strcmp(nacm->rule_lists[i]->rules[j]->module, ntfmodule->name) == 0)) {
-					/* rule does not match */
-					continue;
-				}
+		for (i = 0; nacm->ntf_rules != NULL && nacm->ntf_rules[i] != NULL; i++) {
+			rule = nacm->ntf_rules[i]; /* shortcut */
+
+			/*
+			 * check rules (all must be met):
+			 * - module-name matches "*" or the name of the module where the operation is defined
+			 * - type is NACM_RULE_NOTSET or type is NACM_RULE_NOTIF and data contain "*" or the notification name
+			 * - access has set NACM_ACCESS_READ bit
+			 */
+
+			/* 1) module name */
+			if (!(strcmp(rule->module, "*") == 0 ||
+			    strcmp(rule->module, ntfmodule->name) == 0)) {
+				/* rule does not match */
+				continue;
+			}
 
-				/* 2) type and notification name */
-				if (nacm->rule_lists[i]->rules[j]->type != NACM_RULE_NOTSET) {
-					if (nacm->rule_lists[i]->rules[j]->type == NACM_RULE_NOTIF &&
-					    nacm->rule_lists[i]->rules[j]->type_data.ntf_names != NULL) {
-						for (k = 0; nacm->rule_lists[i]->rules[j]->type_data.ntf_names[k] != NULL; k++) {
-							if (strcmp(nacm->rule_lists[i]->rules[j]->type_data.ntf_names[k], "*") == 0 ||
-							    strcmp(nacm->rule_lists[i]->rules[j]->type_data.ntf_names[k], (char*)(ntfnode->name)) == 0) {
-								break;
-							}
-						}
-						if (nacm->rule_lists[i]->rules[j]->type_data.ntf_names[k] == NULL) {
-							/* rule does not match - notification names do not match */
-							continue;
+			/* 2) type and notification name */
+			if (rule->type != NACM_RULE_NOTSET) {
+				if (rule->type == NACM_RULE_NOTIF &&
+				    rule->type_data.ntf_names != NULL) {
+					for (k = 0; rule->type_data.ntf_names[k] != NULL; k++) {
+						if (strcmp(rule->type_data.ntf_names[k], "*") == 0 ||
+						    strcmp(rule->type_data.ntf_names[k], (char*)(ntfnode->name)) == 0) {
+							break;
 						}
-					} else {
-						/* rule does not match - another type of rule */
+					}
+					if (rule->type_data.ntf_names[k] == NULL) {
+						/* rule does not match - notification names do not match */
 						continue;
 					}
-				}
-
-				/* 3) access */
-				if ((nacm->rule_lists[i]->rules[j]->access & NACM_ACCESS_READ) == 0) {
-					/* rule does not match */
+				} else {
+					/* rule does not match - another type of rule */
 					continue;
 				}
-				/* rule matches */
-				retval = nacm->rule_lists[i]->rules[j]->action;
-				goto nacmfree;
 			}
+
+			/* 3) access */
+			if ((rule->access & NACM_ACCESS_READ) == 0) {
+				/* rule does not match */
+				continue;
+			}
+			/* rule matches */
+			retval = rule->action;
+			goto nacmfree;
 		}
 		/* no matching rule found */
 
@@ -1478,7 +1895,8 @@ int nacm_check_notification(const nc_ntf* ntf, const struct nc_session* session)
 						if (compare_node_to_model(ntfnode, defdeny->nodesetval->nodeTab[i]->parent, ntfmodule->ns) == 1) {
 							xmlXPathFreeObject(defdeny);
 							xmlXPathFreeContext(model_ctxt);
-							return(NACM_DENY);
+							retval = NACM_DENY;
+							goto nacmfree;
 						}
 					}
 				}
@@ -1496,12 +1914,8 @@ nacmfree:
 	if (query_result != NULL) {
 		xmlXPathFreeObject(query_result);
 	}
-	/* free NACM structure */
-	for (i = 0; nacm->rule_lists != NULL && nacm->rule_lists[i] != NULL; i++) {
-		nacm_rule_list_free(nacm->rule_lists[i]);
-	}
-	free(nacm->rule_lists);
-	free(nacm);
+	/* release NACM structure */
+	nacm_rpc_free(nacm);
 
 	return (retval);
 }
@@ -1514,8 +1928,9 @@ int nacm_check_operation(const nc_rpc* rpc)
 	xmlXPathObjectPtr query_result = NULL;
 	xmlNodePtr opnode;
 	const struct data_model* opmodule;
+	struct nacm_rule* rule;
 	NC_OP op;
-	int i, j, k;
+	int i, k;
 
 	if (rpc == NULL) {
 		/* invalid input parameter */
@@ -1546,50 +1961,50 @@ int nacm_check_operation(const nc_rpc* rpc)
 	opmodule = ncds_get_model_operation((char*)(opnode->name), (opnode->ns != NULL) ? (char*)(opnode->ns->href) : NULL);
 
 	if (opmodule != NULL) {
-		for (i = 0; rpc->nacm->rule_lists != NULL && rpc->nacm->rule_lists[i] != NULL; i++) {
-			for (j = 0; rpc->nacm->rule_lists[i]->rules != NULL && rpc->nacm->rule_lists[i]->rules[j] != NULL; j++) {
-				/*
-				 * check rules (all must be met):
-				 * - module-name matches "*" or the name of the module where the operation is defined
-				 * - type is NACM_RULE_NOTSET or type is NACM_RULE_OPERATION and data contain "*" or the operation name
-				 * - access has set NACM_ACCESS_EXEC bit
-				 */
-
-				/* 1) module name */
-				if (!(strcmp(rpc->nacm->rule_lists[i]->rules[j]->module, "*") == 0 ||
-				    strcmp(rpc->nacm->rule_lists[i]->rules[j]->module, opmodule->name) == 0)) {
-					/* rule does not match */
-					continue;
-				}
+		for (i = 0; rpc->nacm->rpc_rules != NULL && rpc->nacm->rpc_rules[i] != NULL; i++) {
+			rule = rpc->nacm->rpc_rules[i]; /* shortcut */
+
+			/*
+			 * check rules (all must be met):
+			 * - module-name matches "*" or the name of the module where the operation is defined
+			 * - type is NACM_RULE_NOTSET or type is NACM_RULE_OPERATION and data contain "*" or the operation name
+			 * - access has set NACM_ACCESS_EXEC bit
+			 */
+
+			/* 1) module name */
+			if (!(strcmp(rule->module, "*") == 0 ||
+			    strcmp(rule->module, opmodule->name) == 0)) {
+				/* rule does not match */
+				continue;
+			}
 
-				/* 2) type and operation name */
-				if (rpc->nacm->rule_lists[i]->rules[j]->type != NACM_RULE_NOTSET) {
-					if (rpc->nacm->rule_lists[i]->rules[j]->type == NACM_RULE_OPERATION &&
-					    rpc->nacm->rule_lists[i]->rules[j]->type_data.rpc_names != NULL) {
-						for (k = 0; rpc->nacm->rule_lists[i]->rules[j]->type_data.rpc_names[k] != NULL; k++) {
-							if (strcmp(rpc->nacm->rule_lists[i]->rules[j]->type_data.rpc_names[k], "*") == 0 ||
-							    strcmp(rpc->nacm->rule_lists[i]->rules[j]->type_data.rpc_names[k], (char*)(opnode->name)) == 0) {
-								break;
-							}
-						}
-						if (rpc->nacm->rule_lists[i]->rules[j]->type_data.rpc_names[k] == NULL) {
-							/* rule does not match - operation names do not match */
-							continue;
+			/* 2) type and operation name */
+			if (rule->type != NACM_RULE_NOTSET) {
+				if (rule->type == NACM_RULE_OPERATION &&
+				    rule->type_data.rpc_names != NULL) {
+					for (k = 0; rule->type_data.rpc_names[k] != NULL; k++) {
+						if (strcmp(rule->type_data.rpc_names[k], "*") == 0 ||
+						    strcmp(rule->type_data.rpc_names[k], (char*)(opnode->name)) == 0) {
+							break;
 						}
-					} else {
-						/* rule does not match - another type of rule */
+					}
+					if (rule->type_data.rpc_names[k] == NULL) {
+						/* rule does not match - operation names do not match */
 						continue;
 					}
-				}
-
-				/* 3) access */
-				if ((rpc->nacm->rule_lists[i]->rules[j]->access & NACM_ACCESS_EXEC) == 0) {
-					/* rule does not match */
+				} else {
+					/* rule does not match - another type of rule */
 					continue;
 				}
-				/* rule matches */
-				return (rpc->nacm->rule_lists[i]->rules[j]->action);
 			}
+
+			/* 3) access */
+			if ((rule->access & NACM_ACCESS_EXEC) == 0) {
+				/* rule does not match */
+				continue;
+			}
+			/* rule matches */
+			return (rule->action);
 		}
 		/* no matching rule found */
 
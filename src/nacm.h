@@ -126,7 +126,19 @@ int nacm_check_data(const xmlNodePtr node, const int access, const struct nacm_r
  */
 int nacm_check_data_read(xmlDocPtr doc, const struct nacm_rpc* nacm);
 
-struct rule_list** nacm_rule_lists_dup(struct rule_list** list);
-void nacm_rule_list_free(struct rule_list* rl);
+/**
+ * @brief Get another reference to the NACM structure of an RPC
+ *
+ * @param[in] nacm NACM structure from the RPC
+ * @return The same NACM structure
+ */
+struct nacm_rpc* nacm_rpc_dup(struct nacm_rpc* nacm);
+
+/**
+ * @brief Release the reference to the NACM structure of an RPC
+ *
+ * @param[in] nacm NACM structure from the RPC
+ */
+void nacm_rpc_free(struct nacm_rpc* nacm);
 
 #endif /* NC_NACM_H_ */
@@ -57,6 +57,7 @@
 
 #include <libxml/tree.h>
 #include <libxml/xpath.h>
+#include <libxml/hash.h>
 
 #include "config.h"
 #include "netconf.h"
@@ -164,6 +165,18 @@
  */
 #define NC_READ_SLEEP 100
 
+/**
+ * Initial size of the session's input buffer, the buffer grows when a single
+ * NETCONF 1.0 message or chunk header does not fit into it.
+ */
+#define NC_READ_BUF_SIZE (1024*16)
+
+/**
+ * Size of the buffer for serializing outgoing NETCONF messages. With NETCONF
+ * 1.1, it is also the maximal size of a single sent chunk.
+ */
+#define NC_WRITE_BUF_SIZE (1024*16)
+
 /*
  * global settings for options passed to xmlRead* functions
  */
@@ -282,6 +295,14 @@ struct callbacks {
  */
 extern struct callbacks callbacks;
 
+/*
+ * The statistics counters are placed in the shared memory and updated by
+ * all the libnetconf's processes and threads, so they are accessed
+ * atomically instead of holding the nc_info lock for each increment.
+ */
+#define NC_STATS_INC(counter) __atomic_add_fetch(&(counter), 1, __ATOMIC_RELAXED)
+#define NC_STATS_GET(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
 /**
  * @ingroup internalAPI
  * @brief NETCONF session statistics as defined in RFC 6022 (as common-counters)
@@ -362,6 +383,16 @@ struct nc_session {
 	int fd_output;
 	/**< @brief Transport protocol identifier */
 	NC_TRANSPORT transport;
+	/**< @brief Input buffer for the data read from the transport, but not yet processed */
+	char *rbuf;
+	/**< @brief Allocated size of the rbuf */
+	size_t rbuf_size;
+	/**< @brief Offset of the first unprocessed byte in the rbuf */
+	size_t rbuf_start;
+	/**< @brief Offset behind the last valid byte in the rbuf */
+	size_t rbuf_end;
+	/**< @brief Number of bytes from the rbuf_start already checked not to complete a message */
+	size_t rbuf_checked;
 #ifndef DISABLE_LIBSSH
 	/**< @brief */
 	ssh_session ssh_sess;
@@ -405,6 +436,12 @@ struct nc_session {
 	pthread_mutex_t mut_mqueue;
 	/**< @brief queue for received, but not processed, NETCONF messages */
 	struct nc_msg* queue_msg;
+	/**< @brief last message in the queue_msg */
+	struct nc_msg* queue_msg_last;
+	/**< @brief messages in the queue_msg indexed by their message-id */
+	xmlHashTablePtr queue_msg_index;
+	/**< @brief callbacks of the asynchronously sent \<rpc\>s indexed by message-id, accessed under mut_mqueue */
+	xmlHashTablePtr pending;
 	/**< @brief queue for received, but not processed, NETCONF Event Notifications */
 	struct nc_msg* queue_event;
 	/**< @brief flag for active notification subscription on the session */
@@ -503,11 +540,36 @@ struct nc_err {
 	struct nc_err* next;
 };
 
+/*
+ * NACM rules applicable to a user, the structure is shared (and never modified)
+ * by all the RPCs of the user's sessions until the NACM configuration changes.
+ */
 struct nacm_rpc {
 	bool default_read; /* false (0) for permit, true (1) for deny */
 	bool default_write; /* false (0) for permit, true (1) for deny */
 	bool default_exec; /* false (0) for permit, true (1) for deny */
 	struct rule_list** rule_lists;
+	/* NULL terminated lists of the rules from rule_lists applicable to data,
+	 * operations and notifications in the order of processing */
+	struct nacm_rule** data_rules;
+	struct nacm_rule** rpc_rules;
+	struct nacm_rule** ntf_rules;
+	unsigned int refs; /* number of references to the structure */
+};
+
+/*
+ * Parameters of the <rpc> decoded by nc_rpc_parse_envelope() in a single walk
+ * through the message instead of the separate XPath queries of the getters.
+ */
+struct nc_rpc_envelope {
+	int valid;                  /* the message was decoded, use the values below */
+	NC_DATASTORE source;
+	NC_DATASTORE target;
+	NC_EDIT_DEFOP_TYPE defop;
+	NC_EDIT_ERROPT_TYPE erropt;
+	NC_EDIT_TESTOPT_TYPE testopt;
+	xmlNodePtr filter;          /* <filter> element in the message document */
+	int filter_count;
 };
 
 /**
@@ -527,16 +589,21 @@ struct nc_msg {
 	struct nacm_rpc *nacm;
 	struct nc_err* error;
 	struct nc_msg* next;
+	struct nc_msg* prev;
 	struct nc_session * session;
 	/* rpc-specific fields */
 	NC_OP op;
 	NC_DATASTORE source;
 	NC_DATASTORE target;
+	struct nc_rpc_envelope envelope;
 };
 
+struct nc_filter_node;
+
 struct nc_filter {
 	NC_FILTER_TYPE type;
 	xmlNodePtr subtree_filter;
+	struct nc_filter_node** compiled; /* compiled subtree filter, see ncxml_filter() */
 };
 
 struct nc_cpblts {
@@ -613,11 +680,19 @@ struct nc_err* nc_err_parse(nc_reply* reply);
 /**
  * @brief Apply filter on the given XML document.
  * @param data XML document to be filtered.
- * @param filter Filter to apply. Only 'subtree' filters are supported.
+ * @param filter Filter to apply. Only 'subtree' filters are supported. The
+ * filter is compiled on its first use and the compiled form is kept in the
+ * filter structure, so the same filter can be cheaply applied repeatedly.
  * @param data_model Data model of the filtered document.
  * @return 0 on success,\n non-zero else
  */
-int ncxml_filter(xmlNodePtr old, const struct nc_filter * filter, xmlNodePtr *new, const xmlDocPtr data_model);
+int ncxml_filter(xmlNodePtr old, struct nc_filter * filter, xmlNodePtr *new, const xmlDocPtr data_model);
+
+/**
+ * @brief Free the compiled subtree filter.
+ * @param compiled Compiled filter from the nc_filter structure.
+ */
+void ncxml_filter_compiled_free(struct nc_filter_node** compiled);
 
 /**
  * @brief Get state information about sessions. Only information about monitored
@@ -50,6 +50,8 @@
 #include <assert.h>
 #include <dirent.h>
 #include <string.h>
+#include <ctype.h>
+#include <limits.h>
 #include <errno.h>
 #include <time.h>
 #include <stdarg.h>
@@ -83,6 +85,10 @@ struct stream_offset {
 	const char* stream;
 	off_t eof_offset;
 	off_t cur_offset;
+	off_t size; /* last known size of the stream file */
+	unsigned int eof_seq; /* segment where the eof_offset belongs to */
+	unsigned int seq; /* segment where the cur_offset belongs to */
+	int fd; /* closed segment being read, -1 when reading the stream file */
 	struct stream_offset* next;
 };
 
@@ -100,6 +106,9 @@ static void ncntf_replay_ends_free(void* data)
 	while (list != NULL) {
 		item = list;
 		list = list->next;
+		if (item->fd != -1) {
+			close(item->fd);
+		}
 		free(item);
 	}
 }
@@ -122,9 +131,79 @@ static void ncntf_replay_ends_free(void* data)
 #define MAGIC_NAME "NCSTREAM"
 #define MAGIC_VERSION 0xFF01
 
+/* size of the record header - int32_t len + uint64_t (time_t meaning) time */
+#define RECORD_HEADER_SIZE (sizeof(int32_t) + sizeof(uint64_t))
+
+/*
+ * STREAM INDEX FILE FORMAT
+ * char[8] == "NCSINDEX"
+ * uint64_t end; - offset in the stream file where the indexed records end
+ * uint64_t tmax; - the latest time of the indexed records
+ * uint64_t last; - offset of the record in the last entry
+ * struct index_entry[] entries;
+ *
+ * An entry is added at the first record starting INDEX_STEP bytes after the
+ * record of the previous entry. Entry's tmax is the latest time of all the
+ * records preceding the entry's record, so the values are not decreasing
+ * even if the events are not stored in the order of their times.
+ */
+
+/*
+ * STREAM SEGMENTS
+ * When the stream file exceeds the segment size set by
+ * ncntf_stream_set_retention(), it is closed as a segment <name>.events.<seq>
+ * together with its index <name>.index.<seq> and a new <name>.events file
+ * with the same header is started. The closed segment ends with a record of
+ * zero length and time, so its readers know to continue in the new stream
+ * file. The sequence number of the current stream file is the number
+ * following the last closed segment. The time of the
+ * latest event removed with the aged segments is kept in <name>.aged as
+ * uint64_t (time_t meaning).
+ */
+
+/* magic bytes to recognize libnetconf's stream index files */
+#define INDEX_MAGIC "NCSINDEX"
+#define INDEX_STEP 65536
+
+struct index_header {
+	char magic[8];
+	uint64_t end;
+	uint64_t tmax;
+	uint64_t last;
+};
+
+struct index_entry {
+	uint64_t offset;
+	uint64_t tmax;
+};
+
+/*
+ * Records read or stored by this process are kept in a small ring of each
+ * stream shared by all the subscribers of the process, so a record is read
+ * from the stream file and parsed only once. Records stored by another
+ * process get into the ring when the first local subscriber reads them from
+ * the stream file.
+ */
+#define NCNTF_RING_SIZE 64
+
+struct ncntf_event {
+	time_t etime;
+	char* text;
+	xmlDocPtr doc; /* parsed on demand, read-only for the subscribers */
+	unsigned int refs;
+};
+
+struct ring_slot {
+	unsigned int seq; /* segment of the record */
+	off_t offset; /* offset of the record in the stream file */
+	off_t next; /* offset of the following record */
+	struct ncntf_event* event;
+};
+
 struct stream {
 	int fd_events;
 	int fd_rules;
+	int fd_index;
 	char* name;
 	char* desc;
 	uint8_t replay;
@@ -132,6 +211,14 @@ struct stream {
 	int locked;
 	char* rules;
 	unsigned int data;
+	struct ring_slot ring[NCNTF_RING_SIZE];
+	unsigned int ring_head;
+	ino_t ino; /* inode of the opened stream file */
+	unsigned int seq; /* segment sequence number of the opened stream file */
+	time_t checked; /* when the stream file was checked to be still current */
+	size_t segment_size;
+	size_t max_size;
+	time_t max_age;
 	struct stream *next;
 };
 
@@ -142,8 +229,17 @@ static xmlDocPtr ncntf_config = NULL;
 static struct stream *streams = NULL;
 static pthread_mutex_t *streams_mut = NULL;
 
+/* local subscribers wait for the events stored by this process here */
+static pthread_mutex_t events_mut = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t events_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int events_seq = 0;
+
 /* local function declaration */
 static int ncntf_event_isallowed(const char* stream, const char* event);
+static int ncntf_stream_lock(struct stream *s);
+static int ncntf_stream_unlock(struct stream *s);
+static time_t stream_aged(const char* name);
+static void ncntf_stream_free(struct stream *s);
 
 /*
  * Modify the given list of files in the specified directory to keep only
@@ -271,6 +367,7 @@ static xmlDocPtr streams_to_xml(void)
 	xmlNsPtr ns;
 	struct stream *s;
 	char* time;
+	time_t aged;
 
 	/* create empty configuration */
 	config = xmlNewDoc(BAD_CAST "1.0");
@@ -288,12 +385,31 @@ static xmlDocPtr streams_to_xml(void)
 			time = nc_time2datetime(s->created, NULL);
 			xmlNewChild(node_stream, NULL, BAD_CAST "replayLogCreationTime", BAD_CAST time);
 			free (time);
+			if ((aged = stream_aged(s->name)) != -1) {
+				time = nc_time2datetime(aged, NULL);
+				xmlNewChild(node_stream, NULL, BAD_CAST "replayLogAgedTime", BAD_CAST time);
+				free (time);
+			}
 		}
 	}
 
 	return (config);
 }
 
+/*
+ * Rebuild the streams configuration data, streams_mut must be held by the
+ * caller. The current document is kept if the new one cannot be built.
+ */
+static void ncntf_config_update(void)
+{
+	xmlDocPtr newconfig;
+
+	if ((newconfig = streams_to_xml()) != NULL) {
+		xmlFreeDoc(ncntf_config);
+		ncntf_config = newconfig;
+	}
+}
+
 static int map_rules(struct stream *s)
 {
 	mode_t mask;
@@ -354,6 +470,511 @@ static int map_rules(struct stream *s)
 	}
 }
 
+/*
+ * Open the index file of the stream. The index only speeds up the replay, so
+ * the failure is not fatal - the stream is then replayed without the index.
+ */
+static void open_index(struct stream *s, int truncate)
+{
+	mode_t mask;
+	char* filepath = NULL;
+
+	assert(s != NULL);
+
+	if (s->fd_index != -1) {
+		if (truncate && ftruncate(s->fd_index, 0) == -1) {
+			WARN("ftruncate() on the stream index file \'%s\' failed (%s).", s->name, strerror(errno));
+		}
+		return;
+	}
+
+	if (streams_path == NULL) {
+		return;
+	}
+	if (asprintf(&filepath, "%s/%s.index", streams_path, s->name) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return;
+	}
+	mask = umask(0000);
+	s->fd_index = open(filepath, O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), FILE_PERM);
+	umask(mask);
+	if (s->fd_index == -1) {
+		WARN("Unable to open the Events stream index file %s (%s)", filepath, strerror(errno));
+	}
+	free(filepath);
+}
+
+/*
+ * Add the records appended to the stream file since the last call into the
+ * stream index. If the index does not correspond to the stream file, it is
+ * created again. The stream file must be locked.
+ */
+static void ncntf_stream_index_sync(struct stream *s)
+{
+	struct index_header h;
+	struct index_entry entry;
+	struct stat st;
+	char* buf;
+	off_t isize, boff;
+	ssize_t blen;
+	int32_t len;
+	uint64_t t;
+
+	if (s->fd_index == -1 || fstat(s->fd_events, &st) == -1 || (isize = lseek(s->fd_index, 0, SEEK_END)) == -1) {
+		return;
+	}
+
+	if (isize < (off_t)sizeof(h) || (isize - sizeof(h)) % sizeof(entry) != 0 ||
+			pread(s->fd_index, &h, sizeof(h), 0) != sizeof(h) ||
+			memcmp(h.magic, INDEX_MAGIC, sizeof(h.magic)) != 0 ||
+			h.end < s->data || h.end > (uint64_t)st.st_size) {
+		/* the index is missing or it is outdated (the stream file was rewritten) */
+		memcpy(h.magic, INDEX_MAGIC, sizeof(h.magic));
+		h.end = s->data;
+		h.tmax = 0;
+		h.last = 0;
+		if (ftruncate(s->fd_index, sizeof(h)) == -1) {
+			WARN("ftruncate() on the stream index file \'%s\' failed (%s).", s->name, strerror(errno));
+			return;
+		}
+		isize = sizeof(h);
+	} else if (h.end == (uint64_t)st.st_size) {
+		/* nothing new */
+		return;
+	}
+
+	/* read the record headers in blocks, the records' content is skipped */
+	if ((buf = malloc(INDEX_STEP)) == NULL) {
+		ERROR("Memory allocation failed - %s (%s:%d).", strerror(errno), __FILE__, __LINE__);
+		return;
+	}
+	boff = h.end;
+	blen = 0;
+	while (h.end + RECORD_HEADER_SIZE <= (uint64_t)st.st_size) {
+		if (h.end + RECORD_HEADER_SIZE > (uint64_t)(boff + blen)) {
+			boff = h.end;
+			if ((blen = pread(s->fd_events, buf, INDEX_STEP, boff)) < (ssize_t)RECORD_HEADER_SIZE) {
+				break;
+			}
+		}
+		memcpy(&len, buf + (h.end - boff), sizeof(int32_t));
+		memcpy(&t, buf + (h.end - boff) + sizeof(int32_t), sizeof(uint64_t));
+		if (len < 0 || h.end + RECORD_HEADER_SIZE + len > (uint64_t)st.st_size) {
+			/* incomplete record */
+			break;
+		}
+
+		if (isize == sizeof(h) || h.end >= h.last + INDEX_STEP) {
+			entry.offset = h.end;
+			entry.tmax = h.tmax;
+			if (pwrite(s->fd_index, &entry, sizeof(entry), isize) != sizeof(entry)) {
+				WARN("Writing the stream index file \'%s\' failed (%s).", s->name, strerror(errno));
+				/* it will be created again next time */
+				h.end = 0;
+				break;
+			}
+			isize += sizeof(entry);
+			h.last = h.end;
+		}
+		if ((time_t)t > (time_t)h.tmax) {
+			h.tmax = t;
+		}
+		h.end += RECORD_HEADER_SIZE + len;
+	}
+	free(buf);
+
+	if (pwrite(s->fd_index, &h, sizeof(h), 0) != sizeof(h)) {
+		WARN("Writing the stream index file \'%s\' failed (%s).", s->name, strerror(errno));
+	}
+}
+
+/*
+ * Search the index for the offset of the record from which the records with
+ * times since the start time can appear. The data is the offset of the first
+ * record in the stream file.
+ */
+static off_t index_search(int fd_index, off_t data, time_t start)
+{
+	struct index_entry entry;
+	off_t isize, lo, hi, mid, offset = data;
+
+	if (fd_index == -1 || (isize = lseek(fd_index, 0, SEEK_END)) <= (off_t)sizeof(struct index_header)) {
+		return (offset);
+	}
+
+	/* binary search for the last entry preceded only by the earlier records */
+	lo = 0;
+	hi = (isize - sizeof(struct index_header)) / sizeof(entry);
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (pread(fd_index, &entry, sizeof(entry), sizeof(struct index_header) + mid * sizeof(entry)) != sizeof(entry)) {
+			break;
+		}
+		if ((time_t)entry.tmax < start) {
+			offset = entry.offset;
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return (offset);
+}
+
+/*
+ * Get the offset of the stream file record from which the records with
+ * times since the start time can appear. The stream file must be locked.
+ */
+static off_t ncntf_stream_index_seek(struct stream *s, time_t start)
+{
+	ncntf_stream_index_sync(s);
+	return (index_search(s->fd_index, s->data, start));
+}
+
+/*
+ * Get the sorted list of sequence numbers of the stream's closed segments.
+ *
+ * returns the number of segments in the list, -1 on error
+ */
+static int segments_list(const char* name, unsigned int **list)
+{
+	struct dirent **filelist;
+	char* prefix;
+	char* end;
+	unsigned long seq;
+	int n, i, j, count = 0;
+	size_t plen;
+
+	*list = NULL;
+	if (streams_path == NULL || asprintf(&prefix, "%s.events.", name) == -1) {
+		return (-1);
+	}
+	plen = strlen(prefix);
+
+	if ((n = scandir(streams_path, &filelist, NULL, NULL)) < 0) {
+		ERROR("Unable to read from the Events streams directory %s (%s).", streams_path, strerror(errno));
+		free(prefix);
+		return (-1);
+	}
+	if ((*list = malloc((n + 1) * sizeof(unsigned int))) == NULL) {
+		ERROR("Memory allocation failed - %s (%s:%d).", strerror(errno), __FILE__, __LINE__);
+		count = -1;
+	}
+	for (i = 0; i < n; i++) {
+		if (count != -1 && strncmp(filelist[i]->d_name, prefix, plen) == 0 && isdigit(filelist[i]->d_name[plen])) {
+			seq = strtoul(filelist[i]->d_name + plen, &end, 10);
+			if (*end == '\0' && seq > 0 && seq < UINT_MAX) {
+				/* insertion sort, there are usually only a few segments */
+				for (j = count++; j > 0 && (*list)[j - 1] > seq; j--) {
+					(*list)[j] = (*list)[j - 1];
+				}
+				(*list)[j] = (unsigned int)seq;
+			}
+		}
+		free(filelist[i]);
+	}
+	free(filelist);
+	free(prefix);
+
+	return (count);
+}
+
+/*
+ * Get the sequence number of the last closed segment of the stream, 0 if
+ * there is none.
+ */
+static unsigned int segments_last(const char* name)
+{
+	unsigned int *list, seq = 0;
+	int n;
+
+	if ((n = segments_list(name, &list)) > 0) {
+		seq = list[n - 1];
+	}
+	free(list);
+
+	return (seq);
+}
+
+/*
+ * Remove all the closed segments of the stream, it is used when the stream
+ * is created again.
+ */
+static void segments_remove(const char* name)
+{
+	unsigned int *list;
+	char* path;
+	int n, i;
+
+	n = segments_list(name, &list);
+	for (i = 0; i < n; i++) {
+		if (asprintf(&path, "%s/%s.events.%u", streams_path, name, list[i]) != -1) {
+			unlink(path);
+			free(path);
+		}
+		if (asprintf(&path, "%s/%s.index.%u", streams_path, name, list[i]) != -1) {
+			unlink(path);
+			free(path);
+		}
+	}
+	free(list);
+
+	if (streams_path != NULL && asprintf(&path, "%s/%s.aged", streams_path, name) != -1) {
+		unlink(path);
+		free(path);
+	}
+}
+
+/*
+ * Get the latest time of the events in the closed segment from its index.
+ *
+ * returns -1 if the time is not known
+ */
+static time_t segment_tmax(const char* name, unsigned int seq)
+{
+	struct index_header h;
+	char* path;
+	time_t tmax = -1;
+	int fd;
+
+	if (asprintf(&path, "%s/%s.index.%u", streams_path, name, seq) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (-1);
+	}
+	if ((fd = open(path, O_RDONLY)) != -1) {
+		if (pread(fd, &h, sizeof(h), 0) == sizeof(h) && memcmp(h.magic, INDEX_MAGIC, sizeof(h.magic)) == 0) {
+			tmax = (time_t)h.tmax;
+		}
+		close(fd);
+	}
+	free(path);
+
+	return (tmax);
+}
+
+/*
+ * Open the closed segment of the stream for reading.
+ *
+ * returns the file descriptor, -1 if the segment does not exist
+ */
+static int segment_open(const char* name, unsigned int seq)
+{
+	char* path;
+	int fd;
+
+	if (asprintf(&path, "%s/%s.events.%u", streams_path, name, seq) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (-1);
+	}
+	fd = open(path, O_RDONLY);
+	free(path);
+
+	return (fd);
+}
+
+/*
+ * Get the time of the latest event removed from the replay log of the stream.
+ *
+ * returns -1 if no event was removed
+ */
+static time_t stream_aged(const char* name)
+{
+	char* path;
+	uint64_t t;
+	time_t aged = -1;
+	int fd;
+
+	if (asprintf(&path, "%s/%s.aged", streams_path, name) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (-1);
+	}
+	if ((fd = open(path, O_RDONLY)) != -1) {
+		if (read(fd, &t, sizeof(uint64_t)) == sizeof(uint64_t)) {
+			aged = (time_t)t;
+		}
+		close(fd);
+	}
+	free(path);
+
+	return (aged);
+}
+
+/*
+ * Create a shared event holding the given record text, the caller holds the
+ * only reference.
+ */
+static struct ncntf_event* ncntf_event_create(time_t etime, char* text)
+{
+	struct ncntf_event* e;
+
+	if ((e = malloc(sizeof(struct ncntf_event))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	e->etime = etime;
+	e->text = text;
+	e->doc = NULL;
+	e->refs = 1;
+
+	return (e);
+}
+
+/*
+ * Drop a reference to the shared event, the last one frees it.
+ */
+static void ncntf_event_release(struct ncntf_event* e)
+{
+	if (e == NULL) {
+		return;
+	}
+
+	DBG_LOCK("streams_mut");
+	pthread_mutex_lock(streams_mut);
+	if (--e->refs > 0) {
+		e = NULL;
+	}
+	DBG_UNLOCK("streams_mut");
+	pthread_mutex_unlock(streams_mut);
+
+	if (e != NULL) {
+		xmlFreeDoc(e->doc);
+		free(e->text);
+		free(e);
+	}
+}
+
+/*
+ * Get the parsed record of the shared event. The document is shared by all
+ * the holders of the event and it must not be modified.
+ */
+static xmlDocPtr ncntf_event_doc(struct ncntf_event* e)
+{
+	xmlDocPtr doc;
+
+	DBG_LOCK("streams_mut");
+	pthread_mutex_lock(streams_mut);
+	doc = e->doc;
+	DBG_UNLOCK("streams_mut");
+	pthread_mutex_unlock(streams_mut);
+	if (doc != NULL) {
+		return (doc);
+	}
+
+	/*
+	 * parse without the dictionary, copying nodes from a document with
+	 * a dictionary would modify the dictionary from several threads
+	 */
+	if ((doc = xmlReadMemory(e->text, strlen(e->text), NULL, NULL, NC_XMLREAD_OPTIONS | XML_PARSE_NODICT)) == NULL) {
+		return (NULL);
+	}
+
+	DBG_LOCK("streams_mut");
+	pthread_mutex_lock(streams_mut);
+	if (e->doc == NULL) {
+		e->doc = doc;
+	} else {
+		/* someone else was faster */
+		xmlFreeDoc(doc);
+		doc = e->doc;
+	}
+	DBG_UNLOCK("streams_mut");
+	pthread_mutex_unlock(streams_mut);
+
+	return (doc);
+}
+
+/*
+ * Find the record starting at the given offset of the given segment in the
+ * stream's ring. streams_mut must be locked.
+ */
+static struct ring_slot* ring_find(struct stream *s, unsigned int seq, off_t offset)
+{
+	struct ring_slot* slot;
+	unsigned int i;
+
+	/* start with the latest records, the subscribers usually wait for them */
+	for (i = 1; i <= NCNTF_RING_SIZE; i++) {
+		slot = &(s->ring[(s->ring_head - i) % NCNTF_RING_SIZE]);
+		if (slot->event == NULL) {
+			/* the ring is not full yet */
+			break;
+		}
+		if (slot->offset == offset && slot->seq == seq) {
+			return (slot);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ * Add the record to the stream's ring replacing the oldest one.
+ * streams_mut must be locked.
+ */
+static void ring_add(struct stream *s, unsigned int seq, off_t offset, off_t next, struct ncntf_event* e)
+{
+	struct ring_slot* slot;
+
+	slot = &(s->ring[s->ring_head++ % NCNTF_RING_SIZE]);
+	ncntf_event_release(slot->event);
+	e->refs++;
+	slot->seq = seq;
+	slot->offset = offset;
+	slot->next = next;
+	slot->event = e;
+}
+
+/*
+ * Drop all the records from the stream's ring.
+ */
+static void ring_clean(struct stream *s)
+{
+	int i;
+
+	for (i = 0; i < NCNTF_RING_SIZE; i++) {
+		ncntf_event_release(s->ring[i].event);
+		s->ring[i].event = NULL;
+	}
+	s->ring_head = 0;
+}
+
+/*
+ * Wake up the local subscribers waiting for a new event.
+ */
+static void ncntf_event_announce(void)
+{
+	pthread_mutex_lock(&events_mut);
+	events_seq++;
+	pthread_cond_broadcast(&events_cond);
+	pthread_mutex_unlock(&events_mut);
+}
+
+/*
+ * Wait until a new event is stored by this process, but at most
+ * NCNTF_DISPATCH_SLEEP microseconds to notice events stored by other
+ * processes. The seq is the events_seq value from the last check of the
+ * stream.
+ */
+static void ncntf_event_wait(unsigned int seq)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += NCNTF_DISPATCH_SLEEP * 1000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&events_mut);
+	while (events_seq == seq) {
+		if (pthread_cond_timedwait(&events_cond, &events_mut, &ts) != 0) {
+			break;
+		}
+	}
+	pthread_mutex_unlock(&events_mut);
+}
+
 /*
  * Create a new stream file and write the header corresponding to the given
  * stream structure. If the file is already opened (the stream structure has a file
@@ -370,6 +991,7 @@ static int write_fileheader(struct stream *s)
 	uint64_t t;
 	ssize_t r;
 	size_t hlen = 0, offset = 0;
+	struct stat st;
 
 	/* check used variables */
 	assert(s != NULL);
@@ -466,10 +1088,19 @@ static int write_fileheader(struct stream *s)
 
 	/* set where the data starts */
 	s->data = lseek(s->fd_events, 0, SEEK_CUR);
+	if (fstat(s->fd_events, &st) == 0) {
+		s->ino = st.st_ino;
+	}
+
+	/* the previous index is not valid anymore */
+	open_index(s, 1);
 
 	return (EXIT_SUCCESS);
 }
 
+/* how many times to try reading the header of a stream file being replaced */
+#define READ_FILEHEADER_ATTEMPTS 5
+
 /*
  * Read the file header and fill in the stream structure of the stream file specified
  * as filepath. If the file is not a proper libnetconf's stream file, NULL is
@@ -483,8 +1114,10 @@ static struct stream *read_fileheader(const char* filepath)
 	uint16_t magic_number;
 	uint16_t len;
 	uint64_t t;
-	int r;
+	int r, attempts = 0;
+	struct stat st;
 
+again:
 	/* open the file */
 	fd = open(filepath, O_RDWR);
 	if (fd == -1) {
@@ -538,11 +1171,43 @@ static struct stream *read_fileheader(const char* filepath)
 	s->locked = 0;
 	s->rules = NULL;
 	s->fd_rules = -1;
+	s->fd_index = -1;
+	memset(s->ring, 0, sizeof(s->ring));
+	s->ring_head = 0;
+	s->ino = 0;
+	s->seq = 0;
+	s->checked = time(NULL);
+	s->segment_size = 0;
+	s->max_size = 0;
+	s->max_age = 0;
 	s->next = NULL;
 
 	/* move to the end of the file */
 	s->data = lseek(s->fd_events, 0, SEEK_CUR);
 
+	/*
+	 * the sequence number follows the last closed segment, keep the file
+	 * locked to avoid closing it as a segment by another process meanwhile
+	 */
+	if (fstat(s->fd_events, &st) == 0 && ncntf_stream_lock(s) == 0) {
+		s->ino = st.st_ino;
+		if (stat(filepath, &st) == 0 && st.st_ino == s->ino) {
+			s->seq = segments_last(s->name) + 1;
+		}
+		ncntf_stream_unlock(s);
+	}
+	if (s->seq == 0) {
+		ncntf_stream_free(s);
+		if (++attempts < READ_FILEHEADER_ATTEMPTS) {
+			/* the file is not the current stream file anymore, try it again */
+			goto again;
+		}
+		ERROR("Unable to get the current Events stream file %s.", filepath);
+		return (NULL);
+	}
+
+	open_index(s, 0);
+
 	return (s);
 
 read_fail:
@@ -570,6 +1235,10 @@ static void ncntf_stream_free(struct stream *s)
 	if (s->fd_events != -1) {
 		close(s->fd_events);
 	}
+	if (s->fd_index != -1) {
+		close(s->fd_index);
+	}
+	ring_clean(s);
 	free(s);
 }
 
@@ -624,17 +1293,19 @@ static struct stream* ncntf_stream_get(const char* stream)
  */
 static int ncntf_stream_lock(struct stream *s)
 {
-	off_t offset;
+	struct flock fl;
+
+	/* lock the whole file, the same as lockf() from the file beginning */
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = 0;
+	fl.l_len = 0;
 
 	/* this will be blocking, but all these locks should be short-term */
-	offset = lseek(s->fd_events, 0, SEEK_CUR);
-	lseek(s->fd_events, 0, SEEK_SET);
-	if (lockf(s->fd_events, F_LOCK, 0) == -1) {
-		lseek(s->fd_events, offset, SEEK_SET);
+	if (fcntl(s->fd_events, F_SETLKW, &fl) == -1) {
 		ERROR("Stream file locking failed (%s).", strerror(errno));
 		return (EXIT_FAILURE);
 	}
-	lseek(s->fd_events, offset, SEEK_SET);
 	s->locked = 1;
 	return (EXIT_SUCCESS);
 }
@@ -644,25 +1315,286 @@ static int ncntf_stream_lock(struct stream *s)
  */
 static int ncntf_stream_unlock(struct stream *s)
 {
-	off_t offset;
+	struct flock fl;
 
 	if (s->locked == 0) {
 		/* nothing to do */
 		return (EXIT_SUCCESS);
 	}
 
-	offset = lseek(s->fd_events, 0, SEEK_CUR);
-	lseek(s->fd_events, 0, SEEK_SET);
-	if (lockf(s->fd_events, F_ULOCK, 0) == -1) {
-		lseek(s->fd_events, offset, SEEK_SET);
+	fl.l_type = F_UNLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = 0;
+	fl.l_len = 0;
+
+	if (fcntl(s->fd_events, F_SETLK, &fl) == -1) {
 		ERROR("Stream file unlocking failed (%s).", strerror(errno));
 		return (EXIT_FAILURE);
 	}
-	lseek(s->fd_events, offset, SEEK_SET);
 	s->locked = 0;
 	return (EXIT_SUCCESS);
 }
 
+/*
+ * Switch the stream structure to the current stream file if the opened one
+ * was closed as a segment (by any process). Unless forced, the check is done
+ * at most once a second. The stream file must not be locked.
+ *
+ * returns 1 if the stream file was switched, 0 else
+ */
+static int ncntf_stream_reopen(struct stream *s, int force)
+{
+	struct stream *n;
+	struct stat st;
+	char* filepath;
+	time_t now;
+	int ret = 0;
+
+	now = time(NULL);
+	if (!force && s->checked == now) {
+		return (0);
+	}
+	s->checked = now;
+
+	if (asprintf(&filepath, "%s/%s.events", streams_path, s->name) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (0);
+	}
+	if (stat(filepath, &st) == 0 && st.st_ino != s->ino && (n = read_fileheader(filepath)) != NULL) {
+		close(s->fd_events);
+		if (s->fd_index != -1) {
+			close(s->fd_index);
+		}
+		s->fd_events = n->fd_events;
+		s->fd_index = n->fd_index;
+		s->data = n->data;
+		s->ino = n->ino;
+		s->seq = n->seq;
+		n->fd_events = -1;
+		n->fd_index = -1;
+		ncntf_stream_free(n);
+		ret = 1;
+	}
+	free(filepath);
+
+	return (ret);
+}
+
+/*
+ * Lock the stream file which is current, i.e. it was not closed as a segment
+ * by another process.
+ */
+static int ncntf_stream_lock_current(struct stream *s)
+{
+	struct stat st;
+	char* filepath;
+	int ret = EXIT_FAILURE;
+
+	if (asprintf(&filepath, "%s/%s.events", streams_path, s->name) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
+	}
+	while (ncntf_stream_lock(s) == 0) {
+		if (stat(filepath, &st) == -1 || st.st_ino == s->ino) {
+			ret = EXIT_SUCCESS;
+			break;
+		}
+		/* the file was closed as a segment meanwhile */
+		ncntf_stream_unlock(s);
+		if (ncntf_stream_reopen(s, 1) == 0) {
+			break;
+		}
+	}
+	free(filepath);
+
+	return (ret);
+}
+
+/*
+ * Remove the oldest closed segments of the stream exceeding the stream's
+ * limits of the total size or age of the events. The stream file must be
+ * locked.
+ */
+static void ncntf_stream_retention(struct stream *s)
+{
+	unsigned int *list;
+	off_t *sizes, total;
+	struct stat st;
+	char* path;
+	time_t tmax, aged = -1, now = time(NULL);
+	uint64_t t;
+	mode_t mask;
+	int n, i, fd;
+
+	if (s->max_size == 0 && s->max_age == 0) {
+		return;
+	}
+	if ((n = segments_list(s->name, &list)) <= 0) {
+		free(list);
+		return;
+	}
+	if ((sizes = calloc(n, sizeof(off_t))) == NULL) {
+		ERROR("Memory allocation failed - %s (%s:%d).", strerror(errno), __FILE__, __LINE__);
+		free(list);
+		return;
+	}
+
+	/* get the size of the whole replay log */
+	total = lseek(s->fd_events, 0, SEEK_END);
+	for (i = 0; i < n; i++) {
+		if (asprintf(&path, "%s/%s.events.%u", streams_path, s->name, list[i]) == -1) {
+			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+			goto cleanup;
+		}
+		if (stat(path, &st) == 0) {
+			sizes[i] = st.st_size;
+			total += st.st_size;
+		}
+		free(path);
+	}
+
+	/* and remove the oldest segments while the limits are exceeded */
+	for (i = 0; i < n; i++) {
+		if ((tmax = segment_tmax(s->name, list[i])) == -1) {
+			tmax = now;
+		}
+		if (!(s->max_size != 0 && (size_t)total > s->max_size) && !(s->max_age != 0 && tmax < now - s->max_age)) {
+			break;
+		}
+
+		VERB("Removing the segment %u of the Events stream %s.", list[i], s->name);
+		if (asprintf(&path, "%s/%s.events.%u", streams_path, s->name, list[i]) != -1) {
+			unlink(path);
+			free(path);
+		}
+		if (asprintf(&path, "%s/%s.index.%u", streams_path, s->name, list[i]) != -1) {
+			unlink(path);
+			free(path);
+		}
+		total -= sizes[i];
+		if (tmax > aged) {
+			aged = tmax;
+		}
+	}
+
+	/* remember the latest removed event for the replayLogAgedTime */
+	if (aged != -1 && aged > stream_aged(s->name) && asprintf(&path, "%s/%s.aged", streams_path, s->name) != -1) {
+		mask = umask(0000);
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, FILE_PERM);
+		umask(mask);
+		t = (uint64_t)aged;
+		if (fd == -1 || write(fd, &t, sizeof(uint64_t)) != sizeof(uint64_t)) {
+			WARN("Unable to store the aged time of the Events stream %s (%s).", s->name, strerror(errno));
+		}
+		if (fd != -1) {
+			close(fd);
+		}
+		free(path);
+	}
+
+cleanup:
+	free(sizes);
+	free(list);
+}
+
+/*
+ * Close the stream file as a segment and start a new one with the same
+ * header. The stream file must be locked, the new stream file is locked
+ * on return.
+ *
+ * returns 0 on success, non-zero value else (the previous stream file is
+ * still used)
+ */
+static int ncntf_stream_rotate(struct stream *s)
+{
+	char *filepath = NULL, *tmppath = NULL, *segpath = NULL;
+	char *indexpath = NULL, *segindexpath = NULL;
+	char marker[RECORD_HEADER_SIZE];
+	int fd_old, fd_index_old;
+	ino_t ino_old;
+	mode_t mask;
+	int ret = EXIT_FAILURE;
+
+	if (asprintf(&filepath, "%s/%s.events", streams_path, s->name) == -1 ||
+			asprintf(&tmppath, "%s/%s.events.tmp", streams_path, s->name) == -1 ||
+			asprintf(&segpath, "%s/%s.events.%u", streams_path, s->name, s->seq) == -1 ||
+			asprintf(&indexpath, "%s/%s.index", streams_path, s->name) == -1 ||
+			asprintf(&segindexpath, "%s/%s.index.%u", streams_path, s->name, s->seq) == -1) {
+		ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+		goto cleanup;
+	}
+
+	/* the index goes with the segment */
+	ncntf_stream_index_sync(s);
+	if (rename(indexpath, segindexpath) == -1) {
+		WARN("Unable to rename the Events stream index file %s (%s).", indexpath, strerror(errno));
+	}
+	fd_index_old = s->fd_index;
+	s->fd_index = -1;
+
+	/* prepare the new stream file aside to replace the current one at once */
+	fd_old = s->fd_events;
+	ino_old = s->ino;
+	mask = umask(0000);
+	s->fd_events = open(tmppath, O_RDWR | O_CREAT | O_TRUNC, FILE_PERM);
+	umask(mask);
+	if (s->fd_events == -1 || write_fileheader(s) != 0) {
+		ERROR("Unable to create the Events stream file %s (%s)", tmppath, strerror(errno));
+		goto revert;
+	}
+	if (link(filepath, segpath) == -1) {
+		ERROR("Unable to close the Events stream file %s as a segment (%s)", filepath, strerror(errno));
+		goto revert;
+	}
+	if (rename(tmppath, filepath) == -1) {
+		ERROR("Unable to replace the Events stream file %s (%s)", filepath, strerror(errno));
+		unlink(segpath);
+		goto revert;
+	}
+	VERB("The Events stream %s continues with the segment %u.", s->name, s->seq + 1);
+
+	/* let the readers of the closed segment know where to continue */
+	memset(marker, 0, RECORD_HEADER_SIZE);
+	if (pwrite(fd_old, marker, RECORD_HEADER_SIZE, lseek(fd_old, 0, SEEK_END)) != (ssize_t)RECORD_HEADER_SIZE) {
+		WARN("Unable to mark the end of the Events stream segment %s (%s).", segpath, strerror(errno));
+	}
+
+	/* the process' locks of the previous file are released by closing it */
+	close(fd_old);
+	if (fd_index_old != -1) {
+		close(fd_index_old);
+	}
+	s->seq++;
+	s->locked = 0;
+	ncntf_stream_lock(s);
+
+	ncntf_stream_retention(s);
+	ret = EXIT_SUCCESS;
+	goto cleanup;
+
+revert:
+	if (s->fd_events != -1) {
+		close(s->fd_events);
+		unlink(tmppath);
+	}
+	if (s->fd_index != -1) {
+		close(s->fd_index);
+	}
+	s->fd_events = fd_old;
+	s->fd_index = fd_index_old;
+	s->ino = ino_old;
+	rename(segindexpath, indexpath);
+
+cleanup:
+	free(filepath);
+	free(tmppath);
+	free(segpath);
+	free(indexpath);
+	free(segindexpath);
+
+	return (ret);
+}
+
 /*
  * Initiate the list of the available streams. It opens all the accessible stream files
  * from the stream directory.
@@ -710,6 +1642,11 @@ static int ncntf_streams_init(void)
 		if (filelist[n] == NULL) { /* was not a regular file */
 			continue;
 		}
+		if (strstr(filelist[n]->d_name, ".events.") != NULL) {
+			/* closed segment of a stream, it is accessed through the stream */
+			free(filelist[n]);
+			continue;
+		}
 
 		if (asprintf(&filepath, "%s/%s", streams_path, filelist[n]->d_name) == -1) {
 			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
@@ -815,7 +1752,18 @@ API char* ncntf_status(void)
 {
 	xmlChar* data;
 
+	if (ncntf_config == NULL) {
+		return (NULL);
+	}
+
+	/* the replay logs could be aged meanwhile */
+	DBG_LOCK("stream_mut");
+	pthread_mutex_lock(streams_mut);
+	ncntf_config_update();
 	xmlDocDumpFormatMemory(ncntf_config, &data, NULL, 1);
+	DBG_UNLOCK("streams_mut");
+	pthread_mutex_unlock(streams_mut);
+
 	return ((char*)data);
 }
 
@@ -835,7 +1783,6 @@ void ncntf_close(void)
 API int ncntf_stream_new(const char* name, const char* desc, int replay)
 {
 	struct stream *s;
-	xmlDocPtr oldconfig;
 
 	if (ncntf_config == NULL) {
 		return (EXIT_FAILURE);
@@ -870,6 +1817,16 @@ API int ncntf_stream_new(const char* name, const char* desc, int replay)
 	s->rules = NULL;
 	s->fd_events = -1;
 	s->fd_rules = -1;
+	s->fd_index = -1;
+	memset(s->ring, 0, sizeof(s->ring));
+	s->ring_head = 0;
+	s->seq = 1;
+	s->checked = time(NULL);
+	s->segment_size = 0;
+	s->max_size = 0;
+	s->max_age = 0;
+	/* the segments of a previous stream of the same name are not valid */
+	segments_remove(s->name);
 	if (write_fileheader(s) != 0 || map_rules(s) != 0) {
 		ncntf_stream_free(s);
 		DBG_UNLOCK("streams_mut");
@@ -879,11 +1836,9 @@ API int ncntf_stream_new(const char* name, const char* desc, int replay)
 		/* add created stream into the list */
 		s->next = streams;
 		streams = s;
+		ncntf_config_update();
 		DBG_UNLOCK("streams_mut");
 		pthread_mutex_unlock(streams_mut);
-		oldconfig = ncntf_config;
-		ncntf_config = streams_to_xml();
-		xmlFreeDoc(oldconfig);
 		return (EXIT_SUCCESS);
 	}
 }
@@ -920,6 +1875,31 @@ API int ncntf_stream_allow_events(const char* stream, const char* event)
 	return (EXIT_SUCCESS);
 }
 
+API int ncntf_stream_set_retention(const char* stream, size_t segment_size, size_t max_size, time_t max_age)
+{
+	struct stream* s;
+
+	if (stream == NULL || max_age < 0) {
+		return (EXIT_FAILURE);
+	}
+
+	DBG_LOCK("stream_mut");
+	pthread_mutex_lock(streams_mut);
+	if ((s = ncntf_stream_get(stream)) == NULL) {
+		/* stream does not exist or some error occurred */
+		DBG_UNLOCK("streams_mut");
+		pthread_mutex_unlock(streams_mut);
+		return (EXIT_FAILURE);
+	}
+	s->segment_size = segment_size;
+	s->max_size = max_size;
+	s->max_age = max_age;
+	DBG_UNLOCK("streams_mut");
+	pthread_mutex_unlock(streams_mut);
+
+	return (EXIT_SUCCESS);
+}
+
 API char** ncntf_stream_list(void)
 {
 	char** list;
@@ -1025,6 +2005,7 @@ API void ncntf_stream_iter_start(const char* stream)
 		/* the list of opened streams is empty */
 		str_off = malloc(sizeof(struct stream_offset));
 		str_off->stream = stream;
+		str_off->fd = -1;
 		str_off->next = off_list;
 		pthread_setspecific(ncntf_replay_ends, (void*)str_off);
 	}
@@ -1036,10 +2017,17 @@ API void ncntf_stream_iter_start(const char* stream)
 		pthread_mutex_unlock(streams_mut);
 		return;
 	}
+	ncntf_stream_reopen(s, 1);
+	if (str_off->fd != -1) {
+		close(str_off->fd);
+		str_off->fd = -1;
+	}
 	/* remember the current end of file position */
-	str_off->eof_offset = lseek(s->fd_events, 0, SEEK_END);
+	str_off->size = str_off->eof_offset = lseek(s->fd_events, 0, SEEK_END);
+	str_off->eof_seq = s->seq;
 	/* and the thread's specific position in the file (start of stream file records section) */
 	str_off->cur_offset = s->data;
+	str_off->seq = s->seq;
 	DBG_UNLOCK("streams_mut");
 	pthread_mutex_unlock(streams_mut);
 }
@@ -1053,25 +2041,75 @@ API void ncntf_stream_iter_finish(const char* stream)
 	if (str_off) {
 		str_off->eof_offset = 0;
 		str_off->cur_offset = 0;
+		str_off->size = 0;
+		str_off->eof_seq = 0;
+		str_off->seq = 0;
+		if (str_off->fd != -1) {
+			close(str_off->fd);
+			str_off->fd = -1;
+		}
 	}
 }
 
 /*
- * Pop the next event record from the stream file.
- *
+ * Move the iteration to the first segment and the first record in it which
+ * can be followed by the events since the start time.
  */
-API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop, time_t *event_time)
+static void ncntf_stream_replay_seek(struct stream *s, struct stream_offset *str_off, time_t start)
+{
+	unsigned int *list;
+	char* path;
+	time_t tmax;
+	int n, i, fd;
+
+	n = segments_list(s->name, &list);
+	for (i = 0; i < n && list[i] < s->seq; i++) {
+		if ((tmax = segment_tmax(s->name, list[i])) != -1 && tmax < start) {
+			/* all the events in the segment precede the start time */
+			continue;
+		}
+
+		str_off->seq = list[i];
+		str_off->cur_offset = s->data;
+		if (tmax != -1 && asprintf(&path, "%s/%s.index.%u", streams_path, s->name, list[i]) != -1) {
+			if ((fd = open(path, O_RDONLY)) != -1) {
+				str_off->cur_offset = index_search(fd, s->data, start);
+				close(fd);
+			}
+			free(path);
+		}
+		free(list);
+		return;
+	}
+	free(list);
+
+	/* only the current stream file can contain such events */
+	if (ncntf_stream_lock(s) == 0) {
+		str_off->cur_offset = ncntf_stream_index_seek(s, start);
+		ncntf_stream_unlock(s);
+	}
+}
+
+/*
+ * Pop the next event record from the stream. The record is taken from the
+ * stream's ring if it is there, otherwise it is read from the stream file and
+ * added into the ring. The caller gets its own reference to the returned event.
+ */
+static struct ncntf_event* ncntf_stream_iter_next_event(const char* stream, time_t start, time_t stop)
 {
 	struct stream *s;
 	int32_t len;
 	uint64_t t;
-	off_t aux;
+	char header[RECORD_HEADER_SIZE];
 	char* text = NULL;
 	off_t* replay_end;
+	off_t offset;
 	char* time_s;
 	time_t tnow;
-	int r;
+	int r, fd;
 	struct stream_offset *str_off, *off_list;
+	struct ring_slot *slot;
+	struct ncntf_event *e;
 
 	if (ncntf_config == NULL) {
 		return (NULL);
@@ -1112,9 +2150,15 @@ API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop,
 		 * so skip to the end of the file and mark replay as done
 		 */
 		str_off->cur_offset = str_off->eof_offset;
+		str_off->seq = str_off->eof_seq;
 		*replay_end = 0;
 	}
 
+	if (start != -1 && s->replay == 1 && *replay_end != 0 && str_off->seq == str_off->eof_seq && str_off->cur_offset == s->data) {
+		/* replay is starting, skip the segments and records preceding the start time at once */
+		ncntf_stream_replay_seek(s, str_off, start);
+	}
+
 	while (1) {
 		/* condition to read events from file (use replay):
 		 * 1) startTime is specified
@@ -1123,7 +2167,7 @@ API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop,
 		 */
 		if ((start != -1) && (s->replay == 1) && (*replay_end != 0)) {
 			/* replay part */
-			if (str_off->cur_offset >= *replay_end) {
+			if (str_off->seq > str_off->eof_seq || (str_off->seq == str_off->eof_seq && str_off->cur_offset >= *replay_end)) {
 				/* we are getting out of replay */
 
 				DBG_UNLOCK("streams_mut");
@@ -1137,44 +2181,93 @@ API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop,
 					text = NULL;
 				}
 				free(time_s);
-				if (event_time != NULL) {
-					*event_time = tnow;
-				}
 				*replay_end = 0;
-				return (text);
+				if (text == NULL || (e = ncntf_event_create(tnow, text)) == NULL) {
+					free(text);
+					return (NULL);
+				}
+				return (e);
 			} else {
 				/* reading data from the stream file as replay */
 			}
 		}
 
-		/* check that we have something to read */
-		if (str_off->cur_offset == (aux = lseek(s->fd_events, 0, SEEK_END))) {
-			/* nothing to read */
+		/* the record can be already known to this process */
+		if ((slot = ring_find(s, str_off->seq, str_off->cur_offset)) != NULL) {
+			str_off->cur_offset = slot->next;
+			if (((start != -1) && (start > slot->event->etime)) || ((stop != -1) && (stop < slot->event->etime))) {
+				/* out of the requested time range, read another event */
+				continue;
+			}
+			e = slot->event;
+			e->refs++;
 			DBG_UNLOCK("streams_mut");
 			pthread_mutex_unlock(streams_mut);
-			return(NULL);
+			return (e);
 		}
-		/* move file offset to the read position */
-		lseek(s->fd_events, str_off->cur_offset, SEEK_SET);
 
-		if (ncntf_stream_lock(s) == 0) {
-			if ((r = read(s->fd_events, &len, sizeof(int32_t))) <= 0) {
-				ERROR("Reading the stream file failed (%s).", (r < 0) ? strerror(errno) : "Unexpected end of file");
+		if (str_off->seq < s->seq) {
+			/* reading a closed segment, it does not change anymore */
+			if (str_off->fd == -1 && (str_off->fd = segment_open(s->name, str_off->seq)) == -1) {
+				/* the segment was removed meanwhile, continue with the next one */
+				str_off->seq++;
+				str_off->cur_offset = s->data;
+				str_off->size = 0;
+				continue;
+			}
+			if (str_off->cur_offset >= str_off->size && str_off->cur_offset >= (str_off->size = lseek(str_off->fd, 0, SEEK_END))) {
+				/* end of the segment, continue with the next one */
+				close(str_off->fd);
+				str_off->fd = -1;
+				str_off->seq++;
+				str_off->cur_offset = s->data;
+				str_off->size = 0;
+				continue;
+			}
+			fd = str_off->fd;
+		} else {
+			str_off->seq = s->seq;
+
+			/*
+			 * check that we have something to read, the file size is checked
+			 * only when all the records known so far were read
+			 */
+			if (str_off->cur_offset >= str_off->size && str_off->cur_offset >= (str_off->size = lseek(s->fd_events, 0, SEEK_END))) {
+				if (ncntf_stream_reopen(s, 0)) {
+					/* the stream file was closed as a segment, finish it */
+					str_off->size = 0;
+					continue;
+				}
+				/* nothing to read */
 				DBG_UNLOCK("streams_mut");
-				ncntf_stream_iter_finish(stream);
 				pthread_mutex_unlock(streams_mut);
-				return (NULL);
+				return(NULL);
 			}
-			str_off->cur_offset += r;
-			if ((r = read(s->fd_events, &t, sizeof(uint64_t))) <= 0) {
+			fd = s->fd_events;
+		}
+
+		if (fd != s->fd_events || ncntf_stream_lock(s) == 0) {
+			/* read the record header at once */
+			if ((r = pread(fd, header, RECORD_HEADER_SIZE, str_off->cur_offset)) < (int)RECORD_HEADER_SIZE) {
 				ERROR("Reading the stream file failed (%s).", (r < 0) ? strerror(errno) : "Unexpected end of file");
 				DBG_UNLOCK("streams_mut");
 				ncntf_stream_iter_finish(stream);
 				pthread_mutex_unlock(streams_mut);
 				return (NULL);
 			}
-			str_off->cur_offset += r;
-			str_off->cur_offset += len;
+			memcpy(&len, header, sizeof(int32_t));
+			memcpy(&t, header + sizeof(int32_t), sizeof(uint64_t));
+			offset = str_off->cur_offset;
+			str_off->cur_offset += RECORD_HEADER_SIZE + len;
+
+			if (len == 0) {
+				/* end of the closed segment, switch to the current stream file */
+				ncntf_stream_unlock(s);
+				if (fd == s->fd_events) {
+					ncntf_stream_reopen(s, 1);
+				}
+				continue;
+			}
 
 			/* check boundaries */
 			if ((start != -1) && (start > (time_t)t)) {
@@ -1198,7 +2291,7 @@ API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop,
 
 			/* we're interested, read content */
 			text = malloc(len * sizeof(char));
-			if ((r = read(s->fd_events, text, len)) <= 0) {
+			if ((r = pread(fd, text, len, str_off->cur_offset - len)) < len) {
 				ERROR("Reading the stream file failed (%s).", (r < 0) ? strerror(errno) : "Unexpected end of file");
 				DBG_UNLOCK("streams_mut");
 				ncntf_stream_iter_finish(stream);
@@ -1207,6 +2300,16 @@ API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop,
 				return (NULL);
 			}
 			ncntf_stream_unlock(s);
+
+			/* share the record with the other subscribers of this process */
+			if ((e = ncntf_event_create((time_t)t, text)) == NULL) {
+				DBG_UNLOCK("streams_mut");
+				ncntf_stream_iter_finish(stream);
+				pthread_mutex_unlock(streams_mut);
+				free(text);
+				return (NULL);
+			}
+			ring_add(s, str_off->seq, offset, str_off->cur_offset, e);
 			break; /* end the reading loop */
 		} else {
 			ERROR("Unable to read an event from the stream file %s (locking failed).", s->name);
@@ -1220,9 +2323,24 @@ API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop,
 	DBG_UNLOCK("streams_mut");
 	pthread_mutex_unlock(streams_mut);
 
+	return (e);
+}
+
+API char* ncntf_stream_iter_next(const char* stream, time_t start, time_t stop, time_t *event_time)
+{
+	struct ncntf_event *e;
+	char* text;
+
+	if ((e = ncntf_stream_iter_next_event(stream, start, stop)) == NULL) {
+		return (NULL);
+	}
+
+	text = strdup(e->text);
 	if (event_time != NULL) {
-		*event_time = (time_t)t;
+		*event_time = e->etime;
 	}
+	ncntf_event_release(e);
+
 	return (text);
 }
 
@@ -1279,6 +2397,7 @@ static int ncntf_event_store(time_t etime, const char* content)
 	char *event_time = NULL, *aux1 = NULL;
 	char *record = NULL, *ename = NULL;
 	struct stream* s;
+	struct ncntf_event* e = NULL;
 	uint64_t etime64;
 	xmlDocPtr edoc;
 	int32_t len;
@@ -1343,8 +2462,13 @@ static int ncntf_event_store(time_t etime, const char* content)
 
 		if (ncntf_event_isallowed(s->name, ename) != 0) {
 			/* log the event to the stream file */
-			if (ncntf_stream_lock(s) == 0) {
+			if (ncntf_stream_lock_current(s) == 0) {
 				offset = lseek(s->fd_events, 0, SEEK_END);
+				if (s->segment_size != 0 && offset > (off_t)s->data && (size_t)offset + RECORD_HEADER_SIZE + len > s->segment_size &&
+						ncntf_stream_rotate(s) == 0) {
+					/* the stream file is full, continue in a new one */
+					offset = lseek(s->fd_events, 0, SEEK_END);
+				}
 				while (((r = write(s->fd_events, &len, sizeof(int32_t))) == -1) && (errno == EAGAIN ||errno == EINTR));
 				if (r == -1) {
                     goto write_failed;
@@ -1365,6 +2489,16 @@ write_failed:
 					if (ftruncate(s->fd_events, offset) == -1) {
 						ERROR("ftruncate() on the stream file \'%s\' failed (%s).", s->name, strerror(errno));
 					}
+				} else {
+					/* add the record into the stream index */
+					ncntf_stream_index_sync(s);
+					/* and hand it over to the local subscribers */
+					if (e == NULL) {
+						e = ncntf_event_create(etime, record);
+					}
+					if (e != NULL) {
+						ring_add(s, s->seq, offset, offset + RECORD_HEADER_SIZE + len, e);
+					}
 				}
 				lseek(s->fd_events, offset, SEEK_SET);
 				ncntf_stream_unlock(s);
@@ -1376,6 +2510,13 @@ write_failed:
 	DBG_UNLOCK("streams_mut");
 	pthread_mutex_unlock(streams_mut);
 
+	if (e != NULL) {
+		/* the record text is owned by the shared event now */
+		record = NULL;
+		ncntf_event_release(e);
+		ncntf_event_announce();
+	}
+
 cleanup:
 	/* final cleanup */
 	free(record);
@@ -2337,7 +3478,9 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 	char* stream = NULL, *event = NULL, *time_s = NULL;
 	struct nc_filter *filter = NULL;
 	time_t start, stop;
-	xmlDocPtr event_doc, filter_doc;
+	struct ncntf_event *shared;
+	unsigned int seq;
+	xmlDocPtr event_doc, shared_doc, filter_doc;
 	xmlNodePtr event_node, aux_node, nodelist = NULL;
 	nc_ntf* ntf;
 	nc_reply *reply;
@@ -2400,18 +3543,23 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 		DBG_UNLOCK("mut_ntf");
 		pthread_mutex_unlock(&(session->mut_ntf));
 
-		if ((event = ncntf_stream_iter_next(stream, start, stop, NULL)) == NULL) {
+		pthread_mutex_lock(&events_mut);
+		seq = events_seq;
+		pthread_mutex_unlock(&events_mut);
+		if ((shared = ncntf_stream_iter_next_event(stream, start, stop)) == NULL) {
 			if ((stop == -1) || ((stop != -1) && (stop > time(NULL)))) {
-				usleep(NCNTF_DISPATCH_SLEEP);
+				ncntf_event_wait(seq);
 				continue;
 			} else {
 				DBG("stream iter end: stop=%ld, time=%ld", stop, time(NULL));
 				break;
 			}
 		}
-		if ((event_doc = xmlReadMemory(event, strlen(event), NULL, NULL, NC_XMLREAD_OPTIONS)) != NULL) {
+		if ((shared_doc = ncntf_event_doc(shared)) != NULL) {
 			/* apply filter */
 			if (filter != NULL) {
+				/* the shared document must not be modified, filter its copy */
+				event_doc = xmlCopyDoc(shared_doc, 1);
 
 				/* filter all content nodes in notification */
 				event_node = event_doc->children->children; /* doc -> <notification> -> <something> */
@@ -2457,9 +3605,12 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 				} else {
 					/* nothing to send */
 					xmlFreeDoc(event_doc);
-					free(event);
+					ncntf_event_release(shared);
 					continue;
 				}
+			} else {
+				/* nothing to change, send the shared document */
+				event_doc = shared_doc;
 			}
 
 			ntf = malloc(sizeof(nc_rpc));
@@ -2473,6 +3624,10 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 				pthread_mutex_unlock(&(session->mut_ntf));
 				nc_filter_free(filter);
 				free(stream);
+				if (event_doc != shared_doc) {
+					xmlFreeDoc(event_doc);
+				}
+				ncntf_event_release(shared);
 				return (-1);
 			}
 			ntf->doc = event_doc;
@@ -2494,7 +3649,11 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 				pthread_mutex_unlock(&(session->mut_ntf));
 				nc_filter_free(filter);
 				free(stream);
+				if (ntf->doc == shared_doc) {
+					ntf->doc = NULL;
+				}
 				ncntf_notif_free(ntf);
+				ncntf_event_release(shared);
 				return (-1);
 			}
 
@@ -2509,7 +3668,11 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 				pthread_mutex_unlock(&(session->mut_ntf));
 				nc_filter_free(filter);
 				free(stream);
+				if (ntf->doc == shared_doc) {
+					ntf->doc = NULL;
+				}
 				ncntf_notif_free(ntf);
+				ncntf_event_release(shared);
 				return (-1);
 			}
 
@@ -2529,7 +3692,11 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 						ncntf_dispatch = 0;
 						nc_filter_free(filter);
 						free(stream);
+						if (ntf->doc == shared_doc) {
+							ntf->doc = NULL;
+						}
 						ncntf_notif_free(ntf);
+						ncntf_event_release(shared);
 
 						DBG_UNLOCK("mut_session");
 						pthread_mutex_unlock(&(session->mut_session));
@@ -2544,17 +3711,19 @@ API long long int ncntf_dispatch_send(struct nc_session* session, const nc_rpc*
 			} else {
 				/* update stats */
 				if (nc_info) {
-					pthread_rwlock_wrlock(&(nc_info->lock));
-					nc_info->stats_nacm.denied_notifs++;
-					pthread_rwlock_unlock(&(nc_info->lock));
+					NC_STATS_INC(nc_info->stats_nacm.denied_notifs);
 				}
 			}
 
+			if (ntf->doc == shared_doc) {
+				/* the shared document is freed with the event */
+				ntf->doc = NULL;
+			}
 			ncntf_notif_free(ntf);
 		} else {
 			WARN("Invalid format of a stored event, skipping.");
 		}
-		free(event);
+		ncntf_event_release(shared);
 	}
 	xmlFreeDoc(filter_doc);
 	ncntf_stream_iter_finish(stream);
@@ -104,6 +104,30 @@ int ncntf_stream_new(const char* name, const char* desc, int replay);
  */
 int ncntf_stream_allow_events(const char* stream, const char* event);
 
+/**
+ * @ingroup notifications
+ * @brief Limit the size of the stream file and the replay log of the given
+ * Notification stream.
+ *
+ * When storing an event would make the stream file bigger than segment_size,
+ * the stream file is closed as a segment of the replay log and the event is
+ * stored into a new stream file. After that, the oldest segments are removed
+ * while the replay log is bigger than max_size or while their events are older
+ * than max_age. The time of the latest removed event is reported as
+ * replayLogAgedTime. The limits apply to the events stored by the calling
+ * process, default values are 0.
+ *
+ * @param[in] stream Name of the stream.
+ * @param[in] segment_size Maximal size of the stream file in bytes, 0 to never
+ * close the stream file.
+ * @param[in] max_size Maximal size of the whole replay log in bytes, 0 for no
+ * limit.
+ * @param[in] max_age Maximal age of the events in the replay log in seconds, 0
+ * for no limit.
+ * @return 0 on success, non-zero on error
+ */
+int ncntf_stream_set_retention(const char* stream, size_t segment_size, size_t max_size, time_t max_age);
+
 /**
  * @ingroup notifications
  * @brief Get the list of NETCONF event notifications streams.
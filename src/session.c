@@ -46,13 +46,15 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
-#include <dirent.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <signal.h>
 #include <poll.h>
+#include <sys/epoll.h>
 #include <pthread.h>
 #include <pwd.h>
 #include <ctype.h>
+#include <limits.h>
 
 #ifndef DISABLE_LIBSSH
 #	include <libssh/libssh.h>
@@ -60,6 +62,7 @@
 
 #include <libxml/tree.h>
 #include <libxml/parser.h>
+#include <libxml/xmlIO.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
 
@@ -116,6 +119,7 @@ struct session_list_item {
 	int scounter; /* number of sessions connected with this record */
 	char session_id[SID_SIZE];
 	pid_t pid;
+	unsigned long long pid_start; /* start time of the process, to recognize reused PIDs */
 	enum nc_transport transport;
 	struct nc_session_stats stats;
 	char login_time[TIME_LENGTH];
@@ -127,8 +131,16 @@ struct session_list_item {
 	char data[1];
 };
 
+/*
+ * Layout version of the sessions monitoring file, the file of a different
+ * layout (including the files without the version, where the first member is
+ * the size, a multiple of SIZE_STEP) is initialized again
+ */
+#define SESSION_LIST_VERSION 0x4e430001
+
 struct session_list_map {
 	/* start of the mapped file with session list */
+	unsigned int version; /* SESSION_LIST_VERSION */
 	int size; /* current file size (may include gaps) */
 	int count; /* current number of sessions */
 	int first_offset;
@@ -139,58 +151,11 @@ struct session_list_map {
 static int session_list_fd = -1;
 static struct session_list_map *session_list = NULL;
 
-#ifdef DISABLE_LIBSSH
-#ifdef ENABLE_TLS
-#define NC_WRITE(session,buf,c,ret) \
-	if (session->fd_output != -1) {ret = write (session->fd_output, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else if (session->tls){ \
-		ret = SSL_write(session->tls, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else { \
-		ret = -1; \
-	}
-#else /* not ENABLE_TLS (but DISABLE_LIBSSH) */
-#define NC_WRITE(session,buf,c,ret) \
-	if (session->fd_output != -1) {ret = write (session->fd_output, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else { \
-		ret = -1; \
-	}
-#endif /* not ENABLE_TLS */
-#else /* not DISABLE_LIBSSH */
-#ifdef ENABLE_TLS
-#define NC_WRITE(session,buf,c,ret) \
-	if(session->ssh_chan){ \
-		ret = ssh_channel_write (session->ssh_chan, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else if (session->tls){ \
-		ret = SSL_write(session->tls, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else if (session->fd_output != -1) { \
-		ret = write (session->fd_output, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else { \
-		ret = -1; \
-	}
-#else /* not ENABLE_TLS */
-#define NC_WRITE(session,buf,c,ret) \
-	if(session->ssh_chan){ \
-		ret = ssh_channel_write (session->ssh_chan, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else if (session->fd_output != -1) { \
-		ret = write (session->fd_output, (buf), strlen(buf)); \
-		if (ret > 0) {c += ret;} \
-	} else { \
-		ret = -1; \
-	}
-#endif /* not ENABLE_TLS */
-#endif /* not DISABLE_LIBSSH */
-
 #define SIZE_STEP (1024*16)
 int nc_session_monitoring_init(void)
 {
 	struct stat fdinfo;
+	struct flock fl;
 	int first = 0, c;
 	size_t size;
 	pthread_rwlockattr_t rwlockattr;
@@ -213,6 +178,20 @@ int nc_session_monitoring_init(void)
 		return (EXIT_FAILURE);
 	}
 
+	/* only a single process initializes the file */
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = 0;
+	fl.l_len = 0;
+	while (fcntl(session_list_fd, F_SETLKW, &fl) == -1) {
+		if (errno != EINTR) {
+			ERROR("Locking the sessions monitoring file failed (%s).", strerror(errno));
+			close(session_list_fd);
+			session_list_fd = -1;
+			return (EXIT_FAILURE);
+		}
+	}
+
 	/* get the file size */
 	if (fstat(session_list_fd, &fdinfo) == -1) {
 		ERROR("Unable to get the sessions monitoring file information (%s)", strerror(errno));
@@ -221,7 +200,7 @@ int nc_session_monitoring_init(void)
 		return (EXIT_FAILURE);
 	}
 
-	if (fdinfo.st_size == 0) {
+	if (fdinfo.st_size < SIZE_STEP) {
 		/* we have a new file, create some initial size using file gaps */
 		first = 1;
 		lseek(session_list_fd, SIZE_STEP - 1, SEEK_SET);
@@ -244,17 +223,25 @@ int nc_session_monitoring_init(void)
 		return (EXIT_FAILURE);
 	}
 
-	if (first) {
+	if (first || session_list->version != SESSION_LIST_VERSION) {
+		if (!first) {
+			WARN("%s: the sessions monitoring file has an unknown layout, initializing it again.", __func__);
+		}
 		pthread_rwlockattr_init(&rwlockattr);
 		pthread_rwlockattr_setpshared(&rwlockattr, PTHREAD_PROCESS_SHARED);
 		pthread_rwlock_init(&(session_list->lock), &rwlockattr);
 		pthread_rwlockattr_destroy(&rwlockattr);
 		pthread_rwlock_wrlock(&(session_list->lock));
-		session_list->size = SIZE_STEP;
+		session_list->size = size;
 		session_list->count = 0;
+		session_list->first_offset = 0;
+		session_list->version = SESSION_LIST_VERSION;
 		pthread_rwlock_unlock(&(session_list->lock));
 	}
 
+	fl.l_type = F_UNLCK;
+	fcntl(session_list_fd, F_SETLK, &fl);
+
 	return (EXIT_SUCCESS);
 }
 
@@ -292,6 +279,51 @@ int nc_session_is_monitored(const char* session_id)
 	return 0;
 }
 
+/* length of path of /proc/<PID>/stat */
+#define ALIVECHECK_PATH_LENGTH 32
+/* length of the /proc/<PID>/stat content we are interested in */
+#define ALIVECHECK_STAT_LENGTH 512
+/*
+ * Get the start time of the process (in clock ticks after the system boot)
+ * to recognize the PID reused by another process. Returns 0 on error with
+ * errno set (ENOENT if the process does not exist).
+ */
+static unsigned long long nc_session_monitor_pid_start(pid_t pid)
+{
+	char path[ALIVECHECK_PATH_LENGTH];
+	char buf[ALIVECHECK_STAT_LENGTH];
+	char *aux;
+	int fd, i;
+	ssize_t len;
+
+	snprintf(path, ALIVECHECK_PATH_LENGTH, "/proc/%d/stat", pid);
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		return (0);
+	}
+	len = read(fd, buf, ALIVECHECK_STAT_LENGTH - 1);
+	close(fd);
+	if (len <= 0) {
+		errno = EINVAL;
+		return (0);
+	}
+	buf[len] = '\0';
+
+	/* the command name can contain spaces, so skip it as a whole */
+	if ((aux = strrchr(buf, ')')) == NULL) {
+		errno = EINVAL;
+		return (0);
+	}
+	/* starttime is the 22nd field, the field after the command name is the 3rd */
+	for (i = 3; i <= 22; i++) {
+		if ((aux = strchr(aux + 1, ' ')) == NULL) {
+			errno = EINVAL;
+			return (0);
+		}
+	}
+
+	return (strtoull(aux + 1, NULL, 10));
+}
+
 API int nc_session_monitor(struct nc_session* session)
 {
 	struct session_list_item *litem = NULL, *litem_aux;
@@ -349,6 +381,7 @@ API int nc_session_monitor(struct nc_session* session)
 					litem->active = 1;
 					/* update PID for keep-alive check */
 					litem->pid = getpid();
+					litem->pid_start = nc_session_monitor_pid_start(litem->pid);
 					pthread_rwlock_unlock(&(session_list->lock));
 
 					/* connect session statistics to the shared memory segment */
@@ -359,6 +392,7 @@ API int nc_session_monitor(struct nc_session* session)
 				} else if (litem->active == 1) {
 					/* update PID for keep-alive check */
 					litem->pid = getpid();
+					litem->pid_start = nc_session_monitor_pid_start(litem->pid);
 					pthread_rwlock_unlock(&(session_list->lock));
 					return (EXIT_SUCCESS);
 				} else {
@@ -446,6 +480,7 @@ API int nc_session_monitor(struct nc_session* session)
 	litem->size = size;
 	strncpy(litem->session_id, session->session_id, SID_SIZE);
 	litem->pid = getpid();
+	litem->pid_start = nc_session_monitor_pid_start(litem->pid);
 	litem->transport = NC_TRTANSPORT_SSH;
 	if (session->stats != NULL) {
 		memcpy(&(litem->stats), session->stats, sizeof(struct nc_session_stats));
@@ -492,80 +527,83 @@ static void nc_session_monitor_remove(struct session_list_item *litem)
 	session_list->count--;
 }
 
-/* length of path of /proc/<PID>/fd/<FDNUM> */
-#define ALIVECHECK_PATH_LENGTH 32
-static void nc_session_monitor_alive_check(void)
+/*
+ * Check that the process holding the monitored session still exists and it
+ * is still the same process (its PID was not reused). The result for the last
+ * checked PID is remembered in the given variables since the sessions of the
+ * same process usually follow each other in the list.
+ */
+static int nc_session_monitor_is_alive(struct session_list_item *litem, pid_t *last_pid, int *last_alive)
 {
-	struct session_list_item *litem;
-	char dirpath[ALIVECHECK_PATH_LENGTH];
-	char linkpath[ALIVECHECK_PATH_LENGTH];
-	char linkname[sizeof(NC_SESSIONSFILE) + 1];
-	char* aux = NULL;
-	int len;
-	DIR *dir;
-	struct dirent* pfd;
+	unsigned long long start;
 
-	if (session_list != NULL) {
-		aux = strdup(NC_SESSIONSFILE);
-		nc_clip_occurences_with(aux, '/', '/');
+	if (litem->pid == *last_pid) {
+		return (*last_alive);
+	}
+	*last_pid = litem->pid;
 
-		pthread_rwlock_wrlock(&(session_list->lock));
+	if (kill(litem->pid, 0) == -1 && errno == ESRCH) {
+		/* no such a process exists */
+		*last_alive = 0;
+	} else if ((start = nc_session_monitor_pid_start(litem->pid)) == 0) {
+		/* if the /proc entry exists but it is not readable, we cannot do more checks */
+		*last_alive = (errno == ENOENT) ? 0 : 1;
+	} else {
+		/* the PID can be reused by another process started later */
+		*last_alive = (litem->pid_start == 0 || litem->pid_start == start) ? 1 : 0;
+	}
 
-		/* check the whole list of monitored sessions */
-		for (litem = (struct session_list_item*) ((char*) (session_list->record) + session_list->first_offset);
-				;
-		        litem = (struct session_list_item*) ((char*) litem + litem->offset_next)) {
-
-			/* check that the monitored process is still alive */
-			snprintf(dirpath, ALIVECHECK_PATH_LENGTH, "/proc/%d/fd", litem->pid);
-			if (access(dirpath, F_OK) == -1) {
-				/* no such a process exists, remove not alive session item */
-				litem->scounter = 0;
-				nc_session_monitor_remove(litem);
-			} else {
-				/* check that the process is still the same (is using libnetconf) */
-				dir = opendir(dirpath);
-				if (dir == NULL) {
-					if (errno == ENOENT) {
-						/* process /proc directory actually does not exist */
-						litem->scounter = 0;
-						nc_session_monitor_remove(litem);
-					} /* else we cannot do more checks */
-					goto alivecheck_next;
-				}
+	return (*last_alive);
+}
 
-				/* search in all file descriptors for the sessions stats file */
-				errno = 0;
-				while((pfd = readdir(dir)) != NULL) {
-					snprintf(linkpath, ALIVECHECK_PATH_LENGTH, "%s/%s", dirpath, pfd->d_name);
-					if ((len = readlink(linkpath, linkname, sizeof(linkname))) > 0) {
-						linkname[len] = 0;
-						if (strcmp(linkname, aux) == 0) {
-							/* we have match, the process uses libnetconf */
-							break;
-						}
-					} /* not a symlink or other problem - simply it doesn't match, continue */
-				}
-				if (pfd == NULL) {
-					/* the process does not use libnetconf, remove not alive session item */
-					litem->scounter = 0;
-					nc_session_monitor_remove(litem);
-				}
-				closedir(dir);
-			}
+static void nc_session_monitor_alive_check(void)
+{
+	struct session_list_item *litem, *next;
+	pid_t last_pid;
+	int last_alive, dead = 0;
 
-alivecheck_next:
-			/* end loop condition */
-			if (litem->offset_next == 0) {
-				/* no other item in the list */
-				break;
-			}
+	if (session_list == NULL) {
+		return;
+	}
+
+	/* check the whole list of monitored sessions, still allowing other readers */
+	pthread_rwlock_rdlock(&(session_list->lock));
+	last_pid = -1;
+	for (litem = (struct session_list_item*) ((char*) (session_list->record) + session_list->first_offset);
+			session_list->count > 0;
+			litem = (struct session_list_item*) ((char*) litem + litem->offset_next)) {
+		if (!nc_session_monitor_is_alive(litem, &last_pid, &last_alive)) {
+			dead = 1;
+			break;
+		}
+		if (litem->offset_next == 0) {
+			/* no other item in the list */
+			break;
 		}
+	}
+	pthread_rwlock_unlock(&(session_list->lock));
 
-		pthread_rwlock_unlock(&(session_list->lock));
-		free(aux);
+	if (!dead) {
+		return;
 	}
 
+	/* remove not alive session items, the list could have changed in the meantime */
+	pthread_rwlock_wrlock(&(session_list->lock));
+	last_pid = -1;
+	for (litem = (struct session_list_item*) ((char*) (session_list->record) + session_list->first_offset);
+			session_list->count > 0;
+			litem = next) {
+		next = (litem->offset_next == 0) ? NULL : (struct session_list_item*) ((char*) litem + litem->offset_next);
+		if (!nc_session_monitor_is_alive(litem, &last_pid, &last_alive)) {
+			litem->scounter = 0;
+			nc_session_monitor_remove(litem);
+		}
+		if (next == NULL) {
+			/* no other item in the list */
+			break;
+		}
+	}
+	pthread_rwlock_unlock(&(session_list->lock));
 }
 
 char* nc_session_stats(void)
@@ -594,10 +632,10 @@ char* nc_session_stats(void)
 				litem->data, /* username */
 				litem->data + (strlen(litem->data) + 1), /* hostname */
 				litem->login_time,
-				litem->stats.in_rpcs,
-				litem->stats.in_bad_rpcs,
-				litem->stats.out_rpc_errors,
-				litem->stats.out_notifications) == -1) {
+				NC_STATS_GET(litem->stats.in_rpcs),
+				NC_STATS_GET(litem->stats.in_bad_rpcs),
+				NC_STATS_GET(litem->stats.out_rpc_errors),
+				NC_STATS_GET(litem->stats.out_notifications)) == -1) {
 			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
 		} else {
 			if (session == NULL) {
@@ -1213,10 +1251,28 @@ static void ncntf_dispatch_stop(struct nc_session *session)
 	pthread_mutex_unlock(&(session->mut_ntf));
 }
 
+/**
+ * @brief Callback of the \<rpc\> sent by nc_session_send_rpc_async()
+ */
+struct nc_reply_pending {
+	void (*func)(struct nc_session* session, const nc_msgid msgid, nc_reply* reply, void* data);
+	void* data;
+};
+
+static void nc_session_cancel_pending(void* payload, void* data, const xmlChar* name)
+{
+	struct nc_reply_pending* pending = (struct nc_reply_pending*) payload;
+
+	/* the session is closed, no reply will come */
+	pending->func((struct nc_session*) data, (const nc_msgid) name, NULL, pending->data);
+	free(pending);
+}
+
 void nc_session_close(struct nc_session* session, NC_SESSION_TERM_REASON reason)
 {
 	int i;
 	struct nc_msg *qmsg, *qmsg_aux;
+	xmlHashTablePtr pending = NULL;
 	NC_SESSION_STATUS sstatus = session->status;
 
 	/* lock session due to accessing its status and other items */
@@ -1328,6 +1384,8 @@ void nc_session_close(struct nc_session* session, NC_SESSION_TERM_REASON reason)
 		session->port = NULL;
 
 		/* remove messages from the queues */
+		DBG_LOCK("mut_mqueue");
+		pthread_mutex_lock(&(session->mut_mqueue));
 		for (i = 0, qmsg = session->queue_event; i < 2; i++, qmsg = session->queue_msg) {
 			while (qmsg != NULL) {
 				qmsg_aux = qmsg->next;
@@ -1335,6 +1393,17 @@ void nc_session_close(struct nc_session* session, NC_SESSION_TERM_REASON reason)
 				qmsg = qmsg_aux;
 			}
 		}
+		session->queue_event = NULL;
+		session->queue_msg = NULL;
+		session->queue_msg_last = NULL;
+		xmlHashFree(session->queue_msg_index, NULL);
+		session->queue_msg_index = NULL;
+
+		/* detach the callbacks of the asynchronously sent rpcs */
+		pending = session->pending;
+		session->pending = NULL;
+		DBG_UNLOCK("mut_mqueue");
+		pthread_mutex_unlock(&(session->mut_mqueue));
 
 		/*
 		 * capabilities, session_id and shared monitoring structure are untouched
@@ -1360,6 +1429,13 @@ void nc_session_close(struct nc_session* session, NC_SESSION_TERM_REASON reason)
 	}
 	session->next = NULL;
 	session->prev = NULL;
+
+	/* no reply will come for the asynchronously sent rpcs, the callbacks
+	 * are called without any session lock held */
+	if (pending != NULL) {
+		xmlHashScan(pending, nc_session_cancel_pending, session);
+		xmlHashFree(pending, NULL);
+	}
 }
 
 
@@ -1385,6 +1461,7 @@ API void nc_session_free(struct nc_session* session)
 	if (session->capabilities != NULL) {
 		nc_cpblts_free(session->capabilities);
 	}
+	free(session->rbuf);
 
 	/* destroy mutexes */
 	pthread_mutex_destroy(&(session->mut_mqueue));
@@ -1448,17 +1525,237 @@ API NC_SESSION_STATUS nc_session_get_status (const struct nc_session* session)
 	return (session->status);
 }
 
+/**
+ * @brief Get the current time of the monotonic clock in milliseconds.
+ */
+static long long nc_time_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/**
+ * @brief Get the number of milliseconds remaining to the deadline.
+ *
+ * @param[in] deadline Deadline as returned by nc_time_ms().
+ * @return Remaining milliseconds or -1 if the deadline was already reached.
+ */
+static int nc_time_remaining(long long deadline)
+{
+	long long now = nc_time_ms();
+
+	if (now >= deadline) {
+		return (-1);
+	}
+	return ((int) (deadline - now));
+}
+
+/**
+ * @brief Get a new deadline for transferring data on the communication
+ * channel. It is supposed to be renewed whenever some data are transferred, so
+ * only the inactivity of the other side is limited, not the whole transfer.
+ *
+ * @return Deadline in the form of nc_time_ms().
+ */
+static long long nc_time_deadline(void)
+{
+	return (nc_time_ms() + READ_TIMEOUT * 1000);
+}
+
+/**
+ * @brief Wait until the output communication file descriptor, that is
+ * currently unable to accept more data, becomes writable.
+ *
+ * @param[in] fd Output file descriptor of the session.
+ * @param[in] deadline Time (as returned by nc_time_ms()) when the writing
+ * timeouts.
+ * @return EXIT_SUCCESS or EXIT_FAILURE when the writing timeout elapsed or
+ * polling failed.
+ */
+static int nc_session_write_wait(int fd, long long deadline)
+{
+	struct pollfd fds;
+	int timeout;
+
+	if ((timeout = nc_time_remaining(deadline)) < 0) {
+		ERROR("Writing timeout elapsed.");
+		return (EXIT_FAILURE);
+	}
+
+	fds.fd = fd;
+	fds.events = POLLOUT;
+	fds.revents = 0;
+	if (poll(&fds, 1, timeout) < 0 && errno != EINTR) {
+		ERROR("Poll on output communication file descriptor failed (%s)", strerror(errno));
+		return (EXIT_FAILURE);
+	}
+	/* POLLHUP and POLLERR are detected by the next writing */
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Write data into the session's communication channel.
+ *
+ * @param[in] session NETCONF session to write to.
+ * @param[in] buf Data to write.
+ * @param[in] size Length of the data.
+ * @return Number of bytes written, 0 if the channel cannot accept data at the
+ * moment, -1 on error.
+ */
+static ssize_t nc_session_transport_write(struct nc_session* session, const char *buf, size_t size)
+{
+	ssize_t c;
+#ifdef ENABLE_TLS
+	int r;
+#endif
+
+#ifndef DISABLE_LIBSSH
+	if (session->ssh_chan) {
+		/* write via libssh */
+		c = ssh_channel_write(session->ssh_chan, buf, size);
+		if (c == SSH_ERROR) {
+			VERB("Writing data into the communication channel failed (%s).", session->ssh_sess ? ssh_get_error(session->ssh_sess) : "description not available");
+			return (-1);
+		}
+		return (c);
+	}
+#endif
+#ifdef ENABLE_TLS
+	if (session->tls) {
+		/* write via OpenSSL */
+		c = SSL_write(session->tls, buf, size);
+		if (c <= 0) {
+			r = SSL_get_error(session->tls, c);
+			if (r == SSL_ERROR_WANT_WRITE || r == SSL_ERROR_WANT_READ) {
+				return (0);
+			}
+			VERB("Writing data into the TLS session failed (SSL code %d).", r);
+			return (-1);
+		}
+		return (c);
+	}
+#endif
+	if (session->fd_output != -1) {
+		/* write via file descriptor */
+		c = write(session->fd_output, buf, size);
+		if (c == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+				return (0);
+			}
+			VERB("Writing data into the communication channel failed (%s).", strerror(errno));
+			return (-1);
+		}
+		return (c);
+	}
+
+	return (-1);
+}
+
+/* maximal length of the NETCONF 1.1 chunk header ("\n#" + 10 digits + "\n") */
+#define NC_CHUNK_HEADER_MAX 13
+
+/**
+ * @brief Context of the libxml2 output buffer writing NETCONF messages
+ * directly into the session's communication channel.
+ */
+struct nc_msg_writer {
+	struct nc_session *session;
+	/* file descriptor to poll when the channel cannot accept more data */
+	int fd;
+	/* time (as returned by nc_time_ms()) when the writing timeouts if no data are written */
+	long long deadline;
+	/* length of the data waiting in buf behind the space for the chunk header */
+	size_t len;
+	char buf[NC_CHUNK_HEADER_MAX + NC_WRITE_BUF_SIZE + sizeof(NC_V10_END_MSG)];
+};
+
+/**
+ * @brief Send the data collected in the writer's buffer as a single chunk (in
+ * case of NETCONF 1.1) and optionally terminate the message.
+ *
+ * @param[in] writer Writer context.
+ * @param[in] last Flag to terminate the message by the end marker.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int nc_msg_writer_flush(struct nc_msg_writer *writer, int last)
+{
+	char header[NC_CHUNK_HEADER_MAX + 1];
+	size_t start = NC_CHUNK_HEADER_MAX, end = NC_CHUNK_HEADER_MAX + writer->len;
+	const char *endmsg;
+	ssize_t c;
+
+	if (writer->session->version == NETCONFV11) {
+		if (writer->len > 0) {
+			/* place the chunk header right in front of the chunk data */
+			c = snprintf(header, NC_CHUNK_HEADER_MAX + 1, "\n#%zu\n", writer->len);
+			start -= c;
+			memcpy(&(writer->buf[start]), header, c);
+		}
+		endmsg = NC_V11_END_MSG;
+	} else { /* NETCONFV10 */
+		endmsg = NC_V10_END_MSG;
+	}
+	if (last) {
+		memcpy(&(writer->buf[end]), endmsg, strlen(endmsg));
+		end += strlen(endmsg);
+	}
+
+	while (start < end) {
+		c = nc_session_transport_write(writer->session, &(writer->buf[start]), end - start);
+		if (c < 0) {
+			return (EXIT_FAILURE);
+		} else if (c == 0) {
+			if (nc_session_write_wait(writer->fd, writer->deadline) != EXIT_SUCCESS) {
+				return (EXIT_FAILURE);
+			}
+			continue;
+		}
+		start += c;
+		writer->deadline = nc_time_deadline();
+	}
+	writer->len = 0;
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief libxml2 output buffer write callback (xmlOutputWriteCallback).
+ */
+static int nc_msg_writer_write(void *context, const char *buffer, int len)
+{
+	struct nc_msg_writer *writer = (struct nc_msg_writer*) context;
+	size_t n;
+	int done = 0;
+
+	while (done < len) {
+		n = NC_WRITE_BUF_SIZE - writer->len;
+		if (n > (size_t) (len - done)) {
+			n = len - done;
+		}
+		memcpy(&(writer->buf[NC_CHUNK_HEADER_MAX + writer->len]), &(buffer[done]), n);
+		writer->len += n;
+		done += n;
+
+		if (writer->len == NC_WRITE_BUF_SIZE && nc_msg_writer_flush(writer, 0) != EXIT_SUCCESS) {
+			return (-1);
+		}
+	}
+
+	return (len);
+}
+
 static int nc_session_send(struct nc_session* session, struct nc_msg *msg)
 {
-	ssize_t c = 0;
 	int len, status;
 	char *text;
-#ifndef DISABLE_LIBSSH
-	const char *emsg;
-#endif
-	char buf[1024];
 	struct pollfd fds;
 	int ret;
+	long long deadline;
+	struct nc_msg_writer writer;
+	xmlOutputBufferPtr out;
 
 	if (session->fd_output == -1 && session->transport_socket == -1
 #ifndef DISABLE_LIBSSH
@@ -1527,459 +1824,454 @@ static int nc_session_send(struct nc_session* session, struct nc_msg *msg)
 		break;
 	}
 
-	/* lock the session for sending the data */
+	/* the other side must accept some data in the same time as it is waited for them */
+	deadline = nc_time_deadline();
 
-	xmlDocDumpFormatMemory (msg->doc, (xmlChar**) (&text), &len, NC_CONTENT_FORMATTED);
-	DBG("Writing message (session %s): %s", session->session_id, text);
+	if (verbose_level >= NC_VERB_DEBUG) {
+		xmlDocDumpFormatMemory (msg->doc, (xmlChar**) (&text), &len, NC_CONTENT_FORMATTED);
+		DBG("Writing message (session %s): %s", session->session_id, text);
+		free(text);
+	}
+
+	writer.session = session;
+	writer.fd = fds.fd;
+	writer.deadline = deadline;
+	writer.len = 0;
 
+	/* lock the session for sending the data */
 	DBG_LOCK("mut_channel");
 	session->mut_channel_flag = 1;
 	pthread_mutex_lock(session->mut_channel);
-	/* if v1.1 send chunk information before message */
-	if (session->version == NETCONFV11) {
-		snprintf (buf, 1024, "\n#%d\n", (int) strlen (text));
-		c = 0;
-		do {
-			NC_WRITE(session, &(buf[c]), c, ret);
-			if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-				usleep(10);
-				continue;
-			}
-#ifndef DISABLE_LIBSSH
-			if (ret == SSH_ERROR) {
-				DBG_UNLOCK("mut_channel");
-				session->mut_channel_flag = 0;
-				pthread_mutex_unlock(session->mut_channel);
-				if (!session->ssh_chan) {
-					emsg = strerror(errno);
-				} else if (session->ssh_chan && session->ssh_sess) {
-					emsg = ssh_get_error(session->ssh_sess);
-				} else {
-					emsg = "description not available";
-				}
-				VERB("Writing data into the communication channel failed (%s).", emsg);
-				free (text);
-				return (EXIT_FAILURE);
-			}
-#endif
-			if (ret <= 0) {
-				DBG_UNLOCK("mut_channel");
-				session->mut_channel_flag = 0;
-				pthread_mutex_unlock(session->mut_channel);
-				free (text);
-				return (EXIT_FAILURE);
-			}
-		} while (c < (ssize_t) strlen (buf));
-	}
-
-	/* write the message */
-	c = 0;
-	do {
-		NC_WRITE(session, &(text[c]), c, ret);
-		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-			usleep(10);
-			continue;
-		}
-#ifndef DISABLE_LIBSSH
-		if (ret == SSH_ERROR) {
-			DBG_UNLOCK("mut_channel");
-			session->mut_channel_flag = 0;
-			pthread_mutex_unlock(session->mut_channel);
-			if (!session->ssh_chan) {
-				emsg = strerror(errno);
-			} else if (session->ssh_chan && session->ssh_sess) {
-				emsg = ssh_get_error(session->ssh_sess);
-			} else {
-				emsg = "description not available";
-			}
-			VERB("Writing data into the communication channel failed (%s).", emsg);
-			free (text);
-			return (EXIT_FAILURE);
-		}
-#endif
-		if (ret <= 0) {
-			DBG_UNLOCK("mut_channel");
-			session->mut_channel_flag = 0;
-			pthread_mutex_unlock(session->mut_channel);
-			free (text);
-			return (EXIT_FAILURE);
-		}
-	} while (c < (ssize_t) strlen (text));
-	free (text);
 
-	/* close message */
-	if (session->version == NETCONFV11) {
-		text = NC_V11_END_MSG;
-	} else { /* NETCONFV10 */
-		text = NC_V10_END_MSG;
+	/* serialize the message directly into the communication channel */
+	if ((out = xmlOutputBufferCreateIO(nc_msg_writer_write, NULL, &writer, NULL)) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		ret = EXIT_FAILURE;
+	} else if (xmlSaveFormatFileTo(out, msg->doc, NULL, NC_CONTENT_FORMATTED) == -1) {
+		/* out was closed (and freed) by xmlSaveFormatFileTo() */
+		ret = EXIT_FAILURE;
+	} else {
+		/* write the rest of the message with its end */
+		ret = nc_msg_writer_flush(&writer, 1);
 	}
-	c = 0;
-	do {
-		NC_WRITE(session, &(text[c]), c, ret);
-		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-			usleep(10);
-			continue;
-		}
-#ifndef DISABLE_LIBSSH
-		if (ret == SSH_ERROR) {
-			DBG_UNLOCK("mut_channel");
-			session->mut_channel_flag = 0;
-			pthread_mutex_unlock(session->mut_channel);
-			if (!session->ssh_chan) {
-				emsg = strerror(errno);
-			} else if (session->ssh_chan && session->ssh_sess) {
-				emsg = ssh_get_error(session->ssh_sess);
-			} else {
-				emsg = "description not available";
-			}
-			VERB("Writing data into the communication channel failed (%s).", emsg);
-			return (EXIT_FAILURE);
-		}
-#endif
-		if (ret <= 0) {
-			DBG_UNLOCK("mut_channel");
-			session->mut_channel_flag = 0;
-			pthread_mutex_unlock(session->mut_channel);
-			return (EXIT_FAILURE);
-		}
-	} while (c < (ssize_t) strlen (text));
 
 	/* unlock the session's output */
 	DBG_UNLOCK("mut_channel");
 	session->mut_channel_flag = 0;
 	pthread_mutex_unlock(session->mut_channel);
 
-	return (EXIT_SUCCESS);
+	return (ret);
 }
 
-static int nc_session_read_len(struct nc_session* session, size_t chunk_length, char **text, size_t *len)
+/**
+ * @brief Read as much data as currently available from the session's
+ * communication channel, but at most size bytes.
+ *
+ * @param[in] session NETCONF session to read from.
+ * @param[out] buf Buffer where the read data are stored.
+ * @param[in] size Size of the buf.
+ * @return Number of bytes read, 0 if no data are currently available, -1 on
+ * error.
+ */
+static ssize_t nc_session_transport_read(struct nc_session* session, char *buf, size_t size)
 {
-	char *buf;
 	ssize_t c;
-	size_t rd = 0;
-	long sleep_count = 0;
 #ifdef ENABLE_TLS
 	int r;
 #endif
 
-	/* check if we can work with the session */
-	if (session->status != NC_SESSION_STATUS_WORKING &&
-			session->status != NC_SESSION_STATUS_CLOSING) {
-		return (EXIT_FAILURE);
+#ifndef DISABLE_LIBSSH
+	if (session->ssh_chan) {
+		/* read via libssh */
+		c = ssh_channel_read(session->ssh_chan, buf, size, 0);
+		if (c == SSH_AGAIN) {
+			return (0);
+		} else if (c == SSH_ERROR) {
+			if (session->ssh_sess != NULL) {
+				ERROR("Reading from the SSH channel failed (%zd: %s)", ssh_get_error_code(session->ssh_sess), ssh_get_error(session->ssh_sess));
+			} else {
+				ERROR("Reading from the SSH channel failed");
+			}
+			return (-1);
+		} else if (c == 0) {
+			if (ssh_channel_is_eof(session->ssh_chan)) {
+				ERROR("Server has closed the communication socket");
+				return (-1);
+			}
+			return (0);
+		}
+		return (c);
+	}
+#endif
+#ifdef ENABLE_TLS
+	if (session->tls) {
+		/* read via OpenSSL */
+		c = SSL_read(session->tls, buf, size);
+		if (c <= 0 && (r = SSL_get_error(session->tls, c))) {
+			if (r == SSL_ERROR_WANT_READ) {
+				return (0);
+			} else if (r == SSL_ERROR_SYSCALL) {
+				ERROR("Reading from the TLS session failed (%s)", strerror(errno));
+			} else if (r == SSL_ERROR_SSL) {
+				ERROR("Reading from the TLS session failed (%s)", ERR_error_string(r, NULL));
+			} else {
+				ERROR("Reading from the TLS session failed (SSL code %d)", r);
+			}
+			return (-1);
+		}
+		return (c);
+	}
+#endif
+	if (session->fd_input != -1) {
+		/* read via file descriptor */
+		c = read(session->fd_input, buf, size);
+		if (c == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+				return (0);
+			}
+			ERROR("Reading from an input file descriptor failed (%s)", strerror(errno));
+			return (-1);
+		} else if (c == 0) {
+			ERROR("EOF received (%s)", strerror(errno));
+			return (-1);
+		}
+		return (c);
 	}
 
-	buf = malloc ((chunk_length + 1) * sizeof(char));
-	if (buf == NULL) {
-		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-		*len = 0;
-		*text = NULL;
+	ERROR("No way to read the input, fatal error.");
+	return (-1);
+}
+
+/**
+ * @brief Wait until the communication channel, that has currently nothing to
+ * read, becomes readable.
+ *
+ * Spurious wake-ups are possible, the caller is supposed to repeat the reading
+ * and call this function again if there is still nothing to read.
+ *
+ * @param[in] session NETCONF session to wait on.
+ * @param[in] deadline Time (as returned by nc_time_ms()) when the reading
+ * timeouts.
+ * @return EXIT_SUCCESS or EXIT_FAILURE when the reading timeout elapsed or
+ * polling failed.
+ */
+static int nc_session_read_wait(struct nc_session* session, long long deadline)
+{
+	struct pollfd fds;
+	int timeout, status;
+
+	if ((timeout = nc_time_remaining(deadline)) < 0) {
+		ERROR("Reading timeout elapsed.");
 		return (EXIT_FAILURE);
 	}
 
-	while (rd < chunk_length) {
-		if ((READ_TIMEOUT * 1000000) / NC_READ_SLEEP == sleep_count) {
-			ERROR("Reading timeout elapsed.");
-			free(buf);
-			*len = 0;
-			*text = NULL;
+#ifndef DISABLE_LIBSSH
+	if (session->ssh_chan) {
+		status = ssh_channel_poll_timeout(session->ssh_chan, timeout, 0);
+		if (status == SSH_ERROR) {
+			ERROR("Polling the SSH channel failed (%s)", session->ssh_sess ? ssh_get_error(session->ssh_sess) : "description not available");
 			return (EXIT_FAILURE);
 		}
-#ifndef DISABLE_LIBSSH
-		if (session->ssh_chan) {
-			/* read via libssh */
-			c = ssh_channel_read(session->ssh_chan, &(buf[rd]), chunk_length - rd, 0);
-			if (c == SSH_AGAIN) {
-				usleep (NC_READ_SLEEP);
-				++sleep_count;
-				continue;
-			} else if (c == SSH_ERROR) {
-				ERROR("Reading from the SSH channel failed (%zd: %s)", ssh_get_error_code(session->ssh_sess), ssh_get_error(session->ssh_sess));
-				free (buf);
-				*len = 0;
-				*text = NULL;
-				return (EXIT_FAILURE);
-			} else if (c == 0) {
-				if (ssh_channel_is_eof(session->ssh_chan)) {
-					ERROR("Server has closed the communication socket");
-					free (buf);
-					*len = 0;
-					*text = NULL;
-					return (EXIT_FAILURE);
-				}
-				usleep (NC_READ_SLEEP);
-				++sleep_count;
-				continue;
-			}
-		} else
+		/* data available, timeout, SSH_EOF or SSH_AGAIN are resolved by the next reading */
+		return (EXIT_SUCCESS);
+	}
 #endif
 #ifdef ENABLE_TLS
-		if (session->tls) {
-			/* read via OpenSSL */
-			c = SSL_read(session->tls, &(buf[rd]), chunk_length - rd);
-			if (c <= 0 && (r = SSL_get_error(session->tls, c))) {
-				if (r == SSL_ERROR_WANT_READ) {
-					usleep(NC_READ_SLEEP);
-					++sleep_count;
-					continue;
-				} else {
-					if (r == SSL_ERROR_SYSCALL) {
-						ERROR("Reading from the TLS session failed (%s)", strerror(errno));
-					} else if (r == SSL_ERROR_SSL) {
-						ERROR("Reading from the TLS session failed (%s)", ERR_error_string(r, NULL));
-					} else {
-						ERROR("Reading from the TLS session failed (SSL code %d)", r);
-					}
-					free (buf);
-					if (len != NULL) {
-						*len = 0;
-					}
-					if (text != NULL) {
-						*text = NULL;
-					}
-					return (EXIT_FAILURE);
-				}
-			}
-		} else
-#endif
-		if (session->fd_input != -1) {
-			/* read via file descriptor */
-			c = read (session->fd_input, &(buf[rd]), chunk_length - rd);
-			if (c == -1) {
-				if (errno == EAGAIN) {
-					usleep (NC_READ_SLEEP);
-					++sleep_count;
-					continue;
-				} else {
-					ERROR("Reading from an input file descriptor failed (%s)", strerror(errno));
-					free (buf);
-					*len = 0;
-					*text = NULL;
-					return (EXIT_FAILURE);
-				}
-			}
-		} else {
-			ERROR("No way to read the input, fatal error.");
-			free (buf);
-			*len = 0;
-			*text = NULL;
-			return (EXIT_FAILURE);
+	if (session->tls) {
+		if (SSL_pending(session->tls) > 0) {
+			return (EXIT_SUCCESS);
 		}
-
-		rd += c;
+		fds.fd = SSL_get_fd(session->tls);
+	} else
+#endif
+	{
+		fds.fd = session->fd_input;
 	}
 
-	/* add terminating null byte */
-	buf[rd] = 0;
+	fds.events = POLLIN;
+	fds.revents = 0;
+	status = poll(&fds, 1, timeout);
+	if (status < 0 && errno != EINTR) {
+		ERROR("Poll on input communication file descriptor failed (%s)", strerror(errno));
+		return (EXIT_FAILURE);
+	}
+	/* POLLHUP and POLLERR are detected by the next reading */
 
-	*len = rd;
-	*text = buf;
 	return (EXIT_SUCCESS);
 }
 
-static int nc_session_read_until(struct nc_session* session, const char* endtag, unsigned int limit, char **text, size_t *len)
+/**
+ * @brief Read the next block of data from the communication channel into the
+ * session's input buffer. The buffer is compacted or enlarged if there is no
+ * free space at its end.
+ *
+ * @param[in] session NETCONF session to read from.
+ * @param[in,out] deadline Time (as returned by nc_time_ms()) when the reading
+ * timeouts, it is renewed when some data are read. NULL to read only the data
+ * currently available without waiting.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int nc_session_fill_rbuf(struct nc_session* session, long long *deadline)
 {
-	size_t rd = 0;
 	ssize_t c;
-	char *buf = NULL;
-	size_t buflen = 0;
-	long sleep_count = 0;
-#ifdef ENABLE_TLS
-	int r;
-#endif
+	char *tmp;
 
-	/* check if we can work with the session */
-	if (session->status != NC_SESSION_STATUS_WORKING &&
-			session->status != NC_SESSION_STATUS_CLOSING) {
-		return (EXIT_FAILURE);
+	if (session->rbuf == NULL) {
+		if ((session->rbuf = malloc(NC_READ_BUF_SIZE * sizeof(char))) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			return (EXIT_FAILURE);
+		}
+		session->rbuf_size = NC_READ_BUF_SIZE;
+		session->rbuf_start = session->rbuf_end = 0;
+	} else if (session->rbuf_start == session->rbuf_end) {
+		/* everything was processed, start from the beginning */
+		session->rbuf_start = session->rbuf_end = 0;
+	}
+
+	if (session->rbuf_end == session->rbuf_size) {
+		if (session->rbuf_start > 0) {
+			/* move unprocessed data to the beginning of the buffer */
+			memmove(session->rbuf, &(session->rbuf[session->rbuf_start]), session->rbuf_end - session->rbuf_start);
+			session->rbuf_end -= session->rbuf_start;
+			session->rbuf_start = 0;
+		} else {
+			/* the buffer is full of unprocessed data, get more memory */
+			tmp = realloc(session->rbuf, (2 * session->rbuf_size) * sizeof(char));
+			if (tmp == NULL) {
+				ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+				return (EXIT_FAILURE);
+			}
+			session->rbuf = tmp;
+			session->rbuf_size = 2 * session->rbuf_size;
+		}
 	}
 
-	if (endtag == NULL) {
+	while ((c = nc_session_transport_read(session, &(session->rbuf[session->rbuf_end]), session->rbuf_size - session->rbuf_end)) == 0) {
+		if (deadline == NULL) {
+			/* nothing to read now */
+			return (EXIT_SUCCESS);
+		}
+		if (nc_session_read_wait(session, *deadline) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
+		}
+	}
+	if (c < 0) {
 		return (EXIT_FAILURE);
 	}
+	session->rbuf_end += c;
+	if (deadline != NULL) {
+		*deadline = nc_time_deadline();
+	}
 
-	/* set starting buffer size */
-	buflen = 1024;
-	buf = (char*) malloc (buflen * sizeof(char));
-	if (buf == NULL) {
-		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Read exactly chunk_length bytes from the session into the given
+ * buffer. The data already present in the session's input buffer are used
+ * first, the large rest of the chunk is read directly into the buffer.
+ *
+ * @param[in] session NETCONF session to read from.
+ * @param[in] chunk_length Number of bytes to read.
+ * @param[out] buf Buffer for the data, it must be at least chunk_length bytes
+ * long. Data are not null-terminated.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int nc_session_read_len(struct nc_session* session, size_t chunk_length, char *buf)
+{
+	ssize_t c;
+	size_t rd = 0, avail;
+	long long deadline;
+
+	/* check if we can work with the session */
+	if (session->status != NC_SESSION_STATUS_WORKING &&
+			session->status != NC_SESSION_STATUS_CLOSING) {
 		return (EXIT_FAILURE);
 	}
+	deadline = nc_time_deadline();
 
-	for (rd = 0;;) {
-		if (limit > 0 && rd > limit) {
-			free(buf);
-			WARN("%s: reading limit reached.", __func__);
-			return (EXIT_FAILURE);
-		}
-
-		if ((READ_TIMEOUT * 1000000) / NC_READ_SLEEP == sleep_count) {
-			free(buf);
-			ERROR("Reading timeout elapsed.");
-			return (EXIT_FAILURE);
-		}
-#ifndef DISABLE_LIBSSH
-		if (session->ssh_chan) {
-			/* read via libssh */
-			c = ssh_channel_read(session->ssh_chan, &(buf[rd]), 1, 0);
-			if (c == SSH_AGAIN) {
-				usleep (NC_READ_SLEEP);
-				++sleep_count;
-				continue;
-			} else if (c == SSH_ERROR) {
-				if (session->ssh_sess != NULL) {
-					ERROR("Reading from the SSH channel failed (%zd: %s)", ssh_get_error_code(session->ssh_sess), ssh_get_error(session->ssh_sess));
-				} else {
-					ERROR("Reading from the SSH channel failed");
-				}
-				free (buf);
-				if (len != NULL) {
-					*len = 0;
-				}
-				if (text != NULL) {
-					*text = NULL;
-				}
+	while (rd < chunk_length) {
+		avail = session->rbuf_end - session->rbuf_start;
+		if (avail > 0) {
+			/* use the already buffered data */
+			if (avail > chunk_length - rd) {
+				avail = chunk_length - rd;
+			}
+			memcpy(&(buf[rd]), &(session->rbuf[session->rbuf_start]), avail);
+			session->rbuf_start += avail;
+			rd += avail;
+		} else if (chunk_length - rd >= NC_READ_BUF_SIZE) {
+			/* avoid copying of the large data via the input buffer */
+			c = nc_session_transport_read(session, &(buf[rd]), chunk_length - rd);
+			if (c < 0) {
 				return (EXIT_FAILURE);
 			} else if (c == 0) {
-				if (ssh_channel_is_eof (session->ssh_chan)) {
-					ERROR("Server has closed the communication socket");
-					free (buf);
-					if (len != NULL) {
-						*len = 0;
-					}
-					if (text != NULL) {
-						*text = NULL;
-					}
+				if (nc_session_read_wait(session, deadline) != EXIT_SUCCESS) {
 					return (EXIT_FAILURE);
 				}
-				usleep (NC_READ_SLEEP);
-				++sleep_count;
 				continue;
 			}
-		} else
-#endif
-#ifdef ENABLE_TLS
-		if (session->tls) {
-			/* read via OpenSSL */
-			c = SSL_read(session->tls, &(buf[rd]), 1);
-			if (c <= 0 && (r = SSL_get_error(session->tls, c))) {
-				if (r == SSL_ERROR_WANT_READ) {
-					usleep(NC_READ_SLEEP);
-					++sleep_count;
-					continue;
-				} else {
-					if (r == SSL_ERROR_SYSCALL) {
-						ERROR("Reading from the TLS session failed (%s)", strerror(errno));
-					} else if (r == SSL_ERROR_SSL) {
-						ERROR("Reading from the TLS session failed (%s)", ERR_error_string(r, NULL));
-					} else {
-						ERROR("Reading from the TLS session failed (SSL code %d)", r);
-					}
-					free (buf);
-					if (len != NULL) {
-						*len = 0;
-					}
-					if (text != NULL) {
-						*text = NULL;
-					}
-					return (EXIT_FAILURE);
-				}
-			}
-		} else
-#endif
-		if (session->fd_input != -1) {
-			/* read via file descriptor */
-			c = read (session->fd_input, &(buf[rd]), 1);
-			if (c == -1) {
-				if (errno == EAGAIN) {
-					usleep (NC_READ_SLEEP);
-					++sleep_count;
-					continue;
-				} else {
-					ERROR("Reading from an input file descriptor failed (%s)", strerror(errno));
-					free (buf);
-					if (len != NULL) {
-						*len = 0;
-					}
-					if (text != NULL) {
-						*text = NULL;
-					}
-					return (EXIT_FAILURE);
-				}
-			} else if (c == 0) {
-				ERROR("EOF received (%s)", strerror(errno));
-				free(buf);
-				if (len != NULL ) {
-					*len = 0;
-				}
-				if (text != NULL ) {
-					*text = NULL;
-				}
-				return (EXIT_FAILURE);
-			}
-		} else {
-			ERROR("No way to read the input, fatal error.");
-			free (buf);
-			if (len != NULL) {
-				*len = 0;
-			}
-			if (text != NULL) {
-				*text = NULL;
-			}
+			rd += c;
+			deadline = nc_time_deadline();
+		} else if (nc_session_fill_rbuf(session, &deadline) != EXIT_SUCCESS) {
 			return (EXIT_FAILURE);
 		}
+	}
 
-		rd += c; /* should be rd++ */
-		buf[rd] = '\0';
+	return (EXIT_SUCCESS);
+}
 
-		if ((rd) < strlen (endtag)) {
-			/* not enough data to compare with endtag */
-			continue;
-		} else {
-			/* compare with endtag */
-			if (strcmp (endtag, &(buf[rd - strlen (endtag)])) == 0) {
+/**
+ * @brief Read data from the session until the endtag is found.
+ *
+ * @param[in] session NETCONF session to read from.
+ * @param[in] endtag String terminating the data to read.
+ * @param[in] limit Maximal number of bytes expected before the endtag, 0 for
+ * no limit.
+ * @param[out] text Read data including the endtag, null-terminated. Caller is
+ * supposed to free it. If NULL, the data are just thrown away.
+ * @param[out] len Length of the read data.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int nc_session_read_until(struct nc_session* session, const char* endtag, unsigned int limit, char **text, size_t *len)
+{
+	size_t taglen, avail, window, searched = 0, rd;
+	char *found, *buf;
+	long long deadline;
+
+	if (len != NULL) {
+		*len = 0;
+	}
+	if (text != NULL) {
+		*text = NULL;
+	}
+
+	/* check if we can work with the session */
+	if (session->status != NC_SESSION_STATUS_WORKING &&
+			session->status != NC_SESSION_STATUS_CLOSING) {
+		return (EXIT_FAILURE);
+	}
+
+	if (endtag == NULL) {
+		return (EXIT_FAILURE);
+	}
+	taglen = strlen(endtag);
+	deadline = nc_time_deadline();
+
+	while (1) {
+		avail = session->rbuf_end - session->rbuf_start;
+		window = avail;
+		if (limit > 0 && window > limit + 1) {
+			window = limit + 1;
+		}
+
+		if (window >= taglen) {
+			/* search only in the data not checked in the previous loops */
+			found = memmem(&(session->rbuf[session->rbuf_start + searched]), window - searched, endtag, taglen);
+			if (found != NULL) {
 				/* end tag found */
-				if (len != NULL) {
-					*len = rd;
-				}
+				rd = (found - &(session->rbuf[session->rbuf_start])) + taglen;
 				if (text != NULL) {
+					if ((buf = malloc((rd + 1) * sizeof(char))) == NULL) {
+						ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+						return (EXIT_FAILURE);
+					}
+					memcpy(buf, &(session->rbuf[session->rbuf_start]), rd);
+					buf[rd] = '\0';
 					*text = buf;
-				} else {
-					free(buf);
 				}
+				if (len != NULL) {
+					*len = rd;
+				}
+				session->rbuf_start += rd;
 				return (EXIT_SUCCESS);
 			}
+			/* the endtag can begin in the last (taglen - 1) checked bytes */
+			searched = window - (taglen - 1);
 		}
 
-		/* resize buffer if needed */
-		if (rd == (buflen-1)) {
-			/* get more memory for the text */
-			void *tmp = realloc (buf, (2 * buflen) * sizeof(char));
-			if (tmp == NULL) {
-				ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-				if (len != NULL) {
-					*len = 0;
-				}
-				if (text != NULL) {
-					*text = NULL;
-				}
-				free(buf);
-				return (EXIT_FAILURE);
-			}
-			buf = tmp;
-			buflen = 2 * buflen;
+		if (limit > 0 && window > limit) {
+			WARN("%s: reading limit reached.", __func__);
+			return (EXIT_FAILURE);
+		}
+
+		/* get more data */
+		if (nc_session_fill_rbuf(session, &deadline) != EXIT_SUCCESS) {
+			return (EXIT_FAILURE);
 		}
 	}
 
 	/* no one could be here */
 	ERROR("Reading NETCONF message fatal failure");
-	free (buf);
-	if (len != NULL) {
-		*len = 0;
+	return (EXIT_FAILURE);
+}
+
+/**
+ * @brief Check whether a complete message is in the session's input buffer,
+ * so nc_session_receive() gets it without waiting for more data. The caller
+ * is supposed to hold the session's mut_channel.
+ *
+ * The framing is checked the same way nc_session_receive() reads it, the
+ * already checked part of the buffer is remembered in the session, so the
+ * next check continues where this one stopped. The data which
+ * nc_session_receive() refuses without waiting for more data are reported
+ * as complete to let it report the error.
+ *
+ * @param[in] session NETCONF session to check.
+ * @return 1 if the message is complete, 0 if more data are needed.
+ */
+static int nc_session_msg_buffered(struct nc_session* session)
+{
+	const char *data, *found, *eol;
+	size_t avail, pos, taglen;
+	unsigned long chunk_length;
+	char header[32];
+
+	if (session->rbuf == NULL || session->rbuf_start == session->rbuf_end) {
+		return (0);
 	}
-	if (text != NULL) {
-		*text = NULL;
+	data = &(session->rbuf[session->rbuf_start]);
+	avail = session->rbuf_end - session->rbuf_start;
+
+	switch (session->version) {
+	case NETCONFV10:
+		taglen = strlen(NC_V10_END_MSG);
+		if (memmem(&(data[session->rbuf_checked]), avail - session->rbuf_checked, NC_V10_END_MSG, taglen) != NULL) {
+			return (1);
+		}
+		/* the endtag can begin in the last (taglen - 1) checked bytes */
+		if (avail >= taglen) {
+			session->rbuf_checked = avail - (taglen - 1);
+		}
+		return (0);
+	case NETCONFV11:
+		/* rbuf_checked points to the beginning of the next chunk header */
+		for (pos = session->rbuf_checked; ; pos = (eol - data) + 1 + chunk_length) {
+			/* "\n#" is expected in the next 3 bytes */
+			if ((found = memmem(&(data[pos]), (avail - pos > 3) ? 3 : avail - pos, "\n#", 2)) == NULL) {
+				return (avail - pos >= 3);
+			}
+			/* chunk size or '#' of the end of chunks, terminated by a newline */
+			if ((eol = memchr(found + 2, '\n', avail - ((found + 2) - data))) == NULL) {
+				return (0);
+			}
+			if ((size_t) (eol - (found + 2)) + 2 > sizeof(header)) {
+				return (1);
+			}
+			memcpy(header, found + 2, (eol - (found + 2)) + 1);
+			header[(eol - (found + 2)) + 1] = '\0';
+			if (strcmp(header, "#\n") == 0 || (chunk_length = strtoul(header, NULL, 10)) == 0) {
+				/* end of the message or an invalid chunk size */
+				return (1);
+			}
+			if (avail - ((eol - data) + 1) < chunk_length) {
+				return (0);
+			}
+			session->rbuf_checked = (eol - data) + 1 + chunk_length;
+		}
+	default:
+		return (1);
 	}
-	return (EXIT_FAILURE);
 }
 
 /**
@@ -2010,6 +2302,69 @@ const nc_msgid nc_msg_parse_msgid(const struct nc_msg *msg)
 	return (ret);
 }
 
+/**
+ * @brief Pass the next part of the received message to the XML push parser.
+ *
+ * @param[in,out] parser Parser context, created with the first non-whitespace
+ * data of the message.
+ * @param[in] data Part of the message.
+ * @param[in] len Length of the data.
+ * @return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int nc_session_parse_chunk(xmlParserCtxtPtr* parser, const char* data, size_t len)
+{
+	if (*parser == NULL) {
+		/* skip leading whitespaces */
+		while (len > 0 && isspace(*data)) {
+			data++;
+			len--;
+		}
+		if (len == 0) {
+			return (EXIT_SUCCESS);
+		}
+
+		if ((*parser = xmlCreatePushParserCtxt(NULL, NULL, NULL, 0, NULL)) == NULL) {
+			ERROR("%s: creating the XML parser failed.", __func__);
+			return (EXIT_FAILURE);
+		}
+		xmlCtxtUseOptions(*parser, NC_XMLREAD_OPTIONS);
+	}
+
+	for (; len > INT_MAX; data += INT_MAX, len -= INT_MAX) {
+		xmlParseChunk(*parser, data, INT_MAX, 0);
+	}
+	xmlParseChunk(*parser, data, (int) len, 0);
+
+	/* only the well-formedness errors are fatal, as with xmlReadDoc() */
+	return ((*parser)->wellFormed ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/**
+ * @brief Get the document from the push parser and free the parser.
+ *
+ * @param[in] parser Parser context with the whole message passed in.
+ * @return Parsed document, NULL if the message is not well-formed.
+ */
+static xmlDocPtr nc_session_parse_finish(xmlParserCtxtPtr parser)
+{
+	xmlDocPtr doc;
+
+	if (parser == NULL) {
+		return (NULL);
+	}
+
+	xmlParseChunk(parser, NULL, 0, 1);
+	doc = parser->myDoc;
+	if (!parser->wellFormed) {
+		xmlFreeDoc(doc);
+		doc = NULL;
+	}
+	parser->myDoc = NULL;
+	xmlFreeParserCtxt(parser);
+
+	return (doc);
+}
+
 static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, struct nc_msg** msg)
 {
 	struct nc_msg *retval;
@@ -2018,13 +2373,16 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 	const char *emsg;
 	char *text = NULL, *tmp_text, *chunk = NULL;
 	size_t len;
-	unsigned long long int text_size = 0, total_len = 0;
+	size_t text_size = 0;
 	size_t chunk_length;
 	struct pollfd fds;
 	int status;
 	unsigned long int revents;
 	NC_MSG_TYPE msgtype;
 	xmlNodePtr root;
+	xmlParserCtxtPtr parser = NULL;
+	xmlDocPtr doc = NULL;
+	int empty = 1;
 
 	if (session == NULL || (session->status != NC_SESSION_STATUS_WORKING && session->status != NC_SESSION_STATUS_CLOSING)) {
 		ERROR("Invalid session to receive data.");
@@ -2046,6 +2404,17 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 
 	/* use while for possibility of repeating test */
 	while(1) {
+		if (session->rbuf_start < session->rbuf_end) {
+			/* some data were already read into the input buffer */
+			break;
+		}
+#ifdef ENABLE_TLS
+		if (session->tls != NULL && SSL_pending(session->tls) > 0) {
+			/* OpenSSL has some already decrypted data */
+			break;
+		}
+#endif
+
 		revents = 0;
 #ifndef DISABLE_LIBSSH
 		if (session->ssh_chan != NULL) {
@@ -2113,9 +2482,7 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 			ERROR("Input channel error (%s)", emsg);
 			nc_session_close(session, NC_SESSION_TERM_DROPPED);
 			if (nc_info) {
-				pthread_rwlock_wrlock(&(nc_info->lock));
-				nc_info->stats.sessions_dropped++;
-				pthread_rwlock_unlock(&(nc_info->lock));
+				NC_STATS_INC(nc_info->stats.sessions_dropped);
 			}
 			return (NC_MSG_UNKNOWN);
 
@@ -2130,9 +2497,7 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 			ERROR("Input channel closed");
 			nc_session_close(session, NC_SESSION_TERM_DROPPED);
 			if (nc_info) {
-				pthread_rwlock_wrlock(&(nc_info->lock));
-				nc_info->stats.sessions_dropped++;
-				pthread_rwlock_unlock(&(nc_info->lock));
+				NC_STATS_INC(nc_info->stats.sessions_dropped);
 			}
 			return (NC_MSG_UNKNOWN);
 		}
@@ -2141,6 +2506,9 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 		break;
 	}
 
+	/* the buffered data are going to be consumed */
+	session->rbuf_checked = 0;
+
 	switch (session->version) {
 	case NETCONFV10:
 		if (nc_session_read_until (session, NC_V10_END_MSG, 0, &text, &len) != 0) {
@@ -2148,20 +2516,31 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 		}
 		text[len - strlen (NC_V10_END_MSG)] = 0;
 		DBG("Received message (session %s): %s", session->session_id, text);
+
+		/* skip leading whitespaces */
+		tmp_text = text;
+		while (isspace(*tmp_text)) {
+			tmp_text++;
+		}
+		empty = (*tmp_text == '\0');
+		/* store the received message in libxml2 format */
+		if (!empty) {
+			doc = xmlReadDoc (BAD_CAST tmp_text, NULL, NULL, NC_XMLREAD_OPTIONS);
+		}
+		free (text);
 		break;
 	case NETCONFV11:
+		/*
+		 * the chunks are passed to the XML parser as they come, so the whole
+		 * message text is never concatenated, only the buffer for the largest
+		 * chunk is kept
+		 */
 		do {
 			if (nc_session_read_until (session, "\n#", 2, NULL, NULL) != 0) {
-				if (total_len > 0) {
-					free (text);
-				}
-				goto malformed_msg_channels_unlock;
+				goto malformed_msg_parser_free;
 			}
 			if (nc_session_read_until (session, "\n", 0, &chunk, &len) != 0) {
-				if (total_len > 0) {
-					free (text);
-				}
-				goto malformed_msg_channels_unlock;
+				goto malformed_msg_parser_free;
 			}
 			if (strcmp (chunk, "#\n") == 0) {
 				/* end of chunked framing message */
@@ -2173,42 +2552,40 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 			chunk_length = strtoul (chunk, (char **) NULL, 10);
 			if (chunk_length == 0) {
 				ERROR("Invalid frame chunk size detected, fatal error.");
-				goto malformed_msg_channels_unlock;
+				free (chunk);
+				goto malformed_msg_parser_free;
 			}
 			free (chunk);
 			chunk = NULL;
 
-			/* now we have size of next chunk, so read the chunk */
-			if (nc_session_read_len (session, chunk_length, &chunk, &len) != 0) {
-				if (total_len > 0) {
-					free (text);
-				}
-				goto malformed_msg_channels_unlock;
-			}
-
-			/*
-			 * realloc resulting text buffer if needed (always needed now)
-			 * don't forget count terminating null byte
-			 * */
-			if (text_size < (total_len + len + 1)) {
-				char *tmp = realloc (text, total_len + len + 1);
+			/* realloc the chunk buffer if needed, don't forget count terminating null byte */
+			if (text_size < chunk_length + 1) {
+				text_size = chunk_length + 1;
+				char *tmp = realloc (text, text_size);
 				if (tmp == NULL) {
 					ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-					free(text);
-					goto malformed_msg_channels_unlock;
+					goto malformed_msg_parser_free;
 				}
 				text = tmp;
-				text[total_len] = '\0';
-				text_size = total_len + len + 1;
 			}
-			memcpy(text + total_len, chunk, len);
-			total_len += len;
-			text[total_len] = '\0';
-			free (chunk);
-			chunk = NULL;
 
+			/* now we have size of next chunk, so read the chunk directly into the buffer */
+			if (nc_session_read_len (session, chunk_length, text) != 0) {
+				goto malformed_msg_parser_free;
+			}
+			text[chunk_length] = '\0';
+			DBG("Received message chunk (session %s): %s", session->session_id, text);
+
+			if (nc_session_parse_chunk(&parser, text, chunk_length) != EXIT_SUCCESS) {
+				ERROR("Invalid XML data received.");
+				goto malformed_msg_parser_free;
+			}
+			empty = (parser == NULL);
 		} while (1);
-		DBG("Received message (session %s): %s", session->session_id, text);
+		free (text);
+		text = NULL;
+		doc = nc_session_parse_finish(parser);
+		parser = NULL;
 		break;
 	default:
 		ERROR("Unsupported NETCONF protocol version (%d)", session->version);
@@ -2219,32 +2596,22 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 	DBG_UNLOCK("mut_channel");
 	pthread_mutex_unlock(session->mut_channel);
 
-	if (text == NULL) {
+	if (empty) {
 		ERROR("Empty message received (session %s)", session->session_id);
 		goto malformed_msg;
 	}
+	if (doc == NULL) {
+		ERROR("Invalid XML data received.");
+		goto malformed_msg;
+	}
 
 	retval = calloc (1, sizeof(struct nc_msg));
 	if (retval == NULL) {
 		ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
-		free (text);
+		xmlFreeDoc (doc);
 		goto malformed_msg;
 	}
-
-	/* skip leading whitespaces */
-	tmp_text=text;
-	while (isspace(*tmp_text)) {
-		tmp_text++;
-	}
-	/* store the received message in libxml2 format */
-	retval->doc = xmlReadDoc (BAD_CAST tmp_text, NULL, NULL, NC_XMLREAD_OPTIONS);
-	if (retval->doc == NULL) {
-		free (retval);
-		free (text);
-		ERROR("Invalid XML data received.");
-		goto malformed_msg;
-	}
-	free (text);
+	retval->doc = doc;
 
 	/* create xpath evaluation context */
 	if ((retval->ctxt = xmlXPathNewContext(retval->doc)) == NULL) {
@@ -2300,7 +2667,8 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 	} else if (xmlStrcmp (root->name, BAD_CAST "rpc") == 0) {
 		msgtype = NC_MSG_RPC;
 
-		/* set with-defaults if any */
+		/* decode the operation parameters, including with-defaults */
+		nc_rpc_parse_envelope(retval);
 		nc_rpc_parse_withdefaults(retval, NULL);
 	} else if (xmlStrcmp (root->name, BAD_CAST "hello") == 0) {
 		/* set message type, we have <hello> message */
@@ -2328,6 +2696,13 @@ static NC_MSG_TYPE nc_session_receive(struct nc_session* session, int timeout, s
 	(*msg)->session = session;
 	return (msgtype);
 
+malformed_msg_parser_free:
+	free (text);
+	if (parser != NULL) {
+		xmlFreeDoc(parser->myDoc);
+		xmlFreeParserCtxt(parser);
+	}
+
 malformed_msg_channels_unlock:
 	DBG_UNLOCK("mut_channel");
 	pthread_mutex_unlock(session->mut_channel);
@@ -2376,12 +2751,198 @@ static NC_MSG_TYPE nc_session_recv_msg(struct nc_session* session, int timeout,
 	return (ret);
 }
 
+/**
+ * @brief Append the received \<rpc-reply\> to the session's queue of replies.
+ * The caller is supposed to hold mut_mqueue.
+ */
+static void nc_session_queue_reply(struct nc_session* session, struct nc_msg* msg)
+{
+	msg->next = NULL;
+	msg->prev = session->queue_msg_last;
+	if (session->queue_msg_last == NULL) {
+		session->queue_msg = msg;
+	} else {
+		session->queue_msg_last->next = msg;
+	}
+	session->queue_msg_last = msg;
+
+	if (msg->msgid == NULL) {
+		return;
+	}
+	if (session->queue_msg_index == NULL && (session->queue_msg_index = xmlHashCreate(16)) == NULL) {
+		ERROR("xmlHashCreate failed (%s:%d).", __FILE__, __LINE__);
+		return;
+	}
+	/* if the message-id is duplicated, only the older reply is indexed, the
+	 * newer one is still available via nc_session_recv_reply() */
+	xmlHashAddEntry(session->queue_msg_index, BAD_CAST msg->msgid, msg);
+}
+
+/**
+ * @brief Remove the \<rpc-reply\> from the session's queue of replies.
+ * The caller is supposed to hold mut_mqueue.
+ */
+static void nc_session_unqueue_reply(struct nc_session* session, struct nc_msg* msg)
+{
+	if (msg->prev == NULL) {
+		session->queue_msg = msg->next;
+	} else {
+		msg->prev->next = msg->next;
+	}
+	if (msg->next == NULL) {
+		session->queue_msg_last = msg->prev;
+	} else {
+		msg->next->prev = msg->prev;
+	}
+	msg->next = NULL;
+	msg->prev = NULL;
+
+	if (msg->msgid != NULL && session->queue_msg_index != NULL &&
+			xmlHashLookup(session->queue_msg_index, BAD_CAST msg->msgid) == msg) {
+		xmlHashRemoveEntry(session->queue_msg_index, BAD_CAST msg->msgid, NULL);
+	}
+}
+
+/**
+ * @brief Pass the received \<rpc-reply\> to the callback of the corresponding
+ * asynchronously sent \<rpc\>. The caller is supposed not to hold mut_mqueue,
+ * the callback is called without it.
+ *
+ * @return 1 if the reply was passed to the callback (and the caller is no more
+ * its owner), 0 if there is no such callback.
+ */
+static int nc_session_dispatch_reply(struct nc_session* session, struct nc_msg* msg)
+{
+	struct nc_reply_pending* pending = NULL;
+
+	if (msg->msgid == NULL) {
+		return (0);
+	}
+
+	DBG_LOCK("mut_mqueue");
+	pthread_mutex_lock(&(session->mut_mqueue));
+	if (session->pending != NULL &&
+			(pending = xmlHashLookup(session->pending, BAD_CAST msg->msgid)) != NULL) {
+		xmlHashRemoveEntry(session->pending, BAD_CAST msg->msgid, NULL);
+	}
+	DBG_UNLOCK("mut_mqueue");
+	pthread_mutex_unlock(&(session->mut_mqueue));
+
+	if (pending == NULL) {
+		return (0);
+	}
+
+	pending->func(session, msg->msgid, (nc_reply*) msg, pending->data);
+	free(pending);
+
+	return (1);
+}
+
+/**
+ * @brief Process the \<rpc-reply\> with error information by the callback set
+ * by nc_callback_error_reply().
+ *
+ * @return 1 if the reply was processed and freed, 0 otherwise.
+ */
+static int nc_session_process_error_reply(struct nc_msg* msg)
+{
+	struct nc_err* error;
+
+	if (nc_reply_get_type(msg) != NC_REPLY_ERROR || callbacks.process_error_reply == NULL) {
+		return (0);
+	}
+
+	/* process rpc-error msg */
+	for (error = msg->error; error != NULL; error = error->next) {
+		callbacks.process_error_reply(error->tag,
+				error->type,
+				error->severity,
+				error->apptag,
+				error->path,
+				error->message,
+				error->attribute,
+				error->element,
+				error->ns,
+				error->sid);
+	}
+	/* free the data */
+	nc_reply_free(msg);
+
+	return (1);
+}
+
+/**
+ * @brief Add event notification into the session's list of notification messages.
+ */
+static void nc_session_queue_notif(struct nc_session* session, struct nc_msg* msg)
+{
+	struct nc_msg* msg_aux;
+
+	DBG_LOCK("mut_equeue");
+	pthread_mutex_lock(&(session->mut_equeue));
+	msg_aux = session->queue_event;
+	if (msg_aux == NULL) {
+		msg->next = session->queue_event;
+		session->queue_event = msg;
+	} else {
+		for (; msg_aux->next != NULL; msg_aux = msg_aux->next);
+		msg_aux->next = msg;
+	}
+	DBG_UNLOCK("mut_equeue");
+	pthread_mutex_unlock(&(session->mut_equeue));
+}
+
+/**
+ * @brief Take the oldest queued \<rpc-reply\> or, if msgid is set, the queued
+ * \<rpc-reply\> with the specified message-id.
+ *
+ * @return The reply removed from the queue, NULL if there is no such reply.
+ */
+static struct nc_msg* nc_session_pop_reply(struct nc_session* session, const nc_msgid msgid)
+{
+	struct nc_msg* msg;
+
+	DBG_LOCK("mut_mqueue");
+	pthread_mutex_lock(&(session->mut_mqueue));
+	if (msgid == NULL) {
+		msg = session->queue_msg;
+	} else if (session->queue_msg_index != NULL) {
+		msg = xmlHashLookup(session->queue_msg_index, BAD_CAST msgid);
+	} else {
+		msg = NULL;
+	}
+	if (msg != NULL) {
+		nc_session_unqueue_reply(session, msg);
+	}
+	DBG_UNLOCK("mut_mqueue");
+	pthread_mutex_unlock(&(session->mut_mqueue));
+
+	return (msg);
+}
+
+/**
+ * @brief Store the received \<rpc-reply\> for the later use of someone else.
+ */
+static void nc_session_store_reply(struct nc_session* session, struct nc_msg* msg)
+{
+	DBG_LOCK("mut_mqueue");
+	pthread_mutex_lock(&(session->mut_mqueue));
+	nc_session_queue_reply(session, msg);
+	DBG_UNLOCK("mut_mqueue");
+	pthread_mutex_unlock(&(session->mut_mqueue));
+}
+
+/*
+ * The receiving functions below hold mut_mqueue only while accessing the queue
+ * of replies and the pending callbacks. Reading of the messages is serialized
+ * by mut_channel in nc_session_receive(), so nc_session_send_rpc_async() is not
+ * blocked by another thread waiting for a reply.
+ */
 #define LOCAL_RECEIVE_TIMEOUT 100
 API NC_MSG_TYPE nc_session_recv_reply(struct nc_session* session, int timeout, nc_reply** reply)
 {
-	struct nc_msg *msg_aux, *msg = NULL;
+	struct nc_msg *msg = NULL;
 	NC_MSG_TYPE ret;
-	struct nc_err* error;
 
 	/* use local timeout to avoid continual long time blocking */
 	int local_timeout;
@@ -2392,17 +2953,10 @@ API NC_MSG_TYPE nc_session_recv_reply(struct nc_session* session, int timeout, n
 		local_timeout = LOCAL_RECEIVE_TIMEOUT;
 	}
 
-	DBG_LOCK("mut_mqueue");
-	pthread_mutex_lock(&(session->mut_mqueue));
-
 try_again:
-	if (session->queue_msg != NULL) {
-		/* pop the oldest reply from the queue */
-		*reply = (nc_reply*)(session->queue_msg);
-		session->queue_msg = (*reply)->next;
-		DBG_UNLOCK("mut_mqueue");
-		pthread_mutex_unlock(&(session->mut_mqueue));
-		(*reply)->next = NULL;
+	if ((msg = nc_session_pop_reply(session, NULL)) != NULL) {
+		/* the oldest reply from the queue */
+		*reply = (nc_reply*) msg;
 		return (NC_MSG_REPLY);
 	}
 
@@ -2410,24 +2964,11 @@ try_again:
 
 	switch (ret) {
 	case NC_MSG_REPLY: /* regular reply received */
-		/* if specified callback for processing rpc-error, use it */
-		if (nc_reply_get_type (msg) == NC_REPLY_ERROR &&
-				callbacks.process_error_reply != NULL) {
-			/* process rpc-error msg */
-			for (error = msg->error; error != NULL; error = error->next) {
-				callbacks.process_error_reply(error->tag,
-						error->type,
-						error->severity,
-						error->apptag,
-						error->path,
-						error->message,
-						error->attribute,
-						error->element,
-						error->ns,
-						error->sid);
-			}
-			/* free the data */
-			nc_reply_free(msg);
+		if (nc_session_dispatch_reply(session, msg)) {
+			/* reply to an asynchronously sent rpc was processed by its callback */
+			ret = NC_MSG_NONE;
+		} else if (nc_session_process_error_reply(msg)) {
+			/* if specified callback for processing rpc-error, it was used */
 			ret = NC_MSG_NONE;
 		} else {
 			*reply = (nc_reply*)msg;
@@ -2445,20 +2986,7 @@ try_again:
 		}
 		break;
 	case NC_MSG_NOTIFICATION:
-		/* add event notification into the session's list of notification messages */
-		DBG_LOCK("mut_equeue");
-		pthread_mutex_lock(&(session->mut_equeue));
-		msg_aux = session->queue_event;
-		if (msg_aux == NULL) {
-			msg->next = session->queue_event;
-			session->queue_event = msg;
-		} else {
-			for (; msg_aux->next != NULL; msg_aux = msg_aux->next);
-			msg_aux->next = msg;
-		}
-		DBG_UNLOCK("mut_equeue");
-		pthread_mutex_unlock(&(session->mut_equeue));
-
+		nc_session_queue_notif(session, msg);
 		break;
 	default:
 		nc_msg_free(msg);
@@ -2466,13 +2994,113 @@ try_again:
 		break;
 	}
 
-	/* session lock is no more needed */
-	DBG_UNLOCK("mut_mqueue");
-	pthread_mutex_unlock(&(session->mut_mqueue));
+	return (ret);
+}
+
+API NC_MSG_TYPE nc_session_recv_reply_msgid(struct nc_session* session, const nc_msgid msgid, int timeout, nc_reply** reply)
+{
+	struct nc_msg *msg = NULL;
+	NC_MSG_TYPE ret;
+	int local_timeout;
+
+	if (msgid == NULL) {
+		ERROR("%s: invalid parameter.", __func__);
+		return (NC_MSG_UNKNOWN);
+	}
+
+	/* use local timeout to avoid continual long time blocking */
+	if (timeout == 0) {
+		local_timeout = 0;
+	} else {
+		local_timeout = LOCAL_RECEIVE_TIMEOUT;
+	}
+
+try_again:
+	/* first, look into the session's list of previously received messages */
+	if ((msg = nc_session_pop_reply(session, msgid)) != NULL) {
+		*reply = (nc_reply*) msg;
+		return (NC_MSG_REPLY);
+	}
+
+	ret = nc_session_recv_msg(session, local_timeout, &msg);
+
+	switch (ret) {
+	case NC_MSG_REPLY:
+		if (nc_msgid_compare(msgid, msg->msgid) != 0) {
+			/* reply with different message ID, store it for the later use of someone else */
+			if (!nc_session_dispatch_reply(session, msg)) {
+				nc_session_store_reply(session, msg);
+			}
+			goto try_again;
+		}
+		if (nc_session_process_error_reply(msg)) {
+			ret = NC_MSG_NONE;
+		} else {
+			*reply = (nc_reply*) msg;
+		}
+		break;
+	case NC_MSG_NOTIFICATION:
+		nc_session_queue_notif(session, msg);
+		goto try_again;
+	case NC_MSG_HELLO:
+		/* unexpected, ignore it */
+		nc_msg_free(msg);
+		goto try_again;
+	case NC_MSG_WOULDBLOCK:
+		if ((timeout == -1) || ((timeout > 0) && ((timeout = timeout - local_timeout) > 0))) {
+			goto try_again;
+		}
+		break;
+	default:
+		ret = NC_MSG_UNKNOWN;
+		break;
+	}
 
 	return (ret);
 }
 
+API int nc_session_process_replies(struct nc_session* session, int timeout)
+{
+	struct nc_msg *msg = NULL;
+	int local_timeout, count = 0;
+
+	/* use local timeout to avoid continual long time blocking */
+	if (timeout == 0) {
+		local_timeout = 0;
+	} else {
+		local_timeout = LOCAL_RECEIVE_TIMEOUT;
+	}
+
+	while (1) {
+		switch (nc_session_recv_msg(session, local_timeout, &msg)) {
+		case NC_MSG_REPLY:
+			if (nc_session_dispatch_reply(session, msg)) {
+				count++;
+			} else if (!nc_session_process_error_reply(msg)) {
+				nc_session_store_reply(session, msg);
+			}
+			break;
+		case NC_MSG_NOTIFICATION:
+			nc_session_queue_notif(session, msg);
+			break;
+		case NC_MSG_HELLO:
+			nc_msg_free(msg);
+			break;
+		case NC_MSG_WOULDBLOCK:
+			if (timeout != 0 && (timeout == -1 || (timeout = timeout - local_timeout) > 0)) {
+				/* still waiting for the first message */
+				continue;
+			}
+			return (count);
+		default:
+			return (count ? count : -1);
+		}
+
+		/* a message was received, process only the messages already available */
+		timeout = local_timeout = 0;
+	}
+}
+
 API int nc_session_send_notif(struct nc_session* session, const nc_ntf* ntf)
 {
 	int ret;
@@ -2500,11 +3128,9 @@ API int nc_session_send_notif(struct nc_session* session, const nc_ntf* ntf)
 
 	if (ret == EXIT_SUCCESS) {
 		/* update stats */
-		session->stats->out_notifications++;
+		NC_STATS_INC(session->stats->out_notifications);
 		if (nc_info) {
-			pthread_rwlock_wrlock(&(nc_info->lock));
-			nc_info->stats.counters.out_notifications++;
-			pthread_rwlock_unlock(&(nc_info->lock));
+			NC_STATS_INC(nc_info->stats.counters.out_notifications);
 		}
 	}
 
@@ -2513,7 +3139,7 @@ API int nc_session_send_notif(struct nc_session* session, const nc_ntf* ntf)
 
 API NC_MSG_TYPE nc_session_recv_notif(struct nc_session* session, int timeout, nc_ntf** ntf)
 {
-	struct nc_msg *msg_aux, *msg=NULL;
+	struct nc_msg *msg=NULL;
 	NC_MSG_TYPE ret;
 
 	/* use local timeout to avoid continual long time blocking */
@@ -2543,16 +3169,14 @@ try_again:
 
 	switch (ret) {
 	case NC_MSG_REPLY: /* regular reply received */
+		DBG_UNLOCK("mut_equeue");
+		pthread_mutex_unlock(&(session->mut_equeue));
+
 		/* add reply into the session's list of reply messages */
-		msg_aux = session->queue_msg;
-		if (msg_aux == NULL) {
-			msg->next = session->queue_msg;
-			session->queue_msg = msg;
-		} else {
-			for (; msg_aux->next != NULL; msg_aux = msg_aux->next);
-			msg_aux->next = msg;
+		if (!nc_session_dispatch_reply(session, msg)) {
+			nc_session_store_reply(session, msg);
 		}
-		break;
+		return (ret);
 	case NC_MSG_NONE:
 		/* <rpc-reply> with error information was processed
 		 * automatically, but we are waiting for a notification
@@ -2658,11 +3282,9 @@ try_again:
 			}
 		}
 		/* update statistics */
-		session->stats->in_rpcs++;
+		NC_STATS_INC(session->stats->in_rpcs);
 		if (nc_info) {
-			pthread_rwlock_wrlock(&(nc_info->lock));
-			nc_info->stats.counters.in_rpcs++;
-			pthread_rwlock_unlock(&(nc_info->lock));
+			NC_STATS_INC(nc_info->stats.counters.in_rpcs);
 		}
 
 		/* NACM init */
@@ -2690,7 +3312,7 @@ try_again:
 				nc_err_set(e, NC_ERR_PARAM_TYPE, "protocol");
 				nc_err_set(e, NC_ERR_PARAM_INFO_BADELEM, "source");
 
-				session->stats->in_bad_rpcs++;
+				NC_STATS_INC(session->stats->in_bad_rpcs);
 				counter = &nc_info->stats.counters.in_bad_rpcs;
 				goto replyerror;
 			}
@@ -2703,7 +3325,7 @@ try_again:
 				nc_err_set(e, NC_ERR_PARAM_TYPE, "protocol");
 				nc_err_set(e, NC_ERR_PARAM_INFO_BADELEM, "target");
 
-				session->stats->in_bad_rpcs++;
+				NC_STATS_INC(session->stats->in_bad_rpcs);
 				counter = &nc_info->stats.counters.in_bad_rpcs;
 				goto replyerror;
 			}
@@ -2722,11 +3344,9 @@ try_again:
 		ret = NC_MSG_UNKNOWN;
 
 		/* update stats */
-		session->stats->in_bad_rpcs++;
+		NC_STATS_INC(session->stats->in_bad_rpcs);
 		if (nc_info) {
-			pthread_rwlock_wrlock(&(nc_info->lock));
-			nc_info->stats.counters.in_bad_rpcs++;
-			pthread_rwlock_unlock(&(nc_info->lock));
+			NC_STATS_INC(nc_info->stats.counters.in_bad_rpcs);
 		}
 
 		break;
@@ -2745,20 +3365,531 @@ replyerror:
 	nc_reply_free(reply);
 	/* update stats */
 	if (nc_info) {
-		pthread_rwlock_wrlock(&(nc_info->lock));
-		(*counter)++;
-		pthread_rwlock_unlock(&(nc_info->lock));
+		NC_STATS_INC(*counter);
 	}
 
 	return (NC_MSG_NONE); /* message processed internally */
 }
 
-API const nc_msgid nc_session_send_rpc(struct nc_session* session, nc_rpc *rpc)
+/* number of the epoll events processed in one step of the dispatcher */
+#define NC_DISPATCHER_EVENTS 64
+/* epoll data of the pipe interrupting the dispatcher */
+#define NC_DISPATCHER_WAKE UINT64_MAX
+
+#define NC_DISPATCHER_IDLE 0   /* waiting for the input in epoll */
+#define NC_DISPATCHER_QUEUED 1 /* waiting for a worker */
+#define NC_DISPATCHER_BUSY 2   /* processed by a worker */
+
+struct nc_dispatcher_item {
+	struct nc_session* session;     /* NULL for a free slot */
+	int fd;
+	uint32_t gen;                   /* generation of the slot to recognize stale epoll events */
+	int state;
+	int removed;                    /* removed while it was processed by a worker */
+	pthread_t worker;
+	int next;                       /* next slot in the queue or in the list of free slots */
+};
+
+struct nc_dispatcher {
+	int epoll_fd;
+	int wake[2];
+	pthread_t reactor;
+	pthread_t* workers;
+	unsigned int workers_count;
+	pthread_mutex_t lock;
+	pthread_cond_t queue_cond;      /* an item was queued or the dispatcher stops */
+	pthread_cond_t space_cond;      /* an item was taken from the queue */
+	pthread_cond_t done_cond;       /* a worker finished the processing of an item */
+	struct nc_dispatcher_item* items;
+	int items_size;
+	int free_slot;
+	int queue_head;
+	int queue_tail;
+	unsigned int queue_count;
+	unsigned int queue_limit;
+	int stop;
+	int running;                    /* the reactor thread was started */
+	void (*func)(struct nc_session* session, nc_rpc* rpc, void* data);
+	void* data;
+};
+
+/**
+ * @brief Check whether a complete message of the session was already read
+ * from the transport or the transport buffers some data, so they are not
+ * signalled by the file descriptor.
+ */
+static int nc_session_input_pending(struct nc_session* session)
+{
+	int ret;
+
+	DBG_LOCK("mut_channel");
+	pthread_mutex_lock(session->mut_channel);
+	ret = nc_session_msg_buffered(session);
+#ifdef ENABLE_TLS
+	if (!ret && session->tls != NULL) {
+		ret = (SSL_pending(session->tls) > 0);
+	}
+#endif
+#ifndef DISABLE_LIBSSH
+	if (!ret && session->ssh_chan != NULL) {
+		ret = (ssh_channel_poll(session->ssh_chan, 0) > 0);
+	}
+#endif
+	DBG_UNLOCK("mut_channel");
+	pthread_mutex_unlock(session->mut_channel);
+
+	return (ret);
+}
+
+/**
+ * @brief Read the data currently available on the session without waiting
+ * and check whether they complete a message, so the worker does not wait for
+ * the rest of the message sent by a stalled client.
+ *
+ * @return 1 if the message is complete or the reading failed (the failure is
+ * then detected by nc_session_recv_rpc()), 0 if more data are needed.
+ */
+static int nc_session_input_complete(struct nc_session* session)
+{
+	int ret;
+
+	DBG_LOCK("mut_channel");
+	pthread_mutex_lock(session->mut_channel);
+	if ((ret = nc_session_msg_buffered(session)) == 0) {
+		ret = (nc_session_fill_rbuf(session, NULL) != EXIT_SUCCESS || nc_session_msg_buffered(session));
+	}
+	DBG_UNLOCK("mut_channel");
+	pthread_mutex_unlock(session->mut_channel);
+
+	return (ret);
+}
+
+/* the caller is supposed to hold the dispatcher's lock */
+static void nc_dispatcher_enqueue(struct nc_dispatcher* dispatcher, int slot)
+{
+	dispatcher->items[slot].state = NC_DISPATCHER_QUEUED;
+	dispatcher->items[slot].next = -1;
+	if (dispatcher->queue_tail == -1) {
+		dispatcher->queue_head = slot;
+	} else {
+		dispatcher->items[dispatcher->queue_tail].next = slot;
+	}
+	dispatcher->queue_tail = slot;
+	dispatcher->queue_count++;
+	pthread_cond_signal(&dispatcher->queue_cond);
+}
+
+/* the caller is supposed to hold the dispatcher's lock */
+static void nc_dispatcher_release(struct nc_dispatcher* dispatcher, int slot)
+{
+	dispatcher->items[slot].session = NULL;
+	dispatcher->items[slot].gen++;
+	dispatcher->items[slot].next = dispatcher->free_slot;
+	dispatcher->free_slot = slot;
+}
+
+/* the caller is supposed to hold the dispatcher's lock */
+static void nc_dispatcher_arm(struct nc_dispatcher* dispatcher, int slot)
+{
+	struct epoll_event ev;
+
+	dispatcher->items[slot].state = NC_DISPATCHER_IDLE;
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.u64 = ((uint64_t) dispatcher->items[slot].gen << 32) | (uint32_t) slot;
+	if (epoll_ctl(dispatcher->epoll_fd, EPOLL_CTL_MOD, dispatcher->items[slot].fd, &ev) == -1) {
+		ERROR("%s: epoll_ctl failed (%s).", __func__, strerror(errno));
+	}
+}
+
+static void* nc_dispatcher_reactor(void* arg)
+{
+	struct nc_dispatcher* dispatcher = (struct nc_dispatcher*) arg;
+	struct epoll_event events[NC_DISPATCHER_EVENTS];
+	char buf[16];
+	uint32_t gen;
+	int i, n, slot, stop = 0;
+
+	while (!stop) {
+		n = epoll_wait(dispatcher->epoll_fd, events, NC_DISPATCHER_EVENTS, -1);
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ERROR("%s: epoll_wait failed (%s).", __func__, strerror(errno));
+			break;
+		}
+
+		DBG_LOCK("dispatcher lock");
+		pthread_mutex_lock(&dispatcher->lock);
+		for (i = 0; i < n && !dispatcher->stop; i++) {
+			if (events[i].data.u64 == NC_DISPATCHER_WAKE) {
+				while (read(dispatcher->wake[0], buf, sizeof(buf)) > 0);
+				continue;
+			}
+
+			/* wait for a free place in the queue of the workers */
+			while (!dispatcher->stop && dispatcher->queue_count >= dispatcher->queue_limit) {
+				pthread_cond_wait(&dispatcher->space_cond, &dispatcher->lock);
+			}
+
+			/* the session could have been removed in the meantime */
+			slot = (int) (events[i].data.u64 & 0xffffffff);
+			gen = (uint32_t) (events[i].data.u64 >> 32);
+			if (slot >= dispatcher->items_size || dispatcher->items[slot].session == NULL
+					|| dispatcher->items[slot].gen != gen || dispatcher->items[slot].state != NC_DISPATCHER_IDLE) {
+				continue;
+			}
+			nc_dispatcher_enqueue(dispatcher, slot);
+		}
+		stop = dispatcher->stop;
+		DBG_UNLOCK("dispatcher lock");
+		pthread_mutex_unlock(&dispatcher->lock);
+	}
+
+	return (NULL);
+}
+
+static void* nc_dispatcher_worker(void* arg)
+{
+	struct nc_dispatcher* dispatcher = (struct nc_dispatcher*) arg;
+	struct nc_session* session;
+	nc_rpc* rpc;
+	NC_MSG_TYPE ret;
+	int slot, pending;
+
+	DBG_LOCK("dispatcher lock");
+	pthread_mutex_lock(&dispatcher->lock);
+	while (1) {
+		while (!dispatcher->stop && dispatcher->queue_head == -1) {
+			pthread_cond_wait(&dispatcher->queue_cond, &dispatcher->lock);
+		}
+		if (dispatcher->stop) {
+			break;
+		}
+
+		/* take the first session from the queue */
+		slot = dispatcher->queue_head;
+		if ((dispatcher->queue_head = dispatcher->items[slot].next) == -1) {
+			dispatcher->queue_tail = -1;
+		}
+		dispatcher->queue_count--;
+		pthread_cond_signal(&dispatcher->space_cond);
+		dispatcher->items[slot].state = NC_DISPATCHER_BUSY;
+		dispatcher->items[slot].worker = pthread_self();
+		session = dispatcher->items[slot].session;
+		DBG_UNLOCK("dispatcher lock");
+		pthread_mutex_unlock(&dispatcher->lock);
+
+		rpc = NULL;
+		if (!nc_session_input_complete(session)) {
+			/* only a part of the message arrived, wait for the rest in epoll */
+			ret = NC_MSG_WOULDBLOCK;
+		} else {
+			/* process a single message, so the other sessions get their turn */
+			ret = nc_session_recv_rpc(session, 0, &rpc);
+		}
+		if (ret == NC_MSG_UNKNOWN && nc_session_get_status(session) != NC_SESSION_STATUS_WORKING) {
+			/* the session is over, remove it before passing it to the caller */
+			DBG_LOCK("dispatcher lock");
+			pthread_mutex_lock(&dispatcher->lock);
+			if (dispatcher->items[slot].removed) {
+				/* the caller already removed it and does not expect it anymore */
+				session = NULL;
+			} else {
+				epoll_ctl(dispatcher->epoll_fd, EPOLL_CTL_DEL, dispatcher->items[slot].fd, NULL);
+			}
+			nc_dispatcher_release(dispatcher, slot);
+			pthread_cond_broadcast(&dispatcher->done_cond);
+			DBG_UNLOCK("dispatcher lock");
+			pthread_mutex_unlock(&dispatcher->lock);
+
+			if (session != NULL) {
+				dispatcher->func(session, NULL, dispatcher->data);
+			}
+
+			DBG_LOCK("dispatcher lock");
+			pthread_mutex_lock(&dispatcher->lock);
+			continue;
+		} else if (ret == NC_MSG_RPC) {
+			dispatcher->func(session, rpc, dispatcher->data);
+		} else {
+			nc_rpc_free(rpc);
+		}
+
+		/*
+		 * check the buffered data without holding the dispatcher's lock, since
+		 * it locks the session's channel - the session is still valid unless
+		 * the callback removed it, other threads removing it wait for us
+		 */
+		DBG_LOCK("dispatcher lock");
+		pthread_mutex_lock(&dispatcher->lock);
+		pending = !dispatcher->items[slot].removed;
+		DBG_UNLOCK("dispatcher lock");
+		pthread_mutex_unlock(&dispatcher->lock);
+		if (pending) {
+			pending = nc_session_input_pending(session);
+		}
+
+		DBG_LOCK("dispatcher lock");
+		pthread_mutex_lock(&dispatcher->lock);
+		if (dispatcher->items[slot].removed) {
+			/* removed meanwhile, the session must not be touched anymore */
+			nc_dispatcher_release(dispatcher, slot);
+		} else if (pending) {
+			/* the next message is already buffered, epoll would not signal it */
+			nc_dispatcher_enqueue(dispatcher, slot);
+		} else {
+			nc_dispatcher_arm(dispatcher, slot);
+		}
+		pthread_cond_broadcast(&dispatcher->done_cond);
+	}
+	DBG_UNLOCK("dispatcher lock");
+	pthread_mutex_unlock(&dispatcher->lock);
+
+	return (NULL);
+}
+
+API struct nc_dispatcher* nc_dispatcher_new(unsigned int workers, unsigned int queue_limit,
+		void (*func)(struct nc_session* session, nc_rpc* rpc, void* data), void* data)
+{
+	struct nc_dispatcher* dispatcher;
+	struct epoll_event ev;
+	int r;
+
+	if (workers == 0 || func == NULL) {
+		ERROR("%s: invalid parameter.", __func__);
+		return (NULL);
+	}
+
+	if ((dispatcher = calloc(1, sizeof(struct nc_dispatcher))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	dispatcher->wake[0] = dispatcher->wake[1] = -1;
+	dispatcher->free_slot = dispatcher->queue_head = dispatcher->queue_tail = -1;
+	dispatcher->queue_limit = (queue_limit == 0) ? UINT_MAX : queue_limit;
+	dispatcher->func = func;
+	dispatcher->data = data;
+	pthread_mutex_init(&dispatcher->lock, NULL);
+	pthread_cond_init(&dispatcher->queue_cond, NULL);
+	pthread_cond_init(&dispatcher->space_cond, NULL);
+	pthread_cond_init(&dispatcher->done_cond, NULL);
+
+	if ((dispatcher->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1 || pipe(dispatcher->wake) == -1) {
+		ERROR("%s: creating the epoll instance failed (%s).", __func__, strerror(errno));
+		nc_dispatcher_free(dispatcher);
+		return (NULL);
+	}
+	fcntl(dispatcher->wake[0], F_SETFL, O_NONBLOCK);
+	ev.events = EPOLLIN;
+	ev.data.u64 = NC_DISPATCHER_WAKE;
+	if (epoll_ctl(dispatcher->epoll_fd, EPOLL_CTL_ADD, dispatcher->wake[0], &ev) == -1) {
+		ERROR("%s: epoll_ctl failed (%s).", __func__, strerror(errno));
+		nc_dispatcher_free(dispatcher);
+		return (NULL);
+	}
+
+	if ((dispatcher->workers = malloc(workers * sizeof(pthread_t))) == NULL) {
+		ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+		nc_dispatcher_free(dispatcher);
+		return (NULL);
+	}
+	for (dispatcher->workers_count = 0; dispatcher->workers_count < workers; dispatcher->workers_count++) {
+		if ((r = pthread_create(&dispatcher->workers[dispatcher->workers_count], NULL, nc_dispatcher_worker, dispatcher)) != 0) {
+			ERROR("%s: creating a thread failed (%s).", __func__, strerror(r));
+			nc_dispatcher_free(dispatcher);
+			return (NULL);
+		}
+	}
+	if ((r = pthread_create(&dispatcher->reactor, NULL, nc_dispatcher_reactor, dispatcher)) != 0) {
+		ERROR("%s: creating a thread failed (%s).", __func__, strerror(r));
+		nc_dispatcher_free(dispatcher);
+		return (NULL);
+	}
+	dispatcher->running = 1;
+
+	return (dispatcher);
+}
+
+API void nc_dispatcher_free(struct nc_dispatcher* dispatcher)
+{
+	unsigned int i;
+
+	if (dispatcher == NULL) {
+		return;
+	}
+
+	DBG_LOCK("dispatcher lock");
+	pthread_mutex_lock(&dispatcher->lock);
+	dispatcher->stop = 1;
+	pthread_cond_broadcast(&dispatcher->queue_cond);
+	pthread_cond_broadcast(&dispatcher->space_cond);
+	DBG_UNLOCK("dispatcher lock");
+	pthread_mutex_unlock(&dispatcher->lock);
+
+	if (dispatcher->running) {
+		/* interrupt epoll_wait() */
+		if (write(dispatcher->wake[1], "", 1) != 1) {
+			WARN("%s: waking up the dispatcher failed (%s).", __func__, strerror(errno));
+		}
+		pthread_join(dispatcher->reactor, NULL);
+	}
+	/* the workers finishing their sessions still re-arm them in epoll */
+	for (i = 0; i < dispatcher->workers_count; i++) {
+		pthread_join(dispatcher->workers[i], NULL);
+	}
+	if (dispatcher->epoll_fd != -1) {
+		close(dispatcher->epoll_fd);
+	}
+	if (dispatcher->wake[0] != -1) {
+		close(dispatcher->wake[0]);
+		close(dispatcher->wake[1]);
+	}
+
+	pthread_mutex_destroy(&dispatcher->lock);
+	pthread_cond_destroy(&dispatcher->queue_cond);
+	pthread_cond_destroy(&dispatcher->space_cond);
+	pthread_cond_destroy(&dispatcher->done_cond);
+	free(dispatcher->workers);
+	free(dispatcher->items);
+	free(dispatcher);
+}
+
+API int nc_dispatcher_add_session(struct nc_dispatcher* dispatcher, struct nc_session* session)
+{
+	struct nc_dispatcher_item* items;
+	struct epoll_event ev;
+	int slot, size, fd, pending;
+
+	if (dispatcher == NULL || session == NULL) {
+		ERROR("%s: invalid parameter.", __func__);
+		return (EXIT_FAILURE);
+	}
+	if (session->status != NC_SESSION_STATUS_WORKING || (fd = nc_session_get_eventfd(session)) == -1) {
+		ERROR("%s: the session %s cannot be dispatched.", __func__, session->session_id);
+		return (EXIT_FAILURE);
+	}
+	/* the session is not dispatched yet, so check it before locking the dispatcher */
+	pending = nc_session_input_pending(session);
+
+	DBG_LOCK("dispatcher lock");
+	pthread_mutex_lock(&dispatcher->lock);
+	if (dispatcher->free_slot == -1) {
+		/* get more slots */
+		size = (dispatcher->items_size == 0) ? 16 : 2 * dispatcher->items_size;
+		if ((items = realloc(dispatcher->items, size * sizeof(struct nc_dispatcher_item))) == NULL) {
+			ERROR("Memory reallocation failed (%s:%d).", __FILE__, __LINE__);
+			DBG_UNLOCK("dispatcher lock");
+			pthread_mutex_unlock(&dispatcher->lock);
+			return (EXIT_FAILURE);
+		}
+		memset(&items[dispatcher->items_size], 0, (size - dispatcher->items_size) * sizeof(struct nc_dispatcher_item));
+		dispatcher->items = items;
+		for (slot = size - 1; slot >= dispatcher->items_size; slot--) {
+			nc_dispatcher_release(dispatcher, slot);
+		}
+		dispatcher->items_size = size;
+	}
+	slot = dispatcher->free_slot;
+	dispatcher->free_slot = dispatcher->items[slot].next;
+	dispatcher->items[slot].session = session;
+	dispatcher->items[slot].fd = fd;
+	dispatcher->items[slot].removed = 0;
+	dispatcher->items[slot].state = NC_DISPATCHER_IDLE;
+
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.u64 = ((uint64_t) dispatcher->items[slot].gen << 32) | (uint32_t) slot;
+	if (epoll_ctl(dispatcher->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		/* e.g. SSH channels sharing the same transport */
+		ERROR("%s: adding the session %s into epoll failed (%s).", __func__, session->session_id, strerror(errno));
+		nc_dispatcher_release(dispatcher, slot);
+		DBG_UNLOCK("dispatcher lock");
+		pthread_mutex_unlock(&dispatcher->lock);
+		return (EXIT_FAILURE);
+	}
+	if (pending) {
+		nc_dispatcher_enqueue(dispatcher, slot);
+	}
+	DBG_UNLOCK("dispatcher lock");
+	pthread_mutex_unlock(&dispatcher->lock);
+
+	return (EXIT_SUCCESS);
+}
+
+API int nc_dispatcher_remove_session(struct nc_dispatcher* dispatcher, struct nc_session* session)
+{
+	int slot, prev;
+	uint32_t gen;
+
+	if (dispatcher == NULL || session == NULL) {
+		ERROR("%s: invalid parameter.", __func__);
+		return (EXIT_FAILURE);
+	}
+
+	DBG_LOCK("dispatcher lock");
+	pthread_mutex_lock(&dispatcher->lock);
+	for (slot = 0; slot < dispatcher->items_size; slot++) {
+		if (dispatcher->items[slot].session == session && !dispatcher->items[slot].removed) {
+			break;
+		}
+	}
+	if (slot == dispatcher->items_size) {
+		DBG_UNLOCK("dispatcher lock");
+		pthread_mutex_unlock(&dispatcher->lock);
+		return (EXIT_FAILURE);
+	}
+
+	epoll_ctl(dispatcher->epoll_fd, EPOLL_CTL_DEL, dispatcher->items[slot].fd, NULL);
+	switch (dispatcher->items[slot].state) {
+	case NC_DISPATCHER_QUEUED:
+		/* unlink it from the queue */
+		if (dispatcher->queue_head == slot) {
+			prev = -1;
+			dispatcher->queue_head = dispatcher->items[slot].next;
+		} else {
+			for (prev = dispatcher->queue_head; dispatcher->items[prev].next != slot; prev = dispatcher->items[prev].next);
+			dispatcher->items[prev].next = dispatcher->items[slot].next;
+		}
+		if (dispatcher->queue_tail == slot) {
+			dispatcher->queue_tail = prev;
+		}
+		dispatcher->queue_count--;
+		pthread_cond_signal(&dispatcher->space_cond);
+		nc_dispatcher_release(dispatcher, slot);
+		break;
+	case NC_DISPATCHER_BUSY:
+		dispatcher->items[slot].removed = 1;
+		if (pthread_equal(dispatcher->items[slot].worker, pthread_self())) {
+			/* called from the callback, the worker releases the slot */
+			break;
+		}
+		/* wait for the worker to finish the processing of the session */
+		gen = dispatcher->items[slot].gen;
+		while (dispatcher->items[slot].gen == gen) {
+			pthread_cond_wait(&dispatcher->done_cond, &dispatcher->lock);
+		}
+		break;
+	default:
+		nc_dispatcher_release(dispatcher, slot);
+		break;
+	}
+	DBG_UNLOCK("dispatcher lock");
+	pthread_mutex_unlock(&dispatcher->lock);
+
+	return (EXIT_SUCCESS);
+}
+
+/**
+ * @brief Send the \<rpc\>, if func is set, it gets the reply.
+ */
+static const nc_msgid nc_session_send_rpc_clb(struct nc_session* session, nc_rpc *rpc,
+		void (*func)(struct nc_session* session, const nc_msgid msgid, nc_reply* reply, void* data), void* data)
 {
 	int ret;
 	char msg_id_str[16];
 	const char* wd;
 	struct nc_msg *msg;
+	struct nc_reply_pending* pending = NULL;
 	NC_OP op;
 
 	if (session == NULL || (session->status != NC_SESSION_STATUS_WORKING && session->status != NC_SESSION_STATUS_CLOSING)) {
@@ -2855,19 +3986,57 @@ API const nc_msgid nc_session_send_rpc(struct nc_session* session, nc_rpc *rpc)
 		sprintf (msg_id_str, "hello");
 	}
 
+	if (func != NULL) {
+		/* register the callback before the reply can be received */
+		if ((pending = malloc(sizeof(struct nc_reply_pending))) == NULL) {
+			ERROR("Memory allocation failed (%s:%d).", __FILE__, __LINE__);
+			ret = EXIT_FAILURE;
+		} else {
+			pending->func = func;
+			pending->data = data;
+
+			DBG_LOCK("mut_mqueue");
+			pthread_mutex_lock(&(session->mut_mqueue));
+			if (session->pending == NULL) {
+				session->pending = xmlHashCreate(16);
+			}
+			if (session->pending == NULL || xmlHashAddEntry(session->pending, BAD_CAST msg_id_str, pending) != 0) {
+				ERROR("%s: registering the reply callback failed.", __func__);
+				free(pending);
+				pending = NULL;
+				ret = EXIT_FAILURE;
+			} else {
+				ret = EXIT_SUCCESS;
+			}
+			DBG_UNLOCK("mut_mqueue");
+			pthread_mutex_unlock(&(session->mut_mqueue));
+		}
+	} else {
+		ret = EXIT_SUCCESS;
+	}
+
 	/* send message */
-	ret = nc_session_send (session, msg);
+	if (ret == EXIT_SUCCESS) {
+		ret = nc_session_send (session, msg);
+	}
 
 	nc_msg_free (msg);
 
 	if (ret != EXIT_SUCCESS) {
-		if (rpc->type.rpc != NC_RPC_HELLO) {
-			DBG_LOCK("mut_session");
-			pthread_mutex_lock(&(session->mut_session));
-			session->msgid--;
-			DBG_UNLOCK("mut_session");
-			pthread_mutex_unlock(&(session->mut_session));
+		if (pending != NULL) {
+			/* if the failed sending closed the session, the callback was
+			 * already called and freed by nc_session_close() */
+			DBG_LOCK("mut_mqueue");
+			pthread_mutex_lock(&(session->mut_mqueue));
+			if (session->pending != NULL && xmlHashLookup(session->pending, BAD_CAST msg_id_str) == pending) {
+				xmlHashRemoveEntry(session->pending, BAD_CAST msg_id_str, NULL);
+				free(pending);
+			}
+			DBG_UNLOCK("mut_mqueue");
+			pthread_mutex_unlock(&(session->mut_mqueue));
 		}
+		/* the message-id is not reused, another thread could take the
+		 * following one meanwhile, the message-ids need not be contiguous */
 		return (NULL);
 	} else {
 		rpc->msgid = strdup(msg_id_str);
@@ -2875,6 +4044,22 @@ API const nc_msgid nc_session_send_rpc(struct nc_session* session, nc_rpc *rpc)
 	}
 }
 
+API const nc_msgid nc_session_send_rpc(struct nc_session* session, nc_rpc *rpc)
+{
+	return (nc_session_send_rpc_clb(session, rpc, NULL, NULL));
+}
+
+API const nc_msgid nc_session_send_rpc_async(struct nc_session* session, nc_rpc *rpc,
+		void (*func)(struct nc_session* session, const nc_msgid msgid, nc_reply* reply, void* data), void* data)
+{
+	if (rpc == NULL || rpc->type.rpc == NC_RPC_HELLO || func == NULL) {
+		ERROR("%s: invalid parameter.", __func__);
+		return (NULL);
+	}
+
+	return (nc_session_send_rpc_clb(session, rpc, func, data));
+}
+
 API const nc_msgid nc_session_send_reply(struct nc_session* session, const nc_rpc* rpc, const nc_reply *reply)
 {
 	int ret;
@@ -2958,11 +4143,9 @@ API const nc_msgid nc_session_send_reply(struct nc_session* session, const nc_rp
 	} else {
 		if (reply->type.reply == NC_REPLY_ERROR) {
 			/* update stats */
-			session->stats->out_rpc_errors++;
+			NC_STATS_INC(session->stats->out_rpc_errors);
 			if (nc_info) {
-				pthread_rwlock_wrlock(&(nc_info->lock));
-				nc_info->stats.counters.out_rpc_errors++;
-				pthread_rwlock_unlock(&(nc_info->lock));
+				NC_STATS_INC(nc_info->stats.counters.out_rpc_errors);
 			}
 		}
 		return (retval);
@@ -2981,100 +4164,13 @@ API int nc_msgid_compare(const nc_msgid id1, const nc_msgid id2)
 API NC_MSG_TYPE nc_session_send_recv(struct nc_session* session, nc_rpc *rpc, nc_reply** reply)
 {
 	const nc_msgid msgid;
-	NC_MSG_TYPE replytype;
-	struct nc_msg* queue = NULL, *msg, *p = NULL;
 
 	msgid = nc_session_send_rpc(session, rpc);
 	if (msgid == NULL) {
 		return (NC_MSG_UNKNOWN);
 	}
 
-	DBG_LOCK("mut_mqueue");
-	pthread_mutex_lock(&(session->mut_mqueue));
-
-	/* first, look into the session's list of previously received messages */
-	if ((queue = session->queue_msg) != NULL) {
-		/* search in the queue for the reply with required message ID */
-		for (msg = queue; msg != NULL; msg = msg->next) {
-			/* test message IDs */
-			if (nc_msgid_compare(msgid, nc_reply_get_msgid((nc_reply*) msg)) == 0) {
-				break;
-			}
-
-			/* store the predecessor */
-			p = msg;
-		}
-
-		if (msg != NULL) {
-			/* we have found the reply in the queue */
-			(*reply) = (nc_reply*) msg;
-
-			/* detach the reply from session's queue */
-			if (p == NULL) {
-				/* no predecessor - we detach the first item in the queue */
-				session->queue_msg = msg->next;
-			} else {
-				p->next = msg->next;
-			}
-			msg->next = NULL;
-			DBG_UNLOCK("mut_mqueue");
-			pthread_mutex_unlock(&(session->mut_mqueue));
-			return (NC_MSG_REPLY);
-		} else {
-			/*
-			 * the queue does not contain required reply, we have to
-			 * read it from the input, but first we have to hide
-			 * session's queue from nc_session_recv_reply()
-			 */
-			session->queue_msg = NULL;
-		}
-	}
-	DBG_UNLOCK("mut_mqueue");
-	pthread_mutex_unlock(&(session->mut_mqueue));
-
-	while (1) {
-		replytype = nc_session_recv_reply(session, -1, reply);
-		if (replytype == NC_MSG_REPLY) {
-			/* compare message ID */
-			if (nc_msgid_compare(msgid, nc_reply_get_msgid(*reply)) != 0) {
-				/* reply with different message ID is expected */
-				DBG_LOCK("mut_mqueue");
-				pthread_mutex_lock(&(session->mut_mqueue));
-				/* store this reply for the later use of someone else */
-				if (queue == NULL) {
-					queue = (struct nc_msg*) (*reply);
-				} else {
-					for (msg = queue; msg->next != NULL; msg = msg->next);
-					msg->next = (struct nc_msg*) (*reply);
-				}
-				/*The message is now owned by the queue, do not return it to the caller*/
-				*reply = NULL;
-				DBG_UNLOCK("mut_mqueue");
-				pthread_mutex_unlock(&(session->mut_mqueue));
-			} else {
-				/* we have it! */
-				break;
-			}
-		} else if (replytype == NC_MSG_UNKNOWN || replytype == NC_MSG_NONE) {
-			/* some error occured */
-			break;
-		}
-		/*
-		 * else (e.g. Notification or an unexpected reply was received)
-		 * read another message in the loop
-		 */
-	}
-
-	if (queue != NULL) {
-		DBG_LOCK("mut_mqueue");
-		pthread_mutex_lock(&(session->mut_mqueue));
-		/* reconnect hidden queue back to the session */
-		session->queue_msg = queue;
-		DBG_UNLOCK("mut_mqueue");
-		pthread_mutex_unlock(&(session->mut_mqueue));
-	}
-
-	return (replytype);
+	return (nc_session_recv_reply_msgid(session, msgid, -1, reply));
 }
 
 const char* nc_session_term_string(NC_SESSION_TERM_REASON reason)
@@ -114,6 +114,11 @@ int nc_session_get_version(const struct nc_session* session);
  * supposed to be used only by select, poll, epoll or an event library (e.g.
  * libevent).
  *
+ * libnetconf reads data from the communication channel in blocks, so more
+ * messages can be already read when the file descriptor is signalled. Therefore,
+ * the caller should call the receiving function with zero timeout until it
+ * returns #NC_MSG_WOULDBLOCK before the next polling.
+ *
  * @param[in] session NETCONF session structure
  * @return Input file descriptor of the communication channel.
  */
@@ -304,6 +309,49 @@ struct nc_cpblts *nc_session_get_cpblts_default(void);
  */
 const nc_msgid nc_session_send_rpc(struct nc_session* session, nc_rpc *rpc);
 
+/**
+ * @ingroup rpc
+ * @brief Send \<rpc\> request via specified NETCONF session without waiting
+ * for its reply. This function is supposed to be performed only by NETCONF
+ * clients.
+ *
+ * The \<rpc-reply\> is passed to the callback when it is received by any of
+ * the functions receiving replies on the session, e.g. nc_session_process_replies().
+ * The callback becomes the owner of the reply and it is supposed to free it by
+ * nc_reply_free(). If the session is closed before the reply is received, the
+ * callback is called with NULL reply. Replies to the rpcs sent this way are
+ * never returned by nc_session_recv_reply().
+ *
+ * This function IS thread safe.
+ *
+ * @param[in] session NETCONF session to use.
+ * @param[in] rpc \<rpc\> message to send.
+ * @param[in] func Callback function receiving the reply. Parameters are the
+ * session, message-id of the sent rpc (valid only until the reply is freed),
+ * the received reply and the data.
+ * @param[in] data Arbitrary user data passed to the callback.
+ * @return NULL on error,\n message-id of sent message on success.
+ */
+const nc_msgid nc_session_send_rpc_async(struct nc_session* session, nc_rpc *rpc,
+		void (*func)(struct nc_session* session, const nc_msgid msgid, nc_reply* reply, void* data), void* data);
+
+/**
+ * @ingroup reply
+ * @brief Receive messages from the specified NETCONF session and pass the
+ * \<rpc-reply\> messages to the callbacks of the rpcs sent by
+ * nc_session_send_rpc_async(). Other replies and notifications are enqueued
+ * for nc_session_recv_reply() and nc_session_recv_notif().
+ *
+ * The function waits for the first message up to the timeout and then
+ * processes all the messages already received without further waiting.
+ *
+ * @param[in] session NETCONF session to use.
+ * @param[in] timeout Timeout in microseconds, -1 for infinite timeout, 0 for
+ * non-blocking
+ * @return Number of replies passed to the callbacks, -1 on error.
+ */
+int nc_session_process_replies(struct nc_session* session, int timeout);
+
 /**
  * @ingroup reply
  * @brief Send \<rpc-reply\> response via specified NETCONF session.
@@ -345,6 +393,79 @@ int nc_session_send_notif(struct nc_session* session, const nc_ntf* ntf);
  */
 NC_MSG_TYPE nc_session_recv_rpc(struct nc_session* session, int timeout, nc_rpc** rpc);
 
+/**
+ * @ingroup session
+ * @brief Dispatcher of the \<rpc\> requests received on many NETCONF sessions.
+ */
+struct nc_dispatcher;
+
+/**
+ * @ingroup rpc
+ * @brief Create a dispatcher receiving the \<rpc\> requests on the NETCONF
+ * sessions added by nc_dispatcher_add_session(). This function is supposed to
+ * be performed only by NETCONF servers.
+ *
+ * A single thread waits (using epoll) for the input on all the sessions, so the
+ * idle sessions do not occupy any thread. The sessions with some input are
+ * queued for the worker threads. A worker receives a single message from the
+ * session (as nc_session_recv_rpc() does) and passes the received \<rpc\> to
+ * the callback, then the session waits for its next input again, so the busy
+ * sessions cannot starve the others.
+ *
+ * The callback is called from the worker threads, so it can be called for
+ * several sessions concurrently, but never concurrently for the same session.
+ * The callback becomes the owner of the rpc and it is supposed to free it by
+ * nc_rpc_free(). When the session is closed, it is removed from the dispatcher
+ * and the callback is called with NULL rpc, so it can free the session.
+ *
+ * @param[in] workers Number of the worker threads.
+ * @param[in] queue_limit Maximal number of the sessions waiting for a worker,
+ * the dispatcher stops accepting the input when the limit is reached. 0 for no
+ * limit.
+ * @param[in] func Callback function processing the received \<rpc\>.
+ * Parameters are the session, the received rpc and the data.
+ * @param[in] data Arbitrary user data passed to the callback.
+ * @return Created dispatcher, NULL on error.
+ */
+struct nc_dispatcher* nc_dispatcher_new(unsigned int workers, unsigned int queue_limit,
+		void (*func)(struct nc_session* session, nc_rpc* rpc, void* data), void* data);
+
+/**
+ * @ingroup rpc
+ * @brief Stop the dispatcher and free it. The sessions still added in the
+ * dispatcher are not freed.
+ *
+ * @param[in] dispatcher Dispatcher to free.
+ */
+void nc_dispatcher_free(struct nc_dispatcher* dispatcher);
+
+/**
+ * @ingroup rpc
+ * @brief Add the NETCONF session into the dispatcher. Since then, the caller
+ * must not receive messages on the session by itself.
+ *
+ * The SSH channels sharing the same SSH transport cannot be added into the
+ * same dispatcher.
+ *
+ * @param[in] dispatcher Dispatcher to use.
+ * @param[in] session NETCONF session to add.
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int nc_dispatcher_add_session(struct nc_dispatcher* dispatcher, struct nc_session* session);
+
+/**
+ * @ingroup rpc
+ * @brief Remove the NETCONF session from the dispatcher. If the session is
+ * just being processed, the function waits for the callback to finish, unless
+ * it is called from the callback itself. The session must be removed before
+ * it is freed.
+ *
+ * @param[in] dispatcher Dispatcher to use.
+ * @param[in] session NETCONF session to remove.
+ * @return EXIT_SUCCESS or EXIT_FAILURE if the session is not in the dispatcher.
+ */
+int nc_dispatcher_remove_session(struct nc_dispatcher* dispatcher, struct nc_session* session);
+
 /**
  * @ingroup reply
  * @brief Receive \<rpc-reply\> response from the specified NETCONF session.
@@ -359,7 +480,8 @@ NC_MSG_TYPE nc_session_recv_rpc(struct nc_session* session, int timeout, nc_rpc*
  * - #NC_MSG_HELLO - success, *reply points to the received \<hello\> message.
  * - #NC_MSG_NONE - success, but \<rpc-reply\> with error information was
  *   processed automatically using callback specified with nc_callback_error_reply()
- *   function. *reply was not changed.
+ *   function or the \<rpc-reply\> was passed to the callback specified with
+ *   nc_session_send_rpc_async(). *reply was not changed.
  * - #NC_MSG_UNKNOWN - error occurred
  * - #NC_MSG_NOTIFICATION - \<notification\> message was received and enqueued
  *   to the internal queue until the nc_session_recv_notif() function is called.
@@ -369,6 +491,30 @@ NC_MSG_TYPE nc_session_recv_rpc(struct nc_session* session, int timeout, nc_rpc*
  */
 NC_MSG_TYPE nc_session_recv_reply(struct nc_session* session, int timeout, nc_reply** reply);
 
+/**
+ * @ingroup reply
+ * @brief Receive \<rpc-reply\> to the \<rpc\> with the specified message-id.
+ * This function is supposed to be performed only by NETCONF clients.
+ *
+ * Other received replies are enqueued for nc_session_recv_reply() (or passed to
+ * the callbacks set by nc_session_send_rpc_async()) and notifications are
+ * enqueued for nc_session_recv_notif().
+ *
+ * @param[in] session NETCONF session to use.
+ * @param[in] msgid Message-id of the \<rpc\> returned by nc_session_send_rpc().
+ * @param[in] timeout Timeout in microseconds, -1 for infinite timeout, 0 for
+ * non-blocking
+ * @param[out] reply Received \<rpc-reply\>
+ * @return
+ * - #NC_MSG_REPLY - success, *reply points to the received \<rpc-reply\> message.
+ * - #NC_MSG_NONE - success, but \<rpc-reply\> with error information was
+ *   processed automatically using callback specified with nc_callback_error_reply()
+ *   function. *reply was not changed.
+ * - #NC_MSG_UNKNOWN - error occurred
+ * - #NC_MSG_WOULDBLOCK - receiving timeouted without the required \<rpc-reply\>.
+ */
+NC_MSG_TYPE nc_session_recv_reply_msgid(struct nc_session* session, const nc_msgid msgid, int timeout, nc_reply** reply);
+
 /**
  * @ingroup notifications
  * @brief Receive a \<notification\> message from the specified NETCONF session.
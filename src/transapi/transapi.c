@@ -374,13 +374,13 @@ static int transapi_apply_callbacks_recursive(const struct transapi_callbacks_in
 }
 
 /* will be called by library after change in running datastore */
-int transapi_running_changed(struct ncds_ds* ds, xmlDocPtr old_doc, xmlDocPtr new_doc, NC_EDIT_ERROPT_TYPE erropt, struct nc_err **error)
+int transapi_running_changed(struct ncds_ds* ds, xmlDocPtr old_doc, xmlDocPtr new_doc, xmlDocPtr edit_doc, NC_EDIT_ERROPT_TYPE erropt, struct nc_err **error)
 {
 	struct xmldiff_tree* diff = NULL, *iter;
 	struct transapi_callbacks_info info;
 	int ret = 0;
 
-	if (xmldiff_diff(&diff, old_doc, new_doc, ds->ext_model_tree) == XMLDIFF_ERR) { /* failed to create diff list */
+	if (xmldiff_diff(&diff, old_doc, new_doc, ds->ext_model_tree, edit_doc) == XMLDIFF_ERR) { /* failed to create diff list */
 		ERROR("Model \"%s\" transAPI: failed to create the tree of differences.", ds->data_model->name);
 		xmldiff_free(diff);
 		return EXIT_FAILURE;
@@ -399,14 +399,12 @@ int transapi_running_changed(struct ncds_ds* ds, xmlDocPtr old_doc, xmlDocPtr ne
 				ret += transapi_apply_callbacks_recursive(&info, iter, erropt, error);
 				/* callbacks actually can also change datastore's data model by adding augment */
 				if (info.model != ds->ext_model) {
-					/* the model is changed, we are not going to use it anymore, but
-					 * keys created from the released model are invalid and freeing
-					 * it can cause segmentation fault, so fix it
+					/* the model is changed, we are not going to use it anymore,
+					 * so get the index of the new model
 					 */
-					if (info.keys || info.keys->nodesetval) {
-						info.keys->nodesetval->nodeNr = 0;
-					}
+					keyListFree(info.keys);
 					info.model = ds->ext_model;
+					info.keys = get_keynode_list(info.model);
 				}
 			}
 
@@ -66,10 +66,12 @@ typedef enum
  * @param[in] ds NETCONF datastore structure for access transAPI connected with this datastore
  * @param[in] old_doc Content of configuration datastore before change.
  * @param[in] new_doc Content of configuration datastore after change.
+ * @param[in] edit_doc Content of the edit-config which made the change, only
+ * the nodes it mentions are compared. NULL to compare the whole documents.
  * @param[in] libxml2 Specify if the module uses libxml2 API
  *
  * @return EXIT_SUCESS or EXIT_FAILURE
  */
-int transapi_running_changed(struct ncds_ds* ds, xmlDocPtr old_doc, xmlDocPtr new_doc, NC_EDIT_ERROPT_TYPE erropt, struct nc_err **error);
+int transapi_running_changed(struct ncds_ds* ds, xmlDocPtr old_doc, xmlDocPtr new_doc, xmlDocPtr edit_doc, NC_EDIT_ERROPT_TYPE erropt, struct nc_err **error);
 
 #endif /* NC_TRANSAPI_INTERNAL_H_ */
@@ -6,6 +6,7 @@
 
 #include <libxml/tree.h>
 #include <libxml/parser.h>
+#include <libxml/hash.h>
 
 #include "netconf_internal.h"
 #include "xmldiff.h"
@@ -270,6 +271,25 @@ static void xmldiff_addsibling_diff(struct xmldiff_tree** siblings, struct xmldi
 	(*new_sibling)->parent = last_sibling->parent;
 }
 
+/**
+ * @brief Get the place where to append a new sibling diff into the list of
+ * diffs starting at head. The last diff is remembered in last, so appending
+ * many diffs does not go through the whole list again and again.
+ */
+static struct xmldiff_tree** xmldiff_tail(struct xmldiff_tree** head, struct xmldiff_tree** last)
+{
+	if (*head == NULL) {
+		return (head);
+	}
+	if (*last == NULL) {
+		*last = *head;
+	}
+	while ((*last)->next != NULL) {
+		*last = (*last)->next;
+	}
+	return (last);
+}
+
 /**
  * @brief Add diff for all descendants of the node
  */
@@ -393,73 +413,352 @@ static int node_cmp(xmlNodePtr node1, xmlNodePtr node2)
 }
 
 /*
- * @brief Return EXIT_SUCCESS if node1 and node2 have same name, are in the same namespace and
- * have the same key values.
+ * @brief Return EXIT_SUCCESS if the anyxml node1 and node2 have the same content,
+ * i.e. the same names, namespaces, attributes and text in the whole subtree.
  *
  * @param node1	One node to compare.
  * @param node2	Other node to compare.
  *
  * @return EXIT_SUCCESS when equivalent EXIT_FAILURE otherwise
  */
-static int list_node_cmp(xmlNodePtr node1, xmlNodePtr node2, struct model_tree * model)
+static int anyxml_cmp(xmlNodePtr node1, xmlNodePtr node2)
 {
-	int i, ret = EXIT_FAILURE;
-	xmlNodePtr node_tmp;
-	xmlChar * tmp_str, *node1_keys, *node2_keys, *new_keys;
-
-	if (node_cmp(node1, node2) == EXIT_SUCCESS) {
-		/* For every old node create string holding the concatenated key values */
-		node1_keys = BAD_CAST strdup ("");
-		node2_keys = BAD_CAST strdup ("");
-		for (i=0; i<model->keys_count; i++) { /* For every specified key */
-			node_tmp = node1->children;
-			while (node_tmp) {
-				if (xmlStrEqual(node_tmp->name, BAD_CAST model->keys[i])) { /* Find matching leaf in old document */
-					tmp_str = xmlNodeGetContent (node_tmp);
-					new_keys  = realloc (node1_keys, sizeof(char) * (strlen((const char*)node1_keys)+strlen((const char*)tmp_str)+1));
-					if (new_keys == NULL) {
-						ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-						ret = EXIT_FAILURE;
-						goto cleanup;
-					}
-					node1_keys = new_keys;
-					strcat((char*)node1_keys, (char*)tmp_str); /* Concatenate key value */
-					xmlFree(tmp_str);
-					break;
-				}
-				node_tmp = node_tmp->next;
+	xmlAttrPtr attr1, attr2;
+	xmlChar *value1, *value2;
+	int ret;
+
+	for (; node1 != NULL && node2 != NULL; node1 = node1->next, node2 = node2->next) {
+		if (node1->type != node2->type) {
+			return (EXIT_FAILURE);
+		}
+		switch (node1->type) {
+		case XML_ELEMENT_NODE:
+			if (node_cmp(node1, node2) != EXIT_SUCCESS && !(node1->ns == NULL && node2->ns == NULL && xmlStrEqual(node1->name, node2->name))) {
+				return (EXIT_FAILURE);
 			}
-			node_tmp = node2->children;
-			while (node_tmp) {
-				if (xmlStrEqual(node_tmp->name, BAD_CAST model->keys[i])) { /* Find matching leaf in old document */
-					tmp_str = xmlNodeGetContent (node_tmp);
-					new_keys = realloc (node2_keys, sizeof(char) * (strlen((const char*)node2_keys)+strlen((const char*)tmp_str)+1));
-					if (new_keys == NULL) {
-						ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-						ret = EXIT_FAILURE;
-						goto cleanup;
-					}
-					node2_keys = new_keys;
-					strcat ((char*)node2_keys, (char*)tmp_str); /* Concatenate key value */
-					xmlFree (tmp_str);
-					break;
+			for (attr1 = node1->properties, attr2 = node2->properties; attr1 != NULL && attr2 != NULL; attr1 = attr1->next, attr2 = attr2->next) {
+				if (!xmlStrEqual(attr1->name, attr2->name) ||
+						(attr1->ns == NULL) != (attr2->ns == NULL) ||
+						(attr1->ns != NULL && !xmlStrEqual(attr1->ns->href, attr2->ns->href))) {
+					return (EXIT_FAILURE);
+				}
+				value1 = xmlNodeGetContent((xmlNodePtr) attr1);
+				value2 = xmlNodeGetContent((xmlNodePtr) attr2);
+				ret = xmlStrEqual(value1, value2);
+				xmlFree(value1);
+				xmlFree(value2);
+				if (!ret) {
+					return (EXIT_FAILURE);
 				}
-				node_tmp = node_tmp->next;
 			}
+			if (attr1 != NULL || attr2 != NULL || anyxml_cmp(node1->children, node2->children) != EXIT_SUCCESS) {
+				return (EXIT_FAILURE);
+			}
+			break;
+		case XML_PI_NODE:
+			if (!xmlStrEqual(node1->name, node2->name)) {
+				return (EXIT_FAILURE);
+			}
+			/* fall through */
+		default:
+			/* text, CDATA, comments */
+			if (!xmlStrEqual(node1->content, node2->content)) {
+				return (EXIT_FAILURE);
+			}
+			break;
 		}
-		if (xmlStrEqual(node1_keys, node2_keys)) {
-			ret = EXIT_SUCCESS;
+	}
+
+	return ((node1 == NULL && node2 == NULL) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/*
+ * @brief Entry of a list or a leaf-list found in one of the compared documents.
+ */
+struct xmldiff_entry {
+	xmlNodePtr node;
+	/* values identifying the entry among its siblings */
+	xmlChar* keys;
+	/* equivalent entry in the other document, NULL if the entry was added or removed */
+	struct xmldiff_entry* match;
+};
+
+/*
+ * @brief Get the key values of the list entry as a single string. Each value
+ * is prefixed by its length, so different tuples of values always give
+ * different strings.
+ *
+ * @param node	List entry.
+ * @param model	Model of the list.
+ * @param trim	Flag to remove the leading and trailing whitespaces of the
+ * values, as edit-config does when it searches for the edited entries.
+ *
+ * @return String with the key values, NULL on error.
+ */
+static xmlChar* list_node_keys(xmlNodePtr node, struct model_tree * model, int trim)
+{
+	xmlBufferPtr buf;
+	xmlNodePtr child;
+	xmlChar *value, *aux, *ret;
+	char len[16];
+	int i;
+
+	if ((buf = xmlBufferCreate()) == NULL) {
+		ERROR("xmlBufferCreate failed (%s:%d).", __FILE__, __LINE__);
+		return (NULL);
+	}
+	for (i = 0; i < model->keys_count; i++) { /* For every specified key */
+		for (child = node->children; child != NULL; child = child->next) {
+			if (xmlStrEqual(child->name, BAD_CAST model->keys[i])) {
+				break;
+			}
 		}
+		if (child == NULL) {
+			/* missing key leaf */
+			xmlBufferCCat(buf, "-:");
+			continue;
+		}
+		value = xmlNodeGetContent(child);
+		if (trim && value != NULL) {
+			aux = BAD_CAST nc_clrwspace((char*)value);
+			xmlFree(value);
+			value = aux;
+		}
+		snprintf(len, sizeof(len), "%d:", xmlStrlen(value));
+		xmlBufferCCat(buf, len);
+		xmlBufferCat(buf, value);
+		xmlFree(value);
+	}
+	ret = xmlStrdup(xmlBufferContent(buf));
+	xmlBufferFree(buf);
 
-cleanup:
-		xmlFree(node1_keys);
-		xmlFree(node2_keys);
+	return (ret);
+}
+
+/*
+ * @brief Collect the entries of a list (model is set) or of a leaf-list
+ * (model is NULL) from the siblings and index them by their keys (values of
+ * the leaf-list). Only the first of the entries with the same keys is indexed.
+ *
+ * @param first	First node of the entries.
+ * @param name	Name of the leaf-list, valid only if the model is NULL.
+ * @param model	Model of the list.
+ * @param entries	Found entries.
+ * @param count	Number of the found entries.
+ * @param index	Hash table of the found entries.
+ *
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int xmldiff_list_entries(xmlNodePtr first, const char* name, struct model_tree * model, struct xmldiff_entry** entries, int* count, xmlHashTablePtr* index)
+{
+	xmlNodePtr node;
+	struct xmldiff_entry* aux;
+	int size = 0;
+
+	*entries = NULL;
+	*count = 0;
+	if ((*index = xmlHashCreate(16)) == NULL) {
+		ERROR("xmlHashCreate failed (%s:%d).", __FILE__, __LINE__);
+		return (EXIT_FAILURE);
 	}
 
-	return(ret);
+	for (node = first; node != NULL; node = node->next) {
+		/* We have to make sure that this really is a list node we are checking now */
+		if ((model != NULL && node_cmp(first, node) != EXIT_SUCCESS) ||
+				(model == NULL && !xmlStrEqual(BAD_CAST name, node->name))) {
+			continue;
+		}
+		if (*count == size) {
+			size = size ? size * 2 : 16;
+			if ((aux = realloc(*entries, size * sizeof(struct xmldiff_entry))) == NULL) {
+				ERROR("Memory reallocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
+				return (EXIT_FAILURE);
+			}
+			*entries = aux;
+		}
+		(*entries)[*count].node = node;
+		(*entries)[*count].match = NULL;
+		(*entries)[*count].keys = (model != NULL) ? list_node_keys(node, model, 0) : xmlNodeGetContent(node);
+		if ((*entries)[*count].keys == NULL) {
+			/* leaf-list entry without a value */
+			(*entries)[*count].keys = xmlStrdup(BAD_CAST "");
+		}
+		(*count)++;
+	}
+
+	/* the entries array is complete, its items can be referenced now */
+	for (size = 0; size < *count; size++) {
+		/* the first of the entries with the same keys is used */
+		xmlHashAddEntry(*index, (*entries)[size].keys, &(*entries)[size]);
+	}
+
+	return (EXIT_SUCCESS);
+}
+
+static void xmldiff_list_entries_free(struct xmldiff_entry* entries, int count, xmlHashTablePtr index)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		xmlFree(entries[i].keys);
+	}
+	free(entries);
+	xmlHashFree(index, NULL);
 }
 
-static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodePtr old_tmp, xmlNodePtr new_tmp, struct model_tree * model);
+/*
+ * @brief Check if the edit-config's node changes its whole subtree, i.e. if it
+ * has any other operation than merge.
+ *
+ * @param edit	Node of the edit-config's content.
+ *
+ * @return 1 if the whole subtree must be compared, 0 otherwise.
+ */
+static int xmldiff_scope_full(xmlNodePtr edit)
+{
+	xmlChar* op;
+	int ret;
+
+	if ((op = xmlGetNsProp(edit, BAD_CAST "operation", BAD_CAST NC_NS_BASE10)) == NULL) {
+		return (0);
+	}
+	ret = !xmlStrEqual(op, BAD_CAST "merge");
+	xmlFree(op);
+
+	return (ret);
+}
+
+/*
+ * @brief Find the edit-config's node corresponding to the instances of the
+ * model node. Edit-config changes only the nodes mentioned in its content, so
+ * the model nodes not present in the edit cannot differ.
+ *
+ * @param scope	Edit-config's node corresponding to the parent of the model
+ * node, NULL if the differences are not limited by any edit.
+ * @param model	Model node.
+ * @param edit	Edit-config's node limiting the comparison of the model node
+ * children (the first entry in case of list), NULL if the whole subtree must
+ * be compared.
+ *
+ * @return 1 if the instances of the model node may differ, 0 otherwise.
+ */
+static int xmldiff_scope_child(xmlNodePtr scope, struct model_tree * model, xmlNodePtr* edit)
+{
+	xmlNodePtr iter;
+
+	*edit = NULL;
+	if (scope == NULL) {
+		return (1);
+	}
+
+	switch (model->type) {
+	case YIN_TYPE_AUGMENT:
+		/* augment's children are placed among the parent's children */
+		*edit = scope;
+		return (1);
+	case YIN_TYPE_CHOICE:
+		/* creating a node in one case removes the nodes of the other cases */
+		return (1);
+	default:
+		break;
+	}
+
+	for (iter = scope->children; iter != NULL; iter = iter->next) {
+		if (iter->type != XML_ELEMENT_NODE || !xmlStrEqual(iter->name, BAD_CAST model->name) ||
+				(iter->ns != NULL && !xmlStrEqual(iter->ns->href, BAD_CAST model->ns_uri))) {
+			continue;
+		}
+		if (*edit == NULL) {
+			*edit = iter;
+			if (model->type == YIN_TYPE_LIST) {
+				/* the entries are limited separately */
+				return (1);
+			}
+		} else {
+			/* the node is edited repeatedly */
+			*edit = NULL;
+			return (1);
+		}
+	}
+
+	if (*edit == NULL) {
+		return (0);
+	}
+	if (model->type == YIN_TYPE_LEAFLIST || xmldiff_scope_full(*edit)) {
+		*edit = NULL;
+	}
+
+	return (1);
+}
+
+/*
+ * @brief Index the list entries mentioned in the edit-config by their keys.
+ *
+ * @param edit	First edit-config's entry of the list.
+ * @param model	Model of the list.
+ *
+ * @return Hash table of the edit-config's entries, NULL if the list entries
+ * are not limited by the edit.
+ */
+static xmlHashTablePtr xmldiff_scope_entries(xmlNodePtr edit, struct model_tree * model)
+{
+	xmlHashTablePtr index;
+	xmlNodePtr iter;
+	xmlChar* keys;
+	int ret;
+
+	if (edit == NULL || model->ordering == YIN_ORDER_USER) {
+		/* the edit can move also the entries it does not mention */
+		return (NULL);
+	}
+	if ((index = xmlHashCreate(16)) == NULL) {
+		return (NULL);
+	}
+
+	for (iter = edit; iter != NULL; iter = iter->next) {
+		if (node_cmp(edit, iter) != EXIT_SUCCESS) {
+			continue;
+		}
+		if ((keys = list_node_keys(iter, model, 1)) == NULL) {
+			xmlHashFree(index, NULL);
+			return (NULL);
+		}
+		ret = xmlHashAddEntry(index, keys, iter);
+		xmlFree(keys);
+		if (ret != 0) {
+			/* the entry is edited repeatedly, compare the whole list */
+			xmlHashFree(index, NULL);
+			return (NULL);
+		}
+	}
+
+	return (index);
+}
+
+/*
+ * @brief Find the edit-config's entry of the list entry.
+ *
+ * @param index	Edit-config's entries as returned by xmldiff_scope_entries().
+ * @param node	List entry.
+ * @param model	Model of the list.
+ *
+ * @return Edit-config's entry, NULL if the list entry is not edited.
+ */
+static xmlNodePtr xmldiff_scope_lookup(xmlHashTablePtr index, xmlNodePtr node, struct model_tree * model)
+{
+	xmlNodePtr ret;
+	xmlChar* keys;
+
+	if ((keys = list_node_keys(node, model, 1)) == NULL) {
+		return (NULL);
+	}
+	ret = xmlHashLookup(index, keys);
+	xmlFree(keys);
+
+	return (ret);
+}
+
+static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodePtr old_tmp, xmlNodePtr new_tmp, struct model_tree * model, xmlNodePtr edit);
 static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlNodePtr old_tmp, xmlNodePtr new_tmp, struct model_tree * model);
 
 /**
@@ -471,15 +770,15 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
  * @param old_node	current node (or sibling) in the old configuration
  * @param new_node	current node (or sibling) in the new configuration
  * @param model	current node in the model
+ * @param scope	edit-config's node corresponding to the parent of the current
+ * nodes, NULL to compare the whole subtree
  */
-static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xmlNodePtr old_node, xmlNodePtr new_node, struct model_tree * model)
+static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xmlNodePtr old_node, xmlNodePtr new_node, struct model_tree * model, xmlNodePtr scope)
 {
 	char * next_path;
 	xmlNodePtr old_tmp, new_tmp;
 	XMLDIFF_OP tmp_op, ret_op = XMLDIFF_NONE;
 	xmlChar * old_content, * new_content;
-	xmlChar * old_str, *new_str;
-	xmlBufferPtr buf;
 	struct xmldiff_tree** tmp_diff;
 	int i;
 
@@ -489,6 +788,11 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 		return XMLDIFF_ERR;
 	}
 
+	/* Skip the nodes untouched by the edit */
+	if (!xmldiff_scope_child(scope, model, &scope)) {
+		return XMLDIFF_NONE;
+	}
+
 	/* Find the node from the model in the old configuration */
 	for (old_tmp = old_node; old_tmp != NULL; old_tmp = old_tmp->next) {
 		if (xmlStrEqual(old_tmp->name, BAD_CAST model->name)) {
@@ -532,6 +836,10 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 		} else {
 			ret_op = XMLDIFF_NONE;
 		}
+		if (ret_op != XMLDIFF_NONE) {
+			/* created or removed container is compared completely, including the default values */
+			scope = NULL;
+		}
 		tmp_diff = malloc(sizeof(struct xmldiff_tree*));
 		*tmp_diff = NULL;
 		tmp_op = XMLDIFF_NONE;
@@ -541,7 +849,7 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 				free(tmp_diff);
 				return (XMLDIFF_ERR);
 			}
-			tmp_op = xmldiff_recursive(tmp_diff, next_path, (old_tmp ? old_tmp->children : NULL), (new_tmp ? new_tmp->children : NULL), &model->children[i]);
+			tmp_op = xmldiff_recursive(tmp_diff, next_path, (old_tmp ? old_tmp->children : NULL), (new_tmp ? new_tmp->children : NULL), &model->children[i], scope);
 			free(next_path);
 
 			if (tmp_op == XMLDIFF_ERR) {
@@ -582,7 +890,7 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 				return (XMLDIFF_ERR);
 			}
 			/* We are moving down the model only (not in the configuration) */
-			tmp_op = xmldiff_recursive(diff, next_path, old_node, new_node, &model->children[i]);
+			tmp_op = xmldiff_recursive(diff, next_path, old_node, new_node, &model->children[i], scope);
 			free(next_path);
 
 			if (tmp_op == XMLDIFF_ERR) {
@@ -619,7 +927,7 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 
 	/* -- LIST -- */
 	case YIN_TYPE_LIST:
-		ret_op = xmldiff_list(diff, path, old_tmp, new_tmp, model);
+		ret_op = xmldiff_list(diff, path, old_tmp, new_tmp, model, scope);
 		break;
 
 	/* -- LEAFLIST -- */
@@ -629,32 +937,18 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 
 	/* -- ANYXML -- */
 	case YIN_TYPE_ANYXML:
-		/* Serialize and compare strings */
-		/* TODO: find better solution in future */
 		if (old_tmp == NULL) {
 			ret_op = XMLDIFF_ADD;
 			xmldiff_add_diff(diff, path, old_tmp, new_tmp, XMLDIFF_ADD, XML_SIBLING);
 		} else if (new_tmp == NULL) {
 			ret_op = XMLDIFF_REM;
 			xmldiff_add_diff(diff, path, old_tmp, new_tmp, XMLDIFF_REM, XML_SIBLING);
-		}
-
-		buf = xmlBufferCreate();
-		xmlNodeDump(buf, old_tmp->doc, old_tmp, 0, 0);
-		old_str = xmlStrdup(xmlBufferContent(buf));
-		xmlBufferEmpty(buf);
-		xmlNodeDump(buf, new_tmp->doc, new_tmp, 0, 0);
-		new_str = xmlStrdup(xmlBufferContent(buf));
-		xmlBufferFree(buf);
-
-		if (xmlStrEqual(old_str, new_str)) {
+		} else if (anyxml_cmp(old_tmp->children, new_tmp->children) == EXIT_SUCCESS) {
 			ret_op = XMLDIFF_NONE;
 		} else {
 			xmldiff_add_diff(diff, path, old_tmp, new_tmp, XMLDIFF_MOD, XML_SIBLING);
 			ret_op = XMLDIFF_CHAIN;
 		}
-		xmlFree(old_str);
-		xmlFree(new_str);
 		break;
 
 	default:
@@ -665,284 +959,126 @@ static XMLDIFF_OP xmldiff_recursive(struct xmldiff_tree** diff, char * path, xml
 	return ret_op;
 }
 
-static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodePtr old_tmp, xmlNodePtr new_tmp, struct model_tree * model)
+static XMLDIFF_OP xmldiff_list(struct xmldiff_tree** diff, char * path, xmlNodePtr old_tmp, xmlNodePtr new_tmp, struct model_tree * model, xmlNodePtr edit)
 {
 	XMLDIFF_OP item_ret_op, tmp_op, ret_op = XMLDIFF_NONE;
-	xmlNodePtr* list_added = NULL, *list_removed = NULL, *realloc_tmp;
-	xmlNodePtr list_old_tmp, list_new_tmp, list_old_inter, list_new_inter;
-	xmlChar* old_keys, *new_keys, *old_str, *new_str, *aux_str;
-	struct xmldiff_tree** tmp_diff;
-	int i, list_added_cnt = 0, list_removed_cnt = 0;
+	struct xmldiff_entry *old_list = NULL, *new_list = NULL;
+	xmlHashTablePtr old_index = NULL, new_index = NULL, edit_index = NULL;
+	xmlNodePtr scope = NULL;
+	struct xmldiff_tree** tmp_diff, *list_diff = NULL, *last = NULL;
+	int i, j, old_cnt = 0, new_cnt = 0;
 	char* next_path;
 
 	/* Find matches according to the key elements, process all the elements inside recursively */
 	/* Not matching are _ADD or _REM */
 	/* Maching are _NONE or _CHAIN, according to the return values of the recursive calls */
 
+	/* Index the entries of both documents by their key values */
+	if (xmldiff_list_entries(old_tmp, NULL, model, &old_list, &old_cnt, &old_index) != EXIT_SUCCESS ||
+			xmldiff_list_entries(new_tmp, NULL, model, &new_list, &new_cnt, &new_index) != EXIT_SUCCESS) {
+		ret_op = XMLDIFF_ERR;
+		goto cleanup;
+	}
+
+	/* Only the entries mentioned in the edit can differ */
+	edit_index = xmldiff_scope_entries(edit, model);
+
 	/* ---REM--- Go through the old nodes and search for matching nodes in the new document*/
-	list_old_tmp = old_tmp;
-	while (list_old_tmp) {
-		/* We have to make sure that this really is a list node we are checking now */
-		if (node_cmp(old_tmp, list_old_tmp)) {
-			list_old_tmp = list_old_tmp->next;
-			continue;
+	for (i = 0; i < old_cnt; i++) {
+		if (edit_index != NULL) {
+			if ((scope = xmldiff_scope_lookup(edit_index, old_list[i].node, model)) == NULL) {
+				continue;
+			} else if (xmldiff_scope_full(scope)) {
+				scope = NULL;
+			}
 		}
+		old_list[i].match = xmlHashLookup(new_index, old_list[i].keys);
 
-		item_ret_op = XMLDIFF_NONE;
-		/* For every old node create string holding the concatenated key values */
-		old_keys = BAD_CAST strdup("");
-		for (i=0; i<model->keys_count; i++) { /* For every specified key */
-			list_old_inter = list_old_tmp->children;
-			while (list_old_inter) {
-				if (xmlStrEqual(list_old_inter->name, BAD_CAST model->keys[i])) { /* Find matching leaf in old document */
-					old_str = xmlNodeGetContent(list_old_inter);
-					aux_str  = realloc(old_keys, sizeof(xmlChar) * (xmlStrlen(old_keys)+xmlStrlen(old_str)+1));
-					if (aux_str == NULL) {
-						ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-						xmlFree(old_str);
-						xmlFree(old_keys);
-						return (XMLDIFF_ERR);
-					}
-					old_keys = aux_str;
-					strcat((char*)old_keys, (char*)old_str); /* Concatenate key value */
-					xmlFree(old_str);
-					break;
-				}
-				list_old_inter = list_old_inter->next;
-			}
+		if (old_list[i].match == NULL) { /* Item NOT found in the new document -> removed */
+			xmldiff_add_diff_recursive(xmldiff_tail(&list_diff, &last), path, old_list[i].node, NULL, XMLDIFF_REM, XML_SIBLING, model);
+			ret_op = XMLDIFF_REM;
+			continue;
 		}
 
-		/* Go through the new list */
-		list_new_tmp = new_tmp;
-		while (list_new_tmp) {
-			if (node_cmp(old_tmp, list_new_tmp)) {
-				list_new_tmp = list_new_tmp->next;
-				continue;
+		/* Item found -> check for changes recursively */
+		item_ret_op = XMLDIFF_NONE;
+		tmp_diff = malloc(sizeof(struct xmldiff_tree*));
+		*tmp_diff = NULL;
+		for (j = 0; j < model->children_count; j++) {
+			if (asprintf(&next_path, "%s/%s:%s", path, model->children[j].ns_prefix, model->children[j].name) == -1) {
+				ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
+				free(tmp_diff);
+				ret_op = XMLDIFF_ERR;
+				goto cleanup;
 			}
+			tmp_op = xmldiff_recursive(tmp_diff, next_path, old_list[i].node->children, old_list[i].match->node->children, &model->children[j], scope);
+			free(next_path);
 
-			new_keys = BAD_CAST strdup("");
-			for (i = 0; i < model->keys_count; i++) {
-				list_new_inter = list_new_tmp->children;
-				while (list_new_inter) {
-					if (xmlStrEqual(list_new_inter->name, BAD_CAST model->keys[i])) {
-						new_str = xmlNodeGetContent(list_new_inter);
-						aux_str  = realloc(new_keys, sizeof(xmlChar) * (xmlStrlen(new_keys)+xmlStrlen(new_str)+1));
-						if (aux_str == NULL) {
-							ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-							xmlFree(new_keys);
-							xmlFree(new_str);
-							return (XMLDIFF_ERR);
-						}
-						new_keys = aux_str;
-						strcat((char*)new_keys, (char*)new_str);
-						xmlFree(new_str);
-						break;
-					}
-					list_new_inter = list_new_inter->next;
-				}
-			}
-			if (strcmp((const char*)old_keys, (const char*)new_keys) == 0) { /* Matching item found */
-				xmlFree(new_keys);
-				break;
+			if (tmp_op == XMLDIFF_ERR) {
+				free(tmp_diff);
+				ret_op = XMLDIFF_ERR;
+				goto cleanup;
+			} else {
+				item_ret_op |= tmp_op;
 			}
-			xmlFree(new_keys);
-			list_new_tmp = list_new_tmp->next;
 		}
-		xmlFree(old_keys);
 
-		if (list_new_tmp == NULL) { /* Item NOT found in the new document -> removed */
-			xmldiff_add_diff_recursive(diff, path, list_old_tmp, list_new_tmp, XMLDIFF_REM, XML_SIBLING, model);
-			ret_op = XMLDIFF_REM;
-			/* Remember that the node was removed */
-			if ((realloc_tmp = realloc(list_removed, ++list_removed_cnt * sizeof(xmlNodePtr))) == NULL) {
-				ERROR("Memory reallocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-				free(list_removed);
-				return (XMLDIFF_ERR);
-			} else {
-				list_removed = realloc_tmp;
-				list_removed[list_removed_cnt-1] = list_old_tmp;
-			}
-		} else { /* Item found -> check for changes recursively */
-			tmp_diff = malloc(sizeof(struct xmldiff_tree*));
-			*tmp_diff = NULL;
-			for (i = 0; i < model->children_count; i++) {
-				if (asprintf(&next_path, "%s/%s:%s", path, model->children[i].ns_prefix, model->children[i].name) == -1) {
-					ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
-					free(tmp_diff);
-					return (XMLDIFF_ERR);
-				}
-				tmp_op = xmldiff_recursive(tmp_diff, next_path, list_old_tmp->children, list_new_tmp->children, &model->children[i]);
-				free(next_path);
-
-				if (tmp_op == XMLDIFF_ERR) {
-					free(tmp_diff);
-					return (XMLDIFF_ERR);
-				} else {
-					item_ret_op |= tmp_op;
-				}
+		if (item_ret_op != XMLDIFF_NONE) {
+			/* There actually was a change, so we append those changes as our children and add our change as a sibling */
+			if (item_ret_op & XMLDIFF_SIBLING) {
+				ret_op |= XMLDIFF_REORDER;
 			}
-
-			if (item_ret_op != XMLDIFF_NONE) {
-				/* There actually was a change, so we append those changes as our children and add our change as a sibling */
-				if (item_ret_op & XMLDIFF_SIBLING) {
-					ret_op |= XMLDIFF_REORDER;
-				}
-				if (item_ret_op & (XMLDIFF_ADD | XMLDIFF_REM | XMLDIFF_MOD | XMLDIFF_REORDER | XMLDIFF_CHAIN)) {
-					ret_op |= XMLDIFF_CHAIN;
-				}
-				if (item_ret_op & XMLDIFF_REM) {
-					xmldiff_add_diff(tmp_diff, path, list_old_tmp, list_new_tmp, ret_op, XML_PARENT);
-				} else {
-					xmldiff_add_diff(tmp_diff, path, list_old_tmp, list_new_tmp, ret_op, XML_PARENT);
-				}
-				*tmp_diff = (*tmp_diff)->parent;
-				xmldiff_addsibling_diff(diff, tmp_diff);
+			if (item_ret_op & (XMLDIFF_ADD | XMLDIFF_REM | XMLDIFF_MOD | XMLDIFF_REORDER | XMLDIFF_CHAIN)) {
+				ret_op |= XMLDIFF_CHAIN;
 			}
-			free(tmp_diff);
+			xmldiff_add_diff(tmp_diff, path, old_list[i].node, old_list[i].match->node, ret_op, XML_PARENT);
+			*tmp_diff = (*tmp_diff)->parent;
+			xmldiff_addsibling_diff(xmldiff_tail(&list_diff, &last), tmp_diff);
 		}
-		list_old_tmp = list_old_tmp->next;
+		free(tmp_diff);
 	}
 
 	/* ---ADD--- Go through the new nodes and search for matching nodes in the old document */
-	list_new_tmp = new_tmp;
-	while (list_new_tmp) {
-		if (node_cmp(new_tmp, list_new_tmp)) {
-			list_new_tmp = list_new_tmp->next;
+	for (i = 0; i < new_cnt; i++) {
+		if (edit_index != NULL && xmldiff_scope_lookup(edit_index, new_list[i].node, model) == NULL) {
 			continue;
 		}
+		new_list[i].match = xmlHashLookup(old_index, new_list[i].keys);
 
-		item_ret_op = XMLDIFF_NONE;
-		/* For every new node create string holding the concatenated key values */
-		new_keys = BAD_CAST strdup ("");
-		for (i = 0; i < model->keys_count; i++) { /* For every specified key */
-			list_new_inter = list_new_tmp->children;
-			while (list_new_inter) {
-				if (xmlStrEqual(list_new_inter->name, BAD_CAST model->keys[i])) { /* Find matching leaf in the old document */
-					new_str = xmlNodeGetContent(list_new_inter);
-					aux_str = realloc(new_keys, sizeof(xmlChar*) * (xmlStrlen(new_keys)+xmlStrlen(new_str)+1));
-					if (aux_str == NULL) {
-						ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-						xmlFree(new_keys);
-						xmlFree(new_str);
-						return (XMLDIFF_ERR);
-					}
-					new_keys = aux_str;
-					strcat((char*)new_keys, (char*)new_str); /* Concatenate key value */
-					xmlFree(new_str);
-					break;
-				}
-				list_new_inter = list_new_inter->next;
-			}
-		}
-		/* Go through the new list */
-		list_old_tmp = old_tmp;
-		while (list_old_tmp) {
-			if (node_cmp(new_tmp, list_old_tmp)) {
-				list_old_tmp = list_old_tmp->next;
-				continue;
-			}
-
-			old_keys = BAD_CAST strdup ("");
-			for (i = 0; i < model->keys_count; i++) {
-				list_old_inter = list_old_tmp->children;
-				while (list_old_inter) {
-					if (xmlStrEqual(list_old_inter->name, BAD_CAST model->keys[i])) {
-						old_str = xmlNodeGetContent(list_old_inter);
-						aux_str = realloc(old_keys, sizeof(xmlChar) * (xmlStrlen(old_keys)+xmlStrlen(old_str)+1));
-						if (aux_str == NULL) {
-							ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-							xmlFree(old_keys);
-							xmlFree(old_str);
-							return (XMLDIFF_ERR);
-						}
-						old_keys = aux_str;
-						strcat((char*)old_keys, (char*)old_str);
-						xmlFree(old_str);
-						break;
-					}
-					list_old_inter = list_old_inter->next;
-				}
-			}
-			if (strcmp((const char*)old_keys, (const char*)new_keys) == 0) { /* Matching item found */
-				free(old_keys);
-				break;
-			}
-			xmlFree(old_keys);
-			list_old_tmp = list_old_tmp->next;
-		}
-		xmlFree(new_keys);
-
-		if (list_old_tmp == NULL) { /* Item NOT found in the old document -> added */
-			xmldiff_add_diff_recursive(diff, path, list_old_tmp, list_new_tmp, XMLDIFF_ADD, XML_SIBLING, model);
+		if (new_list[i].match == NULL) { /* Item NOT found in the old document -> added */
+			xmldiff_add_diff_recursive(xmldiff_tail(&list_diff, &last), path, NULL, new_list[i].node, XMLDIFF_ADD, XML_SIBLING, model);
 			ret_op = XMLDIFF_ADD;
-			/* Remember that the node was added */
-			if ((realloc_tmp = realloc(list_added, ++list_added_cnt * sizeof(xmlNodePtr))) == NULL) {
-				ERROR("Memory reallocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-				free(list_added);
-				return (XMLDIFF_ERR);
-			} else {
-				list_added = realloc_tmp;
-				list_added[list_added_cnt-1] = list_new_tmp;
-			}
-		} else {
-			/* We already checked for changes in these nodes */
 		}
-		list_new_tmp = list_new_tmp->next;
+		/* else we already checked for changes in these nodes */
 	}
 
 	/* list is ordered by user */
 	if (model->ordering == YIN_ORDER_USER) {
-
-		/* Go through old and new list and compare pairs */
-		list_old_tmp = old_tmp;
-		list_new_tmp = new_tmp;
-
-		while (list_old_tmp && list_new_tmp) {
-			/* Nodes are not part of the list we are now processing */
-			if (!xmlStrEqual(list_old_tmp->name, BAD_CAST model->name)) {
-				list_old_tmp = list_old_tmp->next;
-				continue;
-			}
-			if (!xmlStrEqual(list_new_tmp->name, BAD_CAST model->name)) {
-				list_new_tmp = list_new_tmp->next;
-				continue;
-			}
-
-			/* Wasn't the old node removed and that's why it isn't in the new config? */
-			for (i = 0; i < list_removed_cnt; ++i) {
-				if (list_old_tmp == list_removed[i]) {
-					break;
-				}
-			}
-			if (i != list_removed_cnt) {
-				list_old_tmp = list_old_tmp->next;
-				continue;
-			}
-
-			/* Wasn't the new node added and that's why it isn't in the old config? */
-			for (i = 0; i < list_added_cnt; ++i) {
-				if (list_new_tmp == list_added[i]) {
-					break;
-				}
-			}
-			if (i != list_added_cnt) {
-				list_new_tmp = list_new_tmp->next;
-				continue;
+		/* Go through old and new list and compare pairs, skip the removed
+		 * and the added nodes */
+		for (i = 0, j = 0; i < old_cnt && j < new_cnt; i++, j++) {
+			for (; i < old_cnt && old_list[i].match == NULL; i++);
+			for (; j < new_cnt && new_list[j].match == NULL; j++);
+			if (i == old_cnt || j == new_cnt) {
+				break;
 			}
 
 			/* We have to make sure these two nodes are not equal */
-			if (list_node_cmp(list_old_tmp, list_new_tmp, model) != 0) {
+			if (!xmlStrEqual(old_list[i].keys, new_list[j].keys)) {
 				ret_op |= XMLDIFF_SIBLING;
-				xmldiff_add_diff(diff, path, list_old_tmp, list_new_tmp, XMLDIFF_SIBLING, XML_SIBLING);
+				xmldiff_add_diff(xmldiff_tail(&list_diff, &last), path, old_list[i].node, new_list[j].node, XMLDIFF_SIBLING, XML_SIBLING);
 			}
-
-			list_old_tmp = list_old_tmp->next;
-			list_new_tmp = list_new_tmp->next;
 		}
 	}
 
-	free(list_added);
-	free(list_removed);
+cleanup:
+	/* the diffs of the list are collected separately, append them at once */
+	if (list_diff != NULL) {
+		xmldiff_addsibling_diff(diff, &list_diff);
+	}
+	xmldiff_list_entries_free(old_list, old_cnt, old_index);
+	xmldiff_list_entries_free(new_list, new_cnt, new_index);
+	xmlHashFree(edit_index, NULL);
 	return ret_op;
 }
 
@@ -950,145 +1086,61 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
 {
 	XMLDIFF_OP ret_op = XMLDIFF_NONE;
 	char* list_name = strrchr(path, ':')+1;
-	xmlNodePtr* list_added = NULL, *list_removed = NULL, *realloc_tmp;
-	xmlNodePtr list_old_tmp, list_new_tmp;
-	xmlChar* new_str, *old_str;
-	int i, list_added_cnt = 0, list_removed_cnt = 0;
+	struct xmldiff_tree *list_diff = NULL, *last = NULL;
+	struct xmldiff_entry *old_list = NULL, *new_list = NULL;
+	xmlHashTablePtr old_index = NULL, new_index = NULL;
+	int i, j, old_cnt = 0, new_cnt = 0;
+
+	/* Index the entries of both documents by their values */
+	if (xmldiff_list_entries(old_tmp, list_name, NULL, &old_list, &old_cnt, &old_index) != EXIT_SUCCESS ||
+			xmldiff_list_entries(new_tmp, list_name, NULL, &new_list, &new_cnt, &new_index) != EXIT_SUCCESS) {
+		ret_op = XMLDIFF_ERR;
+		goto cleanup;
+	}
 
 	/* Search for matches, only _ADD and _REM will be here */
 	/* For each in the old node find one from the new nodes or log as _REM */
-	list_old_tmp = old_tmp;
-	while (list_old_tmp) {
-		if (!xmlStrEqual(BAD_CAST list_name, list_old_tmp->name)) {
-			list_old_tmp = list_old_tmp->next;
-			continue;
-		}
-		old_str = xmlNodeGetContent(list_old_tmp);
-		list_new_tmp = new_tmp;
-		while (list_new_tmp) {
-			if (!xmlStrEqual(BAD_CAST list_name, list_new_tmp->name)) {
-				list_new_tmp = list_new_tmp->next;
-				continue;
-			}
-			new_str = xmlNodeGetContent(list_new_tmp);
-			if (xmlStrEqual(old_str, new_str)) {
-				xmlFree(new_str);
-				/* Equivalent found */
-				break;
-			}
-			xmlFree(new_str);
-			list_new_tmp = list_new_tmp->next;
-		}
-		xmlFree(old_str);
-		if (list_new_tmp == NULL) {
-			xmldiff_add_diff(diff, path, list_old_tmp, list_new_tmp, XMLDIFF_REM, XML_SIBLING);
+	for (i = 0; i < old_cnt; i++) {
+		if ((old_list[i].match = xmlHashLookup(new_index, old_list[i].keys)) == NULL) {
+			xmldiff_add_diff(xmldiff_tail(&list_diff, &last), path, old_list[i].node, NULL, XMLDIFF_REM, XML_SIBLING);
 			ret_op = XMLDIFF_REM;
-			/* Remember that the node was removed */
-			if ((realloc_tmp = realloc(list_removed, ++list_removed_cnt * sizeof(xmlNodePtr))) == NULL) {
-				ERROR("Memory reallocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-				free(list_removed);
-				return (XMLDIFF_ERR);
-			} else {
-				list_removed = realloc_tmp;
-				list_removed[list_removed_cnt-1] = list_old_tmp;
-			}
 		}
-		list_old_tmp = list_old_tmp->next;
 	}
 
 	/* For each in the new node find one from the old nodes or log as _ADD */
-	list_new_tmp = new_tmp;
-	while (list_new_tmp) {
-		if (!xmlStrEqual(BAD_CAST list_name, list_new_tmp->name)) {
-			list_new_tmp = list_new_tmp->next;
-			continue;
-		}
-		new_str = xmlNodeGetContent(list_new_tmp);
-		list_old_tmp = old_tmp;
-		while (list_old_tmp) {
-			if (!xmlStrEqual(BAD_CAST list_name, list_old_tmp->name)) {
-				list_old_tmp = list_old_tmp->next;
-				continue;
-			}
-			old_str = xmlNodeGetContent(list_old_tmp);
-			if (xmlStrEqual(old_str, new_str)) {
-				xmlFree(old_str);
-				/* Equivalent found */
-				break;
-			}
-			xmlFree(old_str);
-			list_old_tmp = list_old_tmp->next;
-		}
-		xmlFree(new_str);
-		if (list_old_tmp == NULL) {
-			xmldiff_add_diff(diff, path, list_old_tmp, list_new_tmp, XMLDIFF_ADD, XML_SIBLING);
+	for (i = 0; i < new_cnt; i++) {
+		if ((new_list[i].match = xmlHashLookup(old_index, new_list[i].keys)) == NULL) {
+			xmldiff_add_diff(xmldiff_tail(&list_diff, &last), path, NULL, new_list[i].node, XMLDIFF_ADD, XML_SIBLING);
 			ret_op = XMLDIFF_ADD;
-			/* remeber that the node was added*/
-			if ((realloc_tmp = realloc(list_added, ++list_added_cnt * sizeof(xmlNodePtr))) == NULL) {
-				ERROR("Memory reallocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
-				free(list_added);
-				return (XMLDIFF_ERR);
-			} else {
-				list_added = realloc_tmp;
-				list_added[list_added_cnt-1] = list_new_tmp;
-			}
 		}
-		list_new_tmp = list_new_tmp->next;
 	}
 
 	/* leaf-list is ordered by user */
 	if (model->ordering == YIN_ORDER_USER) {
-
-		/* Go through old and new list and compare pairs */
-		list_old_tmp = old_tmp;
-		list_new_tmp = new_tmp;
-
-		while (list_old_tmp && list_new_tmp) {
-			/* Nodes are not part of the leaf-list we are now processing */
-			if (!xmlStrEqual(list_old_tmp->name, BAD_CAST model->name)) {
-				list_old_tmp = list_old_tmp->next;
-				continue;
-			}
-			if (!xmlStrEqual(list_new_tmp->name, BAD_CAST model->name)) {
-				list_new_tmp = list_new_tmp->next;
-				continue;
-			}
-
-			/* Wasn't the old node removed and that's why it isn't in the new config? */
-			for (i = 0; i < list_removed_cnt; ++i) {
-				if (list_old_tmp == list_removed[i]) {
-					break;
-				}
-			}
-			if (i != list_removed_cnt) {
-				list_old_tmp = list_old_tmp->next;
-				continue;
-			}
-
-			/* Wasn't the new node added and that's why it isn't in the old config? */
-			for (i = 0; i < list_added_cnt; ++i) {
-				if (list_new_tmp == list_added[i]) {
-					break;
-				}
-			}
-			if (i != list_added_cnt) {
-				list_new_tmp = list_new_tmp->next;
-				continue;
+		/* Go through old and new list and compare pairs, skip the removed
+		 * and the added nodes */
+		for (i = 0, j = 0; i < old_cnt && j < new_cnt; i++, j++) {
+			for (; i < old_cnt && old_list[i].match == NULL; i++);
+			for (; j < new_cnt && new_list[j].match == NULL; j++);
+			if (i == old_cnt || j == new_cnt) {
+				break;
 			}
 
 			/* We have to make sure these two nodes are not equal */
-			if (xmlStrcmp(list_old_tmp->children->content, list_new_tmp->children->content) != 0) {
+			if (!xmlStrEqual(old_list[i].keys, new_list[j].keys)) {
 				ret_op |= XMLDIFF_SIBLING;
-				xmldiff_add_diff(diff, path, list_old_tmp, list_new_tmp, XMLDIFF_SIBLING, XML_SIBLING);
+				xmldiff_add_diff(xmldiff_tail(&list_diff, &last), path, old_list[i].node, new_list[j].node, XMLDIFF_SIBLING, XML_SIBLING);
 			}
-
-			list_old_tmp = list_old_tmp->next;
-			list_new_tmp = list_new_tmp->next;
 		}
 	}
 
-	free(list_added);
-	free(list_removed);
+cleanup:
+	/* the diffs of the list are collected separately, append them at once */
+	if (list_diff != NULL) {
+		xmldiff_addsibling_diff(diff, &list_diff);
+	}
+	xmldiff_list_entries_free(old_list, old_cnt, old_index);
+	xmldiff_list_entries_free(new_list, new_cnt, new_index);
 	return ret_op;
 }
 
@@ -1098,10 +1150,12 @@ static XMLDIFF_OP xmldiff_leaflist(struct xmldiff_tree** diff, char * path, xmlN
  * @param old		old version of XML document
  * @param new		new version of XML document
  * @param model	data model in YANG format
+ * @param edit	edit-config's content which changed old to new, the nodes it
+ * does not mention are not compared. NULL to compare the whole documents.
  *
  * @return xmldiff structure holding all differences between XML documents or NULL
  */
-XMLDIFF_OP xmldiff_diff(struct xmldiff_tree** diff, xmlDocPtr old, xmlDocPtr new, struct model_tree * model)
+XMLDIFF_OP xmldiff_diff(struct xmldiff_tree** diff, xmlDocPtr old, xmlDocPtr new, struct model_tree * model, xmlDocPtr edit)
 {
 	char* path;
 	XMLDIFF_OP ret_op = XMLDIFF_NONE;
@@ -1117,7 +1171,7 @@ XMLDIFF_OP xmldiff_diff(struct xmldiff_tree** diff, xmlDocPtr old, xmlDocPtr new
 			ERROR("asprintf() failed (%s:%d).", __FILE__, __LINE__);
 			return (XMLDIFF_ERR);
 		}
-		ret_op = xmldiff_recursive(diff, path, old->children, new->children, &model->children[i]);
+		ret_op = xmldiff_recursive(diff, path, old->children, new->children, &model->children[i], (xmlNodePtr)edit);
 		free(path);
 	}
 
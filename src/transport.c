@@ -553,9 +553,7 @@ static int nc_server_handshake(struct nc_session *session, char** cpblts)
 
 	if (retval != EXIT_SUCCESS) {
 		if (nc_info) {
-			pthread_rwlock_wrlock(&(nc_info->lock));
-			nc_info->stats.bad_hellos++;
-			pthread_rwlock_unlock(&(nc_info->lock));
+			NC_STATS_INC(nc_info->stats.bad_hellos);
 		}
 	}
 
@@ -1043,9 +1041,7 @@ struct nc_session* _nc_session_accept(const struct nc_cpblts* capabilities, cons
 
 	retval->logintime = nc_time2datetime(time(NULL), NULL);
 	if (nc_info) {
-		pthread_rwlock_wrlock(&(nc_info->lock));
-		nc_info->stats.sessions_in++;
-		pthread_rwlock_unlock(&(nc_info->lock));
+		NC_STATS_INC(nc_info->stats.sessions_in);
 	}
 
 	if (pw) {
@@ -182,16 +182,20 @@ static xmlChar* check_default_case(xmlNodePtr config_choice, xmlNodePtr model_ch
 	return(xmlGetProp(def, BAD_CAST "value"));
 }
 
-static xmlNodePtr* fill_default(xmlDocPtr config, xmlNodePtr node, const char* namespace, NCWD_MODE mode)
+/* list of the nodes created by a single (recursive) fill_default() call */
+struct created_nodes {
+	xmlNodePtr *nodes;
+	int count;
+	int size;
+};
+
+static xmlNodePtr* fill_default(xmlDocPtr config, xmlNodePtr node, const char* namespace, NCWD_MODE mode, struct created_nodes *created)
 {
 	xmlNodePtr *parents = NULL, *retvals = NULL, *aux_nodeptr;
 	xmlNodePtr aux = NULL;
 	xmlNsPtr ns;
 	xmlChar* value = NULL, *name, *value2;
 	int i, j, k, size = 0, first_call = 0;
-	static xmlNodePtr *created_local = NULL;
-	static int created_count = 0;
-	static int created_size = 0;
 
 	if (mode == NCWD_MODE_NOTSET || mode == NCWD_MODE_EXPLICIT) {
 		return (NULL);
@@ -202,39 +206,39 @@ static xmlNodePtr* fill_default(xmlDocPtr config, xmlNodePtr node, const char* n
 		return (NULL);
 	}
 
-	if (created_local == NULL) {
+	if (created->nodes == NULL) {
 		/* initial (not recursive) call */
 		first_call = 1;
-		created_count = 0;
-		created_size = 32;
-		created_local = malloc(created_size * sizeof(xmlNodePtr));
-		created_local[created_count] = NULL; /* list terminating byte */
+		created->count = 0;
+		created->size = 32;
+		created->nodes = malloc(created->size * sizeof(xmlNodePtr));
+		created->nodes[created->count] = NULL; /* list terminating byte */
 	}
 
 	/* do recursion */
 	if (node->parent == NULL) {
 		if (first_call) {
 			if (retvals == NULL) {
-				for(i = created_count-1; i >= 0; i--) {
-					if (created_local[i]->children == NULL) {
+				for(i = created->count-1; i >= 0; i--) {
+					if (created->nodes[i]->children == NULL) {
 						/* created parent element, but default value was not finally
 						 * created and no other children element exists -> remove
 						 * the created element
 						 */
-						xmlUnlinkNode(created_local[i]);
-						xmlFreeNode(created_local[i]);
+						xmlUnlinkNode(created->nodes[i]);
+						xmlFreeNode(created->nodes[i]);
 					}
 				}
 			}
 			/* free in last recursion call */
-			created_count = 0;
-			free(created_local);
-			created_local = NULL;
+			created->count = 0;
+			free(created->nodes);
+			created->nodes = NULL;
 		}
 		return (NULL);
 	} else if (xmlStrcmp(node->parent->name, BAD_CAST "module") != 0) {
 		/* we will get parent of the config's equivalent of the node */
-		parents = fill_default(config, node->parent, namespace, mode);
+		parents = fill_default(config, node->parent, namespace, mode, created);
 
 		if (parents && xmlStrcmp(node->parent->name, BAD_CAST "choice") == 0) {
 			/* process choices */
@@ -377,19 +381,19 @@ static xmlNodePtr* fill_default(xmlDocPtr config, xmlNodePtr node, const char* n
 				xmlSetNs(aux, ns);
 
 				/* remember created node, for later remove if no default child will be created */
-				if (created_count == created_size-1) {
+				if (created->count == created->size-1) {
 					/* (re)allocate created list */
-					created_size += 32;
-					aux_nodeptr = realloc(created_local, created_size * sizeof(xmlNodePtr));
+					created->size += 32;
+					aux_nodeptr = realloc(created->nodes, created->size * sizeof(xmlNodePtr));
 					if (aux_nodeptr == NULL) {
 						ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
 						free(retvals);
 						goto cleanup;
 					}
-					created_local = aux_nodeptr;
+					created->nodes = aux_nodeptr;
 				}
-				created_local[created_count++] = aux;
-				created_local[created_count] = NULL; /* list terminating byte */
+				created->nodes[created->count++] = aux;
+				created->nodes[created->count] = NULL; /* list terminating byte */
 			}
 			xmlFree(name);
 
@@ -431,21 +435,21 @@ static xmlNodePtr* fill_default(xmlDocPtr config, xmlNodePtr node, const char* n
 	if (parents == NULL) {
 		if (first_call) {
 			if (retvals == NULL) {
-				for(i = created_count-1; i >= 0; i--) {
-					if (created_local[i]->children == NULL) {
+				for(i = created->count-1; i >= 0; i--) {
+					if (created->nodes[i]->children == NULL) {
 						/* created parent element, but default value was not finally
 						 * created and no other children element exists -> remove
 						 * the created element
 						 */
-						xmlUnlinkNode(created_local[i]);
-						xmlFreeNode(created_local[i]);
+						xmlUnlinkNode(created->nodes[i]);
+						xmlFreeNode(created->nodes[i]);
 					}
 				}
 			}
 			/* free in last recursion call */
-			free(created_local);
-			created_local = NULL;
-			created_count = 0;
+			free(created->nodes);
+			created->nodes = NULL;
+			created->count = 0;
 		}
 		return (NULL);
 	}
@@ -464,7 +468,7 @@ static xmlNodePtr* fill_default(xmlDocPtr config, xmlNodePtr node, const char* n
 				} /* else do nothing, configuration data contain (non-)default value */
 
 				if (mode == NCWD_MODE_ALL_TAGGED ||
-						(mode == NCWD_MODE_IMPL_TAGGED && created_count)) { /* the default node is not explicit from datastore */
+						(mode == NCWD_MODE_IMPL_TAGGED && created->count)) { /* the default node is not explicit from datastore */
 					value2 = xmlNodeGetContent(parents[i]);
 					if (xmlStrcmp(value, value2) == 0) {
 						/* add default attribute if element has default value */
@@ -569,19 +573,19 @@ static xmlNodePtr* fill_default(xmlDocPtr config, xmlNodePtr node, const char* n
 					retvals[j] = NULL; /* list terminating NULL */
 
 					/* remember created node, for later remove if no default child will be created */
-					if (created_count == created_size-1) {
+					if (created->count == created->size-1) {
 						/* (re)allocate created list */
-						created_size += 32;
-						aux_nodeptr = realloc(created_local, created_size * sizeof(xmlNodePtr));
+						created->size += 32;
+						aux_nodeptr = realloc(created->nodes, created->size * sizeof(xmlNodePtr));
 						if (aux_nodeptr == NULL) {
 							ERROR("Memory allocation failed (%s:%d - %s).", __FILE__, __LINE__, strerror(errno));
 							free(retvals);
 							goto cleanup;
 						}
-						created_local = aux_nodeptr;
+						created->nodes = aux_nodeptr;
 					}
-					created_local[created_count++] = retvals[j-1];
-					created_local[created_count] = NULL; /* list terminating byte */
+					created->nodes[created->count++] = retvals[j-1];
+					created->nodes[created->count] = NULL; /* list terminating byte */
 				}
 				break;
 			case NCWD_MODE_TRIM:
@@ -601,22 +605,22 @@ static xmlNodePtr* fill_default(xmlDocPtr config, xmlNodePtr node, const char* n
 cleanup:
 	if (first_call) {
 		if (retvals == NULL) {
-			for(i = created_count-1; i >= 0; i--) {
-				if (created_local[i]->children == NULL) {
+			for(i = created->count-1; i >= 0; i--) {
+				if (created->nodes[i]->children == NULL) {
 					/* created parent element, but default value was not finally
 					 * created and no other children element exists -> remove
 					 * the created element
 					 */
-					xmlUnlinkNode(created_local[i]);
-					xmlFreeNode(created_local[i]);
+					xmlUnlinkNode(created->nodes[i]);
+					xmlFreeNode(created->nodes[i]);
 				}
 			}
 		}
 		/* free in last recursion call */
-		free(created_local);
-		created_local = NULL;
-		created_count = 0;
-		created_size = 0;
+		free(created->nodes);
+		created->nodes = NULL;
+		created->count = 0;
+		created->size = 0;
 	}
 
 	return (retvals);
@@ -624,10 +628,9 @@ cleanup:
 
 int ncdflt_default_values(xmlDocPtr config, const xmlDocPtr model, NCWD_MODE mode)
 {
-	xmlXPathContextPtr model_ctxt = NULL;
-	xmlXPathObjectPtr defaults = NULL, query;
+	keyList index;
 	xmlNodePtr root;
-	xmlChar* namespace = NULL;
+	struct created_nodes created = {NULL, 0, 0};
 	int i;
 
 	if (config == NULL || model == NULL) {
@@ -639,51 +642,34 @@ int ncdflt_default_values(xmlDocPtr config, const xmlDocPtr model, NCWD_MODE mod
 		return (EXIT_SUCCESS);
 	}
 
-	/* create xpath evaluation context */
-	if ((model_ctxt = xmlXPathNewContext(model)) == NULL) {
-		WARN("%s: Creating the XPath context failed.", __func__);
+	/* the index contains namespace and default statements of the model */
+	if ((index = get_keynode_list(model)) == NULL) {
+		WARN("%s: Getting the data model index failed.", __func__);
 		/* with-defaults cannot be found */
 		return (EXIT_FAILURE);
 	}
-	if (xmlXPathRegisterNs(model_ctxt, BAD_CAST "yin", BAD_CAST NC_NS_YIN) != 0) {
-		ERROR("%s: Registering yin namespace for the model xpath context failed.", __func__);
-		xmlXPathFreeContext(model_ctxt);
-		return (EXIT_FAILURE);
-	}
-	if ((query = xmlXPathEvalExpression(BAD_CAST "/yin:module/yin:namespace", model_ctxt)) == NULL) {
-		ERROR("%s: Unable to get namespace from the data model.", __func__);
-		xmlXPathFreeContext(model_ctxt);
-		return (EXIT_FAILURE);
-	}
-	if (xmlXPathNodeSetIsEmpty(query->nodesetval) || (namespace = xmlGetProp(query->nodesetval->nodeTab[0], BAD_CAST "uri")) == NULL) {
+	if (index->ns == NULL) {
 		ERROR("%s: Unable to get namespace from the data model.", __func__);
-		xmlFree(namespace);
-		xmlXPathFreeObject(query);
-		xmlXPathFreeContext(model_ctxt);
+		keyListFree(index);
 		return (EXIT_FAILURE);
 	}
-	xmlXPathFreeObject(query);
 
-	if ((defaults = xmlXPathEvalExpression(BAD_CAST "/yin:module/yin:container//yin:default", model_ctxt)) != NULL) {
-		if (!xmlXPathNodeSetIsEmpty(defaults->nodesetval)) {
-			/* if report-all-tagged, add namespace for default attribute into the whole doc */
-			root = xmlDocGetRootElement(config);
-			if ((mode & (NCWD_MODE_ALL_TAGGED | NCWD_MODE_IMPL_TAGGED)) && root != NULL) {
-				xmlNewNs(root, BAD_CAST "urn:ietf:params:xml:ns:netconf:default:1.0", BAD_CAST "wd");
-			}
-			/* process all defaults elements */
-			for (i = 0; i < defaults->nodesetval->nodeNr; i++) {
-				if (xmlStrcmp(defaults->nodesetval->nodeTab[i]->parent->name, BAD_CAST "choice") == 0) {
-					/* skip defaults for choices */
-					continue;
-				}
-				fill_default(config, defaults->nodesetval->nodeTab[i], (char*)namespace, mode);
+	if (index->defaults[0] != NULL) {
+		/* if report-all-tagged, add namespace for default attribute into the whole doc */
+		root = xmlDocGetRootElement(config);
+		if ((mode & (NCWD_MODE_ALL_TAGGED | NCWD_MODE_IMPL_TAGGED)) && root != NULL) {
+			xmlNewNs(root, BAD_CAST "urn:ietf:params:xml:ns:netconf:default:1.0", BAD_CAST "wd");
+		}
+		/* process all defaults elements */
+		for (i = 0; index->defaults[i] != NULL; i++) {
+			if (xmlStrcmp(index->defaults[i]->parent->name, BAD_CAST "choice") == 0) {
+				/* skip defaults for choices */
+				continue;
 			}
+			fill_default(config, index->defaults[i], (char*)(index->ns), mode, &created);
 		}
-		xmlXPathFreeObject(defaults);
 	}
-	xmlFree(namespace);
-	xmlXPathFreeContext(model_ctxt);
+	keyListFree(index);
 
 	return (EXIT_SUCCESS);
 }